@@ -33,9 +33,23 @@
 
 
 #include "Twist.h"
-#include "CircularBuffer.h"
+#include "CorrespondenceIndex.h"
+#include "FrameArena.h"
+#include "ResidualBuffer.h"
+#include "IncrementalVoxelGrid.h"
+#include "MapTile.h"
+#include "MapCubeCodec.h"
+#include "SpscRingBuffer.h"
 #include "time_utils.h"
 
+#include <atomic>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <tuple>
+
 #include <pcl/point_cloud.h>
 #include <pcl/point_types.h>
 #include <pcl/filters/voxel_grid.h>
@@ -74,10 +88,60 @@ typedef struct IMUState2
    };
 } IMUState2;
 
+/** Cached map-side correspondence (fitted edge line or planar patch) of a feature point. */
+struct MapCorrespondence
+{
+   /** The map position of the feature point at the time of the last neighbour search. */
+   float qx = 0, qy = 0, qz = 0;
+
+   /** Flag if a neighbour search has been done for the point in the current optimization. */
+   bool searched = false;
+
+   /** Flag if a line / plane could be fitted to the neighbours found by the last search. */
+   bool valid = false;
+
+   /** Edge line points (x1, y1, z1, x2, y2, z2) or plane coefficients (pa, pb, pc, pd). */
+   float fit[6];
+
+   /** \brief Check if the correspondence has to be searched again for the given point.
+    *
+    * @param p the feature point transformed to the map
+    * @param maxSqDist the squared displacement after which the cached correspondence is considered stale
+    */
+   bool isStale(const pcl::PointXYZI& p, const float& maxSqDist) const
+   {
+      if (!searched)
+         return true;
+
+      float dx = p.x - qx;
+      float dy = p.y - qy;
+      float dz = p.z - qz;
+      return dx * dx + dy * dy + dz * dz > maxSqDist;
+   }
+};
+
+/** Policies for evicting map cubes when the map memory budget is exceeded. */
+enum CubeEvictionPolicy
+{
+   EVICT_FARTHEST,     ///< evict the cubes farthest from the current sensor position first
+   EVICT_LEAST_RECENT  ///< evict the cubes that have not received new points for the longest time first
+};
+
+/** Memory usage of a non-empty map cube. */
+struct CubeMemoryInfo
+{
+   int i, j, k;               ///< cube position in the cube array
+   size_t cornerPoints;       ///< number of corner points
+   size_t surfPoints;         ///< number of surface points
+   size_t bytes;              ///< memory allocated by the cube clouds and their voxel grids
+   size_t lastTouched;        ///< map version of the last insertion into the cube
+};
+
 class BasicLaserMapping
 {
 public:
    explicit BasicLaserMapping();
+   ~BasicLaserMapping();
 
    /** \brief Try to process buffered data. */
    bool process(Time const& laserOdometryTime);
@@ -93,6 +157,85 @@ public:
    void setMaxIterations(size_t val) { _maxIterations = val; }
    void setDeltaTAbort(float val) { _deltaTAbort = val; }
    void setDeltaRAbort(float val) { _deltaRAbort = val; }
+   void setCorrespondenceRefreshDist(float val) { _correspondenceRefreshDist = val; }
+   void setNeighborSearchMethod(NeighborSearchMethod val)
+   { _cornerMapIndex.setMethod(val); _surfMapIndex.setMethod(val); }
+
+   /** \brief Enable / disable the background map update.
+    *
+    * If enabled, the insertion of new feature points into the cube clouds and the creation of the
+    * down sized surround map run on a separate thread, so that process() returns right after the
+    * pose optimization. While an update is running, the next frames are optimized against the
+    * previous map snapshot and their points are handed over with the next update.
+    */
+   void setAsyncMapUpdate(bool val);
+
+   /** \brief Limit the number of points per cube cloud (0 = unlimited), the oldest points are dropped first.
+    *
+    * A full cube is trimmed to 90% of the limit at once, so that the cube is not re-indexed on every
+    * insertion while it stays at the limit.
+    */
+   void setMaxCubePoints(size_t val) { _maxCubePoints = val; }
+
+   /** \brief Keep the cube clouds sorted by the Morton (Z-order) key of their voxels.
+    *
+    * Spatially close map points are then stored close to each other, which improves the cache
+    * locality of the kd-tree build and search. New points are sorted and merged into a cube on
+    * insertion. Should be set before the first map update, cubes filled before stay unsorted until
+    * they are rebuilt.
+    */
+   void setMortonOrderedCubes(bool val) { _mortonOrderedCubes = val; }
+
+   /** \brief Limit the memory of all cubes in bytes (0 = unlimited).
+    *
+    * If the budget is exceeded after a map update, whole cubes outside of the current surround area
+    * are evicted according to the eviction policy until the map fits again.
+    */
+   void setMapMemoryBudget(size_t val) { _mapMemoryBudget = val; }
+   void setCubeEvictionPolicy(CubeEvictionPolicy val) { _cubeEvictionPolicy = val; }
+
+   /** \brief Set the directory map tiles are saved to (empty = no saving).
+    *
+    * Modified cubes are written as map tiles every mapSaveInterval map updates and before they are
+    * cleared by map shifting or eviction.
+    */
+   void setMapSaveDirectory(const std::string& val) { _mapSaveDir = val; }
+   void setMapSaveInterval(size_t val) { _mapSaveInterval = val; }
+
+   /** \brief Register the map tiles of a prior map.
+    *
+    * The tiles are memory mapped and copied into their cubes when the cubes enter the surround area
+    * of the sensor for the first time, so registering a map is cheap regardless of its size.
+    *
+    * @param dir the tile directory
+    * @return the number of registered tiles, or -1 if the directory could not be read
+    */
+   int loadMap(const std::string& dir);
+
+   /** \brief Save all modified cubes to the map save directory.
+    *
+    * @return false if no save directory is set or a tile could not be written, true otherwise
+    */
+   bool saveMap();
+
+   /** \brief Collect the cubes modified since the last call, each down sized by the map filter and quantized.
+    *
+    * Never waits for a running background map update: the running update collects the cubes when it is
+    * done and they are returned by the next call. Once called, modified cubes are also collected right
+    * before they are cleared (leaving the cube array or evicted), so their last points are not lost.
+    * Cubes loaded from a prior map are collected once after they have been loaded.
+    *
+    * @param cubes the resulting cubes in collection order, a later entry of a cube replaces an earlier one
+    * @param all collect all non-empty cubes instead of the modified ones (kept requested until returned)
+    * @return true if the resulting cubes contain all non-empty cubes of the cube array, false otherwise
+    */
+   bool collectModifiedCubes(std::vector<QuantizedMapCube>& cubes, bool all = false);
+
+   /** \brief Stop collecting cleared cubes and discard the collected ones (until the next collectModifiedCubes() call). */
+   void discardCollectedCubes();
+
+   /** \brief Retrieve the cube edge length in meters. */
+   static float cubeSize();
 
    auto& downSizeFilterCorner() { return _downSizeFilterCorner; }
    auto& downSizeFilterSurf() { return _downSizeFilterSurf; }
@@ -103,6 +246,21 @@ public:
    auto maxIterations() const { return _maxIterations; }
    auto deltaTAbort()   const { return _deltaTAbort; }
    auto deltaRAbort()   const { return _deltaRAbort; }
+   auto correspondenceRefreshDist() const { return _correspondenceRefreshDist; }
+   auto neighborSearchMethod() const { return _cornerMapIndex.method(); }
+   auto asyncMapUpdate() const { return _asyncMapUpdate; }
+   auto maxCubePoints() const { return _maxCubePoints; }
+   auto mortonOrderedCubes() const { return _mortonOrderedCubes; }
+   auto mapMemoryBudget() const { return _mapMemoryBudget; }
+   auto cubeEvictionPolicy() const { return _cubeEvictionPolicy; }
+   auto const& mapSaveDirectory() const { return _mapSaveDir; }
+   auto mapSaveInterval() const { return _mapSaveInterval; }
+
+   /** \brief Retrieve the memory usage of all non-empty cubes as of the last collected map update. */
+   auto const& cubeMemoryInfo() const { return _cubeMemoryInfo; }
+
+   /** \brief Retrieve the memory usage of the map in bytes as of the last collected map update. */
+   auto mapMemoryUsage() const { return _mapMemoryUsage; }
 
    auto const& transformAftMapped()   const { return _transformAftMapped; }
    auto const& transformBefMapped()   const { return _transformBefMapped; }
@@ -120,12 +278,104 @@ private:
    void pointAssociateTobeMapped(const pcl::PointXYZI& pi, pcl::PointXYZI& po);
    void transformFullResToMap();
 
-   bool createDownsizedMap();
+   /** \brief Transform a feature point stack to the map.
+    *
+    * @param stack the feature points in the local frame
+    * @param points the resulting points in the map frame
+    */
+   void transformStackToMap(const pcl::PointCloud<pcl::PointXYZI>& stack, pcl::PointCloud<pcl::PointXYZI>& points);
+
+   /** \brief Shift the cube array around the current pose, select the valid / surround cubes and
+    * collect the map clouds the pose is optimized against. */
+   void prepareMapSnapshot();
+
+   /** \brief Accumulate the surround cubes into a down sized map cloud every _mapFrameNum calls.
+    *
+    * @param mapCloud the resulting map cloud
+    * @return true if a new map cloud has been created, false otherwise
+    */
+   bool createDownsizedMap(pcl::PointCloud<pcl::PointXYZI>& mapCloud);
 
    // private:
    size_t toIndex(int i, int j, int k) const
    { return i + _laserCloudWidth * j + _laserCloudWidth * _laserCloudHeight * k; }
 
+   /** \brief Find the index of the cube containing the given map point.
+    *
+    * @param p the point in map coordinates
+    * @param cubeInd the resulting cube index
+    * @return true if the point lies within the cube array, false otherwise
+    */
+   bool cubeIndexOf(const pcl::PointXYZI& p, size_t& cubeInd) const;
+
+   /** \brief Swap the content (clouds and voxel grids) of two cubes. */
+   void swapCubes(size_t indexA, size_t indexB);
+
+   /** \brief Remove all points from a cube and free its memory. */
+   void clearCube(size_t index);
+
+   /** \brief Down size and quantize a cube and append it to the cube collection. */
+   void collectCube(size_t index);
+
+   /** \brief Collect the modified (or all non-empty) cubes, called by the owner of the cube array. */
+   void collectCubes(bool all);
+
+   /** \brief Hand the cube collection over to collectModifiedCubes(), called with the map update mutex held. */
+   void handOverCollectedCubes(bool all);
+
+   /** \brief Write a cube to its map tile if it has been modified since it was last saved.
+    *
+    * @return false if the tile could not be written, true otherwise
+    */
+   bool saveCube(size_t index);
+
+   /** \brief Write all modified cubes to their map tiles. */
+   bool saveModifiedCubes();
+
+   /** \brief Load the registered map tile of an empty cube (if any). */
+   void loadCube(size_t index);
+
+   /** \brief Block until a running background map update is done. */
+   void waitForMapUpdate();
+
+   /** \brief Evict cubes until the map fits into the memory budget and collect the memory statistics.
+    *
+    * @param cubeInfo the resulting memory usage of all non-empty cubes
+    * @return the total memory usage of the map in bytes
+    */
+   size_t enforceMemoryBudget(std::vector<CubeMemoryInfo>& cubeInfo);
+
+   /** \brief Merge new map points into their cube clouds.
+    *
+    * The points are grouped by cube and the cubes are updated in parallel, each cube keeping itself
+    * down sampled via its incremental voxel grid.
+    *
+    * @param points the new points (in map coordinates)
+    * @param cubes the cube clouds to insert into
+    * @param grids the voxel grids of the cube clouds
+    * @param leafSize the voxel leaf size of the cube clouds
+    */
+   void insertIntoCubes(const pcl::PointCloud<pcl::PointXYZI>& points,
+                        std::vector<pcl::PointCloud<pcl::PointXYZI>::Ptr>& cubes,
+                        std::vector<IncrementalVoxelGrid>& grids,
+                        const float& leafSize);
+
+   /** \brief Insert new corner and surface map points into the cube clouds and clear them afterwards. */
+   void updateMap(pcl::PointCloud<pcl::PointXYZI>& cornerPoints,
+                  pcl::PointCloud<pcl::PointXYZI>& surfPoints);
+
+   /** \brief Map update thread main loop. */
+   void mapUpdateLoop();
+
+   /** \brief Hand the pending map points over to the map update thread. */
+   void startMapUpdate();
+
+   /** \brief Check if the background map update is done and take over its results.
+    *
+    * @return true if no map update is running (the cube array can be accessed), false otherwise
+    */
+   bool collectMapUpdate();
+
 private:
    Time _laserOdometryTime;
 
@@ -138,6 +388,7 @@ private:
    size_t _maxIterations;  ///< maximum number of iterations
    float _deltaTAbort;     ///< optimization abort threshold for deltaT
    float _deltaRAbort;     ///< optimization abort threshold for deltaR
+   float _correspondenceRefreshDist;  ///< feature point displacement after which its map correspondence is searched again
 
    int _laserCloudCenWidth;
    int _laserCloudCenHeight;
@@ -151,6 +402,9 @@ private:
    pcl::PointCloud<pcl::PointXYZI>::Ptr _laserCloudSurfLast;     ///< last surface points cloud
    pcl::PointCloud<pcl::PointXYZI>::Ptr _laserCloudFullRes;      ///< last full resolution cloud
 
+   // The stack and surround clouds are no arena clouds: they are the input or output of pcl::VoxelGrid
+   // (and the kd-tree / the published map), which take pcl clouds with their own Eigen allocated point
+   // vector. They are members that keep their capacity across frames, i.e. only allocate while warming up.
    pcl::PointCloud<pcl::PointXYZI>::Ptr _laserCloudCornerStack;
    pcl::PointCloud<pcl::PointXYZI>::Ptr _laserCloudSurfStack;
    pcl::PointCloud<pcl::PointXYZI>::Ptr _laserCloudCornerStackDS;  ///< down sampled
@@ -161,26 +415,85 @@ private:
    pcl::PointCloud<pcl::PointXYZI>::Ptr _laserCloudCornerFromMap;
    pcl::PointCloud<pcl::PointXYZI>::Ptr _laserCloudSurfFromMap;
 
-   pcl::PointCloud<pcl::PointXYZI> _laserCloudOri;
-   pcl::PointCloud<pcl::PointXYZI> _coeffSel;
+   FrameArena _frameArena;   ///< per-frame scratch memory of the optimization
+   ResidualBuffer _residuals;   ///< residuals of the current optimization iteration
+
+   std::vector<MapCorrespondence> _cornerCorrespondences;  ///< cached map lines of the down sampled corner stack
+   std::vector<MapCorrespondence> _surfCorrespondences;    ///< cached map planes of the down sampled surface stack
+   CorrespondenceIndex _cornerMapIndex;          ///< nearest neighbour index of the corner map
+   CorrespondenceIndex _surfMapIndex;            ///< nearest neighbour index of the surface map
+   pcl::PointCloud<pcl::PointXYZI> _mapSel;      ///< feature stack transformed to the map
+   pcl::PointCloud<pcl::PointXYZI> _mapQueries;  ///< stale feature points searched in the current iteration
+   std::vector<int> _mapQuerySlot;               ///< query index of each feature point, -1 if not searched
+   std::vector<int> _mapSearchInd;               ///< map neighbour indices of the queries
+   std::vector<float> _mapSearchSqDis;           ///< squared map neighbour distances of the queries
 
    std::vector<pcl::PointCloud<pcl::PointXYZI>::Ptr> _laserCloudCornerArray;
    std::vector<pcl::PointCloud<pcl::PointXYZI>::Ptr> _laserCloudSurfArray;
-   std::vector<pcl::PointCloud<pcl::PointXYZI>::Ptr> _laserCloudCornerDSArray;  ///< down sampled
-   std::vector<pcl::PointCloud<pcl::PointXYZI>::Ptr> _laserCloudSurfDSArray;    ///< down sampled
+   std::vector<IncrementalVoxelGrid> _laserCloudCornerGrid;  ///< voxel occupancy of the corner cube clouds
+   std::vector<IncrementalVoxelGrid> _laserCloudSurfGrid;    ///< voxel occupancy of the surface cube clouds
+
+   std::vector<std::pair<size_t, size_t> > _insertCubeRefs;      ///< (cube index, point index) pairs sorted by cube
+   std::vector<std::pair<size_t, size_t> > _insertCubeRanges;    ///< ranges in _insertCubeRefs belonging to the same cube
+
+   std::vector<size_t> _cubeLastTouched;   ///< map version of the last insertion per cube
 
    std::vector<size_t> _laserCloudValidInd;
    std::vector<size_t> _laserCloudSurroundInd;
 
    Twist _transformSum, _transformIncre, _transformTobeMapped, _transformBefMapped, _transformAftMapped;
 
-   CircularBuffer<IMUState2> _imuHistory;    ///< history of IMU states
+   SpscRingBuffer<IMUState2> _imuHistory;    ///< history of IMU states (filled by the IMU callback)
 
    pcl::VoxelGrid<pcl::PointXYZI> _downSizeFilterCorner;   ///< voxel filter for down sizing corner clouds
    pcl::VoxelGrid<pcl::PointXYZI> _downSizeFilterSurf;     ///< voxel filter for down sizing surface clouds
    pcl::VoxelGrid<pcl::PointXYZI> _downSizeFilterMap;      ///< voxel filter for down sizing accumulated map
 
    bool _downsizedMapCreated = false;
+
+   float _cornerLeafSize = 0.2;   ///< voxel leaf size of the corner cube clouds
+   float _surfLeafSize = 0.4;     ///< voxel leaf size of the surface cube clouds
+
+   pcl::PointCloud<pcl::PointXYZI> _pendingCorner;  ///< new corner map points waiting for insertion
+   pcl::PointCloud<pcl::PointXYZI> _pendingSurf;    ///< new surface map points waiting for insertion
+
+   bool _asyncMapUpdate = false;        ///< flag if the map is updated on a separate thread
+   std::thread _mapUpdateThread;        ///< map update thread
+   std::mutex _mapUpdateMutex;          ///< guards the map update hand over
+   std::condition_variable _mapUpdateCond;
+   bool _mapUpdatePending = false;      ///< flag if the map update thread owns the cube array
+   bool _mapUpdateStop = false;         ///< flag to stop the map update thread
+   bool _mapUpdateMapCreated = false;   ///< flag if the last map update created a new surround map
+   size_t _mapVersion = 0;              ///< number of finished map updates
+   size_t _fromMapVersion = 0;          ///< map version the current optimization runs against
+   int _centerCubeI = 0, _centerCubeJ = 0, _centerCubeK = 0;  ///< cube of the sensor at the last map snapshot
+
+   size_t _maxCubePoints = 0;           ///< maximum number of points per cube cloud (0 = unlimited)
+   bool _mortonOrderedCubes = false;    ///< keep the cube clouds sorted in Morton order
+   size_t _mapMemoryBudget = 0;         ///< maximum memory of all cubes in bytes (0 = unlimited)
+   CubeEvictionPolicy _cubeEvictionPolicy = EVICT_FARTHEST;
+
+   std::vector<CubeMemoryInfo> _cubeMemoryInfo;         ///< cube memory usage of the last collected map update
+   size_t _mapMemoryUsage = 0;                          ///< map memory usage of the last collected map update
+   std::vector<CubeMemoryInfo> _mapUpdateCubeInfo;      ///< cube memory usage of the running map update
+   size_t _mapUpdateMemoryUsage = 0;                    ///< map memory usage of the running map update
+
+   std::string _mapSaveDir;             ///< map tile save directory (empty = no saving)
+   size_t _mapSaveInterval = 10;        ///< number of map updates between saving modified cubes
+   size_t _mapUpdatesSinceSave = 0;     ///< number of map updates since modified cubes have been saved
+   std::vector<size_t> _cubeSavedVersion;  ///< map version a cube has last been saved / loaded at
+   std::vector<size_t> _cubeCollectedVersion;  ///< map version + 1 a cube has last been collected at (0 = never)
+   std::atomic<bool> _collectCubes{false};     ///< flag if modified cubes are collected before they are cleared
+   std::vector<QuantizedMapCube> _cubeCollection;   ///< cubes collected by the owner of the cube array
+   std::vector<QuantizedMapCube> _collectedCubes;   ///< collected cubes handed over, guarded by _mapUpdateMutex
+   bool _collectedAll = false;          ///< flag if the handed over cubes contain all non-empty cubes
+   bool _collectRequested = false;      ///< flag if the running map update collects the modified cubes when done
+   bool _collectAllRequested = false;   ///< flag if all non-empty cubes are requested
+   std::map<std::tuple<int, int, int>, std::string> _mapTiles;  ///< tile paths by world cube coordinates
+
+   pcl::PointCloud<pcl::PointXYZI> _mapUpdateCorner;      ///< corner map points of the running map update
+   pcl::PointCloud<pcl::PointXYZI> _mapUpdateSurf;        ///< surface map points of the running map update
+   pcl::PointCloud<pcl::PointXYZI> _mapUpdateSurroundDS;  ///< surround map created by the running map update
 };
 
 } // end namespace loam
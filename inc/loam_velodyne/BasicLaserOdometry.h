@@ -1,6 +1,7 @@
 #pragma once
 #include "Twist.h"
-#include "nanoflann_pcl.h"
+#include "CorrespondenceIndex.h"
+#include "ResidualBuffer.h"
 #include <pcl/point_cloud.h>
 #include <pcl/point_types.h>
 
@@ -34,12 +35,15 @@ namespace loam
     void setMaxIterations(size_t val) { _maxIterations = val; }
     void setDeltaTAbort(float val)    { _deltaTAbort = val;   }
     void setDeltaRAbort(float val)    { _deltaRAbort = val;   }
+    void setNeighborSearchMethod(NeighborSearchMethod val)
+    { _lastCornerIndex.setMethod(val); _lastSurfaceIndex.setMethod(val); }
 
     auto frameCount()    const { return _frameCount;    }
     auto scanPeriod()    const { return _scanPeriod;    }
     auto maxIterations() const { return _maxIterations; }
     auto deltaTAbort()   const { return _deltaTAbort;   }
     auto deltaRAbort()   const { return _deltaRAbort;   }
+    auto neighborSearchMethod() const { return _lastCornerIndex.method(); }
 
     /** \brief Transform the given point cloud to the end of the sweep.
      *
@@ -55,6 +59,13 @@ namespace loam
      */
     void transformToStart(const pcl::PointXYZI& pi, pcl::PointXYZI& po);
 
+    /** \brief Transform the given point cloud to the start of the sweep.
+     *
+     * @param cloud the point cloud to transform
+     * @param result the point cloud instance for storing the result
+     */
+    void transformToStart(const pcl::PointCloud<pcl::PointXYZI>& cloud, pcl::PointCloud<pcl::PointXYZI>& result);
+
 
     void pluginIMURotation(const Angle& bcx, const Angle& bcy, const Angle& bcz,
                            const Angle& blx, const Angle& bly, const Angle& blz,
@@ -78,11 +89,11 @@ namespace loam
     pcl::PointCloud<pcl::PointXYZI>::Ptr _lastCornerCloud;    ///< last corner points cloud
     pcl::PointCloud<pcl::PointXYZI>::Ptr _lastSurfaceCloud;   ///< last surface points cloud
 
-    pcl::PointCloud<pcl::PointXYZI>::Ptr _laserCloudOri;      ///< point selection，即从当前点云帧的特征点中选取的可以在上一帧点云中找到对应线/面的特征点
-    pcl::PointCloud<pcl::PointXYZI>::Ptr _coeffSel;           ///< point selection coefficients
+    FrameArena _frameArena;                          ///< per-frame scratch memory of the optimization
+    ResidualBuffer _residuals;    ///< point selection and coefficients，即从当前点云帧的特征点中选取的可以在上一帧点云中找到对应线/面的特征点
 
-    nanoflann::KdTreeFLANN<pcl::PointXYZI> _lastCornerKDTree;   ///< last corner cloud KD-tree
-    nanoflann::KdTreeFLANN<pcl::PointXYZI> _lastSurfaceKDTree;  ///< last surface cloud KD-tree
+    CorrespondenceIndex _lastCornerIndex;    ///< last corner cloud nearest neighbour index
+    CorrespondenceIndex _lastSurfaceIndex;   ///< last surface cloud nearest neighbour index
 
     //存储从MultiScanRegistration节点发送过来的特征点，作为当前点云帧的特征点
     pcl::PointCloud<pcl::PointXYZI>::Ptr _cornerPointsSharp;      ///< sharp corner points cloud
@@ -98,6 +109,13 @@ namespace loam
     std::vector<int> _pointSearchSurfInd2;    ///< second surface point search index buffer
     std::vector<int> _pointSearchSurfInd3;    ///< third surface point search index buffer
 
+    pcl::PointCloud<pcl::PointXYZI> _cornerPointsSel;   ///< sharp corner points transformed to the start of the sweep
+    pcl::PointCloud<pcl::PointXYZI> _surfPointsSel;     ///< flat surface points transformed to the start of the sweep
+    std::vector<int> _cornerSearchInd;        ///< nearest last corner point of each sharp corner point
+    std::vector<float> _cornerSearchSqDis;    ///< squared distance to the nearest last corner point
+    std::vector<int> _surfSearchInd;          ///< nearest last surface point of each flat surface point
+    std::vector<float> _surfSearchSqDis;      ///< squared distance to the nearest last surface point
+
     Twist _transform;     ///< optimized pose transformation
     Twist _transformSum;  ///< accumulated optimized pose transformation
 
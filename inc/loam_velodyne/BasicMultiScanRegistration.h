@@ -0,0 +1,99 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+
+#include "BasicScanRegistration.h"
+
+
+namespace loam {
+
+/** \brief Class realizing a linear mapping from vertical point angle to the corresponding scan ring.
+ *
+ */
+class MultiScanMapper {
+public:
+  /** \brief Construct a new multi scan mapper instance.
+   *
+   * @param lowerBound - the lower vertical bound (degrees)
+   * @param upperBound - the upper vertical bound (degrees)
+   * @param nScanRings - the number of scan rings
+   */
+  MultiScanMapper(const float& lowerBound = -15,
+                  const float& upperBound = 15,
+                  const uint16_t& nScanRings = 16);
+
+  const float& getLowerBound() { return _lowerBound; }
+  const float& getUpperBound() { return _upperBound; }
+  const uint16_t& getNumberOfScanRings() { return _nScanRings; }
+
+  /** \brief Set mapping parameters.
+   *
+   * @param lowerBound - the lower vertical bound (degrees)
+   * @param upperBound - the upper vertical bound (degrees)
+   * @param nScanRings - the number of scan rings
+   */
+  void set(const float& lowerBound,
+           const float& upperBound,
+           const uint16_t& nScanRings);
+
+  /** \brief Map the specified vertical point angle to its ring ID.
+   *
+   * @param angle the vertical point angle (in rad)
+   * @return the ring ID
+   */
+  int getRingForAngle(const float& angle);
+
+  /** Multi scan mapper for Velodyne VLP-16 according to data sheet. */
+  static inline MultiScanMapper Velodyne_VLP_16() { return MultiScanMapper(-15, 15, 16); };
+
+  /** Multi scan mapper for Velodyne HDL-32 according to data sheet. */
+  static inline MultiScanMapper Velodyne_HDL_32() { return MultiScanMapper(-30.67f, 10.67f, 32); };
+
+  /** Multi scan mapper for Velodyne HDL-64E according to data sheet. */
+  static inline MultiScanMapper Velodyne_HDL_64E() { return MultiScanMapper(-24.9f, 2, 64); };
+  
+  /** Multi scan mapper for PandarQT according to data sheet. */
+  static inline MultiScanMapper PandarQT() { return MultiScanMapper(-52.1, 52.1, 64); };
+
+
+private:
+  float _lowerBound;      ///< the vertical angle of the first scan ring
+  float _upperBound;      ///< the vertical angle of the last scan ring
+  uint16_t _nScanRings;   ///< number of scan rings
+  float _factor;          ///< linear interpolation factor
+};
+
+
+
+/** \brief ROS-free scan registration of multi-laser lidar sweeps.
+ *
+ * Sorts the points of a sweep into their scan rings, computes the relative point times from the
+ * horizontal point angles and extracts the features of the scan lines.
+ */
+class BasicMultiScanRegistration : virtual public BasicScanRegistration {
+public:
+  explicit BasicMultiScanRegistration(const MultiScanMapper& scanMapper = MultiScanMapper());
+
+  /** \brief Process a new input cloud.
+   *
+   * @param laserCloudIn the new input cloud to process
+   * @param scanTime the scan (message) timestamp
+   * @return true if the cloud has been registered, false if it had no valid points (the previous results are kept)
+   */
+  bool process(const pcl::PointCloud<pcl::PointXYZ>& laserCloudIn, const Time& scanTime);
+
+  /** \brief Set the mapper for mapping vertical point angles to scan ring IDs. */
+  void setScanMapper(const MultiScanMapper& scanMapper) { _scanMapper = scanMapper; }
+
+  auto& scanMapper() { return _scanMapper; }
+
+private:
+  MultiScanMapper _scanMapper;  ///< mapper for mapping vertical point angles to scan ring IDs
+  std::vector<pcl::PointCloud<pcl::PointXYZI> > _laserCloudScans;   ///< points of the current sweep per scan ring
+};
+
+} // end namespace loam
@@ -7,7 +7,7 @@
 
 #include "Angle.h"
 #include "Vector3.h"
-#include "CircularBuffer.h"
+#include "SpscRingBuffer.h"
 #include "time_utils.h"
 
 namespace loam
@@ -162,6 +162,24 @@ namespace loam
     auto const& surfacePointsLessFlat () { return _surfacePointsLessFlat; }
     auto const& config                () { return _config               ; }
 
+    /** \brief Hand the clouds of the last sweep over by swapping them with the given clouds.
+     *
+     * The clouds are cleared at the start of the next sweep anyway, so swapping moves the results
+     * without a copy and both sides keep their allocations.
+     */
+    void swapResults(pcl::PointCloud<pcl::PointXYZI>& laserCloud,
+                     pcl::PointCloud<pcl::PointXYZI>& cornerPointsSharp,
+                     pcl::PointCloud<pcl::PointXYZI>& cornerPointsLessSharp,
+                     pcl::PointCloud<pcl::PointXYZI>& surfacePointsFlat,
+                     pcl::PointCloud<pcl::PointXYZI>& surfacePointsLessFlat)
+    {
+      _laserCloud.swap(laserCloud);
+      _cornerPointsSharp.swap(cornerPointsSharp);
+      _cornerPointsLessSharp.swap(cornerPointsLessSharp);
+      _surfacePointsFlat.swap(surfacePointsFlat);
+      _surfacePointsLessFlat.swap(surfacePointsLessFlat);
+    }
+
   private:
 
     /** \brief Check is IMU data is available. */
@@ -244,8 +262,7 @@ namespace loam
     IMUState _imuStart;                     ///< the interpolated IMU state corresponding to the start time of the currently processed laser scan
     IMUState _imuCur;                       ///< the interpolated IMU state corresponding to the time of the currently processed laser scan point
     Vector3 _imuPositionShift;              ///< position shift between accumulated IMU position and interpolated IMU position
-    size_t _imuIdx = 0;                         ///< the current index in the IMU history
-    CircularBuffer<IMUState> _imuHistory;   ///< history of IMU states for cloud registration
+    SpscRingBuffer<IMUState> _imuHistory;   ///< history of IMU states for cloud registration (filled by the IMU callback)
 
     pcl::PointCloud<pcl::PointXYZ> _imuTrans = { 4,1 };  ///< IMU transformation information
 
@@ -253,6 +270,9 @@ namespace loam
     std::vector<PointLabel> _regionLabel;     ///< point label buffer
     std::vector<size_t> _regionSortIndices;   ///< sorted region indices based on point curvature
     std::vector<int> _scanNeighborPicked;     ///< flag if neighboring point was already picked
+
+    pcl::PointCloud<pcl::PointXYZI>::Ptr _surfPointsLessFlatScan { new pcl::PointCloud<pcl::PointXYZI> };  ///< less flat surface points of one scan
+    pcl::PointCloud<pcl::PointXYZI> _surfPointsLessFlatScanDS;   ///< down sampled less flat surface points of one scan
   };
 
 }
@@ -0,0 +1,71 @@
+#pragma once
+
+#include "VoxelHashIndex.h"
+#include "nanoflann_pcl.h"
+
+
+namespace loam
+{
+
+  /** Nearest neighbour search structure used for the correspondence search. */
+  enum NeighborSearchMethod
+  {
+    SEARCH_KDTREE,       ///< exact search in a kd-tree
+    SEARCH_VOXEL_HASH    ///< approximate search in a voxel hash, exact within the distance gate
+  };
+
+
+
+  /** \brief Nearest neighbour index over the feature points correspondences are searched in.
+   *
+   * Dispatches to a kd-tree or a voxel hash index, depending on the selected search method.
+   */
+  class CorrespondenceIndex
+  {
+  public:
+    /** \brief Create a new index.
+     *
+     * @param voxelSize the voxel edge length of the voxel hash index
+     * @param maxDistance the distance gate of the correspondence search
+     */
+    CorrespondenceIndex(const float& voxelSize, const float& maxDistance)
+          : _method(SEARCH_KDTREE),
+            _voxelIndex(voxelSize, maxDistance)
+    {}
+
+    /** \brief Select the search method (takes effect with the next setInputCloud()). */
+    void setMethod(const NeighborSearchMethod& method) { _method = method; }
+
+    /** \brief Retrieve the search method. */
+    const NeighborSearchMethod& method() const { return _method; }
+
+    /** \brief Build the index over the given cloud. */
+    void setInputCloud(const pcl::PointCloud<pcl::PointXYZI>::Ptr& cloud)
+    {
+      if (_method == SEARCH_VOXEL_HASH)
+        _voxelIndex.setInputCloud(cloud);
+      else
+        _kdtree.setInputCloud(cloud);
+    }
+
+    /** \brief Search the k nearest neighbours of several points.
+     *
+     * The results of query i are written to indices[i * k ...] and sqrDistances[i * k ...], missing
+     * neighbours are set to -1 / +inf.
+     */
+    void nearestKSearchBatch(const pcl::PointXYZI* queries, const size_t& numQueries, const int& k,
+                             int* indices, float* sqrDistances) const
+    {
+      if (_method == SEARCH_VOXEL_HASH)
+        _voxelIndex.nearestKSearchBatch(queries, numQueries, k, indices, sqrDistances);
+      else
+        _kdtree.nearestKSearchBatch(queries, numQueries, k, indices, sqrDistances);
+    }
+
+  private:
+    NeighborSearchMethod _method;                     ///< selected search method
+    nanoflann::KdTreeFLANN<pcl::PointXYZI> _kdtree;   ///< kd-tree index
+    VoxelHashIndex _voxelIndex;                       ///< voxel hash index
+  };
+
+} // end namespace loam
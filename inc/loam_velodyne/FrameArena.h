@@ -0,0 +1,107 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+
+namespace loam
+{
+
+  /** \brief Monotonic memory arena for the temporaries of one frame.
+   *
+   * Allocations bump a pointer through a list of blocks and are never freed individually. reset()
+   * releases everything at once at the start of the next frame. If a frame needed more than one block,
+   * reset() replaces the blocks by a single block of the total size, so that after the first few frames
+   * the arena does not call malloc anymore.
+   *
+   * Views (see ResidualBuffer) allocated before a reset() become empty on their next clear().
+   */
+  class FrameArena
+  {
+  public:
+    /** Position in the arena, see mark() and rewind(). */
+    struct Marker
+    {
+      size_t block;
+      size_t offset;
+    };
+
+    /** \brief Rewinds the arena to the position at construction time when leaving a scope. */
+    class Scope
+    {
+    public:
+      explicit Scope(FrameArena& arena) : _arena(arena), _marker(arena.mark()) {}
+      ~Scope() { _arena.rewind(_marker); }
+
+      Scope(const Scope&) = delete;
+      Scope& operator=(const Scope&) = delete;
+
+    private:
+      FrameArena& _arena;
+      Marker _marker;
+    };
+
+    explicit FrameArena(const size_t& initialCapacity = 1 << 20);
+
+    FrameArena(const FrameArena&) = delete;
+    FrameArena& operator=(const FrameArena&) = delete;
+
+    /** \brief Allocate memory from the arena.
+     *
+     * @param bytes the number of bytes
+     * @param alignment the alignment (power of two, at most 64)
+     * @return the allocated memory, valid until the next reset() or rewind() before it
+     */
+    void* allocate(const size_t& bytes, const size_t& alignment = 32);
+
+    /** \brief Allocate an uninitialized array of n elements (at least 32 byte aligned). */
+    template <typename T>
+    T* allocate(const size_t& n)
+    {
+      static_assert(std::is_trivially_destructible<T>::value, "arena memory is never destructed");
+      return static_cast<T*>(allocate(n * sizeof(T), alignof(T) > 32 ? alignof(T) : 32));
+    }
+
+    /** \brief Release all allocations (start of a new frame). */
+    void reset();
+
+    /** \brief Retrieve the current position, to release the allocations made after it with rewind(). */
+    Marker mark() const { return Marker{ _current, _offset }; }
+
+    /** \brief Release all allocations made since the given mark(). */
+    void rewind(const Marker& marker);
+
+    /** \brief Retrieve the number of bytes currently allocated. */
+    size_t used() const;
+
+    /** \brief Retrieve the maximum number of bytes allocated within one frame so far. */
+    const size_t& highWater() const { return _highWater; }
+
+    /** \brief Retrieve the total size of the arena blocks. */
+    size_t capacity() const;
+
+    /** \brief Retrieve the number of reset() calls so far. */
+    const uint64_t& generation() const { return _generation; }
+
+  private:
+    /** Memory block of the arena. */
+    struct Block
+    {
+      std::unique_ptr<char[]> data;
+      size_t size;
+    };
+
+    /** \brief Append a new block with room for at least the given number of bytes. */
+    void addBlock(const size_t& minSize);
+
+  private:
+    std::vector<Block> _blocks;   ///< arena blocks, allocation happens in _blocks[_current]
+    size_t _current;              ///< index of the current block
+    size_t _offset;               ///< allocation offset within the current block
+    size_t _highWater;            ///< maximum number of allocated bytes within one frame
+    uint64_t _generation;         ///< number of resets
+  };
+
+} // end namespace loam
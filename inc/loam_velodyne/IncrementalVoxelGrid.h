@@ -0,0 +1,133 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+
+
+namespace loam
+{
+
+  /** \brief Incremental voxel occupancy index for a down sampled point cloud.
+   *
+   * The grid keeps track of which voxel of a fixed, world aligned grid each point of an associated
+   * cloud represents. A new point is either appended to the cloud (if its voxel is still empty) or
+   * merged into the centroid of the point already representing its voxel. This keeps the associated
+   * cloud down sampled at O(new points) per insertion, instead of re-filtering the whole cloud.
+   *
+   * The grid does not own the cloud. The caller is responsible to pass the same cloud to all calls
+   * and to not modify the cloud behind the grid's back (call rebuild() if it did).
+   */
+  class IncrementalVoxelGrid
+  {
+  public:
+    explicit IncrementalVoxelGrid(const float& leafSize = 0.2);
+
+    /** \brief Set a new voxel leaf size.
+     *
+     * Changing the leaf size invalidates the voxel index, call rebuild() afterwards. The merge weights
+     * and insertion stamps of the points are kept for the rebuild.
+     *
+     * @param leafSize the new voxel leaf size
+     */
+    void setLeafSize(const float& leafSize);
+
+    /** \brief Insert a point into the down sampled cloud.
+     *
+     * @param cloud the associated down sampled cloud
+     * @param point the new point
+     */
+    void insert(pcl::PointCloud<pcl::PointXYZI>& cloud, const pcl::PointXYZI& point);
+
+    /** \brief Rebuild the voxel index from the given cloud, merging points that share a voxel.
+     *
+     * If the grid still holds the weights and insertion stamps of the cloud's points (same number of
+     * points), they are kept, so that removeOldest() evicts by age after the rebuild as well. The
+     * points of any other cloud count as inserted in cloud order.
+     *
+     * @param cloud the cloud to index (down sampled in place)
+     */
+    void rebuild(pcl::PointCloud<pcl::PointXYZI>& cloud);
+
+    /** \brief Remove the oldest points (the n points that created their voxels first) from the cloud.
+     *
+     * The order of the remaining points is preserved.
+     *
+     * @param cloud the associated down sampled cloud
+     * @param n the number of points to remove
+     */
+    void removeOldest(pcl::PointCloud<pcl::PointXYZI>& cloud, const size_t& n);
+
+    /** \brief Sort the cloud by the Morton (Z-order) key of the voxels, so that spatially close points
+     * are stored close to each other.
+     *
+     * The first sortedCount points are expected to be sorted already (e.g. by a previous call); only the
+     * remaining points are sorted and merged into them.
+     *
+     * @param cloud the associated down sampled cloud
+     * @param sortedCount the number of leading points that are already sorted
+     */
+    void sortByMorton(pcl::PointCloud<pcl::PointXYZI>& cloud, const size_t& sortedCount = 0);
+
+    /** \brief Remove all voxels (keeps the allocated memory). */
+    void clear();
+
+    /** \brief Remove all voxels and free the allocated memory. */
+    void release();
+
+    /** \brief Retrieve the memory allocated by the voxel index in bytes. */
+    size_t memoryUsage() const
+    { return _slots.capacity() * sizeof(Slot) + (_counts.capacity() + _stamps.capacity()) * sizeof(uint32_t); }
+
+    /** \brief Swap the content of this grid with another grid. */
+    void swap(IncrementalVoxelGrid& other);
+
+    /** \brief Retrieve the voxel leaf size. */
+    const float& leafSize() const { return _leafSize; }
+
+    /** \brief Retrieve the number of occupied voxels. */
+    size_t size() const { return _counts.size(); }
+
+  private:
+    /** Hash table slot, mapping a voxel to the index of its point in the associated cloud. */
+    struct Slot
+    {
+      int32_t x, y, z;
+      uint32_t index;
+    };
+
+    /** \brief Find the slot of the given voxel, or the empty slot where it would be inserted. */
+    size_t findSlot(const int32_t& x, const int32_t& y, const int32_t& z) const;
+
+    /** \brief Insert a point with the given merge weight and insertion stamp.
+     *
+     * @return true if the point has been appended to the cloud, false if it was merged into a voxel
+     */
+    bool merge(pcl::PointCloud<pcl::PointXYZI>& cloud, const pcl::PointXYZI& point,
+               const uint32_t& count, const uint32_t& stamp);
+
+    /** \brief Double the hash table size and re-insert all occupied slots. */
+    void grow();
+
+    /** \brief Move / remove the points of the cloud and re-index the voxels accordingly.
+     *
+     * @param cloud the associated down sampled cloud
+     * @param newIndex the new index of each point, EMPTY_SLOT for points to remove
+     * @param newSize the number of remaining points
+     */
+    void remap(pcl::PointCloud<pcl::PointXYZI>& cloud, const std::vector<uint32_t>& newIndex, const size_t& newSize);
+
+  private:
+    static const uint32_t EMPTY_SLOT = 0xFFFFFFFF;
+
+    float _leafSize;              ///< voxel leaf size
+    float _invLeafSize;           ///< inverse voxel leaf size
+    std::vector<Slot> _slots;     ///< open addressing hash table (power of two size, linear probing)
+    std::vector<uint32_t> _counts;  ///< number of points merged into each point of the associated cloud
+    std::vector<uint32_t> _stamps;  ///< insertion stamp of each point of the associated cloud
+    uint32_t _nextStamp;            ///< stamp of the next inserted point
+  };
+
+} // end namespace loam
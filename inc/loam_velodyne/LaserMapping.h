@@ -36,11 +36,13 @@
 
 #include "BasicLaserMapping.h"
 #include "common.h"
+#include "SweepSynchronizer.h"
 
 #include <ros/ros.h>
 #include <nav_msgs/Odometry.h>
 #include <sensor_msgs/Imu.h>
-#include <sensor_msgs/PointCloud2.h>
+#include <loam_velodyne/MapCubeUpdate.h>
+#include <pcl_ros/point_cloud.h>
 #include <tf/transform_datatypes.h>
 #include <tf/transform_broadcaster.h>
 
@@ -67,19 +69,19 @@ public:
     *
     * @param cornerPointsLastMsg the new last corner cloud message
     */
-   void laserCloudCornerLastHandler(const sensor_msgs::PointCloud2ConstPtr& cornerPointsLastMsg);
+   void laserCloudCornerLastHandler(const pcl::PointCloud<pcl::PointXYZI>::Ptr& cornerPointsLastMsg);
 
    /** \brief Handler method for a new last surface cloud.
     *
     * @param surfacePointsLastMsg the new last surface cloud message
     */
-   void laserCloudSurfLastHandler(const sensor_msgs::PointCloud2ConstPtr& surfacePointsLastMsg);
+   void laserCloudSurfLastHandler(const pcl::PointCloud<pcl::PointXYZI>::Ptr& surfacePointsLastMsg);
 
    /** \brief Handler method for a new full resolution cloud.
     *
     * @param laserCloudFullResMsg the new full resolution cloud message
     */
-   void laserCloudFullResHandler(const sensor_msgs::PointCloud2ConstPtr& laserCloudFullResMsg);
+   void laserCloudFullResHandler(const pcl::PointCloud<pcl::PointXYZI>::Ptr& laserCloudFullResMsg);
 
    /** \brief Handler method for a new laser odometry.
     *
@@ -99,36 +101,60 @@ public:
    /** \brief Try to process buffered data. */
    void process();
 
+   /** \brief Check if the message handlers trigger the processing (otherwise spin() polls at 100 Hz). */
+   bool eventDriven() const { return _eventDriven; }
+
+   /** \brief Write the map cubes modified since the last periodic save, if a map save directory is set. */
+   void shutdown();
 
-protected:
-   /** \brief Reset flags, etc. */
-   void reset();
 
-   /** \brief Check if all required information for a new processing step is available. */
-   bool hasNewData();
+protected:
+   /** \brief Process the buffered data if in event driven mode (called by the message handlers). */
+   void processIfEventDriven();
 
    /** \brief Publish the current result via the respective topics. */
    void publishResult();
 
-private:
-   ros::Time _timeLaserCloudCornerLast;   ///< time of current last corner cloud
-   ros::Time _timeLaserCloudSurfLast;     ///< time of current last surface cloud
-   ros::Time _timeLaserCloudFullRes;      ///< time of current full resolution cloud
-   ros::Time _timeLaserOdometry;          ///< time of current laser odometry
-
-   bool _newLaserCloudCornerLast;  ///< flag if a new last corner cloud has been received
-   bool _newLaserCloudSurfLast;    ///< flag if a new last surface cloud has been received
-   bool _newLaserCloudFullRes;     ///< flag if a new full resolution cloud has been received
-   bool _newLaserOdometry;         ///< flag if a new laser odometry has been received
+   /** \brief Publish the map cubes modified since the last update (incrementalMap mode).
+    *
+    * Cubes are only collected while the update topic has subscribers. A full map key frame is requested
+    * when a subscriber connects and every mapKeyFrameInterval updates, so receivers can resynchronize.
+    */
+   void publishMapUpdate();
 
+private:
+   /** Topics of the messages of one sweep. */
+   enum SweepMessage { CORNER_LAST_MSG, SURF_LAST_MSG, FULL_RES_MSG, ODOMETRY_MSG };
+
+   /** Synchronized messages, the clouds are non-const to be taken over by the processing. */
+   typedef SweepSynchronizer<pcl::PointCloud<pcl::PointXYZI>::Ptr,
+                             pcl::PointCloud<pcl::PointXYZI>::Ptr,
+                             pcl::PointCloud<pcl::PointXYZI>::Ptr,
+                             nav_msgs::Odometry::ConstPtr> Synchronizer;
+   typedef Synchronizer::MessageSet SweepMessages;
+
+   bool _eventDriven;              ///< flag if the message handlers trigger the processing (default: polling)
+   size_t _reportedDrops;          ///< number of dropped sweeps reported so far
+   Synchronizer _synchronizer;     ///< assembles the messages of a sweep (in SweepMessage order)
+   ros::Time _timeLaserOdometry;   ///< time of the currently processed sweep
+
+   bool _incrementalMap;                          ///< flag if modified map cubes are published instead of the surround map
+   ros::Duration _mapPublishPeriod;               ///< minimum time between map publications
+   ros::Time _lastMapPublish;                     ///< time of the last map publication
+   std::vector<QuantizedMapCube> _modifiedCubes;  ///< modified cubes of the current map update
+   size_t _mapKeyFrameInterval;                   ///< number of map updates between key frames (0 = on subscription only)
+   size_t _mapUpdatesSinceKeyFrame;               ///< number of map updates published since the last key frame
+   size_t _mapUpdateSubscribers;                  ///< number of map update subscribers at the last publication
+   uint32_t _mapUpdateSequence;                   ///< sequence number of the next map update
 
    nav_msgs::Odometry _odomAftMapped;      ///< mapping odometry message
    tf::StampedTransform _aftMappedTrans;   ///< mapping odometry transformation
 
-   ros::Publisher _pubLaserCloudSurround;    ///< map cloud message publisher
-   ros::Publisher _pubLaserCloudFullRes;     ///< current full resolution cloud message publisher
-   ros::Publisher _pubOdomAftMapped;         ///< mapping odometry publisher
-   tf::TransformBroadcaster _tfBroadcaster;  ///< mapping odometry transform broadcaster
+   CloudPublisher<pcl::PointXYZI> _pubLaserCloudSurround;   ///< map cloud message publisher
+   ros::Publisher _pubMapCubeUpdate;                        ///< incremental map update publisher
+   CloudPublisher<pcl::PointXYZI> _pubLaserCloudFullRes;    ///< current full resolution cloud message publisher
+   ros::Publisher _pubOdomAftMapped;                        ///< mapping odometry publisher
+   tf::TransformBroadcaster _tfBroadcaster;                 ///< mapping odometry transform broadcaster
 
    ros::Subscriber _subLaserCloudCornerLast;   ///< last corner cloud message subscriber
    ros::Subscriber _subLaserCloudSurfLast;     ///< last surface cloud message subscriber
@@ -38,14 +38,16 @@
 #include "nanoflann_pcl.h"
 
 #include <ros/node_handle.h>
-#include <sensor_msgs/PointCloud2.h>
 #include <nav_msgs/Odometry.h>
 #include <pcl/point_cloud.h>
 #include <pcl/point_types.h>
+#include <pcl_ros/point_cloud.h>
 #include <tf/transform_datatypes.h>
 #include <tf/transform_broadcaster.h>
 
+#include "common.h"
 #include "BasicLaserOdometry.h"
+#include "SweepSynchronizer.h"
 
 namespace loam
 {
@@ -70,37 +72,37 @@ namespace loam
      *
      * @param cornerPointsSharpMsg the new sharp corner cloud message
      */
-    void laserCloudSharpHandler(const sensor_msgs::PointCloud2ConstPtr& cornerPointsSharpMsg);
+    void laserCloudSharpHandler(const pcl::PointCloud<pcl::PointXYZI>::Ptr& cornerPointsSharpMsg);
 
     /** \brief Handler method for a new less sharp corner cloud.
      *
      * @param cornerPointsLessSharpMsg the new less sharp corner cloud message
      */
-    void laserCloudLessSharpHandler(const sensor_msgs::PointCloud2ConstPtr& cornerPointsLessSharpMsg);
+    void laserCloudLessSharpHandler(const pcl::PointCloud<pcl::PointXYZI>::Ptr& cornerPointsLessSharpMsg);
 
     /** \brief Handler method for a new flat surface cloud.
      *
      * @param surfPointsFlatMsg the new flat surface cloud message
      */
-    void laserCloudFlatHandler(const sensor_msgs::PointCloud2ConstPtr& surfPointsFlatMsg);
+    void laserCloudFlatHandler(const pcl::PointCloud<pcl::PointXYZI>::Ptr& surfPointsFlatMsg);
 
     /** \brief Handler method for a new less flat surface cloud.
      *
      * @param surfPointsLessFlatMsg the new less flat surface cloud message
      */
-    void laserCloudLessFlatHandler(const sensor_msgs::PointCloud2ConstPtr& surfPointsLessFlatMsg);
+    void laserCloudLessFlatHandler(const pcl::PointCloud<pcl::PointXYZI>::Ptr& surfPointsLessFlatMsg);
 
     /** \brief Handler method for a new full resolution cloud.
      *
      * @param laserCloudFullResMsg the new full resolution cloud message
      */
-    void laserCloudFullResHandler(const sensor_msgs::PointCloud2ConstPtr& laserCloudFullResMsg);
+    void laserCloudFullResHandler(const pcl::PointCloud<pcl::PointXYZI>::Ptr& laserCloudFullResMsg);
 
     /** \brief Handler method for a new IMU transformation information.
      *
      * @param laserCloudFullResMsg the new IMU transformation information message
      */
-    void imuTransHandler(const sensor_msgs::PointCloud2ConstPtr& imuTransMsg);
+    void imuTransHandler(const pcl::PointCloud<pcl::PointXYZ>::ConstPtr& imuTransMsg);
 
 
     /** \brief Process incoming messages in a loop until shutdown (used in active mode). */
@@ -109,39 +111,42 @@ namespace loam
     /** \brief Try to process buffered data. */
     void process();
 
-  protected:
-    /** \brief Reset flags, etc. */
-    void reset();
+    /** \brief Check if the message handlers trigger the processing (otherwise spin() polls at 100 Hz). */
+    bool eventDriven() const { return _eventDriven; }
 
-    /** \brief Check if all required information for a new processing step is available. */
-    bool hasNewData();
+  protected:
+    /** \brief Process the buffered data if in event driven mode (called by the message handlers). */
+    void processIfEventDriven();
 
     /** \brief Publish the current result via the respective topics. */
     void publishResult();
 
   private:
     uint16_t _ioRatio;       ///< ratio of input to output frames
+    bool _eventDriven;       ///< flag if the message handlers trigger the processing (default: polling)
+
+    /** Topics of the messages of one sweep. */
+    enum SweepMessage { CORNER_SHARP_MSG, CORNER_LESS_SHARP_MSG, SURF_FLAT_MSG, SURF_LESS_FLAT_MSG, FULL_RES_MSG, IMU_TRANS_MSG };
 
-    ros::Time _timeCornerPointsSharp;      ///< time of current sharp corner cloud
-    ros::Time _timeCornerPointsLessSharp;  ///< time of current less sharp corner cloud
-    ros::Time _timeSurfPointsFlat;         ///< time of current flat surface cloud
-    ros::Time _timeSurfPointsLessFlat;     ///< time of current less flat surface cloud
-    ros::Time _timeLaserCloudFullRes;      ///< time of current full resolution cloud
-    ros::Time _timeImuTrans;               ///< time of current IMU transformation information
+    /** Synchronized messages, the clouds are non-const to be taken over by the processing. */
+    typedef SweepSynchronizer<pcl::PointCloud<pcl::PointXYZI>::Ptr,
+                              pcl::PointCloud<pcl::PointXYZI>::Ptr,
+                              pcl::PointCloud<pcl::PointXYZI>::Ptr,
+                              pcl::PointCloud<pcl::PointXYZI>::Ptr,
+                              pcl::PointCloud<pcl::PointXYZI>::Ptr,
+                              pcl::PointCloud<pcl::PointXYZ>::ConstPtr> Synchronizer;
+    typedef Synchronizer::MessageSet SweepMessages;
 
-    bool _newCornerPointsSharp;       ///< flag if a new sharp corner cloud has been received
-    bool _newCornerPointsLessSharp;   ///< flag if a new less sharp corner cloud has been received
-    bool _newSurfPointsFlat;          ///< flag if a new flat surface cloud has been received
-    bool _newSurfPointsLessFlat;      ///< flag if a new less flat surface cloud has been received
-    bool _newLaserCloudFullRes;       ///< flag if a new full resolution cloud has been received
-    bool _newImuTrans;                ///< flag if a new IMU transformation information cloud has been received
+    Synchronizer _synchronizer;   ///< assembles the messages of a sweep (in SweepMessage order)
+    size_t _reportedDrops;        ///< number of dropped sweeps reported so far
+    ros::Time _timeSweep;         ///< time of the currently processed sweep
 
     nav_msgs::Odometry _laserOdometryMsg;       ///< laser odometry message
     tf::StampedTransform _laserOdometryTrans;   ///< laser odometry transformation
 
-    ros::Publisher _pubLaserCloudCornerLast;  ///< last corner cloud message publisher
-    ros::Publisher _pubLaserCloudSurfLast;    ///< last surface cloud message publisher
-    ros::Publisher _pubLaserCloudFullRes;     ///< full resolution cloud message publisher
+    CloudPublisher<pcl::PointXYZI> _pubLaserCloudCornerLast;  ///< last corner cloud message publisher
+    CloudPublisher<pcl::PointXYZI> _pubLaserCloudSurfLast;    ///< last surface cloud message publisher
+    CloudPublisher<pcl::PointXYZI> _pubLaserCloudFullRes;     ///< full resolution cloud message publisher
     ros::Publisher _pubLaserOdometry;         ///< laser odometry publisher
     tf::TransformBroadcaster _tfBroadcaster;  ///< laser odometry transform broadcaster
 
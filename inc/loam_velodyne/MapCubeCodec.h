@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+
+
+namespace loam
+{
+
+  /** \brief Map points of one mapping cube in a compact fixed-point encoding.
+   *
+   * The cube with the world cube coordinates c covers [c * cubeSize - cubeSize / 2, c * cubeSize + cubeSize / 2)
+   * per axis (see MapTileHeader). A point p is stored relative to the cube center as the 16 bit value
+   * round((p - c * cubeSize) / cubeSize * 65536) per axis, i.e. with a resolution of cubeSize / 65536
+   * (0.8 mm for 50 m cubes) in 6 instead of 32 bytes. The intensity is not kept.
+   */
+  struct QuantizedMapCube
+  {
+    int32_t cubeX;                 ///< world cube coordinates
+    int32_t cubeY;
+    int32_t cubeZ;
+    std::vector<int16_t> points;   ///< x, y, z per point
+  };
+
+
+
+  /** \brief Quantize the points of a cube.
+   *
+   * @param cloud the cube points (in map coordinates)
+   * @param cubeSize the cube edge length in meters
+   * @param cube the cube with its world cube coordinates set, receiving the quantized points
+   */
+  void quantizeMapCube(const pcl::PointCloud<pcl::PointXYZI>& cloud, const float& cubeSize, QuantizedMapCube& cube);
+
+  /** \brief Append the points of a quantized cube to a cloud.
+   *
+   * @param cube the quantized cube
+   * @param cubeSize the cube edge length in meters
+   * @param cloud the cloud to append the points (in map coordinates) to
+   */
+  void dequantizeMapCube(const QuantizedMapCube& cube, const float& cubeSize, pcl::PointCloud<pcl::PointXYZI>& cloud);
+
+} // end namespace loam
@@ -0,0 +1,120 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+
+
+namespace loam
+{
+
+  /** Magic number at the start of a map tile file ("LMTL"). */
+  const uint32_t MAP_TILE_MAGIC = 0x4c544d4c;
+
+  /** Current map tile file format version. */
+  const uint32_t MAP_TILE_VERSION = 1;
+
+  /** \brief Header of a binary map tile file.
+   *
+   * A map tile stores the corner and surface points of one mapping cube. The header is followed by
+   * the point data as structure of arrays (host byte order, 4 byte floats):
+   *   corner x[cornerCount], corner y[cornerCount], corner z[cornerCount], corner intensity[cornerCount],
+   *   surface x[surfCount], surface y[surfCount], surface z[surfCount], surface intensity[surfCount]
+   * All arrays are 4 byte aligned relative to the start of the file, so a memory mapped tile can be
+   * accessed in place.
+   */
+  struct MapTileHeader
+  {
+    uint32_t magic;         ///< MAP_TILE_MAGIC
+    uint32_t version;       ///< MAP_TILE_VERSION
+    int32_t cubeX;          ///< world cube coordinates, cube c covers [c * cubeSize - cubeSize / 2, c * cubeSize + cubeSize / 2)
+    int32_t cubeY;
+    int32_t cubeZ;
+    float cubeSize;         ///< cube edge length in meters
+    float cornerLeafSize;   ///< voxel leaf size of the corner points
+    float surfLeafSize;     ///< voxel leaf size of the surface points
+    uint32_t cornerCount;   ///< number of corner points
+    uint32_t surfCount;     ///< number of surface points
+    uint32_t reserved[2];   ///< reserved, zero
+  };
+
+  static_assert(sizeof(MapTileHeader) == 48, "unexpected map tile header size");
+
+
+
+  /** \brief Retrieve the file name of the tile of the given world cube. */
+  std::string mapTileFileName(const int32_t& cubeX, const int32_t& cubeY, const int32_t& cubeZ);
+
+  /** \brief List all map tile files in a directory.
+   *
+   * @param dir the tile directory
+   * @param files the resulting tile file paths
+   * @return false if the directory could not be read, true otherwise
+   */
+  bool listMapTiles(const std::string& dir, std::vector<std::string>& files);
+
+  /** \brief Write a map tile file.
+   *
+   * The tile is written to a temporary file first and renamed afterwards, so that readers never see
+   * a partially written tile.
+   *
+   * @param path the tile file path
+   * @param header the tile header (magic, version and point counts are filled in)
+   * @param corner the corner points
+   * @param surf the surface points
+   * @return true if the tile has been written, false otherwise
+   */
+  bool writeMapTile(const std::string& path, MapTileHeader header,
+                    const pcl::PointCloud<pcl::PointXYZI>& corner,
+                    const pcl::PointCloud<pcl::PointXYZI>& surf);
+
+
+
+  /** \brief Read-only memory mapping of a map tile file. */
+  class MappedMapTile
+  {
+  public:
+    MappedMapTile();
+    ~MappedMapTile();
+
+    MappedMapTile(const MappedMapTile&) = delete;
+    MappedMapTile& operator=(const MappedMapTile&) = delete;
+
+    /** \brief Map a tile file into memory and validate its header and size.
+     *
+     * @param path the tile file path
+     * @return true if the tile is valid, false otherwise
+     */
+    bool open(const std::string& path);
+
+    /** \brief Unmap the tile. */
+    void close();
+
+    /** \brief Retrieve the tile header (only valid after a successful open()). */
+    const MapTileHeader& header() const { return *static_cast<const MapTileHeader*>(_data); }
+
+    /** \brief Retrieve the x, y, z or intensity (field 0 to 3) array of the corner points. */
+    const float* corner(const int& field) const { return points() + field * header().cornerCount; }
+
+    /** \brief Retrieve the x, y, z or intensity (field 0 to 3) array of the surface points. */
+    const float* surf(const int& field) const
+    { return points() + 4 * header().cornerCount + field * header().surfCount; }
+
+    /** \brief Append the corner points to a cloud. */
+    void copyCorner(pcl::PointCloud<pcl::PointXYZI>& cloud) const;
+
+    /** \brief Append the surface points to a cloud. */
+    void copySurf(pcl::PointCloud<pcl::PointXYZI>& cloud) const;
+
+  private:
+    const float* points() const
+    { return reinterpret_cast<const float*>(static_cast<const char*>(_data) + sizeof(MapTileHeader)); }
+
+    void* _data;    ///< mapped file content
+    size_t _size;   ///< mapped file size
+  };
+
+} // end namespace loam
@@ -37,12 +37,13 @@
 
 #include <pcl_conversions/pcl_conversions.h>
 
-#include <sensor_msgs/PointCloud2.h>
+#include <pcl_ros/point_cloud.h>
 #include <ros/node_handle.h>
 #include <sensor_msgs/Imu.h>
 #include <tf/transform_datatypes.h>
 
-#include "loam_velodyne/BasicScanRegistration.h"
+#include "loam_velodyne/BasicMultiScanRegistration.h"
+#include "ShmSweepRing.h"
 #include "common.h"
 #include "math_utils.h"
 
@@ -50,68 +51,10 @@ namespace loam {
 
 
 
-/** \brief Class realizing a linear mapping from vertical point angle to the corresponding scan ring.
- *
- */
-class MultiScanMapper {
-public:
-  /** \brief Construct a new multi scan mapper instance.
-   *
-   * @param lowerBound - the lower vertical bound (degrees)
-   * @param upperBound - the upper vertical bound (degrees)
-   * @param nScanRings - the number of scan rings
-   */
-  MultiScanMapper(const float& lowerBound = -15,
-                  const float& upperBound = 15,
-                  const uint16_t& nScanRings = 16);
-
-  const float& getLowerBound() { return _lowerBound; }
-  const float& getUpperBound() { return _upperBound; }
-  const uint16_t& getNumberOfScanRings() { return _nScanRings; }
-
-  /** \brief Set mapping parameters.
-   *
-   * @param lowerBound - the lower vertical bound (degrees)
-   * @param upperBound - the upper vertical bound (degrees)
-   * @param nScanRings - the number of scan rings
-   */
-  void set(const float& lowerBound,
-           const float& upperBound,
-           const uint16_t& nScanRings);
-
-  /** \brief Map the specified vertical point angle to its ring ID.
-   *
-   * @param angle the vertical point angle (in rad)
-   * @return the ring ID
-   */
-  int getRingForAngle(const float& angle);
-
-  /** Multi scan mapper for Velodyne VLP-16 according to data sheet. */
-  static inline MultiScanMapper Velodyne_VLP_16() { return MultiScanMapper(-15, 15, 16); };
-
-  /** Multi scan mapper for Velodyne HDL-32 according to data sheet. */
-  static inline MultiScanMapper Velodyne_HDL_32() { return MultiScanMapper(-30.67f, 10.67f, 32); };
-
-  /** Multi scan mapper for Velodyne HDL-64E according to data sheet. */
-  static inline MultiScanMapper Velodyne_HDL_64E() { return MultiScanMapper(-24.9f, 2, 64); };
-  
-  /** Multi scan mapper for PandarQT according to data sheet. */
-  static inline MultiScanMapper PandarQT() { return MultiScanMapper(-52.1, 52.1, 64); };
-
-
-private:
-  float _lowerBound;      ///< the vertical angle of the first scan ring
-  float _upperBound;      ///< the vertical angle of the last scan ring
-  uint16_t _nScanRings;   ///< number of scan rings
-  float _factor;          ///< linear interpolation factor
-};
-
-
-
 /** \brief Class for registering point clouds received from multi-laser lidars.
  *
  */
-class MultiScanRegistration : virtual public BasicScanRegistration {
+class MultiScanRegistration : public BasicMultiScanRegistration {
 public:
   MultiScanRegistration(const MultiScanMapper& scanMapper = MultiScanMapper());
 
@@ -122,7 +65,13 @@ public:
    *
    * @param laserCloudMsg the new input cloud message to process
    */
-  void handleCloudMessage(const sensor_msgs::PointCloud2ConstPtr &laserCloudMsg);
+  void handleCloudMessage(const pcl::PointCloud<pcl::PointXYZ>::ConstPtr& laserCloudMsg);
+
+  /** \brief Process the sweeps published to the shared memory sweep ring since the last call.
+   *
+   * Called by the ring poll timer (shmRing parameter), opens the ring once the writer has created it.
+   */
+  void pollShmRing();
 
   /** \brief Handler method for IMU messages.
    *
@@ -145,6 +94,9 @@ private:
    */
   void process(const pcl::PointCloud<pcl::PointXYZ>& laserCloudIn, const Time& scanTime);
 
+  /** \brief Process a new input sweep after the system startup delay. */
+  void processInput(const pcl::PointCloud<pcl::PointXYZ>& laserCloudIn, const Time& scanTime);
+
 
 protected:
   /** \brief Publish the current result via the respective topics. */
@@ -152,17 +104,21 @@ protected:
 
 private:
   int _systemDelay = 20;             ///< system startup delay counter
-  MultiScanMapper _scanMapper;  ///< mapper for mapping vertical point angles to scan ring IDs
-  std::vector<pcl::PointCloud<pcl::PointXYZI> > _laserCloudScans;
   ros::Subscriber _subLaserCloud;   ///< input cloud message subscriber
 
+  std::string _shmRingName;                   ///< shared memory sweep ring name (empty: input via topic)
+  ShmSweepRingReader _shmRing;                ///< shared memory sweep ring input
+  pcl::PointCloud<pcl::PointXYZ> _shmSweep;   ///< sweep read from the ring
+  ros::Timer _shmRingTimer;                   ///< ring poll timer
+  ros::WallTime _shmLastSweep;                ///< time of the last sweep read from the ring
+
   ros::Subscriber _subImu;                    ///< IMU message subscriber
-  ros::Publisher _pubLaserCloud;              ///< full resolution cloud message publisher
-  ros::Publisher _pubCornerPointsSharp;       ///< sharp corner cloud message publisher
-  ros::Publisher _pubCornerPointsLessSharp;   ///< less sharp corner cloud message publisher
-  ros::Publisher _pubSurfPointsFlat;          ///< flat surface cloud message publisher
-  ros::Publisher _pubSurfPointsLessFlat;      ///< less flat surface cloud message publisher
-  ros::Publisher _pubImuTrans;                ///< IMU transformation message publisher
+  CloudPublisher<pcl::PointXYZI> _pubLaserCloud;             ///< full resolution cloud message publisher
+  CloudPublisher<pcl::PointXYZI> _pubCornerPointsSharp;      ///< sharp corner cloud message publisher
+  CloudPublisher<pcl::PointXYZI> _pubCornerPointsLessSharp;  ///< less sharp corner cloud message publisher
+  CloudPublisher<pcl::PointXYZI> _pubSurfPointsFlat;         ///< flat surface cloud message publisher
+  CloudPublisher<pcl::PointXYZI> _pubSurfPointsLessFlat;     ///< less flat surface cloud message publisher
+  CloudPublisher<pcl::PointXYZ> _pubImuTrans;                ///< IMU transformation message publisher
 
 };
 
@@ -0,0 +1,114 @@
+#pragma once
+
+#include <deque>
+
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+
+#include "BasicMultiScanRegistration.h"
+#include "BasicLaserOdometry.h"
+#include "BasicLaserMapping.h"
+#include "BasicTransformMaintenance.h"
+#include "Twist.h"
+#include "time_utils.h"
+
+
+namespace loam
+{
+
+  /** \brief Processing times of the pipeline stages for one sweep (in seconds). */
+  struct PipelineStageTimes
+  {
+    double registration = 0;   ///< scan registration
+    double odometry = 0;       ///< laser odometry
+    double mapping = 0;        ///< laser mapping (zero for sweeps not handed to the mapping)
+    double maintenance = 0;    ///< transform maintenance
+  };
+
+  /** \brief Pose estimate of one sweep. */
+  struct PipelinePose
+  {
+    Time stamp;                 ///< time of the sweep (start of the sweep)
+    Twist odometry;             ///< accumulated laser odometry
+    Twist integrated;           ///< laser odometry corrected by the latest mapping result (as published by the transformMaintenance node)
+    bool mapped;                ///< flag if the laser mapping has registered the sweep to the map
+    PipelineStageTimes times;   ///< processing times of the stages for the sweep
+  };
+
+
+
+  /** \brief Integrate the laser odometry of a sweep with the transform maintenance.
+   *
+   * @param transformMaintenance the transform maintenance holding the latest mapping result
+   * @param odometry the accumulated laser odometry of the sweep
+   * @return the odometry corrected by the latest mapping result
+   */
+  Twist integrateOdometry(BasicTransformMaintenance& transformMaintenance, const Twist& odometry);
+
+
+
+  /** \brief ROS-free LOAM pipeline chaining scan registration, laser odometry, laser mapping and
+   * transform maintenance.
+   *
+   * pushSweep() runs all stages on a new sweep in the calling thread and queues the resulting pose,
+   * which is retrieved with pullPose(). The clouds are handed from stage to stage by swapping them,
+   * except for the last feature clouds, which the odometry keeps for the next sweep. The data flow
+   * is the same as between the ROS nodes, with the stages always waiting for each other: the mapping
+   * processes every ioRatio-th sweep, i.e. exactly the sweeps the laserOdometry node publishes its
+   * clouds for, and the transform maintenance integrates the mapping result of the same sweep.
+   *
+   * The pipeline is not thread safe, the stages are reachable for configuration and for the
+   * intermediate results (e.g. mapping().laserCloudSurroundDS()).
+   */
+  class Pipeline
+  {
+  public:
+    /** \brief Construct a new pipeline.
+     *
+     * @param scanMapper the mapper for mapping vertical point angles to scan ring IDs
+     * @param config the scan registration parameters (the scan period is used by all stages)
+     * @param ioRatio the ratio of odometry to mapping sweeps
+     */
+    explicit Pipeline(const MultiScanMapper& scanMapper = MultiScanMapper(),
+                      const RegistrationParams& config = RegistrationParams(),
+                      const uint16_t& ioRatio = 2);
+
+    /** \brief Process a new sweep through all stages and queue its pose (empty sweeps are skipped).
+     *
+     * @param sweep the sweep in the sensor frame (x forward, z up)
+     * @param stamp the sweep time
+     */
+    void pushSweep(const pcl::PointCloud<pcl::PointXYZ>& sweep, const Time& stamp);
+
+    /** \brief Add an IMU orientation measurement for the laser mapping. */
+    void pushImu(const IMUState2& state) { _mapping.updateIMU(state); }
+
+    /** \brief Retrieve the oldest queued pose.
+     *
+     * @param pose the pose instance for storing the result
+     * @return true if a pose was queued, false otherwise
+     */
+    bool pullPose(PipelinePose& pose);
+
+    /** \brief Retrieve the number of queued poses. */
+    size_t pendingPoses() const { return _poses.size(); }
+
+    void setIoRatio(const uint16_t& val) { _ioRatio = val; }
+    auto ioRatio() const { return _ioRatio; }
+
+    auto& scanRegistration()     { return _scanRegistration; }
+    auto& odometry()             { return _odometry; }
+    auto& mapping()              { return _mapping; }
+    auto& transformMaintenance() { return _transformMaintenance; }
+
+  private:
+    BasicMultiScanRegistration _scanRegistration;     ///< scan registration stage
+    BasicLaserOdometry _odometry;                     ///< laser odometry stage
+    BasicLaserMapping _mapping;                       ///< laser mapping stage
+    BasicTransformMaintenance _transformMaintenance;  ///< transform maintenance stage
+
+    uint16_t _ioRatio;                 ///< ratio of odometry to mapping sweeps
+    std::deque<PipelinePose> _poses;   ///< poses not pulled yet
+  };
+
+} // end namespace loam
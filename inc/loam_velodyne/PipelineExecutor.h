@@ -0,0 +1,164 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+
+#include "Pipeline.h"
+#include "StageQueue.h"
+
+
+namespace loam
+{
+
+  /** Policies of the PipelineExecutor for stages falling behind. */
+  enum BackpressurePolicy
+  {
+    BLOCK_PRODUCER,  ///< a stage (or pushSweep()) waits until the next stage has room, no sweep is lost
+    DROP_OLDEST,     ///< a full stage queue discards its oldest sweep, pushSweep() never waits
+    SKIP_MAPPING     ///< like BLOCK_PRODUCER, but the odometry never waits for the mapping, which only maps
+                     ///< the latest queued mapping sweep
+  };
+
+
+
+  /** \brief Staged executor running the LOAM pipeline stages on separate threads.
+   *
+   * Same data flow as Pipeline, but scan registration, laser odometry and laser mapping / transform
+   * maintenance each run on their own thread, handing the sweeps over via bounded queues: while sweep
+   * N is mapped, sweep N+1 can be in the odometry and sweep N+2 in the scan registration. The
+   * throughput is limited by the slowest stage instead of the sum of all stages.
+   *
+   * A stage falling behind fills its input queue, the BackpressurePolicy decides what happens then.
+   * With SKIP_MAPPING, the odometry hands its sweeps to the mapping without waiting: a new mapping sweep
+   * supersedes the mapping sweep still queued, which is reduced to its odometry pose (and still gets its
+   * integrated pose). So the mapping only processes the latest mapping sweep and mapping lags do not
+   * slow down the odometry; this is how the laserMapping node behaves, but without losing the odometry
+   * poses. The mapping queue then holds at most one mapping sweep plus the pose-only sweeps.
+   *
+   * The stages are configured via the accessors before start(). pushSweep() and pushImu() are called
+   * from one producer thread, pullPose() from one consumer thread.
+   */
+  class PipelineExecutor
+  {
+  public:
+    /** \brief Construct a new executor.
+     *
+     * @param scanMapper the mapper for mapping vertical point angles to scan ring IDs
+     * @param config the scan registration parameters (the scan period is used by all stages)
+     * @param ioRatio the ratio of odometry to mapping sweeps
+     * @param policy the policy for stages falling behind
+     * @param queueSize the capacity of the stage input queues
+     */
+    explicit PipelineExecutor(const MultiScanMapper& scanMapper = MultiScanMapper(),
+                              const RegistrationParams& config = RegistrationParams(),
+                              const uint16_t& ioRatio = 2,
+                              const BackpressurePolicy& policy = BLOCK_PRODUCER,
+                              const size_t& queueSize = 2);
+
+    /** \brief Stop the stage threads (see stop()). */
+    ~PipelineExecutor();
+
+    /** \brief Start the stage threads. */
+    void start();
+
+    /** \brief Process all pushed sweeps and stop the stage threads. */
+    void stop();
+
+    /** \brief Hand a new sweep to the scan registration stage (after start()), waiting for room with
+     * BLOCK_PRODUCER / SKIP_MAPPING.
+     *
+     * @param sweep the sweep in the sensor frame (x forward, z up)
+     * @param stamp the sweep time
+     */
+    void pushSweep(const pcl::PointCloud<pcl::PointXYZ>& sweep, const Time& stamp);
+
+    /** \brief Add an IMU orientation measurement for the laser mapping. */
+    void pushImu(const IMUState2& state) { _mapping.updateIMU(state); }
+
+    /** \brief Retrieve the oldest pose of the processed sweeps.
+     *
+     * @param pose the pose instance for storing the result
+     * @return true if a pose was available, false otherwise
+     */
+    bool pullPose(PipelinePose& pose);
+
+    /** \brief Wait until all pushed sweeps have been processed or dropped. */
+    void flush();
+
+    /** \brief Retrieve the number of sweeps dropped by full queues (DROP_OLDEST). */
+    size_t droppedSweeps() const;
+
+    /** \brief Retrieve the number of mapping sweeps skipped by the mapping (SKIP_MAPPING). */
+    size_t skippedMappings() const { return _skippedMappings; }
+
+    auto policy() const { return _policy; }
+    auto ioRatio() const { return _ioRatio; }
+
+    auto& scanRegistration()     { return _scanRegistration; }
+    auto& odometry()             { return _odometry; }
+    auto& mapping()              { return _mapping; }
+    auto& transformMaintenance() { return _transformMaintenance; }
+
+  private:
+    /** Sweep data handed from stage to stage. */
+    struct SweepWork
+    {
+      Time stamp;                                        ///< sweep time (start of the sweep after the registration)
+      pcl::PointCloud<pcl::PointXYZ> sweep;              ///< input sweep
+      pcl::PointCloud<pcl::PointXYZI> laserCloud;        ///< full resolution cloud
+      pcl::PointCloud<pcl::PointXYZI> cornerSharp;       ///< sharp corner points
+      pcl::PointCloud<pcl::PointXYZI> cornerLessSharp;   ///< less sharp corner points
+      pcl::PointCloud<pcl::PointXYZI> surfFlat;          ///< flat surface points
+      pcl::PointCloud<pcl::PointXYZI> surfLessFlat;      ///< less flat surface points
+      pcl::PointCloud<pcl::PointXYZ> imuTrans;           ///< IMU transformation of the sweep
+      pcl::PointCloud<pcl::PointXYZI> cornerLast;        ///< corner points for the mapping
+      pcl::PointCloud<pcl::PointXYZI> surfLast;          ///< surface points for the mapping
+      Twist odometry;                                    ///< accumulated laser odometry
+      bool mapSweep = false;                             ///< flag if the sweep is a mapping sweep
+      PipelineStageTimes times;                          ///< processing times of the stages so far
+
+      /** \brief Free the clouds of a sweep that only needs its pose. */
+      void releaseClouds();
+    };
+    typedef std::unique_ptr<SweepWork> SweepWorkPtr;
+
+    /** \brief Stage thread main loops. */
+    void registrationLoop();
+    void odometryLoop();
+    void mappingLoop();
+
+    /** \brief Count processed or dropped sweeps and wake up flush(). */
+    void finishSweeps(const size_t& n);
+
+    BasicMultiScanRegistration _scanRegistration;     ///< scan registration stage
+    BasicLaserOdometry _odometry;                     ///< laser odometry stage
+    BasicLaserMapping _mapping;                       ///< laser mapping stage
+    BasicTransformMaintenance _transformMaintenance;  ///< transform maintenance stage
+
+    uint16_t _ioRatio;               ///< ratio of odometry to mapping sweeps
+    BackpressurePolicy _policy;      ///< policy for stages falling behind
+
+    StageQueue<SweepWorkPtr> _registrationQueue;   ///< input sweeps
+    StageQueue<SweepWorkPtr> _odometryQueue;       ///< registered sweeps
+    StageQueue<SweepWorkPtr> _mappingQueue;        ///< sweeps with their odometry
+    std::thread _registrationThread;
+    std::thread _odometryThread;
+    std::thread _mappingThread;
+    bool _running;                                 ///< flag if the stage threads are running
+
+    std::atomic<size_t> _skippedMappings;   ///< number of mapping sweeps skipped with SKIP_MAPPING
+    mutable std::mutex _resultMutex;        ///< guards the poses and sweep counters
+    std::condition_variable _flushCond;     ///< signaled when sweeps are finished
+    std::deque<PipelinePose> _poses;        ///< poses not pulled yet
+    size_t _pushedSweeps;                   ///< number of pushed sweeps
+    size_t _finishedSweeps;                 ///< number of processed or dropped sweeps
+  };
+
+} // end namespace loam
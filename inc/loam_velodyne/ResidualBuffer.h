@@ -0,0 +1,119 @@
+#pragma once
+
+#include <cstring>
+
+#include <pcl/point_types.h>
+
+#include "FrameArena.h"
+
+
+namespace loam
+{
+
+  /** \brief Point to line / plane residuals of one Gauss-Newton iteration, stored as SoA columns in a
+   * FrameArena.
+   *
+   * Each residual holds the source point (px, py, pz), the weighted unit normal of the line / plane
+   * (nx, ny, nz), the weighted distance d of the transformed point to the line / plane and the weight w.
+   * The correspondence search fills the buffer, the Jacobian kernel (simd::KernelTable::jacobian) reads
+   * the columns directly. The storage is released with the next FrameArena::reset().
+   */
+  class ResidualBuffer
+  {
+  public:
+    /** Columns of the buffer. */
+    enum Column { PX, PY, PZ, NX, NY, NZ, D, W, NUM_COLUMNS };
+
+    explicit ResidualBuffer(FrameArena& arena)
+          : _arena(arena),
+            _size(0),
+            _capacity(0),
+            _generation(arena.generation())
+    {
+      clear();
+    }
+
+    ResidualBuffer(const ResidualBuffer&) = delete;
+    ResidualBuffer& operator=(const ResidualBuffer&) = delete;
+
+    size_t size() const { return _size; }
+    bool empty() const { return _size == 0; }
+
+    /** \brief Retrieve a column (size() entries). */
+    const float* column(const Column& c) const { return _columns[c]; }
+
+    const float* px() const { return _columns[PX]; }
+    const float* py() const { return _columns[PY]; }
+    const float* pz() const { return _columns[PZ]; }
+    const float* nx() const { return _columns[NX]; }
+    const float* ny() const { return _columns[NY]; }
+    const float* nz() const { return _columns[NZ]; }
+    const float* d() const { return _columns[D]; }
+    const float* w() const { return _columns[W]; }
+
+    /** \brief Remove all residuals (keeps the storage unless the arena has been reset in between). */
+    void clear()
+    {
+      _size = 0;
+      if (_generation != _arena.generation() || _capacity == 0)
+      {
+        for (auto& column : _columns)
+          column = nullptr;
+        _capacity = 0;
+        _generation = _arena.generation();
+      }
+    }
+
+    /** \brief Make room for at least n residuals. */
+    void reserve(const size_t& n)
+    {
+      if (_generation != _arena.generation())
+        clear();
+      if (n <= _capacity)
+        return;
+
+      for (auto& column : _columns)
+      {
+        float* data = _arena.allocate<float>(n);
+        if (_size > 0)
+          std::memcpy(data, column, _size * sizeof(float));
+        column = data;
+      }
+      _capacity = n;
+    }
+
+    /** \brief Append a residual.
+     *
+     * @param point the source point
+     * @param nx the x component of the weighted normal
+     * @param ny the y component of the weighted normal
+     * @param nz the z component of the weighted normal
+     * @param d the weighted distance to the line / plane
+     * @param w the weight
+     */
+    void push_back(const pcl::PointXYZI& point, const float& nx, const float& ny, const float& nz,
+                   const float& d, const float& w)
+    {
+      if (_size == _capacity)
+        reserve(_capacity < 64 ? 64 : 2 * _capacity);
+
+      _columns[PX][_size] = point.x;
+      _columns[PY][_size] = point.y;
+      _columns[PZ][_size] = point.z;
+      _columns[NX][_size] = nx;
+      _columns[NY][_size] = ny;
+      _columns[NZ][_size] = nz;
+      _columns[D][_size] = d;
+      _columns[W][_size] = w;
+      _size++;
+    }
+
+  private:
+    FrameArena& _arena;               ///< arena holding the columns
+    float* _columns[NUM_COLUMNS];     ///< column storage
+    size_t _size;                     ///< number of residuals
+    size_t _capacity;                 ///< number of residuals fitting into the columns
+    uint64_t _generation;             ///< arena generation the storage belongs to
+  };
+
+} // end namespace loam
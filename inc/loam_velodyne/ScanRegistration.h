@@ -84,12 +84,12 @@ namespace loam
 
   private:
     ros::Subscriber _subImu;                    ///< IMU message subscriber
-    ros::Publisher _pubLaserCloud;              ///< full resolution cloud message publisher
-    ros::Publisher _pubCornerPointsSharp;       ///< sharp corner cloud message publisher
-    ros::Publisher _pubCornerPointsLessSharp;   ///< less sharp corner cloud message publisher
-    ros::Publisher _pubSurfPointsFlat;          ///< flat surface cloud message publisher
-    ros::Publisher _pubSurfPointsLessFlat;      ///< less flat surface cloud message publisher
-    ros::Publisher _pubImuTrans;                ///< IMU transformation message publisher
+    CloudPublisher<pcl::PointXYZI> _pubLaserCloud;             ///< full resolution cloud message publisher
+    CloudPublisher<pcl::PointXYZI> _pubCornerPointsSharp;      ///< sharp corner cloud message publisher
+    CloudPublisher<pcl::PointXYZI> _pubCornerPointsLessSharp;  ///< less sharp corner cloud message publisher
+    CloudPublisher<pcl::PointXYZI> _pubSurfPointsFlat;         ///< flat surface cloud message publisher
+    CloudPublisher<pcl::PointXYZI> _pubSurfPointsLessFlat;     ///< less flat surface cloud message publisher
+    CloudPublisher<pcl::PointXYZ> _pubImuTrans;                ///< IMU transformation message publisher
   };
 
 } // end namespace loam
@@ -0,0 +1,157 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+
+#include "time_utils.h"
+
+
+namespace loam
+{
+
+  /** Magic number at the start of a shared memory sweep ring ("LSHR"). */
+  const uint32_t SHM_SWEEP_RING_MAGIC = 0x4c534852;
+
+  /** Current shared memory sweep ring layout version. */
+  const uint32_t SHM_SWEEP_RING_VERSION = 1;
+
+  /** \brief Header of a shared memory sweep ring.
+   *
+   * A sweep ring hands input sweeps from a lidar driver process to multiScanRegistration through a
+   * POSIX shared memory object, without a socket or message serialization. The object contains the
+   * header (128 bytes) followed by slotCount slots of slotSize bytes each. A slot is a ShmSweepSlot
+   * header (64 bytes) followed by up to maxPoints points of 4 floats x, y, z and an unused fourth value,
+   * which is the memory layout of pcl::PointXYZ (host byte order).
+   *
+   * Sweep n (counting from 0) is written to slot n % slotCount. The single writer never waits for the
+   * reader: it marks the slot as being written (sequence 2n + 1), fills it, marks it complete (sequence
+   * 2n + 2) and then publishes it by setting published to n + 1. A reader copies a slot and checks that
+   * the sequence is unchanged afterwards; if the writer has lapped the reader meanwhile, the sweep is
+   * dropped. All counters are lock-free 64 bit atomics, which work across processes.
+   */
+  struct ShmSweepRingHeader
+  {
+    uint32_t magic;                     ///< SHM_SWEEP_RING_MAGIC, written last by the writer
+    uint32_t version;                   ///< SHM_SWEEP_RING_VERSION
+    uint32_t slotCount;                 ///< number of slots (a power of two)
+    uint32_t maxPoints;                 ///< point capacity of a slot
+    uint64_t slotSize;                  ///< size of a slot in bytes (a multiple of 64)
+    uint64_t reserved[5];               ///< reserved, zero
+    alignas(64) std::atomic<uint64_t> published;   ///< number of published sweeps
+  };
+
+  /** \brief Header of a slot of a shared memory sweep ring. */
+  struct alignas(64) ShmSweepSlot
+  {
+    std::atomic<uint64_t> sequence;   ///< 2n + 1 while sweep n is written, 2n + 2 once it is complete
+    int64_t stamp;                    ///< sweep time in nanoseconds since the epoch
+    uint32_t pointCount;              ///< number of points of the sweep
+    uint32_t reserved;                ///< reserved, zero
+  };
+
+  static_assert(sizeof(ShmSweepRingHeader) == 128, "unexpected sweep ring header size");
+  static_assert(sizeof(ShmSweepSlot) == 64, "unexpected sweep ring slot header size");
+  static_assert(sizeof(pcl::PointXYZ) == 16, "the ring points have the layout of pcl::PointXYZ");
+  static_assert(ATOMIC_LLONG_LOCK_FREE == 2, "the ring counters have to be lock-free to work across processes");
+
+
+
+  /** \brief Writer of a shared memory sweep ring, e.g. in the lidar driver. */
+  class ShmSweepRingWriter
+  {
+  public:
+    ShmSweepRingWriter();
+    ~ShmSweepRingWriter();
+
+    ShmSweepRingWriter(const ShmSweepRingWriter&) = delete;
+    ShmSweepRingWriter& operator=(const ShmSweepRingWriter&) = delete;
+
+    /** \brief Create the shared memory object of a new ring, replacing an existing one of the same name.
+     *
+     * @param name the shared memory object name (e.g. "/loam_sweeps")
+     * @param slotCount the number of slots (rounded up to a power of two)
+     * @param maxPoints the maximum number of points of a sweep
+     * @return true if the ring has been created, false otherwise
+     */
+    bool create(const std::string& name, const uint32_t& slotCount, const uint32_t& maxPoints);
+
+    /** \brief Unmap the ring and remove its shared memory object (open readers keep their mapping). */
+    void close();
+
+    /** \brief Publish a new sweep, overwriting the oldest slot.
+     *
+     * @param sweep the sweep in the sensor frame
+     * @param stamp the sweep time
+     * @return true if the sweep has been published, false if it has more than maxPoints points
+     */
+    bool write(const pcl::PointCloud<pcl::PointXYZ>& sweep, const Time& stamp);
+
+  private:
+    std::string _name;             ///< shared memory object name
+    void* _data;                   ///< mapped ring
+    size_t _size;                  ///< mapped size
+    ShmSweepRingHeader* _header;   ///< ring header
+  };
+
+
+
+  /** \brief Reader of a shared memory sweep ring (one reader per ring). */
+  class ShmSweepRingReader
+  {
+  public:
+    ShmSweepRingReader();
+    ~ShmSweepRingReader();
+
+    ShmSweepRingReader(const ShmSweepRingReader&) = delete;
+    ShmSweepRingReader& operator=(const ShmSweepRingReader&) = delete;
+
+    /** \brief Map an existing ring read-only. Reading starts with the next sweep published.
+     *
+     * @param name the shared memory object name
+     * @return true if the ring has been mapped, false if it does not exist (yet) or is invalid
+     */
+    bool open(const std::string& name);
+
+    /** \brief Unmap the ring. */
+    void close();
+
+    /** \brief Check if a ring is mapped. */
+    bool isOpen() const { return _header != NULL; }
+
+    /** \brief Check if the mapped ring has been removed or replaced by a new ring of the given name (e.g.
+     * by a restarted writer), in which case the reader has to be reopened.
+     */
+    bool isReplaced(const std::string& name) const;
+
+    /** \brief Read the next sweep, without waiting for one.
+     *
+     * The sweep cloud is reused, so reading into the same cloud allocates nothing once its capacity
+     * suffices.
+     *
+     * @param sweep the cloud for storing the sweep
+     * @param stamp the sweep time
+     * @return true if a sweep was read, false if no new sweep is available
+     */
+    bool read(pcl::PointCloud<pcl::PointXYZ>& sweep, Time& stamp);
+
+    /** \brief Retrieve the number of sweeps overwritten by the writer before they could be read. */
+    size_t dropped() const { return _dropped; }
+
+    /** \brief Retrieve the number of sweeps published by the writer so far (ring mapped). */
+    uint64_t published() const { return _header->published.load(std::memory_order_acquire); }
+
+  private:
+    void* _data;                         ///< mapped ring
+    size_t _size;                        ///< mapped size
+    const ShmSweepRingHeader* _header;   ///< ring header
+    uint64_t _inode;                     ///< inode of the mapped shared memory object
+    uint64_t _next;                      ///< number of the next sweep to read
+    size_t _dropped;                     ///< number of overwritten sweeps
+  };
+
+} // end namespace loam
@@ -0,0 +1,161 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+
+
+namespace loam
+{
+
+  /** \brief Lock-free single producer / single consumer ring buffer for sensor histories.
+   *
+   * One thread (e.g. a ROS callback) push()es new elements, another thread (the processing) reads the
+   * buffered elements and discards the ones it does not need anymore. Neither side takes a lock: the
+   * producer only writes the head counter and the consumer only writes the tail counter, each on its own
+   * cache line. The capacity is rounded up to a power of two, so indexing is a mask instead of a modulo.
+   *
+   * All consumer accessors (size(), operator[], upperBound(), ...) see the elements pushed up to the
+   * moment they load the head counter; an element is never overwritten while the consumer can see it. If
+   * the buffer is full, push() drops the new element (counted in dropped()), so the consumer has to
+   * discard old elements in time, e.g. with discardOlderThan().
+   *
+   * @tparam T the element type, with a stamp member for the time-indexed lookups
+   */
+  template <class T>
+  class SpscRingBuffer
+  {
+  public:
+    explicit SpscRingBuffer(const size_t& capacity = 256)
+          : _head(0),
+            _tail(0),
+            _dropped(0)
+    {
+      setCapacity(capacity);
+    }
+
+    SpscRingBuffer(const SpscRingBuffer&) = delete;
+    SpscRingBuffer& operator=(const SpscRingBuffer&) = delete;
+
+    /** \brief Change the capacity (rounded up to a power of two), keeping the newest elements.
+     *
+     * Not thread safe: only call while neither producer nor consumer access the buffer.
+     */
+    void setCapacity(const size_t& capacity)
+    {
+      size_t newCapacity = 2;
+      while (newCapacity < capacity)
+        newCapacity *= 2;
+
+      std::unique_ptr<T[]> newBuffer(new T[newCapacity]);
+      size_t n = size() < newCapacity ? size() : newCapacity;
+      for (size_t i = 0; i < n; i++)
+        newBuffer[i] = (*this)[size() - n + i];
+
+      _buffer = std::move(newBuffer);
+      _mask = newCapacity - 1;
+      _tail.store(0, std::memory_order_relaxed);
+      _head.store(n, std::memory_order_relaxed);
+    }
+
+    /** \brief Retrieve the buffer capacity. */
+    size_t capacity() const { return _mask + 1; }
+
+    /** \brief Retrieve the number of elements dropped by push() because the buffer was full. */
+    size_t dropped() const { return _dropped.load(std::memory_order_relaxed); }
+
+
+    /** \brief Push a new element (producer only).
+     *
+     * @param element the element to push
+     * @return true if the element was added, false if the buffer is full
+     */
+    bool push(const T& element)
+    {
+      const size_t head = _head.load(std::memory_order_relaxed);
+      if (head - _tail.load(std::memory_order_acquire) > _mask)
+      {
+        _dropped.fetch_add(1, std::memory_order_relaxed);
+        return false;
+      }
+
+      _buffer[head & _mask] = element;
+      _head.store(head + 1, std::memory_order_release);
+      return true;
+    }
+
+
+    /** \brief Retrieve the number of buffered elements (consumer only). */
+    size_t size() const
+    {
+      return _head.load(std::memory_order_acquire) - _tail.load(std::memory_order_relaxed);
+    }
+
+    /** \brief Check if the buffer is empty (consumer only). */
+    bool empty() const { return size() == 0; }
+
+    /** \brief Retrieve the i-th oldest element (consumer only, i < size()). */
+    const T& operator[](const size_t& i) const
+    {
+      return _buffer[(_tail.load(std::memory_order_relaxed) + i) & _mask];
+    }
+
+    /** \brief Retrieve the oldest element (consumer only, buffer not empty). */
+    const T& first() const { return (*this)[0]; }
+
+    /** \brief Retrieve the latest element (consumer only, buffer not empty). */
+    const T& last() const { return (*this)[size() - 1]; }
+
+    /** \brief Discard the n oldest elements (consumer only, n <= size()). */
+    void discard(const size_t& n)
+    {
+      _tail.store(_tail.load(std::memory_order_relaxed) + n, std::memory_order_release);
+    }
+
+    /** \brief Find the first element stamped after the given time by binary search (consumer only).
+     *
+     * The elements have to be pushed in stamp order.
+     *
+     * @param stamp the time
+     * @return the index of the first element with a later stamp, or size() if there is none
+     */
+    template <class Stamp>
+    size_t upperBound(const Stamp& stamp) const
+    {
+      size_t lo = 0;
+      size_t hi = size();
+      while (lo < hi)
+      {
+        size_t mid = lo + (hi - lo) / 2;
+        if (stamp < (*this)[mid].stamp)
+          hi = mid;
+        else
+          lo = mid + 1;
+      }
+      return lo;
+    }
+
+    /** \brief Discard the elements older than the given time, keeping the latest of them as the
+     * interpolation start for the given time (consumer only).
+     */
+    template <class Stamp>
+    void discardOlderThan(const Stamp& stamp)
+    {
+      size_t idx = upperBound(stamp);
+      if (idx > 1)
+        discard(idx - 1);
+    }
+
+  private:
+    static const size_t CACHE_LINE = 64;
+
+    std::atomic<size_t> _head;   ///< push counter, written by the producer
+    char _headPadding[CACHE_LINE - sizeof(std::atomic<size_t>)];
+    std::atomic<size_t> _tail;   ///< discard counter, written by the consumer
+    char _tailPadding[CACHE_LINE - sizeof(std::atomic<size_t>)];
+    std::atomic<size_t> _dropped;   ///< number of elements dropped by push()
+    size_t _mask;                   ///< capacity - 1
+    std::unique_ptr<T[]> _buffer;   ///< element storage
+  };
+
+} // end namespace loam
@@ -0,0 +1,166 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <utility>
+
+
+namespace loam
+{
+
+  /** \brief Bounded queue handing work items from one pipeline stage thread to the next.
+   *
+   * One thread push()es, another one pop()s. A full queue either blocks the producer until the consumer
+   * has taken an item (default), or discards its oldest item for the new one (setDropOldest(), counted in
+   * dropped()). close() ends the hand over: pop() returns the remaining items and then false, push()
+   * returns false.
+   *
+   * Unlike SpscRingBuffer, the queue takes a lock, so the producer can discard items and both sides can
+   * sleep while waiting for each other; at sweep rate the lock is negligible against the stage work.
+   *
+   * @tparam T the (movable) item type
+   */
+  template <class T>
+  class StageQueue
+  {
+  public:
+    explicit StageQueue(const size_t& capacity = 2)
+          : _capacity(capacity < 1 ? 1 : capacity),
+            _dropOldest(false),
+            _closed(false),
+            _dropped(0)
+    {}
+
+    StageQueue(const StageQueue&) = delete;
+    StageQueue& operator=(const StageQueue&) = delete;
+
+    /** \brief Set the maximum number of queued items (at least 1). */
+    void setCapacity(const size_t& val)
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      _capacity = val < 1 ? 1 : val;
+    }
+
+    /** \brief Set if a full queue discards its oldest item instead of blocking the producer. */
+    void setDropOldest(const bool& val)
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      _dropOldest = val;
+    }
+
+    /** \brief Retrieve the number of discarded items. */
+    size_t dropped() const
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      return _dropped;
+    }
+
+    /** \brief Retrieve the number of queued items. */
+    size_t size() const
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      return _items.size();
+    }
+
+
+    /** \brief Queue a new item (producer only).
+     *
+     * @param item the item to queue
+     * @return true if the item was queued, false if the queue is closed
+     */
+    bool push(T item)
+    {
+      std::unique_lock<std::mutex> lock(_mutex);
+      if (!_dropOldest)
+        _notFull.wait(lock, [this] { return _items.size() < _capacity || _closed; });
+      if (_closed)
+        return false;
+
+      while (_items.size() >= _capacity)
+      {
+        _items.pop_front();
+        _dropped++;
+      }
+      _items.push_back(std::move(item));
+      lock.unlock();
+      _notEmpty.notify_one();
+      return true;
+    }
+
+    /** \brief Take the oldest item, waiting for one if the queue is empty (consumer only).
+     *
+     * @param item the instance for storing the item
+     * @return true if an item was taken, false if the queue is closed and empty
+     */
+    bool pop(T& item)
+    {
+      std::unique_lock<std::mutex> lock(_mutex);
+      _notEmpty.wait(lock, [this] { return !_items.empty() || _closed; });
+      if (_items.empty())
+        return false;
+
+      item = std::move(_items.front());
+      _items.pop_front();
+      lock.unlock();
+      _notFull.notify_one();
+      return true;
+    }
+
+    /** \brief Queue a new item without waiting, beyond the capacity if need be (producer only).
+     *
+     * For queues whose items can be reduced once a newer item makes them obsolete: supersede(queued, item)
+     * is called for each queued item (oldest first) before the new item is queued, so that the producer can
+     * strip the superseded ones and keep the queue small without being blocked by the consumer.
+     *
+     * @param item the item to queue
+     * @param supersede the function reducing a queued item superseded by the new one
+     * @return true if the item was queued, false if the queue is closed
+     */
+    template <class Supersede>
+    bool pushSuperseding(T item, Supersede supersede)
+    {
+      std::unique_lock<std::mutex> lock(_mutex);
+      if (_closed)
+        return false;
+
+      for (auto& queued : _items)
+        supersede(queued, item);
+      _items.push_back(std::move(item));
+      lock.unlock();
+      _notEmpty.notify_one();
+      return true;
+    }
+
+    /** \brief Close the queue, waking up the waiting producer and consumer. */
+    void close()
+    {
+      {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _closed = true;
+      }
+      _notEmpty.notify_all();
+      _notFull.notify_all();
+    }
+
+    /** \brief Reopen a closed queue, discarding the remaining items. */
+    void reopen()
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      _items.clear();
+      _closed = false;
+    }
+
+  private:
+    mutable std::mutex _mutex;           ///< guards all members
+    std::condition_variable _notEmpty;   ///< signaled when an item was queued or the queue closed
+    std::condition_variable _notFull;    ///< signaled when an item was taken or the queue closed
+    std::deque<T> _items;                ///< queued items, oldest first
+    size_t _capacity;                    ///< maximum number of queued items
+    bool _dropOldest;                    ///< flag if a full queue discards its oldest item
+    bool _closed;                        ///< flag if the queue is closed
+    size_t _dropped;                     ///< number of discarded items
+  };
+
+} // end namespace loam
@@ -0,0 +1,157 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+
+#include "BasicLaserMapping.h"
+#include "time_utils.h"
+
+
+namespace loam
+{
+
+  /** Magic number at the start of a sweep log file ("LSWL"). */
+  const uint32_t SWEEP_LOG_MAGIC = 0x4c57534c;
+
+  /** Current sweep log file format version. */
+  const uint32_t SWEEP_LOG_VERSION = 1;
+
+  /** Maximum number of points of a sweep record (a larger count marks a corrupt record). */
+  const uint32_t SWEEP_LOG_MAX_POINTS = 1u << 24;
+
+  /** Types of the sweep log records. */
+  enum SweepLogRecordType
+  {
+    SWEEP_RECORD = 1,   ///< input sweep, count x, y, z float triples
+    IMU_RECORD = 2      ///< IMU orientation, count (= 2) floats roll and pitch
+  };
+
+  /** \brief Header of a binary sweep log file.
+   *
+   * A sweep log stores the input of the LOAM pipeline (sweeps in the sensor frame and the IMU
+   * orientations for the laser mapping) in recording order, so that a recording can be reprocessed
+   * without ROS and without decoding bag messages. The file header is followed by the records, each
+   * a SweepLogRecordHeader and its payload (host byte order, 4 byte floats).
+   */
+  struct SweepLogHeader
+  {
+    uint32_t magic;     ///< SWEEP_LOG_MAGIC
+    uint32_t version;   ///< SWEEP_LOG_VERSION
+  };
+
+  /** \brief Header of a sweep log record. */
+  struct SweepLogRecordHeader
+  {
+    uint32_t type;    ///< SweepLogRecordType
+    uint32_t count;   ///< number of points of a sweep, number of floats of an IMU orientation
+    int64_t stamp;    ///< sweep / measurement time in nanoseconds since the epoch
+  };
+
+  static_assert(sizeof(SweepLogHeader) == 8, "unexpected sweep log header size");
+  static_assert(sizeof(SweepLogRecordHeader) == 16, "unexpected sweep log record header size");
+
+
+
+  /** \brief One record read from a sweep log. */
+  struct SweepLogRecord
+  {
+    SweepLogRecordType type;                  ///< record type
+    Time stamp;                               ///< sweep / measurement time
+    pcl::PointCloud<pcl::PointXYZ> sweep;     ///< the sweep of a SWEEP_RECORD
+    IMUState2 imu;                            ///< the orientation of an IMU_RECORD
+  };
+
+
+
+  /** \brief Writer of sweep log files. */
+  class SweepLogWriter
+  {
+  public:
+    SweepLogWriter();
+    ~SweepLogWriter();
+
+    SweepLogWriter(const SweepLogWriter&) = delete;
+    SweepLogWriter& operator=(const SweepLogWriter&) = delete;
+
+    /** \brief Create (or truncate) a sweep log file and write its header.
+     *
+     * @param path the sweep log file path
+     * @return true if the file has been created, false otherwise
+     */
+    bool open(const std::string& path);
+
+    /** \brief Close the file.
+     *
+     * @return true if all records have been written, false otherwise
+     */
+    bool close();
+
+    /** \brief Append a sweep record.
+     *
+     * @param sweep the sweep in the sensor frame (at most SWEEP_LOG_MAX_POINTS points)
+     * @param stamp the sweep time
+     * @return true if the record has been written, false otherwise
+     */
+    bool writeSweep(const pcl::PointCloud<pcl::PointXYZ>& sweep, const Time& stamp);
+
+    /** \brief Append an IMU orientation record.
+     *
+     * @param state the IMU orientation and its measurement time
+     * @return true if the record has been written, false otherwise
+     */
+    bool writeImu(const IMUState2& state);
+
+  private:
+    FILE* _file;                 ///< the log file
+    bool _ok;                    ///< flag if all writes succeeded
+    std::vector<float> _buffer;  ///< payload buffer
+  };
+
+
+
+  /** \brief Sequential reader of sweep log files. */
+  class SweepLogReader
+  {
+  public:
+    SweepLogReader();
+    ~SweepLogReader();
+
+    SweepLogReader(const SweepLogReader&) = delete;
+    SweepLogReader& operator=(const SweepLogReader&) = delete;
+
+    /** \brief Open a sweep log file and check its header.
+     *
+     * @param path the sweep log file path
+     * @return true if the file is a sweep log of the current version, false otherwise
+     */
+    bool open(const std::string& path);
+
+    /** \brief Close the file. */
+    void close();
+
+    /** \brief Read the next record.
+     *
+     * The sweep cloud of the record is reused, so reading into the same record instance allocates
+     * nothing once its capacity suffices. The point count of a sweep record is checked against the
+     * remaining file size before anything is allocated, so a corrupt count fails like a truncated record.
+     *
+     * @param record the record instance for storing the result
+     * @return true if a record was read, false at the end of the log or on a truncated / invalid record
+     */
+    bool next(SweepLogRecord& record);
+
+    /** \brief Check if the end of the log has been reached without an error. */
+    bool eof() const { return _eof; }
+
+  private:
+    FILE* _file;                 ///< the log file
+    bool _eof;                   ///< flag if the end of the log has been reached
+    std::vector<float> _buffer;  ///< payload buffer
+  };
+
+} // end namespace loam
@@ -0,0 +1,161 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <map>
+#include <tuple>
+#include <utility>
+
+
+namespace loam
+{
+
+  /** \brief Assembles the messages of a sweep, which arrive on several topics, into complete sets.
+   *
+   * Every topic delivers one message per sweep and all messages of a sweep carry the same time stamp.
+   * Up to maxPending() sweeps are buffered by stamp, so a message arriving early on one topic never
+   * overwrites the message of an earlier sweep still waiting for another topic. pop() retrieves the
+   * complete sets in stamp order.
+   *
+   * Sweeps which cannot be completed anymore are dropped and counted in dropped(): the oldest sweep when
+   * a new one does not fit into the buffer, and the incomplete sweeps older than a popped one. Messages
+   * of sweeps that have already been popped or dropped are ignored and counted in lateMessages(). If
+   * some topics are published for every sweep but the others only for some sweeps, setCountedTopics()
+   * restricts the drop count to sweeps with messages of the latter.
+   *
+   * @tparam Msgs the message types (usually ConstPtrs) of the topics, in topic order
+   */
+  template <typename... Msgs>
+  class SweepSynchronizer
+  {
+  public:
+    /** Messages of one sweep. */
+    typedef std::tuple<Msgs...> MessageSet;
+
+    /** Number of synchronized topics. */
+    static const size_t NUM_TOPICS = sizeof...(Msgs);
+    static_assert(NUM_TOPICS > 0 && NUM_TOPICS <= 32, "the received messages are tracked in a 32 bit mask");
+
+    explicit SweepSynchronizer(const size_t& maxPending = 4)
+          : _maxPending(maxPending < 1 ? 1 : maxPending),
+            _countedTopics(ALL_RECEIVED),
+            _finishedStamp(0),
+            _hasFinished(false),
+            _dropped(0),
+            _lateMessages(0)
+    {}
+
+    /** \brief Set the maximum number of buffered sweeps (at least 1). */
+    void setMaxPending(const size_t& val) { _maxPending = val < 1 ? 1 : val; }
+    const size_t& maxPending() const { return _maxPending; }
+
+    /** \brief Only count dropped sweeps with a message of one of the given topics (bit mask of topic indices). */
+    void setCountedTopics(const uint32_t& mask) { _countedTopics = mask; }
+
+    /** \brief Retrieve the number of buffered (incomplete or not yet popped) sweeps. */
+    size_t pending() const { return _sweeps.size(); }
+
+    /** \brief Retrieve the number of dropped incomplete sweeps. */
+    const size_t& dropped() const { return _dropped; }
+
+    /** \brief Retrieve the number of ignored messages of already popped or dropped sweeps. */
+    const size_t& lateMessages() const { return _lateMessages; }
+
+
+    /** \brief Add the message of topic I.
+     *
+     * @param stamp the sweep time stamp of the message (e.g. in nanoseconds)
+     * @param msg the message
+     */
+    template <size_t I>
+    void add(const uint64_t& stamp, const typename std::tuple_element<I, MessageSet>::type& msg)
+    {
+      if (_hasFinished && stamp <= _finishedStamp)
+      {
+        _lateMessages++;
+        return;
+      }
+
+      auto it = _sweeps.find(stamp);
+      if (it == _sweeps.end())
+        it = _sweeps.emplace(stamp, Sweep()).first;
+
+      std::get<I>(it->second.messages) = msg;
+      it->second.received |= uint32_t(1) << I;
+
+      // drop the oldest sweep if the buffer is full, which might be the new one (counted with its message)
+      if (_sweeps.size() > _maxPending)
+        drop(_sweeps.begin(), std::next(_sweeps.begin()));
+    }
+
+
+    /** \brief Retrieve the oldest complete sweep, dropping the incomplete sweeps before it.
+     *
+     * @param stamp the sweep time stamp
+     * @param messages the messages of the sweep
+     * @return true if a complete sweep was available, false otherwise
+     */
+    bool pop(uint64_t& stamp, MessageSet& messages)
+    {
+      for (auto it = _sweeps.begin(); it != _sweeps.end(); ++it)
+      {
+        if (it->second.received != ALL_RECEIVED)
+          continue;
+
+        stamp = it->first;
+        messages = std::move(it->second.messages);
+        drop(_sweeps.begin(), it);
+        _sweeps.erase(_sweeps.begin());
+        finish(stamp);
+        return true;
+      }
+
+      return false;
+    }
+
+    /** \brief Drop all buffered sweeps without counting them. */
+    void clear() { _sweeps.clear(); }
+
+  private:
+    /** Buffered messages of one sweep. */
+    struct Sweep
+    {
+      MessageSet messages;       ///< received messages
+      uint32_t received = 0;     ///< bit mask of the topics received so far
+    };
+
+    static const uint32_t ALL_RECEIVED = uint32_t((uint64_t(1) << NUM_TOPICS) - 1);
+
+    typedef typename std::map<uint64_t, Sweep>::iterator SweepIterator;
+
+    /** \brief Drop the given range of buffered sweeps. */
+    void drop(const SweepIterator& begin, const SweepIterator& end)
+    {
+      for (auto it = begin; it != end; ++it)
+      {
+        if (it->second.received & _countedTopics)
+          _dropped++;
+        finish(it->first);
+      }
+      _sweeps.erase(begin, end);
+    }
+
+    /** \brief Mark all sweeps up to the given stamp as finished. */
+    void finish(const uint64_t& stamp)
+    {
+      if (!_hasFinished || stamp > _finishedStamp)
+        _finishedStamp = stamp;
+      _hasFinished = true;
+    }
+
+    size_t _maxPending;                    ///< maximum number of buffered sweeps
+    uint32_t _countedTopics;               ///< topics whose sweeps are counted when dropped
+    std::map<uint64_t, Sweep> _sweeps;     ///< buffered sweeps by stamp
+    uint64_t _finishedStamp;               ///< stamp of the latest popped or dropped sweep
+    bool _hasFinished;                     ///< flag if a sweep has been popped or dropped
+    size_t _dropped;                       ///< number of dropped incomplete sweeps
+    size_t _lateMessages;                  ///< number of ignored late messages
+  };
+
+} // end namespace loam
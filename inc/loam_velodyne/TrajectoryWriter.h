@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstdio>
+#include <string>
+
+#include "Twist.h"
+#include "time_utils.h"
+
+
+namespace loam
+{
+
+  /** Trajectory file formats. */
+  enum TrajectoryFormat
+  {
+    TUM_TRAJECTORY,    ///< one "stamp tx ty tz qx qy qz qw" line per pose
+    KITTI_TRAJECTORY   ///< one row-major 3x4 pose matrix line per pose, without stamps
+  };
+
+  /** \brief Writer of trajectory files for the evaluation tools of the TUM RGB-D and KITTI benchmarks.
+   *
+   * The poses are written in the frame of the LOAM poses (/camera_init: z forward, x left, y up), with
+   * the rotation R = Ry(rot_y) * Rx(rot_x) * Rz(rot_z), i.e. the orientation the transformMaintenance
+   * node publishes for /integrated_to_init.
+   */
+  class TrajectoryWriter
+  {
+  public:
+    TrajectoryWriter();
+    ~TrajectoryWriter();
+
+    TrajectoryWriter(const TrajectoryWriter&) = delete;
+    TrajectoryWriter& operator=(const TrajectoryWriter&) = delete;
+
+    /** \brief Create (or truncate) a trajectory file.
+     *
+     * @param path the trajectory file path
+     * @param format the trajectory format
+     * @return true if the file has been created, false otherwise
+     */
+    bool open(const std::string& path, const TrajectoryFormat& format);
+
+    /** \brief Close the file.
+     *
+     * @return true if all poses have been written, false otherwise
+     */
+    bool close();
+
+    /** \brief Append a pose.
+     *
+     * @param stamp the pose time
+     * @param pose the pose
+     * @return true if the pose has been written, false otherwise
+     */
+    bool write(const Time& stamp, const Twist& pose);
+
+  private:
+    FILE* _file;               ///< the trajectory file
+    TrajectoryFormat _format;  ///< the trajectory format
+    bool _ok;                  ///< flag if all writes succeeded
+  };
+
+} // end namespace loam
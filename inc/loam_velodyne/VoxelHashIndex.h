@@ -0,0 +1,100 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+
+
+namespace loam
+{
+
+  /** \brief Voxel hash index for approximate nearest neighbour search within a distance gate.
+   *
+   * The index sorts the points of a cloud into a world aligned voxel grid (hash of voxel to point list,
+   * stored in compressed row format) in O(n). A k nearest neighbour search visits the voxels around
+   * the query in rings of increasing Chebyshev distance until the k-th neighbour is closer than any
+   * point of the next ring, or the ring distance exceeds the maximum search distance.
+   *
+   * Neighbours closer than the maximum search distance are therefore found exactly; neighbours
+   * farther away may be missed and are reported as index -1 / squared distance +inf. This is all the
+   * correspondence search needs, since it thresholds the neighbour distances anyway.
+   */
+  class VoxelHashIndex
+  {
+  public:
+    /** \brief Create a new index.
+     *
+     * @param voxelSize the voxel edge length
+     * @param maxDistance the maximum search distance (the distance gate of the caller)
+     */
+    explicit VoxelHashIndex(const float& voxelSize = 0.5, const float& maxDistance = 1.0);
+
+    /** \brief Set the voxel edge length (takes effect with the next setInputCloud()). */
+    void setVoxelSize(const float& voxelSize) { _voxelSize = voxelSize; }
+
+    /** \brief Set the maximum search distance. */
+    void setMaxDistance(const float& maxDistance) { _maxDistance = maxDistance; }
+
+    /** \brief Build the index over the given cloud. */
+    void setInputCloud(const pcl::PointCloud<pcl::PointXYZI>::Ptr& cloud);
+
+    /** \brief Search the k nearest neighbours of a point.
+     *
+     * @param point the query point
+     * @param k the number of neighbours
+     * @param indices the resulting neighbour indices (k entries, -1 if not found)
+     * @param sqrDistances the resulting squared neighbour distances (k entries, +inf if not found)
+     * @return the number of neighbours found
+     */
+    int nearestKSearch(const pcl::PointXYZI& point, const int& k, int* indices, float* sqrDistances) const;
+
+    /** \brief Search the k nearest neighbours of several points.
+     *
+     * The results of query i are written to indices[i * k ...] and sqrDistances[i * k ...].
+     */
+    void nearestKSearchBatch(const pcl::PointXYZI* queries, const size_t& numQueries, const int& k,
+                             int* indices, float* sqrDistances) const;
+
+    /** \brief Retrieve the voxel edge length. */
+    const float& voxelSize() const { return _voxelSize; }
+
+    /** \brief Retrieve the maximum search distance. */
+    const float& maxDistance() const { return _maxDistance; }
+
+    /** \brief Retrieve the number of occupied voxels. */
+    size_t size() const { return _cellStart.empty() ? 0 : _cellStart.size() - 1; }
+
+  private:
+    /** Hash table slot, mapping a voxel to its cell (point list). */
+    struct Slot
+    {
+      int32_t x, y, z;
+      uint32_t cell;
+    };
+
+    /** \brief Find the slot of the given voxel, or the empty slot where it would be inserted. */
+    size_t findSlot(const int32_t& x, const int32_t& y, const int32_t& z) const;
+
+    /** \brief Add the points of a voxel to the sorted k nearest neighbour candidates. */
+    void searchVoxel(const int32_t& x, const int32_t& y, const int32_t& z, const float* query,
+                     const int& k, int& count, int* indices, float* sqrDistances) const;
+
+  private:
+    static const uint32_t EMPTY_SLOT = 0xFFFFFFFF;
+
+    float _voxelSize;       ///< voxel edge length of the current index
+    float _maxDistance;     ///< maximum search distance
+    float _invVoxelSize;    ///< inverse voxel edge length of the current index
+
+    std::vector<Slot> _slots;                       ///< open addressing hash table (power of two size, linear probing)
+    std::vector<uint32_t> _cellStart;               ///< start of each cell in _points / _indices (plus end marker)
+    std::vector<std::array<float, 3> > _points;     ///< packed point coordinates, grouped by cell
+    std::vector<int> _indices;                      ///< cloud index of each packed point
+    std::vector<uint32_t> _pointCells;              ///< build scratch: cell of each cloud point
+    std::vector<int32_t> _pointVoxels;              ///< build scratch: voxel coordinates of each cloud point (SoA)
+  };
+
+} // end namespace loam
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <algorithm>
+
+#include <pcl/point_cloud.h>
+#include <pcl/pcl_macros.h>
+
+
+namespace loam
+{
+
+  /** \brief Take over the points of a cloud which is not used anymore, dropping invalid (NaN) points in
+   * the same pass.
+   *
+   * Replaces copying a received cloud with pcl::removeNaNFromPointCloud(): the point buffer of src is
+   * swapped into dst instead of copied and, unless src is dense, the valid points are compacted in place.
+   * The points are taken over unchanged, including the scan ring / relative time in the intensity field.
+   *
+   * @param src the cloud to take the points from, empty afterwards
+   * @param dst the cloud receiving the valid points
+   */
+  template <typename PointT>
+  inline void adoptFinitePoints(pcl::PointCloud<PointT>& src, pcl::PointCloud<PointT>& dst)
+  {
+    dst.header = src.header;
+    dst.points.swap(src.points);
+    if (!src.is_dense)
+    {
+      dst.points.erase(std::remove_if(dst.points.begin(), dst.points.end(), [](const PointT& p) {
+                         return !pcl_isfinite(p.x) || !pcl_isfinite(p.y) || !pcl_isfinite(p.z);
+                       }),
+                       dst.points.end());
+    }
+    dst.width = dst.points.size();
+    dst.height = 1;
+    dst.is_dense = true;
+    src.clear();
+  }
+
+} // end namespace loam
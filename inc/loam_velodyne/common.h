@@ -33,15 +33,25 @@
 #ifndef LOAM_COMMON_H
 #define LOAM_COMMON_H
 
+#include <string>
+#include <vector>
+
 #include <ros/ros.h>
 #include <sensor_msgs/PointCloud2.h>
 #include <pcl_conversions/pcl_conversions.h>
+#include <pcl_ros/point_cloud.h>
 #include <pcl/point_types.h>
 #include "time_utils.h"
 
 namespace loam {
 
-/** \brief Construct a new point cloud message from the specified information and publish it via the given publisher.
+/** \brief Publish a copy of the specified cloud via the given publisher.
+ *
+ * The cloud is published as a shared pcl::PointCloud message (see pcl_ros/point_cloud.h): subscribers in
+ * the same process (e.g. the nodelets of a common nodelet manager) receive the shared pointer without
+ * any serialization, other subscribers receive a sensor_msgs::PointCloud2 as before. The copy decouples
+ * the published message from the cloud, which the component keeps modifying. Nothing is copied if there
+ * are no subscribers.
  *
  * @tparam PointT the point type
  * @param publisher the publisher instance
@@ -54,13 +64,100 @@ inline void publishCloudMsg(ros::Publisher& publisher,
                             const pcl::PointCloud<PointT>& cloud,
                             const ros::Time& stamp,
                             std::string frameID) {
-  sensor_msgs::PointCloud2 msg;
-  pcl::toROSMsg(cloud, msg);
-  msg.header.stamp = stamp;
-  msg.header.frame_id = frameID;
+  if (publisher.getNumSubscribers() == 0)
+    return;
+
+  typename pcl::PointCloud<PointT>::Ptr msg(new pcl::PointCloud<PointT>(cloud));
+  msg->header.stamp = pcl_conversions::toPCL(stamp);
+  msg->header.frame_id = frameID;
   publisher.publish(msg);
 }
 
+/** \brief Publisher of pcl cloud messages reusing a small pool of message clouds.
+ *
+ * Like publishCloudMsg(), but instead of allocating a new message cloud for every message, the cloud is
+ * copied into a pooled message cloud no one else holds anymore, i.e. which all subscribers (and the
+ * roscpp publication queue) have released. The points are copied into the existing capacity of the
+ * pooled cloud, so in steady state publishing allocates nothing. The message is still published via
+ * shared pointer, intra-process subscribers share it without serialization. If all pooled clouds are in
+ * use, a new one is allocated (and pooled if the pool is not full).
+ *
+ * A single intra-process subscriber with a non-const callback receives the pooled cloud itself and may
+ * take its points over (see adoptFinitePoints()), so publish() sets all fields of the reused cloud and
+ * never relies on what it held before.
+ *
+ * @tparam PointT the point type
+ */
+template <typename PointT>
+class CloudPublisher {
+public:
+  typedef pcl::PointCloud<PointT> Cloud;
+
+  explicit CloudPublisher(const size_t& poolSize = 3) : _poolSize(poolSize) {}
+
+  /** \brief Advertise the topic (see ros::NodeHandle::advertise()). */
+  void advertise(ros::NodeHandle& node, const std::string& topic, const uint32_t& queueSize) {
+    _publisher = node.advertise<Cloud>(topic, queueSize);
+  }
+
+  /** \brief Publish a copy of the specified cloud, nothing is copied if there are no subscribers.
+   *
+   * @param cloud the cloud to publish
+   * @param stamp the time stamp of the cloud message
+   * @param frameID the message frame ID
+   */
+  void publish(const Cloud& cloud, const ros::Time& stamp, const std::string& frameID) {
+    if (_publisher.getNumSubscribers() == 0)
+      return;
+
+    typename Cloud::Ptr msg = acquire();
+    msg->points.assign(cloud.points.begin(), cloud.points.end());
+    msg->width = cloud.width;
+    msg->height = cloud.height;
+    msg->is_dense = cloud.is_dense;
+    msg->header.stamp = pcl_conversions::toPCL(stamp);
+    msg->header.frame_id = frameID;
+    _publisher.publish(msg);
+  }
+
+  uint32_t getNumSubscribers() const { return _publisher.getNumSubscribers(); }
+
+  ros::Publisher& publisher() { return _publisher; }
+
+private:
+  /** \brief Retrieve a message cloud no one else holds. */
+  typename Cloud::Ptr acquire() {
+    for (auto const& msg : _pool) {
+      if (msg.use_count() == 1)
+        return msg;
+    }
+
+    typename Cloud::Ptr msg(new Cloud());
+    if (_pool.size() < _poolSize)
+      _pool.push_back(msg);
+    return msg;
+  }
+
+  ros::Publisher _publisher;                  ///< the publisher
+  std::vector<typename Cloud::Ptr> _pool;     ///< pooled message clouds
+  size_t _poolSize;                           ///< maximum number of pooled message clouds
+};
+
+/** \brief Publish a copy of the specified cloud via the given pooling publisher (see CloudPublisher). */
+template <typename PointT>
+inline void publishCloudMsg(CloudPublisher<PointT>& publisher,
+                            const pcl::PointCloud<PointT>& cloud,
+                            const ros::Time& stamp,
+                            std::string frameID) {
+  publisher.publish(cloud, stamp, frameID);
+}
+
+/** \brief Retrieve the ROS time stamp of a pcl cloud message. */
+template <typename PointT>
+inline ros::Time cloudStamp(const pcl::PointCloud<PointT>& cloud) {
+  return pcl_conversions::fromPCL(cloud.header).stamp;
+}
+
 
 // ROS time adapters
 inline Time fromROSTime(ros::Time const& rosTime)
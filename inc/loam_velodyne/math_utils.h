@@ -7,6 +7,9 @@
 
 #include <cmath>
 
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+
 
 namespace loam {
 
@@ -274,6 +277,139 @@ inline void rotateYXZ(PointT& p,
   rotZ(p, angZ);
 }
 
+
+
+/** \brief Rigid (or general affine) point transformation p' = R * p + t.
+ *
+ * Transformations are built from the rotation helpers above and chained with then(), so a sequence
+ * of per point rotations and translations can be applied to a whole cloud in one batch pass.
+ */
+struct PointTransform
+{
+  float r[9];   ///< row-major 3x3 matrix R
+  float t[3];   ///< translation t
+
+  /** \brief Create the identity transformation. */
+  PointTransform()
+  {
+    for (int i = 0; i < 9; i++)
+      r[i] = (i % 4 == 0) ? 1.0f : 0.0f;
+    t[0] = t[1] = t[2] = 0.0f;
+  }
+
+  /** \brief Create a pure translation. */
+  static PointTransform translation(const Vector3& v)
+  {
+    PointTransform tf;
+    tf.t[0] = v.x();
+    tf.t[1] = v.y();
+    tf.t[2] = v.z();
+    return tf;
+  }
+
+  /** \brief Create the rotation of rotateZXY(). */
+  static PointTransform rotationZXY(const Angle& angZ, const Angle& angX, const Angle& angY)
+  {
+    PointTransform tf;
+    for (int col = 0; col < 3; col++)
+    {
+      Vector3 e(float(col == 0), float(col == 1), float(col == 2));
+      rotateZXY(e, angZ, angX, angY);
+      tf.setColumn(col, e);
+    }
+    return tf;
+  }
+
+  /** \brief Create the rotation of rotateYXZ(). */
+  static PointTransform rotationYXZ(const Angle& angY, const Angle& angX, const Angle& angZ)
+  {
+    PointTransform tf;
+    for (int col = 0; col < 3; col++)
+    {
+      Vector3 e(float(col == 0), float(col == 1), float(col == 2));
+      rotateYXZ(e, angY, angX, angZ);
+      tf.setColumn(col, e);
+    }
+    return tf;
+  }
+
+  /** \brief Chain two transformations.
+   *
+   * @param next the transformation to apply after this one
+   * @return the transformation p' = next(this(p))
+   */
+  PointTransform then(const PointTransform& next) const
+  {
+    PointTransform tf;
+    for (int i = 0; i < 3; i++)
+    {
+      for (int j = 0; j < 3; j++)
+        tf.r[3 * i + j] = next.r[3 * i] * r[j] + next.r[3 * i + 1] * r[3 + j] + next.r[3 * i + 2] * r[6 + j];
+      tf.t[i] = next.r[3 * i] * t[0] + next.r[3 * i + 1] * t[1] + next.r[3 * i + 2] * t[2] + next.t[i];
+    }
+    return tf;
+  }
+
+  /** \brief Transform a single point. */
+  template <typename PointT>
+  void apply(PointT& p) const
+  {
+    float x = p.x, y = p.y, z = p.z;
+    p.x = r[0] * x + r[1] * y + r[2] * z + t[0];
+    p.y = r[3] * x + r[4] * y + r[5] * z + t[1];
+    p.z = r[6] * x + r[7] * y + r[8] * z + t[2];
+  }
+
+private:
+  void setColumn(const int& col, const Vector3& v)
+  {
+    r[col] = v.x();
+    r[3 + col] = v.y();
+    r[6 + col] = v.z();
+  }
+};
+
+
+
+/** \brief Transform a whole cloud (SIMD batch version of PointTransform::apply()).
+ *
+ * @param tf the transformation
+ * @param cloud the input cloud
+ * @param result the output cloud (may be the input cloud), intensities are copied
+ */
+void transformCloud(const PointTransform& tf,
+                    const pcl::PointCloud<pcl::PointXYZI>& cloud,
+                    pcl::PointCloud<pcl::PointXYZI>& result);
+
+/** \brief Transform structure of arrays points (SIMD batch version of PointTransform::apply()).
+ *
+ * The output arrays may alias the input arrays.
+ */
+void transformPoints(const PointTransform& tf,
+                     const float* x, const float* y, const float* z,
+                     float* outX, float* outY, float* outZ, const size_t& n);
+
+/** \brief Apply a time interpolated transformation to a whole cloud.
+ *
+ * Every point is translated by s * translation and rotated by rotateZXY(s * angZ, s * angX, s * angY),
+ * where s = (intensity - int(intensity)) * invScanPeriod is the relative point time within the sweep
+ * (the fractional part of the intensity), like the per point sweep distortion correction does.
+ *
+ * @param angZ the full sweep rotation angle around the z-axis
+ * @param angX the full sweep rotation angle around the x-axis
+ * @param angY the full sweep rotation angle around the y-axis
+ * @param translation the full sweep translation (applied before the rotation)
+ * @param invScanPeriod the inverse scan period
+ * @param cloud the input cloud
+ * @param result the output cloud (may be the input cloud)
+ * @param truncateIntensity remove the relative time from the output intensities
+ */
+void transformCloudInterpolated(const float& angZ, const float& angX, const float& angY,
+                                const Vector3& translation, const float& invScanPeriod,
+                                const pcl::PointCloud<pcl::PointXYZI>& cloud,
+                                pcl::PointCloud<pcl::PointXYZI>& result,
+                                const bool& truncateIntensity = false);
+
 } // end namespace loam
 
 
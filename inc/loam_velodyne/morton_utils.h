@@ -0,0 +1,81 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <utility>
+#include <vector>
+
+
+namespace loam
+{
+
+  /** \brief Spread the lower 21 bits of a value so that two zero bits follow each bit. */
+  inline uint64_t mortonSpread21(uint64_t v)
+  {
+    v &= 0x1fffff;
+    v = (v | v << 32) & 0x1f00000000ffffULL;
+    v = (v | v << 16) & 0x1f0000ff0000ffULL;
+    v = (v | v << 8) & 0x100f00f00f00f00fULL;
+    v = (v | v << 4) & 0x10c30c30c30c30c3ULL;
+    v = (v | v << 2) & 0x1249249249249249ULL;
+    return v;
+  }
+
+  /** \brief Interleave three 21 bit cell coordinates into a 63 bit Morton (Z-order) code. */
+  inline uint64_t mortonCode3(const uint32_t& x, const uint32_t& y, const uint32_t& z)
+  {
+    return mortonSpread21(x) | mortonSpread21(y) << 1 | mortonSpread21(z) << 2;
+  }
+
+  /** \brief Compute the order in which to visit a set of points so that spatially close points are
+   * visited one after another (ascending Morton code of the points within their bounding box).
+   *
+   * @param points the points (any type with x, y and z members)
+   * @param n the number of points
+   * @param order the resulting visiting order (indices into points)
+   */
+  template <typename PointT>
+  void mortonOrder(const PointT* points, const size_t& n, std::vector<uint32_t>& order)
+  {
+    order.resize(n);
+    if (n == 0)
+      return;
+
+    float minPt[3] = { std::numeric_limits<float>::max(), std::numeric_limits<float>::max(),
+                       std::numeric_limits<float>::max() };
+    float maxPt[3] = { -minPt[0], -minPt[1], -minPt[2] };
+    for (size_t i = 0; i < n; i++)
+    {
+      const float p[3] = { points[i].x, points[i].y, points[i].z };
+      for (int d = 0; d < 3; d++)
+      {
+        minPt[d] = std::min(minPt[d], p[d]);
+        maxPt[d] = std::max(maxPt[d], p[d]);
+      }
+    }
+
+    // quantize each axis of the bounding box to 21 bits
+    float scale[3];
+    for (int d = 0; d < 3; d++)
+      scale[d] = maxPt[d] > minPt[d] ? float(0x1fffff) / (maxPt[d] - minPt[d]) : 0.0f;
+
+    auto cell = [&](const float& v, const int& d)
+    {
+      float c = (v - minPt[d]) * scale[d];
+      return c > 0.0f ? uint32_t(std::min(c, float(0x1fffff))) : 0u;   // NaN maps to cell 0
+    };
+
+    std::vector<std::pair<uint64_t, uint32_t> > keys(n);
+    for (size_t i = 0; i < n; i++)
+    {
+      keys[i].first = mortonCode3(cell(points[i].x, 0), cell(points[i].y, 1), cell(points[i].z, 2));
+      keys[i].second = uint32_t(i);
+    }
+    std::sort(keys.begin(), keys.end());
+
+    for (size_t i = 0; i < n; i++)
+      order[i] = keys[i].second;
+  }
+
+} // end namespace loam
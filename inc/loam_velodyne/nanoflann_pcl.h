@@ -41,16 +41,22 @@
 #ifndef NANO_KDTREE_KDTREE_FLANN_H_
 #define NANO_KDTREE_KDTREE_FLANN_H_
 
+#include <array>
+#include <limits>
+#include <vector>
 #include <boost/shared_ptr.hpp>
 #include <pcl/point_cloud.h>
 #include <pcl/point_types.h>
 #include "nanoflann.hpp"
+#include "morton_utils.h"
 
 namespace nanoflann
 {
 
 // Adapter class to give to nanoflann the same "look and fell" of pcl::KdTreeFLANN.
 // limited to squared distance between 3D points
+// All search methods are const and reentrant, so a tree may be searched from several threads at once
+// (as long as setInputCloud / setEpsilon / setSortedResults are not called concurrently).
 template <typename PointT>
 class KdTreeFLANN
 {
@@ -81,29 +87,45 @@ public:
     int  nearestKSearch (const PointT &point, int k, std::vector<int> &k_indices,
                          std::vector<float> &k_sqr_distances) const;
 
+    // radius is given in meters (like pcl), the resulting distances are squared
     int radiusSearch (const PointT &point, double radius, std::vector<int> &k_indices,
                       std::vector<float> &k_sqr_distances) const;
 
+    // Batched k nearest neighbour search over num_queries points.
+    // The results of query i are written to k_indices[i*k .. i*k+k-1] and k_sqr_distances[i*k .. i*k+k-1]
+    // (both preallocated by the caller), sorted by distance; missing neighbours are set to -1 / +inf.
+    // Large batches are visited in Morton order (so that consecutive searches touch the same tree
+    // nodes) and split across OpenMP threads. Not reentrant: the visiting order is kept in a scratch
+    // buffer of the tree, so batches on the same tree have to be searched one after the other.
+    void nearestKSearchBatch (const PointT *queries, size_t num_queries, int k,
+                              int *k_indices, float *k_sqr_distances) const;
+
 private:
 
     nanoflann::SearchParams _params;
 
+    // Packed copy of the input cloud (or of its indexed subset), taken at setInputCloud, so that the
+    // tree accesses coordinates without branching on the dimension or the indices vector.
     struct PointCloud_Adaptor
     {
-      inline size_t kdtree_get_point_count() const;
-      inline float kdtree_get_pt(const size_t idx, int dim) const;
-      template <class BBOX> bool kdtree_get_bbox(BBOX&) const { return false; }
-      PointCloudConstPtr pcl;
-      IndicesConstPtr indices;
+      inline size_t kdtree_get_point_count() const { return pts.size(); }
+      inline float kdtree_get_pt(const size_t idx, int dim) const { return pts[idx][dim]; }
+      template <class BBOX> bool kdtree_get_bbox(BBOX& bb) const;
+      void setPoints(const PointCloud& cloud, const IndicesConstPtr& indices);
+      std::vector<std::array<float, 3> > pts;
+      float bbox_min[3], bbox_max[3];
     };
 
     typedef nanoflann::KDTreeSingleIndexAdaptor<
-      nanoflann::SO3_Adaptor<float, PointCloud_Adaptor > ,
-      PointCloud_Adaptor, 3, int> KDTreeFlann_PCL_SO3;
+      nanoflann::L2_Simple_Adaptor<float, PointCloud_Adaptor > ,
+      PointCloud_Adaptor, 3, int> KDTreeFlann_PCL_L2;
 
     PointCloud_Adaptor _adaptor;
 
-    KDTreeFlann_PCL_SO3 _kdtree;
+    KDTreeFlann_PCL_L2 _kdtree;
+
+    // Scratch buffer of nearestKSearchBatch (query visiting order), keeps its capacity between batches.
+    mutable std::vector<uint32_t> _order;
 
 };
 
@@ -132,8 +154,7 @@ template<typename PointT> inline
 void KdTreeFLANN<PointT>::setInputCloud(const KdTreeFLANN::PointCloudPtr &cloud,
                                         const IndicesConstPtr &indices)
 {
-    _adaptor.pcl = cloud;
-    _adaptor.indices = indices;
+    _adaptor.setPoints(*cloud, indices);
     _kdtree.buildIndex();
 }
 
@@ -147,27 +168,67 @@ int KdTreeFLANN<PointT>::nearestKSearch(const PointT &point, int num_closest,
 
     nanoflann::KNNResultSet<float,int> resultSet(num_closest);
     resultSet.init( k_indices.data(), k_sqr_distances.data());
-    _kdtree.findNeighbors(resultSet, point.data, nanoflann::SearchParams() );
+    _kdtree.findNeighbors(resultSet, point.data, _params);
     return resultSet.size();
 }
 
+template<typename PointT> inline
+void KdTreeFLANN<PointT>::nearestKSearchBatch(const PointT *queries, size_t num_queries, int k,
+                                              int *k_indices, float *k_sqr_distances) const
+{
+    if (k <= 0)
+        return;
+
+    // sorting only pays off if there are enough queries to share tree paths
+    static const size_t MIN_SORTED_BATCH = 64;
+    std::vector<uint32_t>& order = _order;
+    if (num_queries >= MIN_SORTED_BATCH) {
+        loam::mortonOrder(queries, num_queries, order);
+    } else {
+        order.resize(num_queries);
+        for (size_t i = 0; i < num_queries; i++)
+            order[i] = uint32_t(i);
+    }
+
+    const int n = int(num_queries);
+    #pragma omp parallel for schedule(static, 64) if (num_queries >= 4 * MIN_SORTED_BATCH)
+    for (int i = 0; i < n; i++) {
+        const size_t q = order[i];
+        int *indices = k_indices + q * k;
+        float *dists = k_sqr_distances + q * k;
+
+        nanoflann::KNNResultSet<float,int> resultSet(k);
+        resultSet.init(indices, dists);
+        const float point[3] = { queries[q].x, queries[q].y, queries[q].z };
+        _kdtree.findNeighbors(resultSet, point, _params);
+
+        for (int j = int(resultSet.size()); j < k; j++) {
+            indices[j] = -1;
+            dists[j] = std::numeric_limits<float>::infinity();
+        }
+    }
+}
+
 template<typename PointT> inline
 int KdTreeFLANN<PointT>::radiusSearch(const PointT &point, double radius,
                               std::vector<int> &k_indices,
                               std::vector<float> &k_sqr_distances) const
 {
-    static std::vector<std::pair<int, float> > indices_dist;
+    // per thread scratch buffer, keeps its capacity between calls
+    static thread_local std::vector<std::pair<int, float> > indices_dist;
     indices_dist.reserve( 128 );
 
-    RadiusResultSet<float, int> resultSet(radius, indices_dist);
-    const size_t nFound = _kdtree.findNeighbors(resultSet, point.data, _params);
+    // the L2 metric works on squared distances
+    RadiusResultSet<float, int> resultSet(float(radius * radius), indices_dist);
+    _kdtree.findNeighbors(resultSet, point.data, _params);
+    const size_t nFound = resultSet.size();
 
     if (_params.sorted)
         std::sort(indices_dist.begin(), indices_dist.end(), IndexDist_Sorter() );
 
     k_indices.resize(nFound);
     k_sqr_distances.resize(nFound);
-    for(int i=0; i<nFound; i++ ){
+    for(size_t i=0; i<nFound; i++ ){
         k_indices[i]       = indices_dist[i].first;
         k_sqr_distances[i] = indices_dist[i].second;
     }
@@ -175,19 +236,36 @@ int KdTreeFLANN<PointT>::radiusSearch(const PointT &point, double radius,
 }
 
 template<typename PointT> inline
-size_t KdTreeFLANN<PointT>::PointCloud_Adaptor::kdtree_get_point_count() const {
-    if( indices ) return indices->size();
-    if( pcl)  return pcl->points.size();
-    return 0;
+void KdTreeFLANN<PointT>::PointCloud_Adaptor::setPoints(const PointCloud &cloud,
+                                                        const IndicesConstPtr &indices)
+{
+    const size_t n = indices ? indices->size() : cloud.points.size();
+    pts.resize(n);
+    for (int d = 0; d < 3; d++) {
+        bbox_min[d] = std::numeric_limits<float>::max();
+        bbox_max[d] = -std::numeric_limits<float>::max();
+    }
+
+    for (size_t i = 0; i < n; i++) {
+        const PointT& p = indices ? cloud.points[(*indices)[i]] : cloud.points[i];
+        std::array<float, 3>& q = pts[i];
+        q[0] = p.x;
+        q[1] = p.y;
+        q[2] = p.z;
+        for (int d = 0; d < 3; d++) {
+            bbox_min[d] = std::min(bbox_min[d], q[d]);
+            bbox_max[d] = std::max(bbox_max[d], q[d]);
+        }
+    }
 }
 
-template<typename PointT> inline
-float KdTreeFLANN<PointT>::PointCloud_Adaptor::kdtree_get_pt(const size_t idx, int dim) const{
-    const PointT& p = ( indices ) ? pcl->points[(*indices)[idx]] : pcl->points[idx];
-    if (dim==0) return p.x;
-    else if (dim==1) return p.y;
-    else if (dim==2) return p.z;
-    else return 0.0;
+template<typename PointT> template <class BBOX> inline
+bool KdTreeFLANN<PointT>::PointCloud_Adaptor::kdtree_get_bbox(BBOX& bb) const {
+    for (int d = 0; d < 3; d++) {
+        bb[d].low = bbox_min[d];
+        bb[d].high = bbox_max[d];
+    }
+    return true;
 }
 
 }
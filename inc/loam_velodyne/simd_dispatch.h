@@ -0,0 +1,98 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+
+// Runtime instruction set dispatch of the hot SIMD kernels.
+//
+// The kernels are compiled once per supported instruction set (see simd_kernels.h and the
+// LOAM_MULTI_ISA_KERNELS build option) and the fastest variant the host supports is selected on first
+// use. The interface only passes raw float / int arrays, so the library can be built without
+// -march=native and all Eigen types keep the same alignment in every translation unit.
+
+namespace loam
+{
+namespace simd
+{
+
+  /** Number of floats per pcl::PointXYZI (x, y, z, padding, intensity, padding). */
+  const size_t POINT_STRIDE = 8;
+
+  /** Float offset of the intensity field within a pcl::PointXYZI. */
+  const size_t POINT_INTENSITY = 4;
+
+
+
+  /** \brief Jacobian of point to line / plane residuals with respect to (rot_x, rot_y, rot_z, pos_x,
+   * pos_y, pos_z), for a fixed linearization point.
+   *
+   * The derivative of a residual by rotation k is sum_m (rot[k][m] . (p - offset)) * n_m, the derivative by
+   * translation k is trans[k] . n, with the source point p and the weighted line / plane normal n. The
+   * right hand side of the system is residualScale * d.
+   */
+  struct LinearJacobian
+  {
+    float rot[3][3][3];
+    float offset[3];
+    float trans[3][3];
+    float residualScale;
+  };
+
+
+
+  /** \brief Table of the kernels compiled for one instruction set.
+   *
+   * AoS point arguments point to the x field of the first pcl::PointXYZI of a contiguous array.
+   */
+  struct KernelTable
+  {
+    const char* name;   ///< name of the instruction set
+
+    /** Apply p' = R * p + t to AoS points (row-major R), keeping the intensity. */
+    void (*transformAoS)(const float* r, const float* t, const float* in, float* out, size_t n);
+
+    /** Apply p' = R * p + t to SoA points (row-major R). */
+    void (*transformSoA)(const float* r, const float* t, const float* x, const float* y, const float* z,
+                         float* ox, float* oy, float* oz, size_t n);
+
+    /** Apply p' = R_zxy(s * ang) * (p + s * t) to AoS points, s = (intensity - int(intensity)) * invScanPeriod. */
+    void (*transformInterpolatedAoS)(const float* ang, const float* t, float invScanPeriod,
+                                     bool truncateIntensity, const float* in, float* out, size_t n);
+
+    /** Compute the squared norm of sum_{j = 1..region}(p[i - j] + p[i + j]) - 2 * region * p[i] of n AoS
+     * points; region points before and after the range have to be valid. */
+    void (*curvature)(const float* points, size_t n, int region, float* out);
+
+    /** Compute the voxel coordinates floor(p * invVoxelSize) of n AoS points as three SoA arrays. */
+    void (*voxelCoordinates)(const float* points, size_t n, float invVoxelSize,
+                             int32_t* vx, int32_t* vy, int32_t* vz);
+
+    /** Evaluate the rows of a Gauss-Newton system of point to line / plane residuals, see LinearJacobian.
+     * The residuals are given as SoA columns (source points p, weighted normals n, weighted distances d).
+     * The Jacobian of the n residuals is written to the column-major matrix A (leading dimension ld),
+     * the scaled distances to b. */
+    void (*jacobian)(const LinearJacobian& J, const float* px, const float* py, const float* pz,
+                     const float* nx, const float* ny, const float* nz, const float* d, size_t n,
+                     float* A, size_t ld, float* b);
+  };
+
+
+
+  /** \brief Retrieve the kernels selected for this host.
+   *
+   * The selection happens once on first use. The environment variable LOAM_SIMD_ISA=baseline forces the
+   * baseline kernels, e.g. for comparisons.
+   */
+  const KernelTable& kernels();
+
+  /** \brief Retrieve the baseline kernels (SSE2 on x86-64, NEON on ARM). */
+  const KernelTable& baselineKernels();
+
+#ifdef LOAM_HAVE_AVX2_KERNELS
+  /** \brief Retrieve the AVX2 + FMA kernels (only call on hosts supporting both). */
+  const KernelTable& avx2Kernels();
+#endif
+
+} // end namespace simd
+} // end namespace loam
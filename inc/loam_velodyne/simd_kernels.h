@@ -0,0 +1,407 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+#include "simd_dispatch.h"
+
+
+// Portable SIMD kernels behind the kernel table of simd_dispatch.h.
+//
+// The kernels are written with the GCC / clang vector extensions, so the same source compiles to SSE2
+// on x86-64, NEON on ARM and AVX2 when built with the corresponding target flags. The lane count W is a
+// template parameter: 4 lanes match the 128 bit baseline instruction sets, 8 lanes are meant for AVX2.
+//
+// Only include this header from the kernel translation units (one per instruction set). Everything is
+// placed in an anonymous namespace, so the linker can not merge the inline functions of differently
+// compiled units and run AVX2 code on a host without AVX2. The kernel units must not include Eigen or
+// pcl either: the points are passed as raw floats (see POINT_STRIDE), so no Eigen type with an ISA
+// dependent alignment crosses the dispatch boundary.
+
+namespace loam
+{
+namespace simd
+{
+namespace
+{
+
+  template <int W>
+  struct Vec
+  {
+    typedef float f __attribute__((vector_size(W * sizeof(float))));
+    typedef int32_t i __attribute__((vector_size(W * sizeof(int32_t))));
+  };
+
+  typedef Vec<4>::f float4;
+
+
+
+  /** \brief Broadcast a scalar to all lanes. */
+  template <typename V>
+  inline V splat(const float& v)
+  {
+    V r = {};
+    return r + v;
+  }
+
+
+
+  /** \brief Vectorized sine and cosine (range reduction to [-pi/4, pi/4], Cephes polynomials).
+   *
+   * Accurate to a few ulp for arguments up to a few thousand radians, which covers all rotation angles.
+   */
+  template <int W>
+  inline void sincos(const typename Vec<W>::f& x, typename Vec<W>::f& s, typename Vec<W>::f& c)
+  {
+    typedef typename Vec<W>::f vf;
+    typedef typename Vec<W>::i vi;
+
+    // quadrant (round to nearest of x / (pi / 2))
+    vf t = x * 0.63661977236758134f;
+    vi q = __builtin_convertvector(t + (t >= 0 ? splat<vf>(0.5f) : splat<vf>(-0.5f)), vi);
+    vf qf = __builtin_convertvector(q, vf);
+
+    // extended precision modular arithmetic (Cody-Waite)
+    vf r = ((x - qf * 1.5703125f) - qf * 4.837512969970703125e-4f) - qf * 7.54978995489188216e-8f;
+    vf r2 = r * r;
+
+    vf sp = r + r * r2 * (-1.6666654611e-1f + r2 * (8.3321608736e-3f + r2 * -1.9515295891e-4f));
+    vf cp = 1.0f - 0.5f * r2 + r2 * r2 * (4.166664568298827e-2f + r2 * (-1.388731625493765e-3f
+                                                                    + r2 * 2.443315711809948e-5f));
+
+    // map the polynomial results to the quadrant
+    vi swap = (q & 1) != 0;
+    vf sv = swap ? cp : sp;
+    vf cv = swap ? sp : cp;
+    s = ((q & 2) != 0) ? -sv : sv;
+    c = (((q + 1) & 2) != 0) ? -cv : cv;
+  }
+
+
+
+  /** \brief Rotate SoA points around the z-, x- respectively y-axis (per lane angles, see rotateZXY()). */
+  template <int W>
+  inline void rotateZXY(typename Vec<W>::f& x, typename Vec<W>::f& y, typename Vec<W>::f& z,
+                        const typename Vec<W>::f& angZ, const typename Vec<W>::f& angX,
+                        const typename Vec<W>::f& angY)
+  {
+    typename Vec<W>::f s, c, tmp;
+
+    sincos<W>(angZ, s, c);
+    tmp = x;
+    x = c * tmp - s * y;
+    y = s * tmp + c * y;
+
+    sincos<W>(angX, s, c);
+    tmp = y;
+    y = c * tmp - s * z;
+    z = s * tmp + c * z;
+
+    sincos<W>(angY, s, c);
+    tmp = x;
+    x = c * tmp + s * z;
+    z = c * z - s * tmp;
+  }
+
+
+
+  /** \brief Load the lanes of a vector from a (possibly unaligned) float array. */
+  template <int W>
+  inline typename Vec<W>::f load(const float* p)
+  {
+    typename Vec<W>::f v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+  }
+
+
+
+  /** \brief Apply p' = R * p + t to AoS points (row-major R), exploiting the 16 byte aligned xyz block
+   * of the pcl points: every point is transformed as one 4 lane vector.
+   */
+  inline void transformAoS(const float* r, const float* t, const float* in, float* out, size_t n)
+  {
+    // matrix columns, the fourth lane keeps the padding value of the point
+    const float4 c0 = { r[0], r[3], r[6], 0.0f };
+    const float4 c1 = { r[1], r[4], r[7], 0.0f };
+    const float4 c2 = { r[2], r[5], r[8], 0.0f };
+    const float4 c3 = { t[0], t[1], t[2], 0.0f };
+    const float4 w = { 0.0f, 0.0f, 0.0f, 1.0f };
+
+    for (size_t i = 0; i < n; i++, in += POINT_STRIDE, out += POINT_STRIDE)
+    {
+      float4 p = load<4>(in);
+      float4 q = c0 * p[0] + c1 * p[1] + c2 * p[2] + c3 + w * p;
+      std::memcpy(out, &q, sizeof(q));
+      out[POINT_INTENSITY] = in[POINT_INTENSITY];
+    }
+  }
+
+
+
+  /** \brief Apply p' = R * p + t to SoA points (row-major R). */
+  template <int W>
+  inline void transformSoA(const float* r, const float* t,
+                           const float* x, const float* y, const float* z,
+                           float* ox, float* oy, float* oz, size_t n)
+  {
+    typedef typename Vec<W>::f vf;
+
+    size_t i = 0;
+    for (; i + W <= n; i += W)
+    {
+      vf vx = load<W>(x + i);
+      vf vy = load<W>(y + i);
+      vf vz = load<W>(z + i);
+
+      vf rx = r[0] * vx + r[1] * vy + r[2] * vz + t[0];
+      vf ry = r[3] * vx + r[4] * vy + r[5] * vz + t[1];
+      vf rz = r[6] * vx + r[7] * vy + r[8] * vz + t[2];
+
+      std::memcpy(ox + i, &rx, sizeof(vf));
+      std::memcpy(oy + i, &ry, sizeof(vf));
+      std::memcpy(oz + i, &rz, sizeof(vf));
+    }
+
+    for (; i < n; i++)
+    {
+      float px = x[i], py = y[i], pz = z[i];
+      ox[i] = r[0] * px + r[1] * py + r[2] * pz + t[0];
+      oy[i] = r[3] * px + r[4] * py + r[5] * pz + t[1];
+      oz[i] = r[6] * px + r[7] * py + r[8] * pz + t[2];
+    }
+  }
+
+
+
+  /** \brief Apply the time interpolated transformation p' = R_zxy(s * ang) * (p + s * t) to AoS points,
+   * with s = (intensity - int(intensity)) * invScanPeriod (see transformCloudInterpolated()).
+   */
+  template <int W>
+  inline void transformInterpolatedAoS(const float* ang, const float* t, float invScanPeriod,
+                                       bool truncateIntensity, const float* in, float* out, size_t n)
+  {
+    typedef typename Vec<W>::f vf;
+
+    for (size_t i = 0; i < n; i += W)
+    {
+      const size_t m = (n - i < size_t(W)) ? n - i : size_t(W);
+
+      // gather the block into SoA lanes (unused lanes of the last block stay zero)
+      float bx[W] = {}, by[W] = {}, bz[W] = {}, bs[W] = {};
+      for (size_t l = 0; l < m; l++)
+      {
+        const float* p = in + (i + l) * POINT_STRIDE;
+        bx[l] = p[0];
+        by[l] = p[1];
+        bz[l] = p[2];
+        bs[l] = invScanPeriod * (p[POINT_INTENSITY] - int(p[POINT_INTENSITY]));
+      }
+
+      vf x = load<W>(bx);
+      vf y = load<W>(by);
+      vf z = load<W>(bz);
+      vf s = load<W>(bs);
+
+      x += s * t[0];
+      y += s * t[1];
+      z += s * t[2];
+      rotateZXY<W>(x, y, z, s * ang[0], s * ang[1], s * ang[2]);
+
+      std::memcpy(bx, &x, sizeof(vf));
+      std::memcpy(by, &y, sizeof(vf));
+      std::memcpy(bz, &z, sizeof(vf));
+      for (size_t l = 0; l < m; l++)
+      {
+        float* p = out + (i + l) * POINT_STRIDE;
+        const float intensity = in[(i + l) * POINT_STRIDE + POINT_INTENSITY];
+        p[0] = bx[l];
+        p[1] = by[l];
+        p[2] = bz[l];
+        p[POINT_INTENSITY] = truncateIntensity ? float(int(intensity)) : intensity;
+      }
+    }
+  }
+
+
+
+  /** \brief Compute the curvature of AoS points, see KernelTable::curvature. */
+  template <int W>
+  inline void curvature(const float* points, size_t n, int region, float* out)
+  {
+    typedef typename Vec<W>::f vf;
+
+    // the points are processed in chunks, deinterleaved into stack buffers (no heap allocation, and no
+    // inline code of the standard library may be instantiated in the kernel units)
+    const size_t CHUNK = 256;
+    const int MAX_REGION = 32;
+    const float weight = -2.0f * region;
+
+    if (region > MAX_REGION)
+    {
+      for (size_t i = 0; i < n; i++)
+      {
+        const float* c = points + i * POINT_STRIDE;
+        float dx = weight * c[0], dy = weight * c[1], dz = weight * c[2];
+        for (int j = 1; j <= region; j++)
+        {
+          dx += c[j * POINT_STRIDE] + c[-j * int(POINT_STRIDE)];
+          dy += c[j * POINT_STRIDE + 1] + c[-j * int(POINT_STRIDE) + 1];
+          dz += c[j * POINT_STRIDE + 2] + c[-j * int(POINT_STRIDE) + 2];
+        }
+        out[i] = dx * dx + dy * dy + dz * dz;
+      }
+      return;
+    }
+
+    float x[CHUNK + 2 * MAX_REGION], y[CHUNK + 2 * MAX_REGION], z[CHUNK + 2 * MAX_REGION];
+    for (size_t start = 0; start < n; start += CHUNK)
+    {
+      const size_t m = (n - start < CHUNK) ? n - start : CHUNK;
+
+      // deinterleave the chunk including the neighbours on both sides
+      const float* p = points + (ptrdiff_t(start) - region) * ptrdiff_t(POINT_STRIDE);
+      for (size_t i = 0; i < m + 2 * region; i++, p += POINT_STRIDE)
+      {
+        x[i] = p[0];
+        y[i] = p[1];
+        z[i] = p[2];
+      }
+
+      // same summation order as the scalar code: weighted center, then the neighbour pairs
+      size_t i = 0;
+      for (; i + W <= m; i += W)
+      {
+        const size_t c = i + region;
+        vf dx = weight * load<W>(x + c);
+        vf dy = weight * load<W>(y + c);
+        vf dz = weight * load<W>(z + c);
+        for (int j = 1; j <= region; j++)
+        {
+          dx += load<W>(x + c + j) + load<W>(x + c - j);
+          dy += load<W>(y + c + j) + load<W>(y + c - j);
+          dz += load<W>(z + c + j) + load<W>(z + c - j);
+        }
+        vf d = dx * dx + dy * dy + dz * dz;
+        std::memcpy(out + start + i, &d, sizeof(vf));
+      }
+
+      for (; i < m; i++)
+      {
+        const size_t c = i + region;
+        float dx = weight * x[c], dy = weight * y[c], dz = weight * z[c];
+        for (int j = 1; j <= region; j++)
+        {
+          dx += x[c + j] + x[c - j];
+          dy += y[c + j] + y[c - j];
+          dz += z[c + j] + z[c - j];
+        }
+        out[start + i] = dx * dx + dy * dy + dz * dz;
+      }
+    }
+  }
+
+
+
+  /** \brief Compute the voxel coordinates of AoS points, see KernelTable::voxelCoordinates. */
+  template <int W>
+  inline void voxelCoordinates(const float* points, size_t n, float invVoxelSize,
+                               int32_t* vx, int32_t* vy, int32_t* vz)
+  {
+    typedef typename Vec<W>::f vf;
+    typedef typename Vec<W>::i vi;
+
+    int32_t* out[3] = { vx, vy, vz };
+    for (size_t i = 0; i < n; i += W)
+    {
+      const size_t m = (n - i < size_t(W)) ? n - i : size_t(W);
+
+      float b[3][W] = {};
+      for (size_t l = 0; l < m; l++)
+      {
+        const float* p = points + (i + l) * POINT_STRIDE;
+        b[0][l] = p[0];
+        b[1][l] = p[1];
+        b[2][l] = p[2];
+      }
+
+      for (int d = 0; d < 3; d++)
+      {
+        // floor: truncate, then step down where truncation rounded up (the comparison mask is -1)
+        vf v = load<W>(b[d]) * invVoxelSize;
+        vi c = __builtin_convertvector(v, vi);
+        c += __builtin_convertvector(c, vf) > v;
+
+        int32_t ci[W];
+        std::memcpy(ci, &c, sizeof(c));
+        std::memcpy(out[d] + i, ci, m * sizeof(int32_t));
+      }
+    }
+  }
+
+
+
+  /** \brief Evaluate the rows of a Gauss-Newton system, see KernelTable::jacobian. */
+  template <int W>
+  inline void jacobian(const LinearJacobian& J, const float* px, const float* py, const float* pz,
+                       const float* nx, const float* ny, const float* nz, const float* d, size_t n,
+                       float* A, size_t ld, float* b)
+  {
+    typedef typename Vec<W>::f vf;
+
+    for (size_t i = 0; i < n; i += W)
+    {
+      const size_t m = (n - i < size_t(W)) ? n - i : size_t(W);
+
+      // load the block, the unused lanes of the last block stay zero
+      float g[7][W] = {};
+      const float* columns[7] = { px, py, pz, nx, ny, nz, d };
+      for (int c = 0; c < 7; c++)
+        std::memcpy(g[c], columns[c] + i, m * sizeof(float));
+
+      const vf q[3] = { load<W>(g[0]) - J.offset[0], load<W>(g[1]) - J.offset[1], load<W>(g[2]) - J.offset[2] };
+      const vf v[3] = { load<W>(g[3]), load<W>(g[4]), load<W>(g[5]) };
+
+      vf col[7];
+      for (int k = 0; k < 3; k++)
+      {
+        col[k] = splat<vf>(0.0f);
+        col[k + 3] = splat<vf>(0.0f);
+        for (int c = 0; c < 3; c++)
+        {
+          const float* r = J.rot[k][c];
+          col[k] += (r[0] * q[0] + r[1] * q[1] + r[2] * q[2]) * v[c];
+          col[k + 3] += J.trans[k][c] * v[c];
+        }
+      }
+      col[6] = J.residualScale * load<W>(g[6]);
+
+      for (int k = 0; k < 7; k++)
+      {
+        float out[W];
+        std::memcpy(out, &col[k], sizeof(out));
+        std::memcpy((k < 6 ? A + k * ld : b) + i, out, m * sizeof(float));
+      }
+    }
+  }
+
+
+
+  /** \brief Assemble the kernel table of the instruction set this unit is compiled for. */
+  template <int W>
+  inline KernelTable makeKernelTable(const char* name)
+  {
+    KernelTable table;
+    table.name = name;
+    table.transformAoS = &transformAoS;
+    table.transformSoA = &transformSoA<W>;
+    table.transformInterpolatedAoS = &transformInterpolatedAoS<W>;
+    table.curvature = &curvature<W>;
+    table.voxelCoordinates = &voxelCoordinates<W>;
+    table.jacobian = &jacobian<W>;
+    return table;
+  }
+
+} // end anonymous namespace
+} // end namespace simd
+} // end namespace loam
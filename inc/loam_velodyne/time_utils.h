@@ -12,4 +12,13 @@ namespace loam
   {
     return std::chrono::duration<double>(duration).count();
   };
+
+  /** \brief Retrieve the seconds passed since the given steady clock time and reset it to now (for timing consecutive steps). */
+  inline double lap(std::chrono::steady_clock::time_point& start)
+  {
+    auto now = std::chrono::steady_clock::now();
+    double seconds = std::chrono::duration<double>(now - start).count();
+    start = now;
+    return seconds;
+  }
 }
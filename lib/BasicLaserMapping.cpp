@@ -32,12 +32,16 @@
 
 
 #include "loam_velodyne/BasicLaserMapping.h"
-#include "loam_velodyne/nanoflann_pcl.h"
 #include "loam_velodyne/math_utils.h"
+#include "loam_velodyne/simd_dispatch.h"
 
 #include <Eigen/Eigenvalues>
 #include <Eigen/QR>
 
+#include <algorithm>
+#include <cstdlib>
+#include <iterator>
+
 namespace loam
 {
 
@@ -47,6 +51,10 @@ using std::asin;
 using std::atan2;
 using std::pow;
 
+//每一个cube大小为50m*50m*50m
+static const double CUBE_SIZE = 50.0;
+static const double CUBE_HALF = CUBE_SIZE / 2;
+
 
 BasicLaserMapping::BasicLaserMapping():
    _scanPeriod(0.1),
@@ -57,6 +65,7 @@ BasicLaserMapping::BasicLaserMapping():
    _maxIterations(10),
    _deltaTAbort(0.05),
    _deltaRAbort(0.05),
+   _correspondenceRefreshDist(0.05),
    _laserCloudCenWidth(10),
    _laserCloudCenHeight(5),
    _laserCloudCenDepth(10),
@@ -74,7 +83,10 @@ BasicLaserMapping::BasicLaserMapping():
    _laserCloudSurround(new pcl::PointCloud<pcl::PointXYZI>()),
    _laserCloudSurroundDS(new pcl::PointCloud<pcl::PointXYZI>()),
    _laserCloudCornerFromMap(new pcl::PointCloud<pcl::PointXYZI>()),
-   _laserCloudSurfFromMap(new pcl::PointCloud<pcl::PointXYZI>())
+   _laserCloudSurfFromMap(new pcl::PointCloud<pcl::PointXYZI>()),
+   _residuals(_frameArena),
+   _cornerMapIndex(0.5, 1.0),    // map correspondences are gated at 1 m^2
+   _surfMapIndex(0.5, 1.0)
 {
    // initialize frame counter
    _frameCount = _stackFrameNum - 1;//_frameCount = _stackFrameNum - 1 = 1 - 1 = 0
@@ -87,20 +99,27 @@ BasicLaserMapping::BasicLaserMapping():
    //定义为std::vector<pcl::PointCloud<pcl::PointXYZI>::Ptr> _laserCloudCornerArray;
    _laserCloudCornerArray.resize(_laserCloudNum);
    _laserCloudSurfArray.resize(_laserCloudNum);
-   _laserCloudCornerDSArray.resize(_laserCloudNum);//经过下采样后的点云
-   _laserCloudSurfDSArray.resize(_laserCloudNum);
+   _laserCloudCornerGrid.resize(_laserCloudNum);//每个cube的体素占用索引，插入新点时增量下采样
+   _laserCloudSurfGrid.resize(_laserCloudNum);
+   _cubeLastTouched.resize(_laserCloudNum, 0);
+   _cubeSavedVersion.resize(_laserCloudNum, 0);
+   _cubeCollectedVersion.resize(_laserCloudNum, 0);
 
    for (size_t i = 0; i < _laserCloudNum; i++)
    {//每一个cube都存储相应位置的点云，特别需要注意的是，存储的是特征点云，而不是所有点云，
       _laserCloudCornerArray[i].reset(new pcl::PointCloud<pcl::PointXYZI>());
       _laserCloudSurfArray[i].reset(new pcl::PointCloud<pcl::PointXYZI>());
-      _laserCloudCornerDSArray[i].reset(new pcl::PointCloud<pcl::PointXYZI>());
-      _laserCloudSurfDSArray[i].reset(new pcl::PointCloud<pcl::PointXYZI>());
    }
 
    //设置下采样的网格大小
    _downSizeFilterCorner.setLeafSize(0.2, 0.2, 0.2);
    _downSizeFilterSurf.setLeafSize(0.4, 0.4, 0.4);
+   _downSizeFilterMap.setLeafSize(0.2, 0.2, 0.2);
+}
+
+BasicLaserMapping::~BasicLaserMapping()
+{
+   setAsyncMapUpdate(false);
 }
 
 //基于匀速模型，根据上次微调的结果和odometry这次与上次计算的结果，猜测一个新的世界坐标系的转换矩阵transformTobeMapped
@@ -198,15 +217,16 @@ void BasicLaserMapping::transformAssociateToMap()
 //位姿优化结束后执行该函数
 //记录odometry发送的转换矩阵与mapping之后的转换矩阵，下一帧点云会使用(有IMU的话会使用IMU进行补偿)
 void BasicLaserMapping::transformUpdate()
-{/*
+{
+   // IMU states before the start of the current sweep are not needed anymore
+   Time sweepStart = _laserOdometryTime
+      - std::chrono::duration_cast<Time::duration>(std::chrono::duration<float>(_scanPeriod));
+   _imuHistory.discardOlderThan(sweepStart);
+/*
    if (0 < _imuHistory.size())
    {
-      size_t imuIdx = 0;
-
-      while (imuIdx < _imuHistory.size() - 1 && toSec(_laserOdometryTime - _imuHistory[imuIdx].stamp) + _scanPeriod > 0)
-      {
-         imuIdx++;
-      }
+      // binary search for the first IMU state after the sweep start (or the latest state)
+      size_t imuIdx = std::min(_imuHistory.upperBound(sweepStart), _imuHistory.size() - 1);
 
       IMUState2 imuCur;
 
@@ -260,16 +280,26 @@ void BasicLaserMapping::pointAssociateTobeMapped(const pcl::PointXYZI& pi, pcl::
 }
 
 
+void BasicLaserMapping::transformStackToMap(const pcl::PointCloud<pcl::PointXYZI>& stack,
+                                            pcl::PointCloud<pcl::PointXYZI>& points)
+{
+   // same transformation as pointAssociateToMap(), applied in one batch
+   PointTransform toMap = PointTransform::rotationZXY(_transformTobeMapped.rot_z, _transformTobeMapped.rot_x,
+                                                      _transformTobeMapped.rot_y)
+      .then(PointTransform::translation(_transformTobeMapped.pos));
+   transformCloud(toMap, stack, points);
+}
+
+
 //将当前点云帧的所有点转换到全局坐标系下
 void BasicLaserMapping::transformFullResToMap()
 {
    // transform full resolution input cloud to map
-   for (auto& pt : *_laserCloudFullRes)
-      pointAssociateToMap(pt, pt);
+   transformStackToMap(*_laserCloudFullRes, *_laserCloudFullRes);
 }
 
 //
-bool BasicLaserMapping::createDownsizedMap()
+bool BasicLaserMapping::createDownsizedMap(pcl::PointCloud<pcl::PointXYZI>& mapCloud)
 {
    // create new map cloud according to the input output ratio
    //首次进入该函数时_mapFrameCount = 4，_mapFrameNum = 5，然后下面的if不执行，即不返回false并且_mapFrameCount被置为0
@@ -289,42 +319,480 @@ bool BasicLaserMapping::createDownsizedMap()
       *_laserCloudSurround += *_laserCloudSurfArray[ind];
    }
 
-   //对_laserCloudSurround进行下采样，存储至_laserCloudSurroundDS
-   _laserCloudSurroundDS->clear();
-   _downSizeFilterCorner.setInputCloud(_laserCloudSurround);
-   _downSizeFilterCorner.filter(*_laserCloudSurroundDS);
+   //对_laserCloudSurround进行下采样，存储至mapCloud
+   mapCloud.clear();
+   _downSizeFilterMap.setInputCloud(_laserCloudSurround);
+   _downSizeFilterMap.filter(mapCloud);
    return true;
 }
 
-bool BasicLaserMapping::process(Time const& laserOdometryTime)
+bool BasicLaserMapping::cubeIndexOf(const pcl::PointXYZI& p, size_t& cubeInd) const
 {
-   // skip some frames?!?
-   _frameCount++;// _frameCount = 0
-   if (_frameCount < _stackFrameNum) // _stackFrameNum = 1
+   int cubeI = int((p.x + CUBE_HALF) / CUBE_SIZE) + _laserCloudCenWidth;
+   int cubeJ = int((p.y + CUBE_HALF) / CUBE_SIZE) + _laserCloudCenHeight;
+   int cubeK = int((p.z + CUBE_HALF) / CUBE_SIZE) + _laserCloudCenDepth;
+
+   if (p.x + CUBE_HALF < 0) cubeI--;
+   if (p.y + CUBE_HALF < 0) cubeJ--;
+   if (p.z + CUBE_HALF < 0) cubeK--;
+
+   if (cubeI < 0 || cubeI >= _laserCloudWidth ||
+       cubeJ < 0 || cubeJ >= _laserCloudHeight ||
+       cubeK < 0 || cubeK >= _laserCloudDepth)
+      return false;
+
+   cubeInd = toIndex(cubeI, cubeJ, cubeK);
+   return true;
+}
+
+void BasicLaserMapping::swapCubes(size_t indexA, size_t indexB)
+{
+   std::swap(_laserCloudCornerArray[indexA], _laserCloudCornerArray[indexB]);
+   std::swap(_laserCloudSurfArray[indexA], _laserCloudSurfArray[indexB]);
+   _laserCloudCornerGrid[indexA].swap(_laserCloudCornerGrid[indexB]);
+   _laserCloudSurfGrid[indexA].swap(_laserCloudSurfGrid[indexB]);
+   std::swap(_cubeLastTouched[indexA], _cubeLastTouched[indexB]);
+   std::swap(_cubeSavedVersion[indexA], _cubeSavedVersion[indexB]);
+   std::swap(_cubeCollectedVersion[indexA], _cubeCollectedVersion[indexB]);
+}
+
+void BasicLaserMapping::clearCube(size_t index)
+{
+   // keep the points of a cube that leaves the map on disk
+   if (!_mapSaveDir.empty())
+      saveCube(index);
+
+   // and its last points in the next map update message
+   if (_collectCubes && _cubeCollectedVersion[index] != _cubeLastTouched[index] + 1)
+      collectCube(index);
+
+   pcl::PointCloud<pcl::PointXYZI>().swap(*_laserCloudCornerArray[index]);
+   pcl::PointCloud<pcl::PointXYZI>().swap(*_laserCloudSurfArray[index]);
+   _laserCloudCornerGrid[index].release();
+   _laserCloudSurfGrid[index].release();
+   _cubeLastTouched[index] = 0;
+   _cubeSavedVersion[index] = 0;
+   _cubeCollectedVersion[index] = 0;
+}
+
+bool BasicLaserMapping::saveCube(size_t index)
+{
+   if (_cubeLastTouched[index] <= _cubeSavedVersion[index])
+      return true;
+
+   MapTileHeader header;
+   header.cubeX = int(index % _laserCloudWidth) - _laserCloudCenWidth;
+   header.cubeY = int((index / _laserCloudWidth) % _laserCloudHeight) - _laserCloudCenHeight;
+   header.cubeZ = int(index / (_laserCloudWidth * _laserCloudHeight)) - _laserCloudCenDepth;
+   header.cubeSize = CUBE_SIZE;
+   header.cornerLeafSize = _cornerLeafSize;
+   header.surfLeafSize = _surfLeafSize;
+
+   std::string path = _mapSaveDir + "/" + mapTileFileName(header.cubeX, header.cubeY, header.cubeZ);
+   if (!writeMapTile(path, header, *_laserCloudCornerArray[index], *_laserCloudSurfArray[index]))
    {
+      printf("Failed to write map tile %s!\n", path.c_str());
       return false;
    }
-   _frameCount = 0;
-   _laserOdometryTime = laserOdometryTime;//接收来自LaserOdometry节点的位姿信息的时间戳
 
-   pcl::PointXYZI pointSel;
+   _mapTiles[std::make_tuple(header.cubeX, header.cubeY, header.cubeZ)] = path;
+   _cubeSavedVersion[index] = _cubeLastTouched[index];
+   return true;
+}
 
-   // 根据上一次mapping的位姿优化结果对此次mapping赋予一个初始位姿
-   transformAssociateToMap();
+bool BasicLaserMapping::saveModifiedCubes()
+{
+   bool ok = true;
+   for (size_t ind = 0; ind < _laserCloudNum; ind++)
+      ok = saveCube(ind) && ok;
 
-   //将当前帧的edge point和planar point转换到世界坐标系下
-   for (auto const& pt : _laserCloudCornerLast->points)
+   _mapUpdatesSinceSave = 0;
+   return ok;
+}
+
+void BasicLaserMapping::loadCube(size_t index)
+{
+   if (!_laserCloudCornerArray[index]->empty() || !_laserCloudSurfArray[index]->empty())
+      return;
+
+   int cubeX = int(index % _laserCloudWidth) - _laserCloudCenWidth;
+   int cubeY = int((index / _laserCloudWidth) % _laserCloudHeight) - _laserCloudCenHeight;
+   int cubeZ = int(index / (_laserCloudWidth * _laserCloudHeight)) - _laserCloudCenDepth;
+   auto tile = _mapTiles.find(std::make_tuple(cubeX, cubeY, cubeZ));
+   if (tile == _mapTiles.end())
+      return;
+
+   MappedMapTile mappedTile;
+   if (!mappedTile.open(tile->second) || mappedTile.header().cubeSize != float(CUBE_SIZE))
+   {
+      printf("Invalid map tile %s!\n", tile->second.c_str());
+      _mapTiles.erase(tile);
+      return;
+   }
+
+   // the voxel grids are rebuilt on the next insertion into the cube
+   mappedTile.copyCorner(*_laserCloudCornerArray[index]);
+   mappedTile.copySurf(*_laserCloudSurfArray[index]);
+   _laserCloudCornerGrid[index].setLeafSize(mappedTile.header().cornerLeafSize);
+   _laserCloudSurfGrid[index].setLeafSize(mappedTile.header().surfLeafSize);
+}
+
+int BasicLaserMapping::loadMap(const std::string& dir)
+{
+   std::vector<std::string> files;
+   if (!listMapTiles(dir, files))
+      return -1;
+
+   waitForMapUpdate();
+
+   int numTiles = 0;
+   MappedMapTile mappedTile;
+   for (auto const& file : files)
+   {
+      if (!mappedTile.open(file))
+      {
+         printf("Invalid map tile %s!\n", file.c_str());
+         continue;
+      }
+
+      auto const& header = mappedTile.header();
+      _mapTiles[std::make_tuple(header.cubeX, header.cubeY, header.cubeZ)] = file;
+      numTiles++;
+   }
+
+   return numTiles;
+}
+
+bool BasicLaserMapping::saveMap()
+{
+   if (_mapSaveDir.empty())
+      return false;
+
+   if (_asyncMapUpdate)
+   {
+      waitForMapUpdate();
+      collectMapUpdate();
+   }
+
+   return saveModifiedCubes();
+}
+
+bool BasicLaserMapping::collectModifiedCubes(std::vector<QuantizedMapCube>& cubes, bool all)
+{
+   cubes.clear();
+   _collectCubes = true;
+
+   std::unique_lock<std::mutex> lock(_mapUpdateMutex);
+   _collectAllRequested = _collectAllRequested || all;
+   if (_mapUpdatePending)
+   {
+      // don't wait for the running map update, it collects the cubes when it is done
+      _collectRequested = true;
+   }
+   else
+   {
+      // no map update is running and only this thread starts one, so the cube array can be accessed
+      all = _collectAllRequested;
+      _collectRequested = false;
+      _collectAllRequested = false;
+      lock.unlock();
+      collectCubes(all);
+      lock.lock();
+      handOverCollectedCubes(all);
+   }
+
+   cubes.swap(_collectedCubes);
+   bool complete = _collectedAll;
+   _collectedAll = false;
+   return complete;
+}
+
+void BasicLaserMapping::discardCollectedCubes()
+{
+   _collectCubes = false;
+
+   std::lock_guard<std::mutex> lock(_mapUpdateMutex);
+   _collectRequested = false;
+   _collectAllRequested = false;
+   std::vector<QuantizedMapCube>().swap(_collectedCubes);
+   _collectedAll = false;
+   if (!_mapUpdatePending)
+      std::vector<QuantizedMapCube>().swap(_cubeCollection);
+}
+
+void BasicLaserMapping::collectCube(size_t index)
+{
+   if (_laserCloudCornerArray[index]->empty() && _laserCloudSurfArray[index]->empty())
+      return;
+
+   // down size the cube like the surround map
+   _laserCloudSurround->clear();
+   *_laserCloudSurround += *_laserCloudCornerArray[index];
+   *_laserCloudSurround += *_laserCloudSurfArray[index];
+   _downSizeFilterMap.setInputCloud(_laserCloudSurround);
+   pcl::PointCloud<pcl::PointXYZI> cubeDS;
+   _downSizeFilterMap.filter(cubeDS);
+
+   _cubeCollection.emplace_back();
+   QuantizedMapCube& cube = _cubeCollection.back();
+   cube.cubeX = int(index % _laserCloudWidth) - _laserCloudCenWidth;
+   cube.cubeY = int((index / _laserCloudWidth) % _laserCloudHeight) - _laserCloudCenHeight;
+   cube.cubeZ = int(index / (_laserCloudWidth * _laserCloudHeight)) - _laserCloudCenDepth;
+   quantizeMapCube(cubeDS, CUBE_SIZE, cube);
+
+   _cubeCollectedVersion[index] = _cubeLastTouched[index] + 1;
+}
+
+void BasicLaserMapping::collectCubes(bool all)
+{
+   for (size_t ind = 0; ind < _laserCloudNum; ind++)
+   {
+      if (all || _cubeCollectedVersion[ind] != _cubeLastTouched[ind] + 1)
+         collectCube(ind);
+   }
+}
+
+void BasicLaserMapping::handOverCollectedCubes(bool all)
+{
+   // keep the collection order, a cube cleared earlier may be collected again after it has been reloaded
+   _collectedCubes.insert(_collectedCubes.end(), std::make_move_iterator(_cubeCollection.begin()),
+                          std::make_move_iterator(_cubeCollection.end()));
+   _cubeCollection.clear();
+   _collectedAll = _collectedAll || all;
+}
+
+float BasicLaserMapping::cubeSize()
+{
+   return CUBE_SIZE;
+}
+
+size_t BasicLaserMapping::enforceMemoryBudget(std::vector<CubeMemoryInfo>& cubeInfo)
+{
+   cubeInfo.clear();
+   size_t totalBytes = 0;
+   for (size_t ind = 0; ind < _laserCloudNum; ind++)
+   {
+      auto const& corner = *_laserCloudCornerArray[ind];
+      auto const& surf = *_laserCloudSurfArray[ind];
+      if (corner.empty() && surf.empty())
+         continue;
+
+      CubeMemoryInfo info;
+      info.i = ind % _laserCloudWidth;
+      info.j = (ind / _laserCloudWidth) % _laserCloudHeight;
+      info.k = ind / (_laserCloudWidth * _laserCloudHeight);
+      info.cornerPoints = corner.size();
+      info.surfPoints = surf.size();
+      info.bytes = (corner.points.capacity() + surf.points.capacity()) * sizeof(pcl::PointXYZI)
+                   + _laserCloudCornerGrid[ind].memoryUsage() + _laserCloudSurfGrid[ind].memoryUsage();
+      info.lastTouched = _cubeLastTouched[ind];
+      cubeInfo.push_back(info);
+      totalBytes += info.bytes;
+   }
+
+   if (_mapMemoryBudget == 0 || totalBytes <= _mapMemoryBudget)
+      return totalBytes;
+
+   // order eviction candidates, cubes of the current surround area are never evicted
+   auto sqDist = [this](const CubeMemoryInfo& c) {
+      int di = c.i - _centerCubeI, dj = c.j - _centerCubeJ, dk = c.k - _centerCubeK;
+      return di * di + dj * dj + dk * dk;
+   };
+   auto evictFirst = [&](const CubeMemoryInfo& a, const CubeMemoryInfo& b) {
+      if (_cubeEvictionPolicy == EVICT_LEAST_RECENT && a.lastTouched != b.lastTouched)
+         return a.lastTouched < b.lastTouched;
+      return sqDist(a) > sqDist(b);
+   };
+   std::sort(cubeInfo.begin(), cubeInfo.end(), evictFirst);
+
+   size_t evicted = 0;
+   for (auto const& info : cubeInfo)
+   {
+      if (totalBytes <= _mapMemoryBudget)
+         break;
+      if (std::abs(info.i - _centerCubeI) <= 2 && std::abs(info.j - _centerCubeJ) <= 2 && std::abs(info.k - _centerCubeK) <= 2)
+         continue;
+
+      clearCube(toIndex(info.i, info.j, info.k));
+      totalBytes -= info.bytes;
+      evicted++;
+   }
+   cubeInfo.erase(std::remove_if(cubeInfo.begin(), cubeInfo.end(), [this](const CubeMemoryInfo& c) {
+      return _laserCloudCornerArray[toIndex(c.i, c.j, c.k)]->empty() && _laserCloudSurfArray[toIndex(c.i, c.j, c.k)]->empty();
+   }), cubeInfo.end());
+
+   printf("Map exceeded memory budget, evicted %lu cubes (%lu bytes left)!\n", evicted, totalBytes);
+   return totalBytes;
+}
+
+void BasicLaserMapping::insertIntoCubes(const pcl::PointCloud<pcl::PointXYZI>& points,
+                                        std::vector<pcl::PointCloud<pcl::PointXYZI>::Ptr>& cubes,
+                                        std::vector<IncrementalVoxelGrid>& grids,
+                                        const float& leafSize)
+{
+   // group points by cube
+   _insertCubeRefs.clear();
+   size_t cubeInd;
+   for (size_t i = 0; i < points.size(); i++)
+   {
+      if (cubeIndexOf(points[i], cubeInd))
+         _insertCubeRefs.emplace_back(cubeInd, i);
+   }
+   std::sort(_insertCubeRefs.begin(), _insertCubeRefs.end());
+
+   _insertCubeRanges.clear();
+   for (size_t i = 0; i < _insertCubeRefs.size(); i++)
+   {
+      if (i == 0 || _insertCubeRefs[i].first != _insertCubeRefs[i - 1].first)
+         _insertCubeRanges.emplace_back(i, i);
+      _insertCubeRanges.back().second = i + 1;
+   }
+
+   // every cube is touched by exactly one range, so the cubes can be updated independently
+   #pragma omp parallel for schedule(dynamic)
+   for (int r = 0; r < int(_insertCubeRanges.size()); r++)
+   {
+      auto const& range = _insertCubeRanges[r];
+      size_t ind = _insertCubeRefs[range.first].first;
+      pcl::PointCloud<pcl::PointXYZI>& cube = *cubes[ind];
+      IncrementalVoxelGrid& grid = grids[ind];
+      size_t sortedCount = cube.size();
+
+      if (grid.leafSize() != leafSize || grid.size() != cube.size())
+      {
+         // leaf size changed or cube cloud not yet indexed
+         grid.setLeafSize(leafSize);
+         grid.rebuild(cube);
+         sortedCount = 0;
+      }
+
+      for (size_t i = range.first; i < range.second; i++)
+         grid.insert(cube, points[_insertCubeRefs[i].second]);
+
+      // new voxels are appended, merge them into the Morton ordered cube
+      if (_mortonOrderedCubes)
+         grid.sortByMorton(cube, sortedCount);
+
+      // evict in batches down to 90% of the limit, removeOldest() re-indexes the whole cube
+      if (_maxCubePoints > 0 && cube.size() > _maxCubePoints)
+         grid.removeOldest(cube, cube.size() - _maxCubePoints * 9 / 10);
+
+      _cubeLastTouched[ind] = _mapVersion + 1;
+   }
+}
+
+void BasicLaserMapping::updateMap(pcl::PointCloud<pcl::PointXYZI>& cornerPoints,
+                                  pcl::PointCloud<pcl::PointXYZI>& surfPoints)
+{
+   insertIntoCubes(cornerPoints, _laserCloudCornerArray, _laserCloudCornerGrid, _cornerLeafSize);
+   insertIntoCubes(surfPoints, _laserCloudSurfArray, _laserCloudSurfGrid, _surfLeafSize);
+
+   cornerPoints.clear();
+   surfPoints.clear();
+
+   if (!_mapSaveDir.empty() && ++_mapUpdatesSinceSave >= _mapSaveInterval)
+      saveModifiedCubes();
+}
+
+void BasicLaserMapping::setAsyncMapUpdate(bool val)
+{
+   if (val == _asyncMapUpdate)
+      return;
+
+   if (val)
+   {
+      _mapUpdateStop = false;
+      _mapUpdateThread = std::thread(&BasicLaserMapping::mapUpdateLoop, this);
+   }
+   else
+   {
+      {
+         std::lock_guard<std::mutex> lock(_mapUpdateMutex);
+         _mapUpdateStop = true;
+      }
+      _mapUpdateCond.notify_all();
+      _mapUpdateThread.join();
+
+      // finish a map update that has been handed over but not yet collected
+      collectMapUpdate();
+   }
+
+   _asyncMapUpdate = val;
+}
+
+void BasicLaserMapping::mapUpdateLoop()
+{
+   std::unique_lock<std::mutex> lock(_mapUpdateMutex);
+   while (true)
    {
-      pointAssociateToMap(pt, pointSel);
-      _laserCloudCornerStack->push_back(pointSel);
+      _mapUpdateCond.wait(lock, [this] { return _mapUpdatePending || _mapUpdateStop; });
+      if (!_mapUpdatePending)
+         break;
+
+      // the cube array is owned by this thread until the update is marked as done
+      lock.unlock();
+      updateMap(_mapUpdateCorner, _mapUpdateSurf);
+      _mapUpdateMemoryUsage = enforceMemoryBudget(_mapUpdateCubeInfo);
+      bool mapCreated = createDownsizedMap(_mapUpdateSurroundDS);
+      lock.lock();
+
+      // collect the cubes requested while the update was running (the mutex is not held meanwhile)
+      bool collectAll = false;
+      if (_collectRequested)
+      {
+         collectAll = _collectAllRequested;
+         _collectRequested = false;
+         _collectAllRequested = false;
+         lock.unlock();
+         collectCubes(collectAll);
+         lock.lock();
+      }
+      handOverCollectedCubes(collectAll);
+
+      _mapUpdateMapCreated = mapCreated;
+      _mapUpdatePending = false;
+      _mapVersion++;
+      _mapUpdateCond.notify_all();
    }
+}
 
-   for (auto const& pt : _laserCloudSurfLast->points)
+void BasicLaserMapping::startMapUpdate()
+{
    {
-      pointAssociateToMap(pt, pointSel);
-      _laserCloudSurfStack->push_back(pointSel);
+      std::lock_guard<std::mutex> lock(_mapUpdateMutex);
+      _mapUpdateCorner.swap(_pendingCorner);
+      _mapUpdateSurf.swap(_pendingSurf);
+      _mapUpdatePending = true;
    }
+   _mapUpdateCond.notify_all();
+}
+
+void BasicLaserMapping::waitForMapUpdate()
+{
+   std::unique_lock<std::mutex> lock(_mapUpdateMutex);
+   _mapUpdateCond.wait(lock, [this] { return !_mapUpdatePending; });
+}
+
+bool BasicLaserMapping::collectMapUpdate()
+{
+   std::lock_guard<std::mutex> lock(_mapUpdateMutex);
+   if (_mapUpdatePending)
+      return false;
+
+   if (_mapUpdateMapCreated)
+   {
+      _laserCloudSurroundDS->swap(_mapUpdateSurroundDS);
+      _mapUpdateMapCreated = false;
+      _downsizedMapCreated = true;
+   }
+   _cubeMemoryInfo.swap(_mapUpdateCubeInfo);
+   _mapMemoryUsage = _mapUpdateMemoryUsage;
+   _fromMapVersion = _mapVersion;
+   return true;
+}
 
+void BasicLaserMapping::prepareMapSnapshot()
+{
    //获取y方向上10米高位置的点在世界坐标系下的坐标，该点只在后面判断cube是否在Lidar可视范围内使用了
    pcl::PointXYZI pointOnYAxis;
    pointOnYAxis.x = 0.0;
@@ -332,10 +800,6 @@ bool BasicLaserMapping::process(Time const& laserOdometryTime)
    pointOnYAxis.z = 0.0;
    pointAssociateToMap(pointOnYAxis, pointOnYAxis);
 
-   //每一个cube大小为50m*50m*50m
-   auto const CUBE_SIZE = 50.0;
-   auto const CUBE_HALF = CUBE_SIZE / 2;
-
    //_laserCloudCenWidth=10,_laserCloudCenHeight=5,_laserCloudCenDepth=10
    //地图被划分为了宽21*高11*长21=4851个cube，centerCubeI/J/K分别表示当前点云帧的结束时刻Lidar在地图中的IJK(对应宽高长)坐标，
    //加上偏移量是保证IJK坐标不为负数，因为cube存储在_laserCloudCornerArray/_laserCloudSurfArray数组中，而数组下标不能为负的
@@ -359,16 +823,15 @@ bool BasicLaserMapping::process(Time const& laserOdometryTime)
       {
          for (int k = 0; k < _laserCloudDepth; k++)//_laserCloudDepth = 21
          {
+            // clear (and save) the cube leaving the map while it is still at its own position,
+            // the rotation then moves the emptied cube to the opposite edge
+            clearCube(toIndex(_laserCloudWidth - 1, j, k));
             for (int i = _laserCloudWidth - 1; i >= 1; i--)//_laserCloudWidth = 21
             {
                const size_t indexA = toIndex(i, j, k);
                const size_t indexB = toIndex(i - 1, j, k);
-               std::swap(_laserCloudCornerArray[indexA], _laserCloudCornerArray[indexB]);
-               std::swap(_laserCloudSurfArray[indexA], _laserCloudSurfArray[indexB]);
+               swapCubes(indexA, indexB);
             }
-            const size_t indexC = toIndex(0, j, k);
-            _laserCloudCornerArray[indexC]->clear();
-            _laserCloudSurfArray[indexC]->clear();
          }
       }
       centerCubeI++;
@@ -382,16 +845,13 @@ bool BasicLaserMapping::process(Time const& laserOdometryTime)
       {
          for (int k = 0; k < _laserCloudDepth; k++)
          {
+            clearCube(toIndex(0, j, k));
             for (int i = 0; i < _laserCloudWidth - 1; i++)
             {
                const size_t indexA = toIndex(i, j, k);
                const size_t indexB = toIndex(i + 1, j, k);
-               std::swap(_laserCloudCornerArray[indexA], _laserCloudCornerArray[indexB]);
-               std::swap(_laserCloudSurfArray[indexA], _laserCloudSurfArray[indexB]);
+               swapCubes(indexA, indexB);
             }
-            const size_t indexC = toIndex(_laserCloudWidth - 1, j, k);
-            _laserCloudCornerArray[indexC]->clear();
-            _laserCloudSurfArray[indexC]->clear();
          }
       }
       centerCubeI--;
@@ -404,16 +864,13 @@ bool BasicLaserMapping::process(Time const& laserOdometryTime)
       {
          for (int k = 0; k < _laserCloudDepth; k++)
          {
+            clearCube(toIndex(i, _laserCloudHeight - 1, k));
             for (int j = _laserCloudHeight - 1; j >= 1; j--)
             {
                const size_t indexA = toIndex(i, j, k);
                const size_t indexB = toIndex(i, j - 1, k);
-               std::swap(_laserCloudCornerArray[indexA], _laserCloudCornerArray[indexB]);
-               std::swap(_laserCloudSurfArray[indexA], _laserCloudSurfArray[indexB]);
+               swapCubes(indexA, indexB);
             }
-            const size_t indexC = toIndex(i, 0, k);
-            _laserCloudCornerArray[indexC]->clear();
-            _laserCloudSurfArray[indexC]->clear();
          }
       }
       centerCubeJ++;
@@ -426,16 +883,13 @@ bool BasicLaserMapping::process(Time const& laserOdometryTime)
       {
          for (int k = 0; k < _laserCloudDepth; k++)
          {
+            clearCube(toIndex(i, 0, k));
             for (int j = 0; j < _laserCloudHeight - 1; j++)
             {
                const size_t indexA = toIndex(i, j, k);
                const size_t indexB = toIndex(i, j + 1, k);
-               std::swap(_laserCloudCornerArray[indexA], _laserCloudCornerArray[indexB]);
-               std::swap(_laserCloudSurfArray[indexA], _laserCloudSurfArray[indexB]);
+               swapCubes(indexA, indexB);
             }
-            const size_t indexC = toIndex(i, _laserCloudHeight - 1, k);
-            _laserCloudCornerArray[indexC]->clear();
-            _laserCloudSurfArray[indexC]->clear();
          }
       }
       centerCubeJ--;
@@ -448,16 +902,13 @@ bool BasicLaserMapping::process(Time const& laserOdometryTime)
       {
          for (int j = 0; j < _laserCloudHeight; j++)
          {
+            clearCube(toIndex(i, j, _laserCloudDepth - 1));
             for (int k = _laserCloudDepth - 1; k >= 1; k--)
             {
                const size_t indexA = toIndex(i, j, k);
                const size_t indexB = toIndex(i, j, k - 1);
-               std::swap(_laserCloudCornerArray[indexA], _laserCloudCornerArray[indexB]);
-               std::swap(_laserCloudSurfArray[indexA], _laserCloudSurfArray[indexB]);
+               swapCubes(indexA, indexB);
             }
-            const size_t indexC = toIndex(i, j, 0);
-            _laserCloudCornerArray[indexC]->clear();
-            _laserCloudSurfArray[indexC]->clear();
          }
       }
       centerCubeK++;
@@ -470,22 +921,23 @@ bool BasicLaserMapping::process(Time const& laserOdometryTime)
       {
          for (int j = 0; j < _laserCloudHeight; j++)
          {
+            clearCube(toIndex(i, j, 0));
             for (int k = 0; k < _laserCloudDepth - 1; k++)
             {
                const size_t indexA = toIndex(i, j, k);
                const size_t indexB = toIndex(i, j, k + 1);
-               std::swap(_laserCloudCornerArray[indexA], _laserCloudCornerArray[indexB]);
-               std::swap(_laserCloudSurfArray[indexA], _laserCloudSurfArray[indexB]);
+               swapCubes(indexA, indexB);
             }
-            const size_t indexC = toIndex(i, j, _laserCloudDepth - 1);
-            _laserCloudCornerArray[indexC]->clear();
-            _laserCloudSurfArray[indexC]->clear();
          }
       }
       centerCubeK--;
       _laserCloudCenDepth--;
    }
 
+   _centerCubeI = centerCubeI;
+   _centerCubeJ = centerCubeJ;
+   _centerCubeK = centerCubeK;
+
    _laserCloudValidInd.clear();//存储以当前Lidar所在的cube为中心的125个处于Lidar可视范围内的cube的索引
    _laserCloudSurroundInd.clear();//存储以当前Lidar所在的cube为中心的125个cube索引
    //向IJK正负方向各扩展2个cube，IJK方向各5个cube，总共125个cube，用于和当前点云帧进行特征匹配
@@ -567,6 +1019,13 @@ bool BasicLaserMapping::process(Time const& laserOdometryTime)
       }
    }
 
+   // fill surround cubes that are still empty from the registered prior map tiles
+   if (!_mapTiles.empty())
+   {
+      for (auto const& ind : _laserCloudSurroundInd)
+         loadCube(ind);
+   }
+
    // prepare valid map corner and surface cloud for pose optimization
    _laserCloudCornerFromMap->clear();//
    _laserCloudSurfFromMap->clear();
@@ -575,25 +1034,66 @@ bool BasicLaserMapping::process(Time const& laserOdometryTime)
       *_laserCloudCornerFromMap += *_laserCloudCornerArray[ind];
       *_laserCloudSurfFromMap += *_laserCloudSurfArray[ind];
    }
+}
 
-   // prepare feature stack clouds for pose optimization
-   for (auto& pt : *_laserCloudCornerStack)//在process()函数的开始，312行左右
-      pointAssociateTobeMapped(pt, pt);//将特征点变换回当前点云帧结束时刻的lidar坐标系下
+bool BasicLaserMapping::process(Time const& laserOdometryTime)
+{
+   // skip some frames?!?
+   _frameCount++;// _frameCount = 0
+   if (_frameCount < _stackFrameNum) // _stackFrameNum = 1
+   {
+      return false;
+   }
+   _frameCount = 0;
+   _laserOdometryTime = laserOdometryTime;//接收来自LaserOdometry节点的位姿信息的时间戳
+
+   // 根据上一次mapping的位姿优化结果对此次mapping赋予一个初始位姿
+   transformAssociateToMap();
+
+   //将当前帧的edge point和planar point转换到世界坐标系下
+   transformStackToMap(*_laserCloudCornerLast, _mapSel);
+   *_laserCloudCornerStack += _mapSel;
+
+   transformStackToMap(*_laserCloudSurfLast, _mapSel);
+   *_laserCloudSurfStack += _mapSel;
+
+   // the cube array may only be touched while no map update is running in the background,
+   // otherwise the pose is optimized against the map snapshot of the previous frame
+   bool mapIdle = true;
+   if (_asyncMapUpdate)
+   {
+      _downsizedMapCreated = false;
+      mapIdle = collectMapUpdate();
+      if (!mapIdle)
+         printf("Map update still running, optimize against map version %lu!\n", _fromMapVersion);
+   }
+
+   if (mapIdle)
+   {
+      prepareMapSnapshot();
 
-   for (auto& pt : *_laserCloudSurfStack)
-      pointAssociateTobeMapped(pt, pt);
+      // cube cloud resolution used by the next map update
+      _cornerLeafSize = _downSizeFilterCorner.getLeafSize()[0];
+      _surfLeafSize = _downSizeFilterSurf.getLeafSize()[0];
+   }
+
+   // prepare feature stack clouds for pose optimization
+   //将特征点变换回当前点云帧结束时刻的lidar坐标系下（与pointAssociateTobeMapped()相同的变换）
+   PointTransform toBeMapped = PointTransform::translation(-_transformTobeMapped.pos)
+      .then(PointTransform::rotationYXZ(-_transformTobeMapped.rot_y, -_transformTobeMapped.rot_x,
+                                        -_transformTobeMapped.rot_z));
+   transformCloud(toBeMapped, *_laserCloudCornerStack, *_laserCloudCornerStack);
+   transformCloud(toBeMapped, *_laserCloudSurfStack, *_laserCloudSurfStack);
 
    //下采样
    // down sample feature stack clouds
    _laserCloudCornerStackDS->clear();
    _downSizeFilterCorner.setInputCloud(_laserCloudCornerStack);
    _downSizeFilterCorner.filter(*_laserCloudCornerStackDS);
-   size_t laserCloudCornerStackNum = _laserCloudCornerStackDS->size();
 
    _laserCloudSurfStackDS->clear();
    _downSizeFilterSurf.setInputCloud(_laserCloudSurfStack);
    _downSizeFilterSurf.filter(*_laserCloudSurfStackDS);
-   size_t laserCloudSurfStackNum = _laserCloudSurfStackDS->size();
 
    _laserCloudCornerStack->clear();
    _laserCloudSurfStack->clear();
@@ -601,71 +1101,29 @@ bool BasicLaserMapping::process(Time const& laserOdometryTime)
    // run pose optimization
    optimizeTransformTobeMapped();
 
-   // store down sized corner stack points in corresponding cube clouds
-   //将edge point归入对应的cube中
-   for (int i = 0; i < laserCloudCornerStackNum; i++)
-   {
-      pointAssociateToMap(_laserCloudCornerStackDS->points[i], pointSel);
-
-      int cubeI = int((pointSel.x + CUBE_HALF) / CUBE_SIZE) + _laserCloudCenWidth;
-      int cubeJ = int((pointSel.y + CUBE_HALF) / CUBE_SIZE) + _laserCloudCenHeight;
-      int cubeK = int((pointSel.z + CUBE_HALF) / CUBE_SIZE) + _laserCloudCenDepth;
+   // store down sized stack points in corresponding cube clouds
+   //将edge point和planar point转换到世界坐标系下，等待归入对应的cube中
+   transformStackToMap(*_laserCloudCornerStackDS, _mapSel);
+   _pendingCorner += _mapSel;
 
-      if (pointSel.x + CUBE_HALF < 0) cubeI--;
-      if (pointSel.y + CUBE_HALF < 0) cubeJ--;
-      if (pointSel.z + CUBE_HALF < 0) cubeK--;
+   transformStackToMap(*_laserCloudSurfStackDS, _mapSel);
+   _pendingSurf += _mapSel;
 
-      if (cubeI >= 0 && cubeI < _laserCloudWidth &&
-          cubeJ >= 0 && cubeJ < _laserCloudHeight &&
-          cubeK >= 0 && cubeK < _laserCloudDepth)
-      {
-         size_t cubeInd = cubeI + _laserCloudWidth * cubeJ + _laserCloudWidth * _laserCloudHeight * cubeK;
-         _laserCloudCornerArray[cubeInd]->push_back(pointSel);
-      }
-   }
-
-   // store down sized surface stack points in corresponding cube clouds
-   //将planar point归入对应的cube中
-   for (int i = 0; i < laserCloudSurfStackNum; i++)
+   if (!_asyncMapUpdate)
    {
-      pointAssociateToMap(_laserCloudSurfStackDS->points[i], pointSel);
-
-      int cubeI = int((pointSel.x + CUBE_HALF) / CUBE_SIZE) + _laserCloudCenWidth;
-      int cubeJ = int((pointSel.y + CUBE_HALF) / CUBE_SIZE) + _laserCloudCenHeight;
-      int cubeK = int((pointSel.z + CUBE_HALF) / CUBE_SIZE) + _laserCloudCenDepth;
-
-      if (pointSel.x + CUBE_HALF < 0) cubeI--;
-      if (pointSel.y + CUBE_HALF < 0) cubeJ--;
-      if (pointSel.z + CUBE_HALF < 0) cubeK--;
-
-      if (cubeI >= 0 && cubeI < _laserCloudWidth &&
-          cubeJ >= 0 && cubeJ < _laserCloudHeight &&
-          cubeK >= 0 && cubeK < _laserCloudDepth)
-      {
-         size_t cubeInd = cubeI + _laserCloudWidth * cubeJ + _laserCloudWidth * _laserCloudHeight * cubeK;
-         _laserCloudSurfArray[cubeInd]->push_back(pointSel);
-      }
+      updateMap(_pendingCorner, _pendingSurf);
+      _mapMemoryUsage = enforceMemoryBudget(_cubeMemoryInfo);
+      _mapVersion++;
+      _fromMapVersion = _mapVersion;
+      _downsizedMapCreated = createDownsizedMap(*_laserCloudSurroundDS);//所有处理步骤完成，将_downsizedMapCreated置为true，可publish相关数据的topic
    }
-
-   // down size all valid (within field of view) feature cube clouds
-   // 对
-   for (auto const& ind : _laserCloudValidInd)
+   else if (mapIdle)
    {
-      _laserCloudCornerDSArray[ind]->clear();
-      _downSizeFilterCorner.setInputCloud(_laserCloudCornerArray[ind]);
-      _downSizeFilterCorner.filter(*_laserCloudCornerDSArray[ind]);
-
-      _laserCloudSurfDSArray[ind]->clear();
-      _downSizeFilterSurf.setInputCloud(_laserCloudSurfArray[ind]);
-      _downSizeFilterSurf.filter(*_laserCloudSurfDSArray[ind]);
-
-      // swap cube clouds for next processing
-      _laserCloudCornerArray[ind].swap(_laserCloudCornerDSArray[ind]);
-      _laserCloudSurfArray[ind].swap(_laserCloudSurfDSArray[ind]);
+      // hand the new points over to the map update thread, the pose can be published right away
+      startMapUpdate();
    }
 
    transformFullResToMap();//将所有点转换到世界坐标系下
-   _downsizedMapCreated = createDownsizedMap();//所有处理步骤完成，将_downsizedMapCreated置为true，可publish相关数据的topic
 
    return true;
 }
@@ -692,8 +1150,78 @@ void BasicLaserMapping::updateOdometry(Twist const& twist)
    _transformSum = twist;
 }
 
-nanoflann::KdTreeFLANN<pcl::PointXYZI> kdtreeCornerFromMap;
-nanoflann::KdTreeFLANN<pcl::PointXYZI> kdtreeSurfFromMap;
+/** Number of map neighbours used to fit an edge line / planar patch. */
+static const int MAP_NEIGHBORS = 5;
+
+/** \brief Search the map neighbours of all feature points with a stale correspondence in one batch.
+ *
+ * @param index the map nearest neighbour index
+ * @param points the feature points transformed to the map
+ * @param corrs the cached correspondences of the feature points
+ * @param maxSqDist the squared displacement after which a correspondence is stale
+ * @param queries the query buffer
+ * @param querySlot the resulting query index of each feature point (-1 if the cached correspondence is still valid)
+ * @param searchInd the resulting neighbour indices (MAP_NEIGHBORS per query)
+ * @param searchSqDis the resulting squared neighbour distances (MAP_NEIGHBORS per query)
+ * @return the number of searched points
+ */
+static size_t searchStaleCorrespondences(const CorrespondenceIndex& index,
+                                         const pcl::PointCloud<pcl::PointXYZI>& points,
+                                         const std::vector<MapCorrespondence>& corrs,
+                                         const float& maxSqDist,
+                                         pcl::PointCloud<pcl::PointXYZI>& queries,
+                                         std::vector<int>& querySlot,
+                                         std::vector<int>& searchInd,
+                                         std::vector<float>& searchSqDis)
+{
+   queries.clear();
+   querySlot.resize(points.size());
+   for (size_t i = 0; i < points.size(); i++)
+   {
+      if (corrs[i].isStale(points[i], maxSqDist))
+      {
+         querySlot[i] = int(queries.size());
+         queries.push_back(points[i]);
+      }
+      else
+      {
+         querySlot[i] = -1;
+      }
+   }
+
+   searchInd.resize(queries.size() * MAP_NEIGHBORS);
+   searchSqDis.resize(queries.size() * MAP_NEIGHBORS);
+   index.nearestKSearchBatch(queries.points.data(), queries.size(), MAP_NEIGHBORS,
+                             searchInd.data(), searchSqDis.data());
+
+   return queries.size();
+}
+
+/** \brief Set up the Jacobian of the map residuals at the given pose (derivatives of R_yxz * p + t). */
+static simd::LinearJacobian mapResidualJacobian(const Twist& transform)
+{
+   const float srx = transform.rot_x.sin(), crx = transform.rot_x.cos();
+   const float sry = transform.rot_y.sin(), cry = transform.rot_y.cos();
+   const float srz = transform.rot_z.sin(), crz = transform.rot_z.cos();
+
+   simd::LinearJacobian J = {
+      {  // rotation derivatives: factors of the x, y and z normal component
+         { { crx*sry*srz, crx*crz*sry, -srx*sry },
+           { -srx*srz, -crz*srx, -crx },
+           { crx*cry*srz, crx*cry*crz, -cry*srx } },
+         { { cry*srx*srz - crz*sry, sry*srz + cry*crz*srx, crx*cry },
+           { 0, 0, 0 },
+           { -cry*crz - srx*sry*srz, cry*srz - crz*srx*sry, -crx*sry } },
+         { { crz*srx*sry - cry*srz, -cry*crz - srx*sry*srz, 0 },
+           { crx*crz, -crx*srz, 0 },
+           { sry*srz + cry*crz*srx, crz*sry - cry*srx*srz, 0 } }
+      },
+      { 0, 0, 0 },
+      { { 1, 0, 0 }, { 0, 1, 0 }, { 0, 0, 1 } },
+      -1.0f
+   };
+   return J;
+}
 
 //优化位姿
 void BasicLaserMapping::optimizeTransformTobeMapped()
@@ -704,13 +1232,10 @@ void BasicLaserMapping::optimizeTransformTobeMapped()
       return;
    }
 
-   pcl::PointXYZI pointSel, pointOri, /*pointProj, */coeff;
+   pcl::PointXYZI pointSel, pointOri/*, pointProj*/;
 
-   std::vector<int> pointSearchInd(5, 0);
-   std::vector<float> pointSearchSqDis(5, 0);
-
-   kdtreeCornerFromMap.setInputCloud(_laserCloudCornerFromMap);
-   kdtreeSurfFromMap.setInputCloud(_laserCloudSurfFromMap);
+   _cornerMapIndex.setInputCloud(_laserCloudCornerFromMap);
+   _surfMapIndex.setInputCloud(_laserCloudSurfFromMap);
 
    Eigen::Matrix<float, 5, 3> matA0;
    Eigen::Matrix<float, 5, 1> matB0;
@@ -732,181 +1257,233 @@ void BasicLaserMapping::optimizeTransformTobeMapped()
 
    size_t laserCloudCornerStackNum = _laserCloudCornerStackDS->size();
    size_t laserCloudSurfStackNum = _laserCloudSurfStackDS->size();
+
+   // map correspondences are only searched again for feature points that moved by more than
+   // _correspondenceRefreshDist since their last search, otherwise the cached line / plane fit is reused
+   _cornerCorrespondences.assign(laserCloudCornerStackNum, MapCorrespondence());
+   _surfCorrespondences.assign(laserCloudSurfStackNum, MapCorrespondence());
+   const float maxSqRefreshDist = _correspondenceRefreshDist * _correspondenceRefreshDist;
+   size_t searchCount = 0;
+
+   // 所选特征点数量的上限已知，预先在帧内存池中分配，迭代中不再扩容
+   _frameArena.reset();
+   _residuals.clear();
+   _residuals.reserve(laserCloudCornerStackNum + laserCloudSurfStackNum);
+
    size_t iterCount;
    for (iterCount = 0; iterCount < _maxIterations; iterCount++)//最大迭代次数10次，_maxIterations=10
    {
-      _laserCloudOri.clear();
-      _coeffSel.clear();
+      _residuals.clear();
 
       //处理edge point
+      // transform all points to the map first and search the neighbours of the stale ones in one batch
+      transformStackToMap(*_laserCloudCornerStackDS, _mapSel);//将当前点云帧中的特征点转换回世界坐标系
+      searchCount += searchStaleCorrespondences(_cornerMapIndex, _mapSel, _cornerCorrespondences,
+                                                maxSqRefreshDist, _mapQueries, _mapQuerySlot,
+                                                _mapSearchInd, _mapSearchSqDis);//寻找最近的5个点
+
       for (int i = 0; i < laserCloudCornerStackNum; i++)
       {
          pointOri = _laserCloudCornerStackDS->points[i];
-         pointAssociateToMap(pointOri, pointSel);//将当前点云帧中的特征点转换回世界坐标系
-         kdtreeCornerFromMap.nearestKSearch(pointSel, 5, pointSearchInd, pointSearchSqDis);//寻找最近的5个点
+         pointSel = _mapSel.points[i];
 
-         if (pointSearchSqDis[4] < 1.0)//最大距离不超过1才处理
+         MapCorrespondence& corr = _cornerCorrespondences[i];
+         if (_mapQuerySlot[i] >= 0)
          {
-            Vector3 vc(0, 0, 0);
-
-            for (int j = 0; j < 5; j++)
-               vc += Vector3(_laserCloudCornerFromMap->points[pointSearchInd[j]]);
-            vc /= 5.0;//5个点的xyz坐标求平均值，可理解为质心
+            corr.qx = pointSel.x;
+            corr.qy = pointSel.y;
+            corr.qz = pointSel.z;
+            corr.searched = true;
+            corr.valid = false;
 
-            Eigen::Matrix3f mat_a;
-            mat_a.setZero();
+            const int* pointSearchInd = &_mapSearchInd[_mapQuerySlot[i] * MAP_NEIGHBORS];
+            const float* pointSearchSqDis = &_mapSearchSqDis[_mapQuerySlot[i] * MAP_NEIGHBORS];
 
-            //求协方差
-            for (int j = 0; j < 5; j++)
+            if (pointSearchSqDis[4] < 1.0)//最大距离不超过1才处理
             {
-               Vector3 a = Vector3(_laserCloudCornerFromMap->points[pointSearchInd[j]]) - vc;
-
-               mat_a(0, 0) += a.x() * a.x();
-               mat_a(1, 0) += a.x() * a.y();
-               mat_a(2, 0) += a.x() * a.z();
-               mat_a(1, 1) += a.y() * a.y();
-               mat_a(2, 1) += a.y() * a.z();
-               mat_a(2, 2) += a.z() * a.z();
-            }
-            matA1 = mat_a / 5.0;
-            // This solver only looks at the lower-triangular part of matA1.
-            //此处求当前点云特征点对应线/面的理论参考论文"Low-drift and real-time lidar odometry and mapping"第6节 Lidar mapping
-            Eigen::SelfAdjointEigenSolver<Eigen::Matrix3f> esolver(matA1);
-            matD1 = esolver.eigenvalues().real();//特征值Eigen::Matrix<float, 1, 3> matD1;
-            matV1 = esolver.eigenvectors().real();//特征向量Eigen::Matrix3f matV1;
-
-            if (matD1(0, 2) > 3 * matD1(0, 1))//如果最大的特征值大于第二大的特征值三倍以上，特征值默认从小到大排列
-            {
-               //(x0,y0,z0)代表特征点
-               float x0 = pointSel.x;
-               float y0 = pointSel.y;
-               float z0 = pointSel.z;
-               //(x1,y1,z1)和(x2,y2,z2)代表edge line上的两点
-               float x1 = vc.x() + 0.1 * matV1(0, 2);
-               float y1 = vc.y() + 0.1 * matV1(1, 2);
-               float z1 = vc.z() + 0.1 * matV1(2, 2);
-               float x2 = vc.x() - 0.1 * matV1(0, 2);
-               float y2 = vc.y() - 0.1 * matV1(1, 2);
-               float z2 = vc.z() - 0.1 * matV1(2, 2);
-               //与LaserOdometry节点求点到直线的距离方法相同
-               float a012 = sqrt(((x0 - x1)*(y0 - y2) - (x0 - x2)*(y0 - y1))
-                                 * ((x0 - x1)*(y0 - y2) - (x0 - x2)*(y0 - y1))
-                                 + ((x0 - x1)*(z0 - z2) - (x0 - x2)*(z0 - z1))
-                                 * ((x0 - x1)*(z0 - z2) - (x0 - x2)*(z0 - z1))
-                                 + ((y0 - y1)*(z0 - z2) - (y0 - y2)*(z0 - z1))
-                                 * ((y0 - y1)*(z0 - z2) - (y0 - y2)*(z0 - z1)));
-
-               float l12 = sqrt((x1 - x2)*(x1 - x2) + (y1 - y2)*(y1 - y2) + (z1 - z2)*(z1 - z2));
-
-               float la = ((y1 - y2)*((x0 - x1)*(y0 - y2) - (x0 - x2)*(y0 - y1))
-                           + (z1 - z2)*((x0 - x1)*(z0 - z2) - (x0 - x2)*(z0 - z1))) / a012 / l12;
-
-               float lb = -((x1 - x2)*((x0 - x1)*(y0 - y2) - (x0 - x2)*(y0 - y1))
-                            - (z1 - z2)*((y0 - y1)*(z0 - z2) - (y0 - y2)*(z0 - z1))) / a012 / l12;
-
-               float lc = -((x1 - x2)*((x0 - x1)*(z0 - z2) - (x0 - x2)*(z0 - z1))
-                            + (y1 - y2)*((y0 - y1)*(z0 - z2) - (y0 - y2)*(z0 - z1))) / a012 / l12;
-
-               float ld2 = a012 / l12;
-
-//                // TODO: Why writing to a variable that's never read? Maybe it should be used afterwards?
-//                pointProj = pointSel;
-//                pointProj.x -= la * ld2;
-//                pointProj.y -= lb * ld2;
-//                pointProj.z -= lc * ld2;
-               //根据距离设置权重
-               float s = 1 - 0.9f * fabs(ld2);
-
-               coeff.x = s * la;
-               coeff.y = s * lb;
-               coeff.z = s * lc;
-               coeff.intensity = s * ld2;
-
-               if (s > 0.1)
+               Vector3 vc(0, 0, 0);
+
+               for (int j = 0; j < 5; j++)
+                  vc += Vector3(_laserCloudCornerFromMap->points[pointSearchInd[j]]);
+               vc /= 5.0;//5个点的xyz坐标求平均值，可理解为质心
+
+               Eigen::Matrix3f mat_a;
+               mat_a.setZero();
+
+               //求协方差
+               for (int j = 0; j < 5; j++)
+               {
+                  Vector3 a = Vector3(_laserCloudCornerFromMap->points[pointSearchInd[j]]) - vc;
+
+                  mat_a(0, 0) += a.x() * a.x();
+                  mat_a(1, 0) += a.x() * a.y();
+                  mat_a(2, 0) += a.x() * a.z();
+                  mat_a(1, 1) += a.y() * a.y();
+                  mat_a(2, 1) += a.y() * a.z();
+                  mat_a(2, 2) += a.z() * a.z();
+               }
+               matA1 = mat_a / 5.0;
+               // This solver only looks at the lower-triangular part of matA1.
+               //此处求当前点云特征点对应线/面的理论参考论文"Low-drift and real-time lidar odometry and mapping"第6节 Lidar mapping
+               Eigen::SelfAdjointEigenSolver<Eigen::Matrix3f> esolver(matA1);
+               matD1 = esolver.eigenvalues().real();//特征值Eigen::Matrix<float, 1, 3> matD1;
+               matV1 = esolver.eigenvectors().real();//特征向量Eigen::Matrix3f matV1;
+
+               if (matD1(0, 2) > 3 * matD1(0, 1))//如果最大的特征值大于第二大的特征值三倍以上，特征值默认从小到大排列
                {
-                  _laserCloudOri.push_back(pointOri);
-                  _coeffSel.push_back(coeff);
+                  //(x1,y1,z1)和(x2,y2,z2)代表edge line上的两点
+                  corr.fit[0] = vc.x() + 0.1 * matV1(0, 2);
+                  corr.fit[1] = vc.y() + 0.1 * matV1(1, 2);
+                  corr.fit[2] = vc.z() + 0.1 * matV1(2, 2);
+                  corr.fit[3] = vc.x() - 0.1 * matV1(0, 2);
+                  corr.fit[4] = vc.y() - 0.1 * matV1(1, 2);
+                  corr.fit[5] = vc.z() - 0.1 * matV1(2, 2);
+                  corr.valid = true;
                }
             }
          }
+
+         if (!corr.valid)
+            continue;
+
+         //(x0,y0,z0)代表特征点
+         float x0 = pointSel.x;
+         float y0 = pointSel.y;
+         float z0 = pointSel.z;
+         float x1 = corr.fit[0];
+         float y1 = corr.fit[1];
+         float z1 = corr.fit[2];
+         float x2 = corr.fit[3];
+         float y2 = corr.fit[4];
+         float z2 = corr.fit[5];
+         //与LaserOdometry节点求点到直线的距离方法相同
+         float a012 = sqrt(((x0 - x1)*(y0 - y2) - (x0 - x2)*(y0 - y1))
+                           * ((x0 - x1)*(y0 - y2) - (x0 - x2)*(y0 - y1))
+                           + ((x0 - x1)*(z0 - z2) - (x0 - x2)*(z0 - z1))
+                           * ((x0 - x1)*(z0 - z2) - (x0 - x2)*(z0 - z1))
+                           + ((y0 - y1)*(z0 - z2) - (y0 - y2)*(z0 - z1))
+                           * ((y0 - y1)*(z0 - z2) - (y0 - y2)*(z0 - z1)));
+
+         float l12 = sqrt((x1 - x2)*(x1 - x2) + (y1 - y2)*(y1 - y2) + (z1 - z2)*(z1 - z2));
+
+         float la = ((y1 - y2)*((x0 - x1)*(y0 - y2) - (x0 - x2)*(y0 - y1))
+                     + (z1 - z2)*((x0 - x1)*(z0 - z2) - (x0 - x2)*(z0 - z1))) / a012 / l12;
+
+         float lb = -((x1 - x2)*((x0 - x1)*(y0 - y2) - (x0 - x2)*(y0 - y1))
+                      - (z1 - z2)*((y0 - y1)*(z0 - z2) - (y0 - y2)*(z0 - z1))) / a012 / l12;
+
+         float lc = -((x1 - x2)*((x0 - x1)*(z0 - z2) - (x0 - x2)*(z0 - z1))
+                      + (y1 - y2)*((y0 - y1)*(z0 - z2) - (y0 - y2)*(z0 - z1))) / a012 / l12;
+
+         float ld2 = a012 / l12;
+
+//         // TODO: Why writing to a variable that's never read? Maybe it should be used afterwards?
+//         pointProj = pointSel;
+//         pointProj.x -= la * ld2;
+//         pointProj.y -= lb * ld2;
+//         pointProj.z -= lc * ld2;
+         //根据距离设置权重
+         float s = 1 - 0.9f * fabs(ld2);
+
+         if (s > 0.1)
+         {
+            _residuals.push_back(pointOri, s * la, s * lb, s * lc, s * ld2, s);
+         }
       }
 
       //处理planar point
+      transformStackToMap(*_laserCloudSurfStackDS, _mapSel);
+      searchCount += searchStaleCorrespondences(_surfMapIndex, _mapSel, _surfCorrespondences,
+                                                maxSqRefreshDist, _mapQueries, _mapQuerySlot,
+                                                _mapSearchInd, _mapSearchSqDis);
+
       for (int i = 0; i < laserCloudSurfStackNum; i++)
       {
          pointOri = _laserCloudSurfStackDS->points[i];
-         pointAssociateToMap(pointOri, pointSel);
-         kdtreeSurfFromMap.nearestKSearch(pointSel, 5, pointSearchInd, pointSearchSqDis);
+         pointSel = _mapSel.points[i];
 
-         //此处和论文中以及上面通过构建协方差求edge line不一样，使用的是最小二乘法拟合平面，求planar patch的平面方程Ax+By+Cz+1=0
-         if (pointSearchSqDis[4] < 1.0)
+         MapCorrespondence& corr = _surfCorrespondences[i];
+         if (_mapQuerySlot[i] >= 0)
          {
-            for (int j = 0; j < 5; j++)
-            {//matA0(5,3)——5行3列矩阵
-               matA0(j, 0) = _laserCloudSurfFromMap->points[pointSearchInd[j]].x;
-               matA0(j, 1) = _laserCloudSurfFromMap->points[pointSearchInd[j]].y;
-               matA0(j, 2) = _laserCloudSurfFromMap->points[pointSearchInd[j]].z;
-            }
-            //5个点构建平面方程，求参数A、B、C，联立得matA0*matX0=matB0
-            matX0 = matA0.colPivHouseholderQr().solve(matB0);//矩阵matB0(5,1)，元素全设为1，对应将上面的平面的1移到等式右边
-
-            float pa = matX0(0, 0);
-            float pb = matX0(1, 0);
-            float pc = matX0(2, 0);
-            float pd = 1;
-
-            float ps = sqrt(pa * pa + pb * pb + pc * pc);
-            pa /= ps;
-            pb /= ps;
-            pc /= ps;
-            pd /= ps;
-
-            bool planeValid = true;
-            for (int j = 0; j < 5; j++)
+            corr.qx = pointSel.x;
+            corr.qy = pointSel.y;
+            corr.qz = pointSel.z;
+            corr.searched = true;
+            corr.valid = false;
+
+            const int* pointSearchInd = &_mapSearchInd[_mapQuerySlot[i] * MAP_NEIGHBORS];
+            const float* pointSearchSqDis = &_mapSearchSqDis[_mapQuerySlot[i] * MAP_NEIGHBORS];
+
+            //此处和论文中以及上面通过构建协方差求edge line不一样，使用的是最小二乘法拟合平面，求planar patch的平面方程Ax+By+Cz+1=0
+            if (pointSearchSqDis[4] < 1.0)
             {
-               if (fabs(pa * _laserCloudSurfFromMap->points[pointSearchInd[j]].x +
-                        pb * _laserCloudSurfFromMap->points[pointSearchInd[j]].y +
-                        pc * _laserCloudSurfFromMap->points[pointSearchInd[j]].z + pd) > 0.2)
-               {//将5个临近点带入平面方程检验平面方程是否拟合良好
-                  planeValid = false;
-                  break;
+               for (int j = 0; j < 5; j++)
+               {//matA0(5,3)——5行3列矩阵
+                  matA0(j, 0) = _laserCloudSurfFromMap->points[pointSearchInd[j]].x;
+                  matA0(j, 1) = _laserCloudSurfFromMap->points[pointSearchInd[j]].y;
+                  matA0(j, 2) = _laserCloudSurfFromMap->points[pointSearchInd[j]].z;
+               }
+               //5个点构建平面方程，求参数A、B、C，联立得matA0*matX0=matB0
+               matX0 = matA0.colPivHouseholderQr().solve(matB0);//矩阵matB0(5,1)，元素全设为1，对应将上面的平面的1移到等式右边
+
+               float pa = matX0(0, 0);
+               float pb = matX0(1, 0);
+               float pc = matX0(2, 0);
+               float pd = 1;
+
+               float ps = sqrt(pa * pa + pb * pb + pc * pc);
+               pa /= ps;
+               pb /= ps;
+               pc /= ps;
+               pd /= ps;
+
+               bool planeValid = true;
+               for (int j = 0; j < 5; j++)
+               {
+                  if (fabs(pa * _laserCloudSurfFromMap->points[pointSearchInd[j]].x +
+                           pb * _laserCloudSurfFromMap->points[pointSearchInd[j]].y +
+                           pc * _laserCloudSurfFromMap->points[pointSearchInd[j]].z + pd) > 0.2)
+                  {//将5个临近点带入平面方程检验平面方程是否拟合良好
+                     planeValid = false;
+                     break;
+                  }
+               }
+
+               if (planeValid)
+               {
+                  corr.fit[0] = pa;
+                  corr.fit[1] = pb;
+                  corr.fit[2] = pc;
+                  corr.fit[3] = pd;
+                  corr.valid = true;
                }
             }
+         }
 
-            if (planeValid)
-            {
-               float pd2 = pa * pointSel.x + pb * pointSel.y + pc * pointSel.z + pd;
+         if (!corr.valid)
+            continue;
 
-               //                // TODO: Why writing to a variable that's never read? Maybe it should be used afterwards?
-               //                pointProj = pointSel;
-               //                pointProj.x -= pa * pd2;
-               //                pointProj.y -= pb * pd2;
-               //                pointProj.z -= pc * pd2;
+         float pa = corr.fit[0];
+         float pb = corr.fit[1];
+         float pc = corr.fit[2];
+         float pd = corr.fit[3];
+         float pd2 = pa * pointSel.x + pb * pointSel.y + pc * pointSel.z + pd;
 
-               float s = 1 - 0.9f * fabs(pd2) / sqrt(calcPointDistance(pointSel));
+         //         // TODO: Why writing to a variable that's never read? Maybe it should be used afterwards?
+         //         pointProj = pointSel;
+         //         pointProj.x -= pa * pd2;
+         //         pointProj.y -= pb * pd2;
+         //         pointProj.z -= pc * pd2;
 
-               coeff.x = s * pa;
-               coeff.y = s * pb;
-               coeff.z = s * pc;
-               coeff.intensity = s * pd2;
+         float s = 1 - 0.9f * fabs(pd2) / sqrt(calcPointDistance(pointSel));
 
-               if (s > 0.1)
-               {
-                  _laserCloudOri.push_back(pointOri);
-                  _coeffSel.push_back(coeff);
-               }
-            }
+         if (s > 0.1)
+         {
+            _residuals.push_back(pointOri, s * pa, s * pb, s * pc, s * pd2, s);
          }
       }
 
-      float srx = _transformTobeMapped.rot_x.sin();
-      float crx = _transformTobeMapped.rot_x.cos();
-      float sry = _transformTobeMapped.rot_y.sin();
-      float cry = _transformTobeMapped.rot_y.cos();
-      float srz = _transformTobeMapped.rot_z.sin();
-      float crz = _transformTobeMapped.rot_z.cos();
-
-      size_t laserCloudSelNum = _laserCloudOri.size();
+      size_t laserCloudSelNum = _residuals.size();
       if (laserCloudSelNum < 50)//特征点大于50个才进行优化迭代
       {
          printf("There are few feature points!Didn't iteration!\n");
@@ -914,43 +1491,24 @@ void BasicLaserMapping::optimizeTransformTobeMapped()
       }
 
       //这部分的迭代过程与LaserOdometry节点的迭代过程系统，都是使用高斯牛顿法
-      Eigen::Matrix<float, Eigen::Dynamic, 6> matA(laserCloudSelNum, 6);
-      Eigen::Matrix<float, 6, Eigen::Dynamic> matAt(6, laserCloudSelNum);
+      // 雅可比矩阵与残差向量的内存取自帧内存池，本次迭代结束时释放
+      FrameArena::Scope iterationScratch(_frameArena);
+      Eigen::Map<Eigen::Matrix<float, Eigen::Dynamic, 6>, Eigen::Aligned16>
+         matA(_frameArena.allocate<float>(laserCloudSelNum * 6), laserCloudSelNum, 6);
       Eigen::Matrix<float, 6, 6> matAtA;
-      Eigen::VectorXf matB(laserCloudSelNum);
-      Eigen::VectorXf matAtB;
-      Eigen::VectorXf matX;
-
-      for (int i = 0; i < laserCloudSelNum; i++)
-      {
-         pointOri = _laserCloudOri.points[i];
-         coeff = _coeffSel.points[i];
-
-         float arx = (crx*sry*srz*pointOri.x + crx * crz*sry*pointOri.y - srx * sry*pointOri.z) * coeff.x
-            + (-srx * srz*pointOri.x - crz * srx*pointOri.y - crx * pointOri.z) * coeff.y
-            + (crx*cry*srz*pointOri.x + crx * cry*crz*pointOri.y - cry * srx*pointOri.z) * coeff.z;
-
-         float ary = ((cry*srx*srz - crz * sry)*pointOri.x
-                      + (sry*srz + cry * crz*srx)*pointOri.y + crx * cry*pointOri.z) * coeff.x
-            + ((-cry * crz - srx * sry*srz)*pointOri.x
-               + (cry*srz - crz * srx*sry)*pointOri.y - crx * sry*pointOri.z) * coeff.z;
-
-         float arz = ((crz*srx*sry - cry * srz)*pointOri.x + (-cry * crz - srx * sry*srz)*pointOri.y)*coeff.x
-            + (crx*crz*pointOri.x - crx * srz*pointOri.y) * coeff.y
-            + ((sry*srz + cry * crz*srx)*pointOri.x + (crz*sry - cry * srx*srz)*pointOri.y)*coeff.z;
-
-         matA(i, 0) = arx;
-         matA(i, 1) = ary;
-         matA(i, 2) = arz;
-         matA(i, 3) = coeff.x;
-         matA(i, 4) = coeff.y;
-         matA(i, 5) = coeff.z;
-         matB(i, 0) = -coeff.intensity;
-      }
-
-      matAt = matA.transpose();
-      matAtA = matAt * matA;
-      matAtB = matAt * matB;
+      Eigen::Map<Eigen::VectorXf, Eigen::Aligned16>
+         matB(_frameArena.allocate<float>(laserCloudSelNum), laserCloudSelNum);
+      Eigen::Matrix<float, 6, 1> matAtB;
+      Eigen::Matrix<float, 6, 1> matX;
+
+      // 雅可比矩阵（按列存储）与残差由SIMD kernel批量计算
+      const simd::LinearJacobian J = mapResidualJacobian(_transformTobeMapped);
+      simd::kernels().jacobian(J, _residuals.px(), _residuals.py(), _residuals.pz(),
+                               _residuals.nx(), _residuals.ny(), _residuals.nz(), _residuals.d(),
+                               laserCloudSelNum, matA.data(), size_t(matA.outerStride()), matB.data());
+
+      matAtA.noalias() = matA.transpose() * matA;
+      matAtB.noalias() = matA.transpose() * matB;
       matX = matAtA.colPivHouseholderQr().solve(matAtB);
 
       //退化场景判断与处理
@@ -1013,7 +1571,7 @@ void BasicLaserMapping::optimizeTransformTobeMapped()
          break;//旋转平移量足够小就停止迭代
       }
    }
-   printf("complete a transform optimization!iterCount=%lu\n",iterCount);
+   printf("complete a transform optimization!iterCount=%lu, searchCount=%lu\n", iterCount, searchCount);
    transformUpdate();
 }
 
@@ -1,5 +1,6 @@
 #include "loam_velodyne/BasicLaserOdometry.h"
 #include "loam_velodyne/math_utils.h"
+#include "loam_velodyne/simd_dispatch.h"
 #include <pcl/filters/filter.h>
 #include <Eigen/Eigenvalues>
 #include <Eigen/QR>
@@ -30,8 +31,9 @@ BasicLaserOdometry::BasicLaserOdometry(float scanPeriod, size_t maxIterations) :
    _laserCloud(new pcl::PointCloud<pcl::PointXYZI>()),
    _lastCornerCloud(new pcl::PointCloud<pcl::PointXYZI>()),
    _lastSurfaceCloud(new pcl::PointCloud<pcl::PointXYZI>()),
-   _laserCloudOri(new pcl::PointCloud<pcl::PointXYZI>()),
-   _coeffSel(new pcl::PointCloud<pcl::PointXYZI>())
+   _residuals(_frameArena),
+   _lastCornerIndex(1.0, 5.0),    // correspondences are gated at 25 m^2
+   _lastSurfaceIndex(1.0, 5.0)
 {}
 
 
@@ -53,37 +55,32 @@ void BasicLaserOdometry::transformToStart(const pcl::PointXYZI& pi, pcl::PointXY
 }
 
 
+void BasicLaserOdometry::transformToStart(const pcl::PointCloud<pcl::PointXYZI>& cloud,
+                                          pcl::PointCloud<pcl::PointXYZI>& result)
+{
+   // same transformation as transformToStart() of a single point, applied in one batch
+   transformCloudInterpolated(-_transform.rot_z.rad(), -_transform.rot_x.rad(), -_transform.rot_y.rad(),
+                              -_transform.pos, 1.f / _scanPeriod, cloud, result);
+}
+
+
 //将上一帧点云中的点相对结束位置去除因匀速运动产生的畸变，效果相当于得到在点云扫描结束位置静止扫描得到的点云
 size_t BasicLaserOdometry::transformToEnd(pcl::PointCloud<pcl::PointXYZI>::Ptr& cloud)
 {
    size_t cloudSize = cloud->points.size();
 
-   for (size_t i = 0; i < cloudSize; i++)
-   {
-      pcl::PointXYZI& point = cloud->points[i];
-
-      float s = (1.f / _scanPeriod) * (point.intensity - int(point.intensity));
-
-      //这里都是减号，是因为通过优化计算出来的变换是从当前点云帧结束时刻到初始时刻的
-      //而将点云全部投影到结束时刻则需要加个负号
-      point.x -= s * _transform.pos.x();
-      point.y -= s * _transform.pos.y();
-      point.z -= s * _transform.pos.z();
-      point.intensity = int(point.intensity);
+   //这里都是减号，是因为通过优化计算出来的变换是从当前点云帧结束时刻到初始时刻的
+   //而将点云全部投影到结束时刻则需要加个负号
+   //先去除匀速运动产生的畸变（每个点的插值系数s不同），并去掉intensity中的相对时间
+   transformCloudInterpolated(-_transform.rot_z.rad(), -_transform.rot_x.rad(), -_transform.rot_y.rad(),
+                              -_transform.pos, 1.f / _scanPeriod, *cloud, *cloud, true);
 
-      Angle rx = -s * _transform.rot_x.rad();
-      Angle ry = -s * _transform.rot_y.rad();
-      Angle rz = -s * _transform.rot_z.rad();
-      rotateZXY(point, rz, rx, ry);
-      rotateYXZ(point, _transform.rot_y, _transform.rot_x, _transform.rot_z);
-
-      point.x += _transform.pos.x() - _imuShiftFromStart.x();
-      point.y += _transform.pos.y() - _imuShiftFromStart.y();
-      point.z += _transform.pos.z() - _imuShiftFromStart.z();
-
-      rotateZXY(point, _imuRollStart, _imuPitchStart, _imuYawStart);
-      rotateYXZ(point, -_imuYawEnd, -_imuPitchEnd, -_imuRollEnd);
-   }
+   //余下的变换对所有点都相同，合并为一个变换
+   PointTransform toEnd = PointTransform::rotationYXZ(_transform.rot_y, _transform.rot_x, _transform.rot_z)
+      .then(PointTransform::translation(_transform.pos - _imuShiftFromStart))
+      .then(PointTransform::rotationZXY(_imuRollStart, _imuPitchStart, _imuYawStart))
+      .then(PointTransform::rotationYXZ(-_imuYawEnd, -_imuPitchEnd, -_imuRollEnd));
+   transformCloud(toEnd, *cloud, *cloud);
 
    return cloudSize;
 }
@@ -235,6 +232,44 @@ void BasicLaserOdometry::updateIMU(pcl::PointCloud<pcl::PointXYZ> const& imuTran
    _imuVeloFromStart = imuTrans.points[3];
 }
 
+/** \brief Set up the Jacobian of the odometry residuals at the given sweep transform. */
+static simd::LinearJacobian odometryResidualJacobian(const Twist& transform)
+{
+   //求偏导数
+   //要求偏导数，首先要获得原函数，原函数将当前点云帧中的特征点(pointOri)通过位姿变换统一到上一帧点云的坐标系中，
+   //然后求变换后的点到前面求得的直线/平面的距离，完整的论述见论文"low-drift and real-time lidar odometry and mapping"5.3节的公式6~10
+   //如果该位姿变换是正确的，距离应该为0，不为0则通过高斯-牛顿法进行迭代使距离逼近0
+   //X~=R*X+t，X表示当前点云帧特征点，R、t表示位姿变换，得到了X在上一帧点云坐标系下的表示X~
+   //就可以求这一点到对应的线/平面的距离，此时前面求取的线/平面的单位法向量就派上用场了
+   //f/T=dR/dΘ*[(pointOri.x-tx),(pointOri.y-ty),(pointOri.z-tz)]*[coeff.x,coeff.y,coeff.z]
+   //旋转矩阵R由欧拉角表示，https://en.wikipedia.org/wiki/Euler_angles，R=Y1X2Z3
+   const float srx = transform.rot_x.sin(), crx = transform.rot_x.cos();
+   const float sry = transform.rot_y.sin(), cry = transform.rot_y.cos();
+   const float srz = transform.rot_z.sin(), crz = transform.rot_z.cos();
+
+   simd::LinearJacobian J = {
+      {  // rotation derivatives: factors of the x, y and z normal component
+         { { -crx*sry*srz, crx*crz*sry, srx*sry },
+           { srx*srz, -crz*srx, crx },
+           { crx*cry*srz, -crx*cry*crz, -cry*srx } },
+         { { -crz*sry - cry*srx*srz, cry*crz*srx - sry*srz, -crx*cry },
+           { 0, 0, 0 },
+           { cry*crz - srx*sry*srz, cry*srz + crz*srx*sry, -crx*sry } },
+         { { -cry*srz - crz*srx*sry, cry*crz - srx*sry*srz, 0 },
+           { -crx*crz, -crx*srz, 0 },
+           { cry*crz*srx - sry*srz, crz*sry + cry*srx*srz, 0 } }
+      },
+      { transform.pos.x(), transform.pos.y(), transform.pos.z() },
+      {  // translation derivatives
+         { -(cry*crz - srx*sry*srz), crx*srz, -(crz*sry + cry*srx*srz) },
+         { -(cry*srz + crz*srx*sry), -crx*crz, -(sry*srz - cry*crz*srx) },
+         { crx*sry, -srx, -crx*cry }
+      },
+      -0.05f
+   };
+   return J;
+}
+
 void BasicLaserOdometry::process()
 {
    if (!_systemInited)
@@ -244,8 +279,8 @@ void BasicLaserOdometry::process()
       _surfPointsLessFlat.swap(_lastSurfaceCloud);
 
       //使用上一帧的点云特征点构建kd-tree，方便查找最近点
-      _lastCornerKDTree.setInputCloud(_lastCornerCloud);
-      _lastSurfaceKDTree.setInputCloud(_lastSurfaceCloud);
+      _lastCornerIndex.setInputCloud(_lastCornerCloud);
+      _lastSurfaceIndex.setInputCloud(_lastSurfaceCloud);
 
       _transformSum.rot_x += _imuPitchStart;
       _transformSum.rot_z += _imuRollStart;
@@ -254,7 +289,6 @@ void BasicLaserOdometry::process()
       return;
    }
 
-   pcl::PointXYZI coeff;
    bool isDegenerate = false;//退化标志
    Eigen::Matrix<float, 6, 6> matP;//P矩阵，预测矩阵
 
@@ -269,8 +303,6 @@ void BasicLaserOdometry::process()
 
    if (lastCornerCloudSize > 10 && lastSurfaceCloudSize > 100)
    {
-      std::vector<int> pointSearchInd(1);
-      std::vector<float> pointSearchSqDis(1);
       std::vector<int> indices;
 
       pcl::removeNaNFromPointCloud(*_cornerPointsSharp, *_cornerPointsSharp, indices);
@@ -283,38 +315,51 @@ void BasicLaserOdometry::process()
       _pointSearchSurfInd2.resize(surfPointsFlatNum);
       _pointSearchSurfInd3.resize(surfPointsFlatNum);
 
+      // 所选特征点数量的上限已知，预先在帧内存池中分配，迭代中不再扩容
+      _frameArena.reset();
+      _residuals.clear();
+      _residuals.reserve(cornerPointsSharpNum + surfPointsFlatNum);
+
       //Levenberg-Marquardt算法(L-M method)，非线性最小二乘算法，最优化算法的一种
       //最多迭代25次
       for (size_t iterCount = 0; iterCount < _maxIterations; iterCount++)
       {
          pcl::PointXYZI pointSel, pointProj, tripod1, tripod2, tripod3;
-         _laserCloudOri->clear();//每次迭代前清空上一次迭代中存储的被选中的上一帧点云的点
-         _coeffSel->clear();
+         _residuals.clear();//每次迭代前清空上一次迭代中存储的被选中的点及其对应的线/面
 
          //处理edge point，寻找上一帧点云中与之最近的且能构成直线的两点
          //处理当前点云中的曲率最大的特征点,从上个点云中曲率比较大的特征点中找两个最近距离点，
          //一个点使用kd-tree查找，另一个根据找到的点在其相邻线找另外一个最近距离的点
+         //此处没有直接将_cornerPointsSharp中的点投影到该帧点云的初始时刻，而是透过_cornerPointsSel
+         //是因为后续建立优化方程还需要用到_cornerPointsSharp中的特征点
+         transformToStart(*_cornerPointsSharp, _cornerPointsSel);
+
+         if (iterCount % 5 == 0)
+         {//每迭代五次，重新查找最近点
+            //kd-tree一次性查找所有点的最近距离点，边沿点未经过体素栅格滤波，一般边沿点本来就比较少，不做滤波
+            //_cornerSearchInd——最近点的序号，_cornerSearchSqDis——离最近点的距离
+            pcl::removeNaNFromPointCloud(*_lastCornerCloud, *_lastCornerCloud, indices);
+            _cornerSearchInd.resize(cornerPointsSharpNum);
+            _cornerSearchSqDis.resize(cornerPointsSharpNum);
+            _lastCornerIndex.nearestKSearchBatch(_cornerPointsSel.points.data(), cornerPointsSharpNum, 1,
+                                                  _cornerSearchInd.data(), _cornerSearchSqDis.data());
+         }
+
          for (int i = 0; i < cornerPointsSharpNum; i++)
          {
-            //此处没有直接将_cornerPointsSharp中的点投影到该帧点云的初始时刻，而是透过pointSel变量
-            //是因为后续建立优化方程还需要用到_surfPointsFlat中的特征点
-            transformToStart(_cornerPointsSharp->points[i], pointSel);
+            pointSel = _cornerPointsSel.points[i];
 
             if (iterCount % 5 == 0)
-            {//每迭代五次，重新查找最近点
-               //kd-tree查找一个最近距离点，边沿点未经过体素栅格滤波，一般边沿点本来就比较少，不做滤波
-               //pointSearchInd——最近点的序号，pointSearchSqDis——离最近点的距离
-               pcl::removeNaNFromPointCloud(*_lastCornerCloud, *_lastCornerCloud, indices);
-               _lastCornerKDTree.nearestKSearch(pointSel, 1, pointSearchInd, pointSearchSqDis);
+            {
                int closestPointInd = -1, minPointInd2 = -1;
 
                //寻找相邻线距离目标点距离最小的点，这里没有再采用kdTree.nearestKSearch()查找，而是遍历临近scan的点
                //原因是要确保这两个点能构成合理的直线
                //再次提醒：velodyne是2度一线，scanID相邻并不代表线号相邻，相邻线度数相差2度，也即线号scanID相差2
-               if (pointSearchSqDis[0] < 25)//找到的最近点距离的确很近的话
+               if (_cornerSearchSqDis[i] < 25)//找到的最近点距离的确很近的话
                {
                   //提取最近点线号
-                  closestPointInd = pointSearchInd[0];
+                  closestPointInd = _cornerSearchInd[i];
                   int closestPointScan = int(_lastCornerCloud->points[closestPointInd].intensity);
 
                   float pointSqDis, minPointSqDis2 = 25;//初始门槛值5米，可大致过滤掉scanID相邻，但实际线不相邻的值
@@ -430,15 +475,9 @@ void BasicLaserOdometry::process()
                }
 
                //考虑权重
-               coeff.x = s * la;
-               coeff.y = s * lb;
-               coeff.z = s * lc;
-               coeff.intensity = s * ld2;
-
                if (s > 0.1 && ld2 != 0)
                {//只保留权重大的，也即距离比较小的点，同时也舍弃距离为零的
-                  _laserCloudOri->push_back(_cornerPointsSharp->points[i]);
-                  _coeffSel->push_back(coeff);
+                  _residuals.push_back(_cornerPointsSharp->points[i], s * la, s * lb, s * lc, s * ld2, s);
                }
             }
          }
@@ -447,20 +486,29 @@ void BasicLaserOdometry::process()
          //对本次接收到的曲率最小的点,从上次接收到的点云曲率比较小的点中找三点组成平面，
          //一个使用kd-tree查找，另外一个在同一线上查找满足要求的，第三个在不同线上查找满足要求的
          //与上面对edge point的处理类似
+         //此处没有直接将_surfPointsFlat中的点投影到该帧点云的初始时刻，而是透过_surfPointsSel
+         //是因为后续建立优化方程还需要用到_surfPointsFlat中的特征点
+         transformToStart(*_surfPointsFlat, _surfPointsSel);
+
+         if (iterCount % 5 == 0)
+         {
+            //kd-tree一次性查找所有点的第一个最近点，_surfSearchInd——最近点的序号，_surfSearchSqDis——离最近点的距离
+            _surfSearchInd.resize(surfPointsFlatNum);
+            _surfSearchSqDis.resize(surfPointsFlatNum);
+            _lastSurfaceIndex.nearestKSearchBatch(_surfPointsSel.points.data(), surfPointsFlatNum, 1,
+                                                   _surfSearchInd.data(), _surfSearchSqDis.data());
+         }
+
          for (int i = 0; i < surfPointsFlatNum; i++)
          {
-            //此处没有直接将_surfPointsFlat中的点投影到该帧点云的初始时刻，而是透过pointSel变量
-            //是因为后续建立优化方程还需要用到_surfPointsFlat中的特征点
-            transformToStart(_surfPointsFlat->points[i], pointSel);
+            pointSel = _surfPointsSel.points[i];
 
             if (iterCount % 5 == 0)
             {
-               //kd-tree查找第一个最近点，pointSearchInd——最近点的序号，pointSearchSqDis——离最近点的距离
-               _lastSurfaceKDTree.nearestKSearch(pointSel, 1, pointSearchInd, pointSearchSqDis);
                int closestPointInd = -1, minPointInd2 = -1, minPointInd3 = -1;
-               if (pointSearchSqDis[0] < 25)
+               if (_surfSearchSqDis[i] < 25)
                {
-                  closestPointInd = pointSearchInd[0];
+                  closestPointInd = _surfSearchInd[i];
                   int closestPointScan = int(_lastSurfaceCloud->points[closestPointInd].intensity);
 
                   float pointSqDis, minPointSqDis2 = 25, minPointSqDis3 = 25;
@@ -586,108 +634,40 @@ void BasicLaserOdometry::process()
                   s = 1 - 1.8f * fabs(pd2) / sqrt(calcPointDistance(pointSel));
                }
 
-               coeff.x = s * pa;
-               coeff.y = s * pb;
-               coeff.z = s * pc;
-               coeff.intensity = s * pd2;
-
                if (s > 0.1 && pd2 != 0)
                {
-                  _laserCloudOri->push_back(_surfPointsFlat->points[i]);
-                  _coeffSel->push_back(coeff);
+                  _residuals.push_back(_surfPointsFlat->points[i], s * pa, s * pb, s * pc, s * pd2, s);
                }
             }
          }
 
-         int pointSelNum = _laserCloudOri->points.size();
+         int pointSelNum = _residuals.size();
          if (pointSelNum < 10)
          {//满足要求的特征点至少10个，特征匹配数量太少弃用此帧数据
             continue;
          }
 
-         Eigen::Matrix<float, Eigen::Dynamic, 6> matA(pointSelNum, 6);//该矩阵每一行为偏导，多少列代表多少个点
-         Eigen::Matrix<float, 6, Eigen::Dynamic> matAt(6, pointSelNum);//该矩阵等于矩阵matA的转置
+         // 雅可比矩阵与残差向量的内存取自帧内存池，本次迭代结束时释放
+         FrameArena::Scope iterationScratch(_frameArena);
+         Eigen::Map<Eigen::Matrix<float, Eigen::Dynamic, 6>, Eigen::Aligned16>
+            matA(_frameArena.allocate<float>(pointSelNum * 6), pointSelNum, 6);//该矩阵每一行为偏导，多少列代表多少个点
          Eigen::Matrix<float, 6, 6> matAtA;//该矩阵等于矩阵A的转置乘以矩阵A
-         Eigen::VectorXf matB(pointSelNum);//每一个点(不管是edge还是planar point)对应的距离
+         Eigen::Map<Eigen::VectorXf, Eigen::Aligned16>
+            matB(_frameArena.allocate<float>(pointSelNum), pointSelNum);//每一个点(不管是edge还是planar point)对应的距离
          Eigen::Matrix<float, 6, 1> matAtB;//该矩阵等于矩阵A的转置乘以矩阵B
          Eigen::Matrix<float, 6, 1> matX;//matAtA*matX=matAtB
 
          //当前点云中有多少个特征点(edge/planar point)就对应多少个方程
-         for (int i = 0; i < pointSelNum; i++)
-         {
-            //此处是用_laserCloudOri中的点来建立方程，_laserCloudOri的点来自于当前点云帧中的特征点_cornerPointsSharp/_surfPointsFlat中可在上一帧点云中找到对应线/面的点，见248~560行代码
-            //前面寻找其对应的上一帧点云中的线/面是提取_cornerPointsSharp/_surfPointsFlat中的点
-            //赋给变量pointSel，pointSel再投影到当前点云帧的初始时刻(见261/414行代码)，进而寻找上一帧点云中与之对应的线/面
-            //而在该部分，则是通过变换矩阵将特征点变换到初始时刻，这与通过poingSel投影到初始时刻起相同的作用
-            //再利用高斯牛顿迭代法不断优化这个变换矩阵，最终可以得到当前帧从初始时刻到结束时刻，这个时间段的位姿变换
-            //而前面pointSel投影到初始时刻则是基于匀速假设，投影所使用的位姿变换是上一帧点云的位姿变换
-            const pcl::PointXYZI& pointOri = _laserCloudOri->points[i];
-            coeff = _coeffSel->points[i];
-
-            float s = 1;
-
-            float srx = sin(s * _transform.rot_x.rad());
-            float crx = cos(s * _transform.rot_x.rad());
-            float sry = sin(s * _transform.rot_y.rad());
-            float cry = cos(s * _transform.rot_y.rad());
-            float srz = sin(s * _transform.rot_z.rad());
-            float crz = cos(s * _transform.rot_z.rad());
-            float tx = s * _transform.pos.x();
-            float ty = s * _transform.pos.y();
-            float tz = s * _transform.pos.z();
-
-            //求偏导数
-            //要求偏导数，首先要获得原函数，原函数将当前点云帧中的特征点(pointOri)通过位姿变换统一到上一帧点云的坐标系中，
-            //然后求变换后的点到前面求得的直线/平面的距离，完整的论述见论文"low-drift and real-time lidar odometry and mapping"5.3节的公式6~10
-            //如果该位姿变换是正确的，距离应该为0，不为0则通过高斯-牛顿法进行迭代使距离逼近0
-            //X~=R*X+t，X表示当前点云帧特征点，R、t表示位姿变换，得到了X在上一帧点云坐标系下的表示X~
-            //就可以求这一点到对应的线/平面的距离，此时前面求取的线/平面的单位法向量就派上用场了
-            //f/T=dR/dΘ*[(pointOri.x-tx),(pointOri.x-tx),(pointOri.x-tx)]*[coeff.x,coeff.y,coeff.z]
-            //旋转矩阵R由欧拉角表示，https://en.wikipedia.org/wiki/Euler_angles，R=Y1X2Z3
-            float arx = (-s * crx*sry*srz*pointOri.x + s * crx*crz*sry*pointOri.y + s * srx*sry*pointOri.z
-                         + s * tx*crx*sry*srz - s * ty*crx*crz*sry - s * tz*srx*sry) * coeff.x
-               + (s*srx*srz*pointOri.x - s * crz*srx*pointOri.y + s * crx*pointOri.z
-                  + s * ty*crz*srx - s * tz*crx - s * tx*srx*srz) * coeff.y
-               + (s*crx*cry*srz*pointOri.x - s * crx*cry*crz*pointOri.y - s * cry*srx*pointOri.z
-                  + s * tz*cry*srx + s * ty*crx*cry*crz - s * tx*crx*cry*srz) * coeff.z;
-
-            float ary = ((-s * crz*sry - s * cry*srx*srz)*pointOri.x
-                         + (s*cry*crz*srx - s * sry*srz)*pointOri.y - s * crx*cry*pointOri.z
-                         + tx * (s*crz*sry + s * cry*srx*srz) + ty * (s*sry*srz - s * cry*crz*srx)
-                         + s * tz*crx*cry) * coeff.x
-               + ((s*cry*crz - s * srx*sry*srz)*pointOri.x
-                  + (s*cry*srz + s * crz*srx*sry)*pointOri.y - s * crx*sry*pointOri.z
-                  + s * tz*crx*sry - ty * (s*cry*srz + s * crz*srx*sry)
-                  - tx * (s*cry*crz - s * srx*sry*srz)) * coeff.z;
-
-            float arz = ((-s * cry*srz - s * crz*srx*sry)*pointOri.x + (s*cry*crz - s * srx*sry*srz)*pointOri.y
-                         + tx * (s*cry*srz + s * crz*srx*sry) - ty * (s*cry*crz - s * srx*sry*srz)) * coeff.x
-               + (-s * crx*crz*pointOri.x - s * crx*srz*pointOri.y
-                  + s * ty*crx*srz + s * tx*crx*crz) * coeff.y
-               + ((s*cry*crz*srx - s * sry*srz)*pointOri.x + (s*crz*sry + s * cry*srx*srz)*pointOri.y
-                  + tx * (s*sry*srz - s * cry*crz*srx) - ty * (s*crz*sry + s * cry*srx*srz)) * coeff.z;
-
-            float atx = -s * (cry*crz - srx * sry*srz) * coeff.x + s * crx*srz * coeff.y
-               - s * (crz*sry + cry * srx*srz) * coeff.z;
-
-            float aty = -s * (cry*srz + crz * srx*sry) * coeff.x - s * crx*crz * coeff.y
-               - s * (sry*srz - cry * crz*srx) * coeff.z;
-
-            float atz = s * crx*sry * coeff.x - s * srx * coeff.y - s * crx*cry * coeff.z;
-
-            //float d2 = coeff.intensity;
-
-            matA(i, 0) = arx;
-            matA(i, 1) = ary;
-            matA(i, 2) = arz;
-            matA(i, 3) = atx;
-            matA(i, 4) = aty;
-            matA(i, 5) = atz;
-            matB(i, 0) = -0.05 * coeff.intensity;
-         }
-         matAt = matA.transpose();//求转置
-         matAtA = matAt * matA;//matAtA是矩阵A的转置乘以A
-         matAtB = matAt * matB;//matAtB是矩阵A的转置乘以B
+         //此处是用_residuals中的点来建立方程，_residuals的点来自于当前点云帧中的特征点_cornerPointsSharp/_surfPointsFlat中可在上一帧点云中找到对应线/面的点
+         //通过变换矩阵将特征点变换到初始时刻，再利用高斯牛顿迭代法不断优化这个变换矩阵，最终可以得到当前帧从初始时刻到结束时刻的位姿变换
+         //偏导数的推导见odometryResidualJacobian()，雅可比矩阵（按列存储）与残差由SIMD kernel批量计算
+         const simd::LinearJacobian J = odometryResidualJacobian(_transform);
+         simd::kernels().jacobian(J, _residuals.px(), _residuals.py(), _residuals.pz(),
+                                  _residuals.nx(), _residuals.ny(), _residuals.nz(), _residuals.d(),
+                                  pointSelNum, matA.data(), size_t(matA.outerStride()), matB.data());
+
+         matAtA.noalias() = matA.transpose() * matA;//matAtA是矩阵A的转置乘以A
+         matAtB.noalias() = matA.transpose() * matB;//matAtB是矩阵A的转置乘以B
 
          //高斯牛顿法，根据迭代公式可得(matAt*matA)[x(k)-x(k+1)]=matAt*matB
          //其中x(k)表示上一次的位姿变换，matX=x(k)-x(k+1)，我们要求的是x(k+1)
@@ -817,8 +797,8 @@ void BasicLaserOdometry::process()
 
    if (lastCornerCloudSize > 10 && lastSurfaceCloudSize > 100)
    {//点足够多就构建kd-tree，否则弃用此帧，沿用上一帧数据的kd-tree
-      _lastCornerKDTree.setInputCloud(_lastCornerCloud);
-      _lastSurfaceKDTree.setInputCloud(_lastSurfaceCloud);
+      _lastCornerIndex.setInputCloud(_lastCornerCloud);
+      _lastSurfaceIndex.setInputCloud(_lastSurfaceCloud);
    }
    
 }
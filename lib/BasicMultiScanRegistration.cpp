@@ -0,0 +1,122 @@
+#include <algorithm>
+#include <cmath>
+
+#include <pcl/pcl_macros.h>
+
+#include "loam_velodyne/BasicMultiScanRegistration.h"
+
+
+namespace loam {
+
+MultiScanMapper::MultiScanMapper(const float& lowerBound,
+                                 const float& upperBound,
+                                 const uint16_t& nScanRings)
+    : _lowerBound(lowerBound),
+      _upperBound(upperBound),
+      _nScanRings(nScanRings),
+      _factor((nScanRings - 1) / (upperBound - lowerBound))
+{}
+
+void MultiScanMapper::set(const float &lowerBound,
+                          const float &upperBound,
+                          const uint16_t &nScanRings)
+{
+  _lowerBound = lowerBound;
+  _upperBound = upperBound;
+  _nScanRings = nScanRings;
+  _factor = (nScanRings - 1) / (upperBound - lowerBound);
+}
+
+int MultiScanMapper::getRingForAngle(const float& angle) {
+  return int(((angle * 180 / M_PI) - _lowerBound) * _factor + 0.5);
+}
+
+
+
+BasicMultiScanRegistration::BasicMultiScanRegistration(const MultiScanMapper& scanMapper)
+    : _scanMapper(scanMapper)
+{}
+
+
+
+bool BasicMultiScanRegistration::process(const pcl::PointCloud<pcl::PointXYZ>& laserCloudIn, const Time& scanTime)
+{
+  size_t cloudSize = laserCloudIn.size();
+  if (cloudSize == 0)
+    return false;
+
+  // determine scan start and end orientations
+  float startOri = -std::atan2(laserCloudIn[0].y, laserCloudIn[0].x);
+  float endOri = -std::atan2(laserCloudIn[cloudSize - 1].y,
+                             laserCloudIn[cloudSize - 1].x) + 2 * float(M_PI);
+  if (endOri - startOri > 3 * M_PI)
+    endOri -= 2 * M_PI;
+  else if (endOri - startOri < M_PI)
+    endOri += 2 * M_PI;
+
+  bool halfPassed = false;
+  pcl::PointXYZI point;
+  _laserCloudScans.resize(_scanMapper.getNumberOfScanRings());
+  // clear all scanline points
+  std::for_each(_laserCloudScans.begin(), _laserCloudScans.end(), [](auto&&v) {v.clear(); }); 
+
+  // extract valid points from input cloud
+  for (int i = 0; i < cloudSize; i++)
+  {
+    point.x = laserCloudIn[i].y;
+    point.y = laserCloudIn[i].z;
+    point.z = laserCloudIn[i].x;
+
+    // skip NaN and INF valued points
+    if (!pcl_isfinite(point.x) || !pcl_isfinite(point.y) || !pcl_isfinite(point.z))
+      continue;
+
+    // skip zero valued points
+    if (point.x * point.x + point.y * point.y + point.z * point.z < 0.0001)
+      continue;
+
+    // calculate vertical point angle and scan ID
+    float angle = std::atan(point.y / std::sqrt(point.x * point.x + point.z * point.z));
+    int scanID = _scanMapper.getRingForAngle(angle);
+    if (scanID >= _scanMapper.getNumberOfScanRings() || scanID < 0 )
+      continue;
+
+    // calculate horizontal point angle
+    float ori = -std::atan2(point.x, point.z);
+    if (!halfPassed)
+    {
+      if (ori < startOri - M_PI / 2)
+        ori += 2 * M_PI;
+      else if (ori > startOri + M_PI * 3 / 2)
+        ori -= 2 * M_PI;
+      if (ori - startOri > M_PI)
+        halfPassed = true;
+    }
+    else
+    {
+      ori += 2 * M_PI;
+
+      if (ori < endOri - M_PI * 3 / 2)
+        ori += 2 * M_PI;
+      else if (ori > endOri + M_PI / 2)
+        ori -= 2 * M_PI;
+    }
+
+    // calculate relative scan time based on point orientation
+    float relTime = config().scanPeriod * (ori - startOri) / (endOri - startOri);
+    point.intensity = scanID + relTime;
+
+    //projectPointToStartOfSweep(point, relTime);//可注释掉
+
+    _laserCloudScans[scanID].push_back(point);
+  }
+
+  // a sweep without valid points keeps the previous results
+  if (std::all_of(_laserCloudScans.begin(), _laserCloudScans.end(), [](auto const& v) { return v.empty(); }))
+    return false;
+
+  processScanlines(scanTime, _laserCloudScans);
+  return true;
+}
+
+} // end namespace loam
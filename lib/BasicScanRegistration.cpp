@@ -2,6 +2,7 @@
 
 #include "loam_velodyne/BasicScanRegistration.h"
 #include "loam_velodyne/math_utils.h"
+#include "loam_velodyne/simd_dispatch.h"
 
 namespace loam
 {
@@ -48,7 +49,7 @@ void BasicScanRegistration::processScanlines(const Time& scanTime, std::vector<p
 bool BasicScanRegistration::configure(const RegistrationParams& config)
 {
   _config = config;
-  _imuHistory.ensureCapacity(_config.imuHistorySize);
+  _imuHistory.setCapacity(_config.imuHistorySize);
   return true;
 }
 
@@ -56,8 +57,11 @@ void BasicScanRegistration::reset(const Time& scanTime)
 {
   _scanTime = scanTime;
 
-  // re-initialize IMU start index and state
-  _imuIdx = 0;
+  // drop the IMU states before the new scan (keeping the latest of them as interpolation start),
+  // the history rejects new states once it is full
+  _imuHistory.discardOlderThan(scanTime);
+
+  // re-initialize IMU start state
 //  if (hasIMUData()) {
 //    interpolateIMUStateFor(0, _imuStart);//由于没有IMU数据，该函数不执行
 //  }
@@ -137,17 +141,16 @@ void BasicScanRegistration::transformToStartIMU(pcl::PointXYZI& point)
 
 void BasicScanRegistration::interpolateIMUStateFor(const float &relTime, IMUState &outputState)
 {
-  double timeDiff = toSec(_scanTime - _imuHistory[_imuIdx].stamp) + relTime;
-  while (_imuIdx < _imuHistory.size() - 1 && timeDiff > 0) {
-    _imuIdx++;
-    timeDiff = toSec(_scanTime - _imuHistory[_imuIdx].stamp) + relTime;
-  }
+  // binary search for the first IMU state after the point time (or the latest state)
+  Time pointTime = _scanTime + std::chrono::duration_cast<Time::duration>(std::chrono::duration<float>(relTime));
+  size_t imuIdx = std::min(_imuHistory.upperBound(pointTime), _imuHistory.size() - 1);
+  double timeDiff = toSec(_scanTime - _imuHistory[imuIdx].stamp) + relTime;
 
-  if (_imuIdx == 0 || timeDiff > 0) {
-    outputState = _imuHistory[_imuIdx];
+  if (imuIdx == 0 || timeDiff > 0) {
+    outputState = _imuHistory[imuIdx];
   } else {
-    float ratio = -timeDiff / toSec(_imuHistory[_imuIdx].stamp - _imuHistory[_imuIdx - 1].stamp);
-    IMUState::interpolate(_imuHistory[_imuIdx], _imuHistory[_imuIdx - 1], ratio, outputState);
+    float ratio = -timeDiff / toSec(_imuHistory[imuIdx].stamp - _imuHistory[imuIdx - 1].stamp);
+    IMUState::interpolate(_imuHistory[imuIdx], _imuHistory[imuIdx - 1], ratio, outputState);
   }
 }*/
 
@@ -156,8 +159,12 @@ void BasicScanRegistration::extractFeatures(const uint16_t& beginIdx)
 {
   // extract features from individual scans
   size_t nScans = _scanIndices.size();
+  pcl::VoxelGrid<pcl::PointXYZI> downSizeFilter;
+  downSizeFilter.setLeafSize(_config.lessFlatFilterSize, _config.lessFlatFilterSize, _config.lessFlatFilterSize);
+
   for (size_t i = beginIdx; i < nScans; i++) {
-    pcl::PointCloud<pcl::PointXYZI>::Ptr surfPointsLessFlatScan(new pcl::PointCloud<pcl::PointXYZI>);
+    pcl::PointCloud<pcl::PointXYZI>& surfPointsLessFlatScan = *_surfPointsLessFlatScan;
+    surfPointsLessFlatScan.clear();
     size_t scanStartIdx = _scanIndices[i].first;
     size_t scanEndIdx = _scanIndices[i].second;
 
@@ -239,19 +246,16 @@ void BasicScanRegistration::extractFeatures(const uint16_t& beginIdx)
       // extract less flat surface features
       for (int k = 0; k < regionSize; k++) {
         if (_regionLabel[k] <= SURFACE_LESS_FLAT) {
-          surfPointsLessFlatScan->push_back(_laserCloud[sp + k]);
+          surfPointsLessFlatScan.push_back(_laserCloud[sp + k]);
         }
       }
     }
 
     // down size less flat surface point cloud of current scan
-    pcl::PointCloud<pcl::PointXYZI> surfPointsLessFlatScanDS;
-    pcl::VoxelGrid<pcl::PointXYZI> downSizeFilter;
-    downSizeFilter.setInputCloud(surfPointsLessFlatScan);
-    downSizeFilter.setLeafSize(_config.lessFlatFilterSize, _config.lessFlatFilterSize, _config.lessFlatFilterSize);
-    downSizeFilter.filter(surfPointsLessFlatScanDS);
+    downSizeFilter.setInputCloud(_surfPointsLessFlatScan);
+    downSizeFilter.filter(_surfPointsLessFlatScanDS);
 
-    _surfacePointsLessFlat += surfPointsLessFlatScanDS;
+    _surfacePointsLessFlat += _surfPointsLessFlatScanDS;
   }
 }
 
@@ -291,20 +295,10 @@ void BasicScanRegistration::setRegionBuffersFor(const size_t& startIdx, const si
   _regionLabel.assign(regionSize, SURFACE_LESS_FLAT);
 
   // calculate point curvatures and reset sort indices
-  float pointWeight = -2 * _config.curvatureRegion;
+  simd::kernels().curvature(reinterpret_cast<const float*>(&_laserCloud[startIdx]), regionSize,
+                            _config.curvatureRegion, _regionCurvature.data());
 
   for (size_t i = startIdx, regionIdx = 0; i <= endIdx; i++, regionIdx++) {
-    float diffX = pointWeight * _laserCloud[i].x;
-    float diffY = pointWeight * _laserCloud[i].y;
-    float diffZ = pointWeight * _laserCloud[i].z;
-
-    for (int j = 1; j <= _config.curvatureRegion; j++) {
-      diffX += _laserCloud[i + j].x + _laserCloud[i - j].x;
-      diffY += _laserCloud[i + j].y + _laserCloud[i - j].y;
-      diffZ += _laserCloud[i + j].z + _laserCloud[i - j].z;
-    }
-
-    _regionCurvature[regionIdx] = diffX * diffX + diffY * diffY + diffZ * diffZ;
     _regionSortIndices[regionIdx] = i;
   }
 
@@ -0,0 +1,100 @@
+#include "loam_velodyne/FrameArena.h"
+
+#include <algorithm>
+
+
+namespace loam
+{
+
+FrameArena::FrameArena(const size_t& initialCapacity)
+      : _current(0),
+        _offset(0),
+        _highWater(0),
+        _generation(0)
+{
+  addBlock(initialCapacity);
+}
+
+
+
+void FrameArena::addBlock(const size_t& minSize)
+{
+  // blocks are over-allocated by the maximum alignment, so that any request fitting the size fits
+  Block block;
+  block.size = minSize;
+  block.data.reset(new char[minSize + 64]);
+  _blocks.push_back(std::move(block));
+}
+
+
+
+void* FrameArena::allocate(const size_t& bytes, const size_t& alignment)
+{
+  for (;;)
+  {
+    Block& block = _blocks[_current];
+    uintptr_t base = reinterpret_cast<uintptr_t>(block.data.get());
+    uintptr_t ptr = (base + _offset + alignment - 1) & ~uintptr_t(alignment - 1);
+    size_t end = size_t(ptr - base) + bytes;
+
+    if (end <= block.size + 64)
+    {
+      _offset = end;
+      _highWater = std::max(_highWater, used());
+      return reinterpret_cast<void*>(ptr);
+    }
+
+    // continue in the next block, append one if there is none
+    if (_current + 1 == _blocks.size())
+      addBlock(std::max(bytes, 2 * block.size));
+    _current++;
+    _offset = 0;
+  }
+}
+
+
+
+void FrameArena::reset()
+{
+  // merge the blocks of a frame that did not fit into a single one
+  if (_blocks.size() > 1)
+  {
+    size_t total = capacity();
+    _blocks.clear();
+    addBlock(total);
+  }
+
+  _current = 0;
+  _offset = 0;
+  _generation++;
+}
+
+
+
+void FrameArena::rewind(const Marker& marker)
+{
+  _current = marker.block;
+  _offset = marker.offset;
+}
+
+
+
+size_t FrameArena::used() const
+{
+  size_t bytes = _offset;
+  for (size_t i = 0; i < _current; i++)
+    bytes += _blocks[i].size;
+  return bytes;
+}
+
+
+
+size_t FrameArena::capacity() const
+{
+  size_t bytes = 0;
+  for (const auto& block : _blocks)
+    bytes += block.size;
+  return bytes;
+}
+
+} // end namespace loam
@@ -0,0 +1,270 @@
+#include "loam_velodyne/IncrementalVoxelGrid.h"
+#include "loam_velodyne/morton_utils.h"
+
+#include <algorithm>
+#include <cmath>
+#include <utility>
+
+
+namespace loam
+{
+
+IncrementalVoxelGrid::IncrementalVoxelGrid(const float& leafSize)
+      : _nextStamp(0)
+{
+  setLeafSize(leafSize);
+}
+
+
+
+void IncrementalVoxelGrid::setLeafSize(const float& leafSize)
+{
+  _leafSize = leafSize;
+  _invLeafSize = 1.0f / leafSize;
+
+  // drop the voxel index only, rebuild() re-applies the weights and stamps of the points
+  for (auto& slot : _slots)
+    slot.index = EMPTY_SLOT;
+}
+
+
+
+void IncrementalVoxelGrid::clear()
+{
+  for (auto& slot : _slots)
+    slot.index = EMPTY_SLOT;
+  _counts.clear();
+  _stamps.clear();
+  _nextStamp = 0;
+}
+
+
+
+void IncrementalVoxelGrid::release()
+{
+  std::vector<Slot>().swap(_slots);
+  std::vector<uint32_t>().swap(_counts);
+  std::vector<uint32_t>().swap(_stamps);
+  _nextStamp = 0;
+}
+
+
+
+void IncrementalVoxelGrid::swap(IncrementalVoxelGrid& other)
+{
+  std::swap(_leafSize, other._leafSize);
+  std::swap(_invLeafSize, other._invLeafSize);
+  _slots.swap(other._slots);
+  _counts.swap(other._counts);
+  _stamps.swap(other._stamps);
+  std::swap(_nextStamp, other._nextStamp);
+}
+
+
+
+size_t IncrementalVoxelGrid::findSlot(const int32_t& x, const int32_t& y, const int32_t& z) const
+{
+  const size_t mask = _slots.size() - 1;
+  size_t idx = (uint32_t(x) * 73856093u ^ uint32_t(y) * 19349663u ^ uint32_t(z) * 83492791u) & mask;
+
+  while (_slots[idx].index != EMPTY_SLOT
+         && (_slots[idx].x != x || _slots[idx].y != y || _slots[idx].z != z))
+  {
+    idx = (idx + 1) & mask;
+  }
+
+  return idx;
+}
+
+
+
+void IncrementalVoxelGrid::grow()
+{
+  std::vector<Slot> oldSlots(_slots.empty() ? 64 : _slots.size() * 2, Slot{0, 0, 0, EMPTY_SLOT});
+  oldSlots.swap(_slots);
+
+  for (auto const& slot : oldSlots)
+  {
+    if (slot.index != EMPTY_SLOT)
+      _slots[findSlot(slot.x, slot.y, slot.z)] = slot;
+  }
+}
+
+
+
+void IncrementalVoxelGrid::insert(pcl::PointCloud<pcl::PointXYZI>& cloud, const pcl::PointXYZI& point)
+{
+  if (merge(cloud, point, 1, _nextStamp))
+    _nextStamp++;
+}
+
+
+
+bool IncrementalVoxelGrid::merge(pcl::PointCloud<pcl::PointXYZI>& cloud, const pcl::PointXYZI& point,
+                                 const uint32_t& count, const uint32_t& stamp)
+{
+  // keep the load factor of the hash table below 0.5
+  if (2 * (_counts.size() + 1) > _slots.size())
+    grow();
+
+  const int32_t x = int32_t(std::floor(point.x * _invLeafSize));
+  const int32_t y = int32_t(std::floor(point.y * _invLeafSize));
+  const int32_t z = int32_t(std::floor(point.z * _invLeafSize));
+
+  Slot& slot = _slots[findSlot(x, y, z)];
+  if (slot.index == EMPTY_SLOT)
+  {
+    // first point in this voxel
+    slot = Slot{x, y, z, uint32_t(_counts.size())};
+    _counts.push_back(count);
+    _stamps.push_back(stamp);
+    cloud.push_back(point);
+    return true;
+  }
+
+  // move the voxel centroid towards the new point, the voxel keeps the older stamp
+  _counts[slot.index] += count;
+  float w = float(count) / float(_counts[slot.index]);
+  pcl::PointXYZI& centroid = cloud.points[slot.index];
+  centroid.x += (point.x - centroid.x) * w;
+  centroid.y += (point.y - centroid.y) * w;
+  centroid.z += (point.z - centroid.z) * w;
+  centroid.intensity += (point.intensity - centroid.intensity) * w;
+  _stamps[slot.index] = std::min(_stamps[slot.index], stamp);
+  return false;
+}
+
+
+
+void IncrementalVoxelGrid::rebuild(pcl::PointCloud<pcl::PointXYZI>& cloud)
+{
+  // scratch buffers, the cubes are rebuilt in parallel
+  static thread_local pcl::PointCloud<pcl::PointXYZI> points;
+  static thread_local std::vector<uint32_t> counts, stamps;
+
+  if (_counts.size() == cloud.size() && _stamps.size() == cloud.size())
+  {
+    // the points are still described by the index (e.g. after a leaf size change), keep their weights and age
+    counts.swap(_counts);
+    stamps.swap(_stamps);
+  }
+  else
+  {
+    // unknown cloud, the points count as inserted in cloud order
+    counts.assign(cloud.size(), 1);
+    stamps.resize(cloud.size());
+    for (size_t i = 0; i < cloud.size(); i++)
+      stamps[i] = _nextStamp++;
+  }
+
+  for (auto& slot : _slots)
+    slot.index = EMPTY_SLOT;
+  _counts.clear();
+  _stamps.clear();
+
+  // re-insert all points into the emptied cloud
+  points.swap(cloud);
+  cloud.clear();
+  cloud.reserve(points.size());
+
+  for (size_t i = 0; i < points.size(); i++)
+    merge(cloud, points[i], counts[i], stamps[i]);
+}
+
+
+
+void IncrementalVoxelGrid::remap(pcl::PointCloud<pcl::PointXYZI>& cloud,
+                                 const std::vector<uint32_t>& newIndex,
+                                 const size_t& newSize)
+{
+  // scratch buffers, the cubes are updated in parallel
+  static thread_local pcl::PointCloud<pcl::PointXYZI> points;
+  static thread_local std::vector<uint32_t> counts, stamps;
+  static thread_local std::vector<Slot> oldSlots;
+
+  points.swap(cloud);
+  cloud.points.resize(newSize);
+  cloud.width = newSize;
+  cloud.height = 1;
+
+  counts.resize(newSize);
+  stamps.resize(newSize);
+  for (size_t i = 0; i < newIndex.size(); i++)
+  {
+    if (newIndex[i] == EMPTY_SLOT)
+      continue;
+    cloud.points[newIndex[i]] = points.points[i];
+    counts[newIndex[i]] = _counts[i];
+    stamps[newIndex[i]] = _stamps[i];
+  }
+  _counts.swap(counts);
+  _stamps.swap(stamps);
+
+  // re-insert the remaining voxels into an emptied table of the same size
+  oldSlots.assign(_slots.size(), Slot{0, 0, 0, EMPTY_SLOT});
+  oldSlots.swap(_slots);
+  for (auto const& slot : oldSlots)
+  {
+    if (slot.index != EMPTY_SLOT && newIndex[slot.index] != EMPTY_SLOT)
+      _slots[findSlot(slot.x, slot.y, slot.z)] = Slot{slot.x, slot.y, slot.z, newIndex[slot.index]};
+  }
+}
+
+
+
+void IncrementalVoxelGrid::removeOldest(pcl::PointCloud<pcl::PointXYZI>& cloud, const size_t& n)
+{
+  if (n >= cloud.size())
+  {
+    cloud.clear();
+    clear();
+    return;
+  }
+
+  static thread_local std::vector<uint32_t> stamps, newIndex;
+
+  // stamps are unique, so exactly the points below the n-th smallest stamp are removed
+  stamps.assign(_stamps.begin(), _stamps.end());
+  std::nth_element(stamps.begin(), stamps.begin() + n, stamps.end());
+  const uint32_t minStamp = stamps[n];
+
+  newIndex.resize(_stamps.size());
+  uint32_t next = 0;
+  for (size_t i = 0; i < _stamps.size(); i++)
+    newIndex[i] = _stamps[i] < minStamp ? EMPTY_SLOT : next++;
+
+  remap(cloud, newIndex, next);
+}
+
+
+
+void IncrementalVoxelGrid::sortByMorton(pcl::PointCloud<pcl::PointXYZI>& cloud, const size_t& sortedCount)
+{
+  if (sortedCount >= _counts.size())
+    return;
+
+  // Morton keys of the voxel coordinates, shifted into the positive 21 bit range
+  static thread_local std::vector<std::pair<uint64_t, uint32_t> > keys;
+  static thread_local std::vector<uint32_t> newIndex;
+
+  const int32_t offset = 1 << 20;
+  keys.resize(_counts.size());
+  for (auto const& slot : _slots)
+  {
+    if (slot.index != EMPTY_SLOT)
+      keys[slot.index] = std::make_pair(mortonCode3(uint32_t(slot.x + offset), uint32_t(slot.y + offset),
+                                                   uint32_t(slot.z + offset)), slot.index);
+  }
+
+  // sort the new points and merge them into the already sorted ones
+  std::sort(keys.begin() + sortedCount, keys.end());
+  std::inplace_merge(keys.begin(), keys.begin() + sortedCount, keys.end());
+
+  newIndex.resize(keys.size());
+  for (size_t i = 0; i < keys.size(); i++)
+    newIndex[keys[i].second] = uint32_t(i);
+
+  remap(cloud, newIndex, keys.size());
+}
+
+} // end namespace loam
@@ -32,12 +32,25 @@
 
 #include "loam_velodyne/LaserMapping.h"
 #include "loam_velodyne/common.h"
+#include "loam_velodyne/cloud_utils.h"
 
 namespace loam
 {
 
 LaserMapping::LaserMapping()
+      : _eventDriven(false),
+        _reportedDrops(0),
+        _synchronizer(8),
+        _incrementalMap(false),
+        _mapPublishPeriod(0),
+        _mapKeyFrameInterval(10),
+        _mapUpdatesSinceKeyFrame(0),
+        _mapUpdateSubscribers(0),
+        _mapUpdateSequence(0)
 {
+   // the laser odometry is published for every sweep, the clouds only for every ioRatio-th sweep
+   _synchronizer.setCountedTopics((1u << CORNER_LAST_MSG) | (1u << SURF_LAST_MSG) | (1u << FULL_RES_MSG));
+
    // initialize mapping odometry and odometry tf messages
    _odomAftMapped.header.frame_id = "/camera_init";
    _odomAftMapped.child_frame_id = "/aft_mapped";
@@ -151,23 +164,259 @@ bool LaserMapping::setup(ros::NodeHandle& node, ros::NodeHandle& privateNode)
       }
    }*/
 
+   // fetch laser mapping params
+   float fParam;
+   int iParam;
+   if (privateNode.getParam("maxIterations", iParam))
+   {
+      if (iParam < 1)
+      {
+         ROS_ERROR("Invalid maxIterations parameter: %d (expected > 0)", iParam);
+         return false;
+      }
+      else
+      {
+         setMaxIterations(iParam);
+         ROS_INFO("laserMapping node set maxIterations: %d", iParam);
+      }
+   }
+
+   if (privateNode.getParam("deltaTAbort", fParam))
+   {
+      if (fParam <= 0)
+      {
+         ROS_ERROR("Invalid deltaTAbort parameter: %f (expected > 0)", fParam);
+         return false;
+      }
+      else
+      {
+         setDeltaTAbort(fParam);
+         ROS_INFO("laserMapping node set deltaTAbort: %g", fParam);
+      }
+   }
+
+   if (privateNode.getParam("deltaRAbort", fParam))
+   {
+      if (fParam <= 0)
+      {
+         ROS_ERROR("Invalid deltaRAbort parameter: %f (expected > 0)", fParam);
+         return false;
+      }
+      else
+      {
+         setDeltaRAbort(fParam);
+         ROS_INFO("laserMapping node set deltaRAbort: %g", fParam);
+      }
+   }
+
+   if (privateNode.getParam("correspondenceRefreshDist", fParam))
+   {
+      if (fParam < 0)
+      {
+         ROS_ERROR("Invalid correspondenceRefreshDist parameter: %f (expected >= 0)", fParam);
+         return false;
+      }
+      else
+      {
+         setCorrespondenceRefreshDist(fParam);
+         ROS_INFO("laserMapping node set correspondenceRefreshDist: %g", fParam);
+      }
+   }
+
+   if (privateNode.getParam("maxCubePoints", iParam))
+   {
+      if (iParam < 0)
+      {
+         ROS_ERROR("Invalid maxCubePoints parameter: %d (expected >= 0)", iParam);
+         return false;
+      }
+      else
+      {
+         setMaxCubePoints(iParam);
+         ROS_INFO("laserMapping node set maxCubePoints: %d", iParam);
+      }
+   }
+
+   if (privateNode.getParam("mapMemoryBudget", fParam))
+   {
+      if (fParam < 0)
+      {
+         ROS_ERROR("Invalid mapMemoryBudget parameter: %f (expected >= 0)", fParam);
+         return false;
+      }
+      else
+      {
+         setMapMemoryBudget(size_t(fParam * 1024 * 1024));
+         ROS_INFO("laserMapping node set mapMemoryBudget: %g MB", fParam);
+      }
+   }
+
+   std::string sParam;
+   if (privateNode.getParam("cubeEvictionPolicy", sParam))
+   {
+      if (sParam == "farthest")
+      {
+         setCubeEvictionPolicy(EVICT_FARTHEST);
+      }
+      else if (sParam == "least_recent")
+      {
+         setCubeEvictionPolicy(EVICT_LEAST_RECENT);
+      }
+      else
+      {
+         ROS_ERROR("Invalid cubeEvictionPolicy parameter: %s (expected farthest or least_recent)", sParam.c_str());
+         return false;
+      }
+      ROS_INFO("laserMapping node set cubeEvictionPolicy: %s", sParam.c_str());
+   }
+
+   if (privateNode.getParam("neighborSearch", sParam))
+   {
+      if (sParam == "kdtree")
+      {
+         setNeighborSearchMethod(SEARCH_KDTREE);
+      }
+      else if (sParam == "voxel_hash")
+      {
+         setNeighborSearchMethod(SEARCH_VOXEL_HASH);
+      }
+      else
+      {
+         ROS_ERROR("Invalid neighborSearch parameter: %s (expected kdtree or voxel_hash)", sParam.c_str());
+         return false;
+      }
+      ROS_INFO("laserMapping node set neighborSearch: %s", sParam.c_str());
+   }
+
+   if (privateNode.getParam("mapLoadDirectory", sParam) && !sParam.empty())
+   {
+      int numTiles = loadMap(sParam);
+      if (numTiles < 0)
+      {
+         ROS_ERROR("Invalid mapLoadDirectory parameter: %s (directory not readable)", sParam.c_str());
+         return false;
+      }
+      ROS_INFO("laserMapping node registered %d map tiles from %s", numTiles, sParam.c_str());
+   }
+
+   if (privateNode.getParam("mapSaveDirectory", sParam))
+   {
+      setMapSaveDirectory(sParam);
+      ROS_INFO("laserMapping node set mapSaveDirectory: %s", sParam.c_str());
+   }
+
+   if (privateNode.getParam("mapSaveInterval", iParam))
+   {
+      if (iParam < 1)
+      {
+         ROS_ERROR("Invalid mapSaveInterval parameter: %d (expected > 0)", iParam);
+         return false;
+      }
+      else
+      {
+         setMapSaveInterval(iParam);
+         ROS_INFO("laserMapping node set mapSaveInterval: %d", iParam);
+      }
+   }
+
+   bool bParam;
+   if (privateNode.getParam("asyncMapUpdate", bParam))
+   {
+      setAsyncMapUpdate(bParam);
+      ROS_INFO("laserMapping node set asyncMapUpdate: %s", bParam ? "true" : "false");
+   }
+
+   if (privateNode.getParam("mortonOrderedCubes", bParam))
+   {
+      setMortonOrderedCubes(bParam);
+      ROS_INFO("laserMapping node set mortonOrderedCubes: %s", bParam ? "true" : "false");
+   }
+
+   int queueSize = 5;
+   if (privateNode.getParam("queueSize", iParam))
+   {
+      if (iParam < 1)
+      {
+         ROS_ERROR("Invalid queueSize parameter: %d (expected > 0)", iParam);
+         return false;
+      }
+      else
+      {
+         queueSize = iParam;
+         ROS_INFO("laserMapping node set queueSize: %d", iParam);
+      }
+   }
+
+   if (privateNode.getParam("maxPendingSweeps", iParam))
+   {
+      if (iParam < 1)
+      {
+         ROS_ERROR("Invalid maxPendingSweeps parameter: %d (expected > 0)", iParam);
+         return false;
+      }
+      else
+      {
+         _synchronizer.setMaxPending(iParam);
+         ROS_INFO("laserMapping node set maxPendingSweeps: %d", iParam);
+      }
+   }
+
+   if (privateNode.getParam("eventDriven", bParam))
+   {
+      _eventDriven = bParam;
+      ROS_INFO("laserMapping node set eventDriven: %s", bParam ? "true" : "false");
+   }
+
+   if (privateNode.getParam("incrementalMap", bParam))
+   {
+      _incrementalMap = bParam;
+      ROS_INFO("laserMapping node set incrementalMap: %s", bParam ? "true" : "false");
+   }
+
+   if (privateNode.getParam("mapPublishRate", fParam))
+   {
+      if (fParam < 0)
+      {
+         ROS_ERROR("Invalid mapPublishRate parameter: %f (expected >= 0)", fParam);
+         return false;
+      }
+      else
+      {
+         _mapPublishPeriod = ros::Duration(fParam > 0 ? 1.0 / fParam : 0.0);
+         ROS_INFO("laserMapping node set mapPublishRate: %g", fParam);
+      }
+   }
+
+   if (privateNode.getParam("mapKeyFrameInterval", iParam))
+   {
+      if (iParam < 0)
+      {
+         ROS_ERROR("Invalid mapKeyFrameInterval parameter: %d (expected >= 0)", iParam);
+         return false;
+      }
+      else
+      {
+         _mapKeyFrameInterval = iParam;
+         ROS_INFO("laserMapping node set mapKeyFrameInterval: %d", iParam);
+      }
+   }
+
    // advertise laser mapping topics
-   _pubLaserCloudSurround = node.advertise<sensor_msgs::PointCloud2>("/laser_cloud_surround", 1);
-   _pubLaserCloudFullRes  = node.advertise<sensor_msgs::PointCloud2>("/velodyne_cloud_registered", 2);
+   _pubLaserCloudSurround.advertise(node, "/laser_cloud_surround", 1);
+   _pubMapCubeUpdate      = node.advertise<loam_velodyne::MapCubeUpdate>("/laser_cloud_map_updates", 5);
+   _pubLaserCloudFullRes.advertise(node, "/velodyne_cloud_registered", 2);
    _pubOdomAftMapped      = node.advertise<nav_msgs::Odometry>("/aft_mapped_to_init", 5);
 
-   // subscribe to laser odometry topics
-   _subLaserCloudCornerLast = node.subscribe<sensor_msgs::PointCloud2>
-      ("/laser_cloud_corner_last", 2, &LaserMapping::laserCloudCornerLastHandler, this);
+   // subscribe to laser odometry topics, the cloud handlers take non-const messages, so roscpp hands the
+   // received clouds over for adoptFinitePoints() (copying them only if shared by several subscriptions)
+   _subLaserCloudCornerLast = node.subscribe("/laser_cloud_corner_last", queueSize, &LaserMapping::laserCloudCornerLastHandler, this);
 
-   _subLaserCloudSurfLast = node.subscribe<sensor_msgs::PointCloud2>
-      ("/laser_cloud_surf_last", 2, &LaserMapping::laserCloudSurfLastHandler, this);
+   _subLaserCloudSurfLast = node.subscribe("/laser_cloud_surf_last", queueSize, &LaserMapping::laserCloudSurfLastHandler, this);
 
    _subLaserOdometry = node.subscribe<nav_msgs::Odometry>
-      ("/laser_odom_to_init", 5, &LaserMapping::laserOdometryHandler, this);
+      ("/laser_odom_to_init", queueSize, &LaserMapping::laserOdometryHandler, this);
 
-   _subLaserCloudFullRes = node.subscribe<sensor_msgs::PointCloud2>
-      ("/velodyne_cloud_3", 2, &LaserMapping::laserCloudFullResHandler, this);
+   _subLaserCloudFullRes = node.subscribe("/velodyne_cloud_3", queueSize, &LaserMapping::laserCloudFullResHandler, this);
 
    // subscribe to IMU topic
    _subImu = node.subscribe<sensor_msgs::Imu>("/imu/data", 50, &LaserMapping::imuHandler, this);
@@ -177,44 +426,28 @@ bool LaserMapping::setup(ros::NodeHandle& node, ros::NodeHandle& privateNode)
 
 
 
-void LaserMapping::laserCloudCornerLastHandler(const sensor_msgs::PointCloud2ConstPtr& cornerPointsLastMsg)
+void LaserMapping::laserCloudCornerLastHandler(const pcl::PointCloud<pcl::PointXYZI>::Ptr& cornerPointsLastMsg)
 {
-   _timeLaserCloudCornerLast = cornerPointsLastMsg->header.stamp;
-   laserCloudCornerLast().clear();
-   pcl::fromROSMsg(*cornerPointsLastMsg, laserCloudCornerLast());
-   _newLaserCloudCornerLast = true;
+   _synchronizer.add<CORNER_LAST_MSG>(cloudStamp(*cornerPointsLastMsg).toNSec(), cornerPointsLastMsg);
+   processIfEventDriven();
 }
 
-void LaserMapping::laserCloudSurfLastHandler(const sensor_msgs::PointCloud2ConstPtr& surfacePointsLastMsg)
+void LaserMapping::laserCloudSurfLastHandler(const pcl::PointCloud<pcl::PointXYZI>::Ptr& surfacePointsLastMsg)
 {
-   _timeLaserCloudSurfLast = surfacePointsLastMsg->header.stamp;
-   laserCloudSurfLast().clear();
-   pcl::fromROSMsg(*surfacePointsLastMsg, laserCloudSurfLast());
-   _newLaserCloudSurfLast = true;
+   _synchronizer.add<SURF_LAST_MSG>(cloudStamp(*surfacePointsLastMsg).toNSec(), surfacePointsLastMsg);
+   processIfEventDriven();
 }
 
-void LaserMapping::laserCloudFullResHandler(const sensor_msgs::PointCloud2ConstPtr& laserCloudFullResMsg)
+void LaserMapping::laserCloudFullResHandler(const pcl::PointCloud<pcl::PointXYZI>::Ptr& laserCloudFullResMsg)
 {
-   _timeLaserCloudFullRes = laserCloudFullResMsg->header.stamp;
-   laserCloud().clear();
-   pcl::fromROSMsg(*laserCloudFullResMsg, laserCloud());
-   _newLaserCloudFullRes = true;
+   _synchronizer.add<FULL_RES_MSG>(cloudStamp(*laserCloudFullResMsg).toNSec(), laserCloudFullResMsg);
+   processIfEventDriven();
 }
 
 void LaserMapping::laserOdometryHandler(const nav_msgs::Odometry::ConstPtr& laserOdometry)
 {
-   _timeLaserOdometry = laserOdometry->header.stamp;
-
-   double roll, pitch, yaw;
-   geometry_msgs::Quaternion geoQuat = laserOdometry->pose.pose.orientation;
-   tf::Matrix3x3(tf::Quaternion(geoQuat.z, -geoQuat.x, -geoQuat.y, geoQuat.w)).getRPY(roll, pitch, yaw);
-   ROS_INFO("LaserMapping node update Odometry data!Data time is [%u.%09u]",_timeLaserOdometry.sec,_timeLaserOdometry.nsec);
-   updateOdometry(-pitch, -yaw, roll,
-                  laserOdometry->pose.pose.position.x,
-                  laserOdometry->pose.pose.position.y,
-                  laserOdometry->pose.pose.position.z);
-
-   _newLaserOdometry = true;
+   _synchronizer.add<ODOMETRY_MSG>(laserOdometry->header.stamp.toNSec(), laserOdometry);
+   processIfEventDriven();
 }
 
 void LaserMapping::imuHandler(const sensor_msgs::Imu::ConstPtr& imuIn)
@@ -228,6 +461,13 @@ void LaserMapping::imuHandler(const sensor_msgs::Imu::ConstPtr& imuIn)
 
 void LaserMapping::spin()
 {
+   if (_eventDriven)
+   {
+      // the message handlers process each complete set of messages right away
+      ros::spin();
+      return;
+   }
+
    ros::Rate rate(100);
    bool status = ros::ok();
 
@@ -243,58 +483,70 @@ void LaserMapping::spin()
    }
 }
 
-void LaserMapping::reset()
+void LaserMapping::shutdown()
 {
-   _newLaserCloudCornerLast = false;
-   _newLaserCloudSurfLast = false;
-   _newLaserCloudFullRes = false;
-   _newLaserOdometry = false;
+   // write the cubes modified since the last periodic save
+   if (!mapSaveDirectory().empty() && !saveMap())
+      ROS_ERROR("laserMapping node failed to save the map to %s", mapSaveDirectory().c_str());
 }
 
-bool LaserMapping::hasNewData()
+void LaserMapping::processIfEventDriven()
 {
-   return _newLaserCloudCornerLast && _newLaserCloudSurfLast &&
-      _newLaserCloudFullRes && _newLaserOdometry &&
-      fabs((_timeLaserCloudCornerLast - _timeLaserOdometry).toSec()) < 0.005 &&
-      fabs((_timeLaserCloudSurfLast - _timeLaserOdometry).toSec()) < 0.005 &&
-      fabs((_timeLaserCloudFullRes - _timeLaserOdometry).toSec()) < 0.005;
+   // the last message of a complete, time matched set triggers the processing
+   if (_eventDriven)
+      process();
 }
 
 void LaserMapping::process()
 {
-   if (!hasNewData())// waiting for new data to arrive...
-      return;
-
-   reset();// reset flags, etc.
-   ROS_INFO("LaserMapping node Start to process data from laserOdometry!Data time is [%u.%09u]",_timeLaserOdometry.sec,_timeLaserOdometry.nsec);
-   //由于mapping过程计算量大，程序会堵塞在此处直到完成mapping，在此期间，由于无法执行ros::spinOnce()，
-   //也就无法调用回调函数，即_laserCloudCornerLast、_laserCloudSurfLast、
-   //_laserCloudFullRes以及_transformSum变量是无法更新的
-   if (!BasicLaserMapping::process(fromROSTime(_timeLaserOdometry)))
+   // process all complete sweeps in stamp order, the synchronizer matches the messages of a sweep by
+   // their stamp and buffers the incomplete sweeps
+   uint64_t stamp;
+   SweepMessages msgs;
+   while (_synchronizer.pop(stamp, msgs))
    {
-      ROS_INFO("LaserMapping node didn't complete a mapping!");
-      return;
+      _timeLaserOdometry.fromNSec(stamp);
+
+      // take over the received points instead of copying them
+      adoptFinitePoints(*std::get<CORNER_LAST_MSG>(msgs), laserCloudCornerLast());
+      adoptFinitePoints(*std::get<SURF_LAST_MSG>(msgs), laserCloudSurfLast());
+      adoptFinitePoints(*std::get<FULL_RES_MSG>(msgs), laserCloud());
+
+      const nav_msgs::Odometry& laserOdometry = *std::get<ODOMETRY_MSG>(msgs);
+      double roll, pitch, yaw;
+      geometry_msgs::Quaternion geoQuat = laserOdometry.pose.pose.orientation;
+      tf::Matrix3x3(tf::Quaternion(geoQuat.z, -geoQuat.x, -geoQuat.y, geoQuat.w)).getRPY(roll, pitch, yaw);
+      updateOdometry(-pitch, -yaw, roll,
+                     laserOdometry.pose.pose.position.x,
+                     laserOdometry.pose.pose.position.y,
+                     laserOdometry.pose.pose.position.z);
+
+      ROS_INFO("LaserMapping node Start to process data from laserOdometry!Data time is [%u.%09u]",_timeLaserOdometry.sec,_timeLaserOdometry.nsec);
+      //由于mapping过程计算量大，程序会堵塞在此处直到完成mapping，在此期间，由于无法执行ros::spinOnce()，
+      //也就无法调用回调函数，新到达的消息在订阅队列中等待，之后由_synchronizer按时间戳组合
+      if (!BasicLaserMapping::process(fromROSTime(_timeLaserOdometry)))
+      {
+         ROS_INFO("LaserMapping node didn't complete a mapping!");
+         continue;
+      }
+      else
+      {
+         ROS_INFO("LaserMapping node complete a mapping!");
+      }
+
+      publishResult();
    }
-   else
+
+   if (_synchronizer.dropped() > _reportedDrops)
    {
-      ROS_INFO("LaserMapping node complete a mapping!");
+      ROS_WARN("LaserMapping node dropped %zu incomplete sweeps (%zu in total)",
+               _synchronizer.dropped() - _reportedDrops, _synchronizer.dropped());
+      _reportedDrops = _synchronizer.dropped();
    }
-
-   publishResult();
 }
 
 void LaserMapping::publishResult()
 {
-   // publish new map cloud according to the input output ratio
-   if (hasFreshMap()) // publish new map cloud，发布submap中的点云数据，间隔4次发布1次
-   {
-      publishCloudMsg(_pubLaserCloudSurround, laserCloudSurroundDS(), _timeLaserOdometry, "/camera_init");
-      ROS_INFO("LaserMapping node publish topic 'laserCloudSurroundDS'!");
-   }
-   ROS_INFO("LaserMapping node publish topic 'laserCloud' and '_odomAftMapped'!");
-   // publish transformed full resolution input cloud，发布所有点云数据
-   publishCloudMsg(_pubLaserCloudFullRes, laserCloud(), _timeLaserOdometry, "/camera_init");
-
    // publish odometry after mapped transformations，发布优化过的位姿变换
    geometry_msgs::Quaternion geoQuat = tf::createQuaternionMsgFromRollPitchYaw
    (transformAftMapped().rot_z.rad(), -transformAftMapped().rot_x.rad(), -transformAftMapped().rot_y.rad());
@@ -323,6 +575,61 @@ void LaserMapping::publishResult()
                                          transformAftMapped().pos.y(),
                                          transformAftMapped().pos.z()));
    _tfBroadcaster.sendTransform(_aftMappedTrans);
+
+   // publish new map cloud according to the input output ratio and the map publish rate
+   if (hasFreshMap() && (_timeLaserOdometry >= _lastMapPublish + _mapPublishPeriod || _timeLaserOdometry < _lastMapPublish))
+   {
+      if (_incrementalMap)
+      {
+         publishMapUpdate();
+         ROS_INFO("LaserMapping node publish topic 'laser_cloud_map_updates'!");
+      }
+      else
+      {
+         publishCloudMsg(_pubLaserCloudSurround, laserCloudSurroundDS(), _timeLaserOdometry, "/camera_init");//发布submap中的点云数据，间隔4次发布1次
+         ROS_INFO("LaserMapping node publish topic 'laserCloudSurroundDS'!");
+      }
+      _lastMapPublish = _timeLaserOdometry;
+   }
+   ROS_INFO("LaserMapping node publish topic 'laserCloud' and '_odomAftMapped'!");
+   // publish transformed full resolution input cloud，发布所有点云数据
+   publishCloudMsg(_pubLaserCloudFullRes, laserCloud(), _timeLaserOdometry, "/camera_init");
+}
+
+void LaserMapping::publishMapUpdate()
+{
+   // stop collecting while nobody listens, a new subscriber gets a key frame
+   size_t subscribers = _pubMapCubeUpdate.getNumSubscribers();
+   bool keyFrame = subscribers > _mapUpdateSubscribers
+                   || (_mapKeyFrameInterval > 0 && _mapUpdatesSinceKeyFrame + 1 >= _mapKeyFrameInterval);
+   if (subscribers == 0 && _mapUpdateSubscribers > 0)
+      discardCollectedCubes();
+   _mapUpdateSubscribers = subscribers;
+   if (subscribers == 0)
+      return;
+
+   // a requested key frame may only be returned with a later call, an empty key frame is still sent
+   keyFrame = collectModifiedCubes(_modifiedCubes, keyFrame);
+   if (_modifiedCubes.empty() && !keyFrame)
+      return;
+   _mapUpdatesSinceKeyFrame = keyFrame ? 0 : _mapUpdatesSinceKeyFrame + 1;
+
+   // the quantized points are swapped into the message
+   loam_velodyne::MapCubeUpdatePtr msg(new loam_velodyne::MapCubeUpdate());
+   msg->header.stamp = _timeLaserOdometry;
+   msg->header.frame_id = "/camera_init";
+   msg->sequence = _mapUpdateSequence++;
+   msg->keyFrame = keyFrame;
+   msg->cubeSize = cubeSize();
+   msg->cubes.resize(_modifiedCubes.size());
+   for (size_t i = 0; i < _modifiedCubes.size(); i++)
+   {
+      msg->cubes[i].x = _modifiedCubes[i].cubeX;
+      msg->cubes[i].y = _modifiedCubes[i].cubeY;
+      msg->cubes[i].z = _modifiedCubes[i].cubeZ;
+      msg->cubes[i].points.swap(_modifiedCubes[i].points);
+   }
+   _pubMapCubeUpdate.publish(msg);
 }
 
 } // end namespace loam
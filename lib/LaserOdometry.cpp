@@ -30,10 +30,9 @@
 //   J. Zhang and S. Singh. LOAM: Lidar Odometry and Mapping in Real-time.
 //     Robotics: Science and Systems Conference (RSS). Berkeley, CA, July 2014.
 
-#include <pcl/filters/filter.h>
-
 #include "loam_velodyne/LaserOdometry.h"
 #include "loam_velodyne/common.h"
+#include "loam_velodyne/cloud_utils.h"
 #include "loam_velodyne/math_utils.h"
 
 namespace loam
@@ -50,7 +49,9 @@ namespace loam
 
   LaserOdometry::LaserOdometry(float scanPeriod, uint16_t ioRatio, size_t maxIterations):
     BasicLaserOdometry(scanPeriod, maxIterations),
-    _ioRatio(ioRatio)
+    _ioRatio(ioRatio),
+    _eventDriven(false),
+    _reportedDrops(0)
   {
     // initialize odometry and odometry tf messages
     _laserOdometryMsg.header.frame_id = "/camera_init";
@@ -137,122 +138,141 @@ namespace loam
       }
     }*/
 
+    std::string sParam;
+    if (privateNode.getParam("neighborSearch", sParam))
+    {
+      if (sParam == "kdtree")
+      {
+        setNeighborSearchMethod(SEARCH_KDTREE);
+      }
+      else if (sParam == "voxel_hash")
+      {
+        setNeighborSearchMethod(SEARCH_VOXEL_HASH);
+      }
+      else
+      {
+        ROS_ERROR("Invalid neighborSearch parameter: %s (expected kdtree or voxel_hash)", sParam.c_str());
+        return false;
+      }
+      ROS_INFO("laserOdometry node set neighborSearch: %s", sParam.c_str());
+    }
+
+    bool bParam;
+    if (privateNode.getParam("eventDriven", bParam))
+    {
+      _eventDriven = bParam;
+      ROS_INFO("laserOdometry node set eventDriven: %s", bParam ? "true" : "false");
+    }
+
+    int queueSize = 5;
+    if (privateNode.getParam("queueSize", iParam))
+    {
+      if (iParam < 1)
+      {
+        ROS_ERROR("Invalid queueSize parameter: %d (expected > 0)", iParam);
+        return false;
+      }
+      else
+      {
+        queueSize = iParam;
+        ROS_INFO("laserOdometry node set queueSize: %d", iParam);
+      }
+    }
+
+    if (privateNode.getParam("maxPendingSweeps", iParam))
+    {
+      if (iParam < 1)
+      {
+        ROS_ERROR("Invalid maxPendingSweeps parameter: %d (expected > 0)", iParam);
+        return false;
+      }
+      else
+      {
+        _synchronizer.setMaxPending(iParam);
+        ROS_INFO("laserOdometry node set maxPendingSweeps: %d", iParam);
+      }
+    }
+
     // advertise laser odometry topics
-    _pubLaserCloudCornerLast = node.advertise<sensor_msgs::PointCloud2>("/laser_cloud_corner_last", 2);
-    _pubLaserCloudSurfLast = node.advertise<sensor_msgs::PointCloud2>("/laser_cloud_surf_last", 2);
-    _pubLaserCloudFullRes = node.advertise<sensor_msgs::PointCloud2>("/velodyne_cloud_3", 2);
+    _pubLaserCloudCornerLast.advertise(node, "/laser_cloud_corner_last", 2);
+    _pubLaserCloudSurfLast.advertise(node, "/laser_cloud_surf_last", 2);
+    _pubLaserCloudFullRes.advertise(node, "/velodyne_cloud_3", 2);
     _pubLaserOdometry = node.advertise<nav_msgs::Odometry>("/laser_odom_to_init", 5);
 
-    // subscribe to scan registration topics
-    _subCornerPointsSharp = node.subscribe<sensor_msgs::PointCloud2>
-      ("/laser_cloud_sharp", 2, &LaserOdometry::laserCloudSharpHandler, this);
+    // subscribe to scan registration topics, the cloud handlers take non-const messages, so roscpp hands
+    // the received clouds over for adoptFinitePoints() (copying them only if shared by several subscriptions)
+    _subCornerPointsSharp = node.subscribe("/laser_cloud_sharp", queueSize, &LaserOdometry::laserCloudSharpHandler, this);
 
-    _subCornerPointsLessSharp = node.subscribe<sensor_msgs::PointCloud2>
-      ("/laser_cloud_less_sharp", 2, &LaserOdometry::laserCloudLessSharpHandler, this);
+    _subCornerPointsLessSharp = node.subscribe("/laser_cloud_less_sharp", queueSize, &LaserOdometry::laserCloudLessSharpHandler, this);
 
-    _subSurfPointsFlat = node.subscribe<sensor_msgs::PointCloud2>
-      ("/laser_cloud_flat", 2, &LaserOdometry::laserCloudFlatHandler, this);
+    _subSurfPointsFlat = node.subscribe("/laser_cloud_flat", queueSize, &LaserOdometry::laserCloudFlatHandler, this);
 
-    _subSurfPointsLessFlat = node.subscribe<sensor_msgs::PointCloud2>
-      ("/laser_cloud_less_flat", 2, &LaserOdometry::laserCloudLessFlatHandler, this);
+    _subSurfPointsLessFlat = node.subscribe("/laser_cloud_less_flat", queueSize, &LaserOdometry::laserCloudLessFlatHandler, this);
 
-    _subLaserCloudFullRes = node.subscribe<sensor_msgs::PointCloud2>
-      ("/velodyne_cloud_2", 2, &LaserOdometry::laserCloudFullResHandler, this);
+    _subLaserCloudFullRes = node.subscribe("/velodyne_cloud_2", queueSize, &LaserOdometry::laserCloudFullResHandler, this);
 
-    _subImuTrans = node.subscribe<sensor_msgs::PointCloud2>
-      ("/imu_trans", 5, &LaserOdometry::imuTransHandler, this);
+    _subImuTrans = node.subscribe<pcl::PointCloud<pcl::PointXYZ> >
+      ("/imu_trans", queueSize, &LaserOdometry::imuTransHandler, this);
 
     return true;
   }
 
-  void LaserOdometry::reset()
+  void LaserOdometry::laserCloudSharpHandler(const pcl::PointCloud<pcl::PointXYZI>::Ptr& cornerPointsSharpMsg)
   {
-    _newCornerPointsSharp = false;
-    _newCornerPointsLessSharp = false;
-    _newSurfPointsFlat = false;
-    _newSurfPointsLessFlat = false;
-    _newLaserCloudFullRes = false;
-    _newImuTrans = false;
+    _synchronizer.add<CORNER_SHARP_MSG>(cloudStamp(*cornerPointsSharpMsg).toNSec(), cornerPointsSharpMsg);
+    processIfEventDriven();
   }
 
-  void LaserOdometry::laserCloudSharpHandler(const sensor_msgs::PointCloud2ConstPtr& cornerPointsSharpMsg)
-  {
-    _timeCornerPointsSharp = cornerPointsSharpMsg->header.stamp;
-
-    cornerPointsSharp()->clear();
-    pcl::fromROSMsg(*cornerPointsSharpMsg, *cornerPointsSharp());
-    std::vector<int> indices;
-    pcl::removeNaNFromPointCloud(*cornerPointsSharp(), *cornerPointsSharp(), indices);
-    _newCornerPointsSharp = true;
-  }
 
 
-
-  void LaserOdometry::laserCloudLessSharpHandler(const sensor_msgs::PointCloud2ConstPtr& cornerPointsLessSharpMsg)
+  void LaserOdometry::laserCloudLessSharpHandler(const pcl::PointCloud<pcl::PointXYZI>::Ptr& cornerPointsLessSharpMsg)
   {
-    _timeCornerPointsLessSharp = cornerPointsLessSharpMsg->header.stamp;
-
-    cornerPointsLessSharp()->clear();
-    pcl::fromROSMsg(*cornerPointsLessSharpMsg, *cornerPointsLessSharp());
-    std::vector<int> indices;
-    pcl::removeNaNFromPointCloud(*cornerPointsLessSharp(), *cornerPointsLessSharp(), indices);
-    _newCornerPointsLessSharp = true;
+    _synchronizer.add<CORNER_LESS_SHARP_MSG>(cloudStamp(*cornerPointsLessSharpMsg).toNSec(), cornerPointsLessSharpMsg);
+    processIfEventDriven();
   }
 
 
 
-  void LaserOdometry::laserCloudFlatHandler(const sensor_msgs::PointCloud2ConstPtr& surfPointsFlatMsg)
+  void LaserOdometry::laserCloudFlatHandler(const pcl::PointCloud<pcl::PointXYZI>::Ptr& surfPointsFlatMsg)
   {
-    _timeSurfPointsFlat = surfPointsFlatMsg->header.stamp;
-
-    surfPointsFlat()->clear();
-    pcl::fromROSMsg(*surfPointsFlatMsg, *surfPointsFlat());
-    std::vector<int> indices;
-    pcl::removeNaNFromPointCloud(*surfPointsFlat(), *surfPointsFlat(), indices);
-    _newSurfPointsFlat = true;
+    _synchronizer.add<SURF_FLAT_MSG>(cloudStamp(*surfPointsFlatMsg).toNSec(), surfPointsFlatMsg);
+    processIfEventDriven();
   }
 
 
 
-  void LaserOdometry::laserCloudLessFlatHandler(const sensor_msgs::PointCloud2ConstPtr& surfPointsLessFlatMsg)
+  void LaserOdometry::laserCloudLessFlatHandler(const pcl::PointCloud<pcl::PointXYZI>::Ptr& surfPointsLessFlatMsg)
   {
-    _timeSurfPointsLessFlat = surfPointsLessFlatMsg->header.stamp;
-
-    surfPointsLessFlat()->clear();
-    pcl::fromROSMsg(*surfPointsLessFlatMsg, *surfPointsLessFlat());
-    std::vector<int> indices;
-    pcl::removeNaNFromPointCloud(*surfPointsLessFlat(), *surfPointsLessFlat(), indices);
-    _newSurfPointsLessFlat = true;
+    _synchronizer.add<SURF_LESS_FLAT_MSG>(cloudStamp(*surfPointsLessFlatMsg).toNSec(), surfPointsLessFlatMsg);
+    processIfEventDriven();
   }
 
 
 
-  void LaserOdometry::laserCloudFullResHandler(const sensor_msgs::PointCloud2ConstPtr& laserCloudFullResMsg)
+  void LaserOdometry::laserCloudFullResHandler(const pcl::PointCloud<pcl::PointXYZI>::Ptr& laserCloudFullResMsg)
   {
-    _timeLaserCloudFullRes = laserCloudFullResMsg->header.stamp;
-
-    laserCloud()->clear();
-    pcl::fromROSMsg(*laserCloudFullResMsg, *laserCloud());
-    std::vector<int> indices;
-    pcl::removeNaNFromPointCloud(*laserCloud(), *laserCloud(), indices);
-    _newLaserCloudFullRes = true;
+    _synchronizer.add<FULL_RES_MSG>(cloudStamp(*laserCloudFullResMsg).toNSec(), laserCloudFullResMsg);
+    processIfEventDriven();
   }
 
 
 
-  void LaserOdometry::imuTransHandler(const sensor_msgs::PointCloud2ConstPtr& imuTransMsg)
+  void LaserOdometry::imuTransHandler(const pcl::PointCloud<pcl::PointXYZ>::ConstPtr& imuTransMsg)
   {
-    _timeImuTrans = imuTransMsg->header.stamp;
-
-    pcl::PointCloud<pcl::PointXYZ> imuTrans;
-    pcl::fromROSMsg(*imuTransMsg, imuTrans);
-    updateIMU(imuTrans);
-    _newImuTrans = true;
+    _synchronizer.add<IMU_TRANS_MSG>(cloudStamp(*imuTransMsg).toNSec(), imuTransMsg);
+    processIfEventDriven();
   }
 
 
   void LaserOdometry::spin()
   {
+    if (_eventDriven)
+    {
+      // the message handlers process each complete set of messages right away
+      ros::spin();
+      return;
+    }
+
     ros::Rate rate(100);
     bool status = ros::ok();
 
@@ -269,29 +289,42 @@ namespace loam
     }
   }
 
-//判断是否收到了上一个节点所发的所有topic，并判断topic的时间戳确保信息同步
-  bool LaserOdometry::hasNewData()
+  void LaserOdometry::processIfEventDriven()
   {
-    return _newCornerPointsSharp && _newCornerPointsLessSharp && _newSurfPointsFlat &&
-      _newSurfPointsLessFlat && _newLaserCloudFullRes && _newImuTrans &&
-      fabs((_timeCornerPointsSharp - _timeSurfPointsLessFlat).toSec()) < 0.005 &&
-      fabs((_timeCornerPointsLessSharp - _timeSurfPointsLessFlat).toSec()) < 0.005 &&
-      fabs((_timeSurfPointsFlat - _timeSurfPointsLessFlat).toSec()) < 0.005 &&
-      fabs((_timeLaserCloudFullRes - _timeSurfPointsLessFlat).toSec()) < 0.005 &&
-      fabs((_timeImuTrans - _timeSurfPointsLessFlat).toSec()) < 0.005;
+    // the last message of a complete, time matched set triggers the processing
+    if (_eventDriven)
+      process();
   }
 
-
-
   void LaserOdometry::process()
   {
-    if (!hasNewData())//等待获取数据，根据LaserOdometry::spin()中的设定，process()执行频率为100Hz
-      return;// waiting for new data to arrive...
+    // process all complete sweeps in stamp order, the synchronizer matches the messages of a sweep by
+    // their stamp and buffers the incomplete sweeps
+    uint64_t stamp;
+    SweepMessages msgs;
+    while (_synchronizer.pop(stamp, msgs))
+    {
+      _timeSweep.fromNSec(stamp);
+
+      // take over the received points instead of copying them
+      adoptFinitePoints(*std::get<CORNER_SHARP_MSG>(msgs), *cornerPointsSharp());
+      adoptFinitePoints(*std::get<CORNER_LESS_SHARP_MSG>(msgs), *cornerPointsLessSharp());
+      adoptFinitePoints(*std::get<SURF_FLAT_MSG>(msgs), *surfPointsFlat());
+      adoptFinitePoints(*std::get<SURF_LESS_FLAT_MSG>(msgs), *surfPointsLessFlat());
+      adoptFinitePoints(*std::get<FULL_RES_MSG>(msgs), *laserCloud());
+      updateIMU(*std::get<IMU_TRANS_MSG>(msgs));
+
+      BasicLaserOdometry::process();
+      publishResult();
+      ROS_INFO("LaserOdometry node complete a motion estimation!");
+    }
 
-    reset();// reset flags, etc.
-    BasicLaserOdometry::process();
-    publishResult();
-    ROS_INFO("LaserOdometry node complete a motion estimation!");
+    if (_synchronizer.dropped() > _reportedDrops)
+    {
+      ROS_WARN("LaserOdometry node dropped %zu incomplete sweeps (%zu in total)",
+               _synchronizer.dropped() - _reportedDrops, _synchronizer.dropped());
+      _reportedDrops = _synchronizer.dropped();
+    }
   }
 
 
@@ -302,7 +335,7 @@ namespace loam
                                                                                -transformSum().rot_x.rad(),
                                                                                -transformSum().rot_y.rad());
 
-    _laserOdometryMsg.header.stamp            = _timeSurfPointsLessFlat;
+    _laserOdometryMsg.header.stamp            = _timeSweep;
     _laserOdometryMsg.pose.pose.orientation.x = -geoQuat.y;
     _laserOdometryMsg.pose.pose.orientation.y = -geoQuat.z;
     _laserOdometryMsg.pose.pose.orientation.z = geoQuat.x;
@@ -312,7 +345,7 @@ namespace loam
     _laserOdometryMsg.pose.pose.position.z    = transformSum().pos.z();
     _pubLaserOdometry.publish(_laserOdometryMsg);//发布全局位姿变换数据的话题
 
-    _laserOdometryTrans.stamp_ = _timeSurfPointsLessFlat;
+    _laserOdometryTrans.stamp_ = _timeSweep;
     _laserOdometryTrans.setRotation(tf::Quaternion(-geoQuat.y, -geoQuat.z, geoQuat.x, geoQuat.w));
     _laserOdometryTrans.setOrigin(tf::Vector3(transformSum().pos.x(), transformSum().pos.y(), transformSum().pos.z()));
     _tfBroadcaster.sendTransform(_laserOdometryTrans);
@@ -320,7 +353,7 @@ namespace loam
     // publish cloud results according to the input output ratio
     if (_ioRatio < 2 || frameCount() % _ioRatio == 1)
     {
-      ros::Time sweepTime = _timeSurfPointsLessFlat;
+      ros::Time sweepTime = _timeSweep;
       //之所以publish lastCornerCloud/lastSurfaceCloud
       //是因为在BasicLaserOdometry::process()中已经将当前帧的特征点与上一帧的特征点进行了交换，为下一次的运动估计做准备
       //这里的lastCornerCloud/lastSurfaceCloud并不是当前点云帧的特征点，而是曲率相对较小的edge point或曲率相对较大的planar point
@@ -0,0 +1,58 @@
+#include "loam_velodyne/MapCubeCodec.h"
+
+#include <cmath>
+
+
+namespace loam
+{
+
+static inline int16_t quantize(const float& offset, const float& scale)
+{
+  long q = std::lround(offset * scale);
+  return int16_t(q < -32768 ? -32768 : (q > 32767 ? 32767 : q));
+}
+
+
+
+void quantizeMapCube(const pcl::PointCloud<pcl::PointXYZI>& cloud, const float& cubeSize, QuantizedMapCube& cube)
+{
+  const float scale = 65536.0f / cubeSize;
+  const float originX = cube.cubeX * cubeSize;
+  const float originY = cube.cubeY * cubeSize;
+  const float originZ = cube.cubeZ * cubeSize;
+
+  cube.points.resize(3 * cloud.size());
+  int16_t* q = cube.points.data();
+  for (auto const& p : cloud)
+  {
+    *q++ = quantize(p.x - originX, scale);
+    *q++ = quantize(p.y - originY, scale);
+    *q++ = quantize(p.z - originZ, scale);
+  }
+}
+
+
+
+void dequantizeMapCube(const QuantizedMapCube& cube, const float& cubeSize, pcl::PointCloud<pcl::PointXYZI>& cloud)
+{
+  const float scale = cubeSize / 65536.0f;
+  const float originX = cube.cubeX * cubeSize;
+  const float originY = cube.cubeY * cubeSize;
+  const float originZ = cube.cubeZ * cubeSize;
+
+  size_t numPoints = cube.points.size() / 3;
+  size_t offset = cloud.size();
+  cloud.resize(offset + numPoints);
+
+  const int16_t* q = cube.points.data();
+  for (size_t i = 0; i < numPoints; i++, q += 3)
+  {
+    pcl::PointXYZI& p = cloud[offset + i];
+    p.x = originX + q[0] * scale;
+    p.y = originY + q[1] * scale;
+    p.z = originZ + q[2] * scale;
+    p.intensity = 0;
+  }
+}
+
+} // end namespace loam
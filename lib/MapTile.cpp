@@ -0,0 +1,193 @@
+#include "loam_velodyne/MapTile.h"
+
+#include <cstdio>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+namespace loam
+{
+
+std::string mapTileFileName(const int32_t& cubeX, const int32_t& cubeY, const int32_t& cubeZ)
+{
+  char name[64];
+  snprintf(name, sizeof(name), "tile_%d_%d_%d.bin", cubeX, cubeY, cubeZ);
+  return name;
+}
+
+
+
+bool listMapTiles(const std::string& dir, std::vector<std::string>& files)
+{
+  files.clear();
+
+  DIR* d = opendir(dir.c_str());
+  if (d == NULL)
+    return false;
+
+  while (dirent* entry = readdir(d))
+  {
+    int32_t x, y, z;
+    if (sscanf(entry->d_name, "tile_%d_%d_%d", &x, &y, &z) == 3 && mapTileFileName(x, y, z) == entry->d_name)
+    {
+      files.push_back(dir + "/" + entry->d_name);
+    }
+  }
+  closedir(d);
+
+  return true;
+}
+
+
+
+/** \brief Write the x, y, z and intensity arrays of a cloud. */
+static bool writeFields(FILE* file, const pcl::PointCloud<pcl::PointXYZI>& cloud, std::vector<float>& buffer)
+{
+  buffer.resize(cloud.size());
+  for (int field = 0; field < 4; field++)
+  {
+    for (size_t i = 0; i < cloud.size(); i++)
+    {
+      const pcl::PointXYZI& p = cloud.points[i];
+      buffer[i] = field == 0 ? p.x : field == 1 ? p.y : field == 2 ? p.z : p.intensity;
+    }
+    if (fwrite(buffer.data(), sizeof(float), buffer.size(), file) != buffer.size())
+      return false;
+  }
+  return true;
+}
+
+
+
+bool writeMapTile(const std::string& path, MapTileHeader header,
+                  const pcl::PointCloud<pcl::PointXYZI>& corner,
+                  const pcl::PointCloud<pcl::PointXYZI>& surf)
+{
+  header.magic = MAP_TILE_MAGIC;
+  header.version = MAP_TILE_VERSION;
+  header.cornerCount = corner.size();
+  header.surfCount = surf.size();
+  header.reserved[0] = header.reserved[1] = 0;
+
+  std::string tmpPath = path + ".tmp";
+  FILE* file = fopen(tmpPath.c_str(), "wb");
+  if (file == NULL)
+    return false;
+
+  std::vector<float> buffer;
+  bool ok = fwrite(&header, sizeof(header), 1, file) == 1
+            && writeFields(file, corner, buffer)
+            && writeFields(file, surf, buffer);
+  ok = (fclose(file) == 0) && ok;
+
+  if (!ok || rename(tmpPath.c_str(), path.c_str()) != 0)
+  {
+    unlink(tmpPath.c_str());
+    return false;
+  }
+
+  return true;
+}
+
+
+
+MappedMapTile::MappedMapTile()
+      : _data(NULL),
+        _size(0)
+{
+}
+
+
+
+MappedMapTile::~MappedMapTile()
+{
+  close();
+}
+
+
+
+bool MappedMapTile::open(const std::string& path)
+{
+  close();
+
+  int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0)
+    return false;
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 || size_t(st.st_size) < sizeof(MapTileHeader))
+  {
+    ::close(fd);
+    return false;
+  }
+
+  void* data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd);
+  if (data == MAP_FAILED)
+    return false;
+
+  _data = data;
+  _size = st.st_size;
+
+  // validate header and point data size
+  const MapTileHeader& h = header();
+  size_t expectedSize = sizeof(MapTileHeader) + 4 * sizeof(float) * (size_t(h.cornerCount) + h.surfCount);
+  if (h.magic != MAP_TILE_MAGIC || h.version != MAP_TILE_VERSION || _size != expectedSize)
+  {
+    close();
+    return false;
+  }
+
+  return true;
+}
+
+
+
+void MappedMapTile::close()
+{
+  if (_data != NULL)
+    munmap(_data, _size);
+
+  _data = NULL;
+  _size = 0;
+}
+
+
+
+/** \brief Append SoA point arrays to a cloud. */
+static void appendFields(const float* x, const float* y, const float* z, const float* intensity, const size_t& n,
+                         pcl::PointCloud<pcl::PointXYZI>& cloud)
+{
+  size_t offset = cloud.size();
+  cloud.points.resize(offset + n);
+  for (size_t i = 0; i < n; i++)
+  {
+    pcl::PointXYZI& p = cloud.points[offset + i];
+    p.x = x[i];
+    p.y = y[i];
+    p.z = z[i];
+    p.intensity = intensity[i];
+  }
+  cloud.width = cloud.points.size();
+  cloud.height = 1;
+}
+
+
+
+void MappedMapTile::copyCorner(pcl::PointCloud<pcl::PointXYZI>& cloud) const
+{
+  appendFields(corner(0), corner(1), corner(2), corner(3), header().cornerCount, cloud);
+}
+
+
+
+void MappedMapTile::copySurf(pcl::PointCloud<pcl::PointXYZI>& cloud) const
+{
+  appendFields(surf(0), surf(1), surf(2), surf(3), header().surfCount, cloud);
+}
+
+} // end namespace loam
@@ -34,33 +34,8 @@
 
 namespace loam {
 
-MultiScanMapper::MultiScanMapper(const float& lowerBound,
-                                 const float& upperBound,
-                                 const uint16_t& nScanRings)
-    : _lowerBound(lowerBound),
-      _upperBound(upperBound),
-      _nScanRings(nScanRings),
-      _factor((nScanRings - 1) / (upperBound - lowerBound))
-{}
-
-void MultiScanMapper::set(const float &lowerBound,
-                          const float &upperBound,
-                          const uint16_t &nScanRings)
-{
-  _lowerBound = lowerBound;
-  _upperBound = upperBound;
-  _nScanRings = nScanRings;
-  _factor = (nScanRings - 1) / (upperBound - lowerBound);
-}
-
-int MultiScanMapper::getRingForAngle(const float& angle) {
-  return int(((angle * 180 / M_PI) - _lowerBound) * _factor + 0.5);
-}
-
-
-
 MultiScanRegistration::MultiScanRegistration(const MultiScanMapper& scanMapper)
-    : _scanMapper(scanMapper)//在MultiScanRegigtration.h里声明该构造函数时已经给scanMapper赋予了默认参数
+    : BasicMultiScanRegistration(scanMapper)//在MultiScanRegigtration.h里声明该构造函数时已经给scanMapper赋予了默认参数
 {}
 
 bool MultiScanRegistration::setup(ros::NodeHandle& node, ros::NodeHandle& privateNode)
@@ -70,12 +45,12 @@ bool MultiScanRegistration::setup(ros::NodeHandle& node, ros::NodeHandle& privat
   _subImu = node.subscribe<sensor_msgs::Imu>("/imu/data", 50, &MultiScanRegistration::handleIMUMessage, this);
 
   // advertise scan registration topics
-  _pubLaserCloud            = node.advertise<sensor_msgs::PointCloud2>("/velodyne_cloud_2", 2);
-  _pubCornerPointsSharp     = node.advertise<sensor_msgs::PointCloud2>("/laser_cloud_sharp", 2);
-  _pubCornerPointsLessSharp = node.advertise<sensor_msgs::PointCloud2>("/laser_cloud_less_sharp", 2);
-  _pubSurfPointsFlat        = node.advertise<sensor_msgs::PointCloud2>("/laser_cloud_flat", 2);
-  _pubSurfPointsLessFlat    = node.advertise<sensor_msgs::PointCloud2>("/laser_cloud_less_flat", 2);
-  _pubImuTrans              = node.advertise<sensor_msgs::PointCloud2>("/imu_trans", 5);
+  _pubLaserCloud.advertise(node, "/velodyne_cloud_2", 2);
+  _pubCornerPointsSharp.advertise(node, "/laser_cloud_sharp", 2);
+  _pubCornerPointsLessSharp.advertise(node, "/laser_cloud_less_sharp", 2);
+  _pubSurfPointsFlat.advertise(node, "/laser_cloud_flat", 2);
+  _pubSurfPointsLessFlat.advertise(node, "/laser_cloud_less_flat", 2);
+  _pubImuTrans.advertise(node, "/imu_trans", 5);
 
   // fetch scan mapping params
   std::string lidarName;
@@ -84,13 +59,13 @@ bool MultiScanRegistration::setup(ros::NodeHandle& node, ros::NodeHandle& privat
   if (privateNode.getParam("lidar", lidarName))
   {
     if (lidarName == "VLP-16")
-      _scanMapper = MultiScanMapper::Velodyne_VLP_16();
+      setScanMapper(MultiScanMapper::Velodyne_VLP_16());
     else if (lidarName == "HDL-32")
-      _scanMapper = MultiScanMapper::Velodyne_HDL_32();
+      setScanMapper(MultiScanMapper::Velodyne_HDL_32());
     else if (lidarName == "HDL-64E")
-      _scanMapper = MultiScanMapper::Velodyne_HDL_64E();
+      setScanMapper(MultiScanMapper::Velodyne_HDL_64E());
     else if (lidarName == "PandarQT")
-      _scanMapper = MultiScanMapper::PandarQT();
+      setScanMapper(MultiScanMapper::PandarQT());
     else
     {
       ROS_ERROR("Invalid lidar parameter: %s (only \"VLP-16\", \"HDL-32\" , \"HDL-64E\" and \"PandarQT\" are supported)!", lidarName.c_str());
@@ -114,18 +89,31 @@ bool MultiScanRegistration::setup(ros::NodeHandle& node, ros::NodeHandle& privat
         return false;
       }
 
-      _scanMapper.set(vAngleMin, vAngleMax, nScanRings);
+      scanMapper().set(vAngleMin, vAngleMax, nScanRings);
       ROS_INFO("Set linear scan mapper from %g to %g degrees with %d scan rings.", vAngleMin, vAngleMax, nScanRings);
     }*/
     ROS_ERROR("Please enter the Lidar Name!");
   }
 
-  // subscribe to input cloud topic
-  if (privateNode.getParam("PointCloudTopicName", topicName))
+  // read the input sweeps from a shared memory sweep ring, written by the lidar driver on the same host
+  if (privateNode.getParam("shmRing", _shmRingName) && !_shmRingName.empty())
+  {
+    double pollRate = 200;
+    if (privateNode.getParam("shmPollRate", pollRate) && pollRate <= 0)
+    {
+      ROS_ERROR("Invalid shmPollRate parameter: %f (expected > 0)", pollRate);
+      return false;
+    }
+    _shmRingTimer = node.createTimer(ros::Duration(1.0 / pollRate),
+                                     [this](const ros::TimerEvent&) { pollShmRing(); });
+    ROS_INFO("multiScanRegistration node set shmRing: %s (polled at %g Hz)", _shmRingName.c_str(), pollRate);
+  }
+  // or subscribe to input cloud topic
+  else if (privateNode.getParam("PointCloudTopicName", topicName))
   {
-    _subLaserCloud = node.subscribe<sensor_msgs::PointCloud2>
+    _subLaserCloud = node.subscribe<pcl::PointCloud<pcl::PointXYZ> >
         (topicName, 2, &MultiScanRegistration::handleCloudMessage, this);
-    ROS_INFO("laserMapping node set maxIterations: %s", topicName.c_str());
+    ROS_INFO("multiScanRegistration node set PointCloudTopicName: %s", topicName.c_str());
   }
 
   parseParams(privateNode,config);
@@ -136,7 +124,55 @@ bool MultiScanRegistration::setup(ros::NodeHandle& node, ros::NodeHandle& privat
 
 
 
-void MultiScanRegistration::handleCloudMessage(const sensor_msgs::PointCloud2ConstPtr &laserCloudMsg)
+void MultiScanRegistration::handleCloudMessage(const pcl::PointCloud<pcl::PointXYZ>::ConstPtr& laserCloudMsg)
+{
+  processInput(*laserCloudMsg, fromROSTime(cloudStamp(*laserCloudMsg)));
+}
+
+
+
+void MultiScanRegistration::pollShmRing()
+{
+  if (!_shmRing.isOpen())
+  {
+    if (!_shmRing.open(_shmRingName))
+    {
+      ROS_WARN_THROTTLE(5, "Waiting for shared memory sweep ring %s.", _shmRingName.c_str());
+      return;
+    }
+    ROS_INFO("Opened shared memory sweep ring %s.", _shmRingName.c_str());
+  }
+
+  size_t dropped = _shmRing.dropped();
+  Time scanTime;
+  bool hasSweep = false;
+  while (_shmRing.read(_shmSweep, scanTime))
+  {
+    processInput(_shmSweep, scanTime);
+    hasSweep = true;
+  }
+
+  if (_shmRing.dropped() > dropped)
+    ROS_WARN("Dropped %zu sweeps overwritten in the shared memory sweep ring.", _shmRing.dropped() - dropped);
+
+  // a restarted writer creates a new ring, check for it once the sweeps stay away for a second
+  auto now = ros::WallTime::now();
+  if (hasSweep)
+    _shmLastSweep = now;
+  else if ((now - _shmLastSweep).toSec() > 1.0)
+  {
+    _shmLastSweep = now;
+    if (_shmRing.isReplaced(_shmRingName))
+    {
+      ROS_INFO("Shared memory sweep ring %s has been replaced, reopening.", _shmRingName.c_str());
+      _shmRing.close();
+    }
+  }
+}
+
+
+
+void MultiScanRegistration::processInput(const pcl::PointCloud<pcl::PointXYZ>& laserCloudIn, const Time& scanTime)
 {
   if (_systemDelay > 0) 
   {
@@ -144,12 +180,11 @@ void MultiScanRegistration::handleCloudMessage(const sensor_msgs::PointCloud2Con
     return;
   }
 
-  // fetch new input cloud
-  pcl::PointCloud<pcl::PointXYZ> laserCloudIn;
-  pcl::fromROSMsg(*laserCloudMsg, laserCloudIn);
-
-  process(laserCloudIn, fromROSTime(laserCloudMsg->header.stamp));
+  process(laserCloudIn, scanTime);
 }
+
+
+
 void MultiScanRegistration::handleIMUMessage(const sensor_msgs::Imu::ConstPtr& imuIn)
 {
   tf::Quaternion orientation;
@@ -175,76 +210,9 @@ void MultiScanRegistration::handleIMUMessage(const sensor_msgs::Imu::ConstPtr& i
 
 void MultiScanRegistration::process(const pcl::PointCloud<pcl::PointXYZ>& laserCloudIn, const Time& scanTime)
 {
-  size_t cloudSize = laserCloudIn.size();
-
-  // determine scan start and end orientations
-  float startOri = -std::atan2(laserCloudIn[0].y, laserCloudIn[0].x);
-  float endOri = -std::atan2(laserCloudIn[cloudSize - 1].y,
-                             laserCloudIn[cloudSize - 1].x) + 2 * float(M_PI);
-  if (endOri - startOri > 3 * M_PI)
-    endOri -= 2 * M_PI;
-  else if (endOri - startOri < M_PI)
-    endOri += 2 * M_PI;
-
-  bool halfPassed = false;
-  pcl::PointXYZI point;
-  _laserCloudScans.resize(_scanMapper.getNumberOfScanRings());
-  // clear all scanline points
-  std::for_each(_laserCloudScans.begin(), _laserCloudScans.end(), [](auto&&v) {v.clear(); }); 
-
-  // extract valid points from input cloud
-  for (int i = 0; i < cloudSize; i++)
-  {
-    point.x = laserCloudIn[i].y;
-    point.y = laserCloudIn[i].z;
-    point.z = laserCloudIn[i].x;
-
-    // skip NaN and INF valued points
-    if (!pcl_isfinite(point.x) || !pcl_isfinite(point.y) || !pcl_isfinite(point.z))
-      continue;
-
-    // skip zero valued points
-    if (point.x * point.x + point.y * point.y + point.z * point.z < 0.0001)
-      continue;
-
-    // calculate vertical point angle and scan ID
-    float angle = std::atan(point.y / std::sqrt(point.x * point.x + point.z * point.z));
-    int scanID = _scanMapper.getRingForAngle(angle);
-    if (scanID >= _scanMapper.getNumberOfScanRings() || scanID < 0 )
-      continue;
-
-    // calculate horizontal point angle
-    float ori = -std::atan2(point.x, point.z);
-    if (!halfPassed)
-    {
-      if (ori < startOri - M_PI / 2)
-        ori += 2 * M_PI;
-      else if (ori > startOri + M_PI * 3 / 2)
-        ori -= 2 * M_PI;
-      if (ori - startOri > M_PI)
-        halfPassed = true;
-    }
-    else
-    {
-      ori += 2 * M_PI;
-
-      if (ori < endOri - M_PI * 3 / 2)
-        ori += 2 * M_PI;
-      else if (ori > endOri + M_PI / 2)
-        ori -= 2 * M_PI;
-    }
-
-    // calculate relative scan time based on point orientation
-    float relTime = config().scanPeriod * (ori - startOri) / (endOri - startOri);
-    point.intensity = scanID + relTime;
-
-    //projectPointToStartOfSweep(point, relTime);//可注释掉
-
-    _laserCloudScans[scanID].push_back(point);
-  }
-
-  processScanlines(scanTime, _laserCloudScans);
-  publishResult();
+  // an empty sweep would republish the previous results
+  if (BasicMultiScanRegistration::process(laserCloudIn, scanTime))
+    publishResult();
 }
 
 void MultiScanRegistration::publishResult()
@@ -0,0 +1,102 @@
+#include "loam_velodyne/Pipeline.h"
+
+
+namespace loam
+{
+
+Twist integrateOdometry(BasicTransformMaintenance& transformMaintenance, const Twist& odometry)
+{
+  transformMaintenance.updateOdometry(odometry.rot_x.rad(), odometry.rot_y.rad(), odometry.rot_z.rad(),
+                                      odometry.pos.x(), odometry.pos.y(), odometry.pos.z());
+  transformMaintenance.transformAssociateToMap();
+
+  auto const& transformMapped = transformMaintenance.transformMapped();
+  Twist integrated;
+  integrated.rot_x = transformMapped[0];
+  integrated.rot_y = transformMapped[1];
+  integrated.rot_z = transformMapped[2];
+  integrated.pos.x() = transformMapped[3];
+  integrated.pos.y() = transformMapped[4];
+  integrated.pos.z() = transformMapped[5];
+  return integrated;
+}
+
+
+
+Pipeline::Pipeline(const MultiScanMapper& scanMapper,
+                   const RegistrationParams& config,
+                   const uint16_t& ioRatio)
+      : _scanRegistration(scanMapper),
+        _odometry(config.scanPeriod),
+        _ioRatio(ioRatio)
+{
+  _scanRegistration.configure(config);
+  _mapping.setScanPeriod(config.scanPeriod);
+}
+
+
+
+void Pipeline::pushSweep(const pcl::PointCloud<pcl::PointXYZ>& sweep, const Time& stamp)
+{
+  auto start = std::chrono::steady_clock::now();
+  PipelineStageTimes times;
+
+  // scan registration: the feature clouds are swapped into the odometry input clouds
+  if (!_scanRegistration.process(sweep, stamp))
+    return;
+
+  _scanRegistration.swapResults(*_odometry.laserCloud(),
+                                *_odometry.cornerPointsSharp(),
+                                *_odometry.cornerPointsLessSharp(),
+                                *_odometry.surfPointsFlat(),
+                                *_odometry.surfPointsLessFlat());
+  _odometry.updateIMU(_scanRegistration.imuTransform());
+  times.registration = lap(start);
+
+  // laser odometry
+  _odometry.process();
+  times.odometry = lap(start);
+
+  PipelinePose pose;
+  pose.stamp = _scanRegistration.sweepStart();
+  pose.odometry = _odometry.transformSum();
+  pose.mapped = false;
+
+  // laser mapping, for the sweeps the laserOdometry node publishes its clouds for
+  if (_ioRatio < 2 || _odometry.frameCount() % _ioRatio == 1)
+  {
+    _odometry.transformToEnd(_odometry.laserCloud());
+    _mapping.laserCloud().swap(*_odometry.laserCloud());
+    _mapping.laserCloudCornerLast() = *_odometry.lastCornerCloud();
+    _mapping.laserCloudSurfLast() = *_odometry.lastSurfaceCloud();
+    _mapping.updateOdometry(pose.odometry);
+
+    if (_mapping.process(pose.stamp))
+    {
+      _transformMaintenance.updateMappingTransform(_mapping.transformAftMapped(), _mapping.transformBefMapped());
+      pose.mapped = true;
+    }
+    times.mapping = lap(start);
+  }
+
+  // transform maintenance
+  pose.integrated = integrateOdometry(_transformMaintenance, pose.odometry);
+  times.maintenance = lap(start);
+  pose.times = times;
+
+  _poses.push_back(pose);
+}
+
+
+
+bool Pipeline::pullPose(PipelinePose& pose)
+{
+  if (_poses.empty())
+    return false;
+
+  pose = _poses.front();
+  _poses.pop_front();
+  return true;
+}
+
+} // end namespace loam
@@ -0,0 +1,268 @@
+#include "loam_velodyne/PipelineExecutor.h"
+
+
+namespace loam
+{
+
+PipelineExecutor::PipelineExecutor(const MultiScanMapper& scanMapper,
+                                   const RegistrationParams& config,
+                                   const uint16_t& ioRatio,
+                                   const BackpressurePolicy& policy,
+                                   const size_t& queueSize)
+      : _scanRegistration(scanMapper),
+        _odometry(config.scanPeriod),
+        _ioRatio(ioRatio),
+        _policy(policy),
+        _registrationQueue(queueSize),
+        _odometryQueue(queueSize),
+        _mappingQueue(queueSize),
+        _running(false),
+        _skippedMappings(0),
+        _pushedSweeps(0),
+        _finishedSweeps(0)
+{
+  _scanRegistration.configure(config);
+  _mapping.setScanPeriod(config.scanPeriod);
+
+  _registrationQueue.setDropOldest(policy == DROP_OLDEST);
+  _odometryQueue.setDropOldest(policy == DROP_OLDEST);
+  _mappingQueue.setDropOldest(policy == DROP_OLDEST);
+}
+
+
+
+void PipelineExecutor::SweepWork::releaseClouds()
+{
+  pcl::PointCloud<pcl::PointXYZ>().swap(sweep);
+  pcl::PointCloud<pcl::PointXYZI>().swap(laserCloud);
+  pcl::PointCloud<pcl::PointXYZI>().swap(cornerSharp);
+  pcl::PointCloud<pcl::PointXYZI>().swap(cornerLessSharp);
+  pcl::PointCloud<pcl::PointXYZI>().swap(surfFlat);
+  pcl::PointCloud<pcl::PointXYZI>().swap(surfLessFlat);
+  pcl::PointCloud<pcl::PointXYZ>().swap(imuTrans);
+  pcl::PointCloud<pcl::PointXYZI>().swap(cornerLast);
+  pcl::PointCloud<pcl::PointXYZI>().swap(surfLast);
+}
+
+
+
+PipelineExecutor::~PipelineExecutor()
+{
+  stop();
+}
+
+
+
+void PipelineExecutor::start()
+{
+  if (_running)
+    return;
+
+  _registrationQueue.reopen();
+  _odometryQueue.reopen();
+  _mappingQueue.reopen();
+  _registrationThread = std::thread(&PipelineExecutor::registrationLoop, this);
+  _odometryThread = std::thread(&PipelineExecutor::odometryLoop, this);
+  _mappingThread = std::thread(&PipelineExecutor::mappingLoop, this);
+  _running = true;
+}
+
+
+
+void PipelineExecutor::stop()
+{
+  if (!_running)
+    return;
+
+  // closing the input queue lets each stage process its remaining sweeps and close the next queue
+  _registrationQueue.close();
+  _registrationThread.join();
+  _odometryThread.join();
+  _mappingThread.join();
+  _running = false;
+}
+
+
+
+void PipelineExecutor::pushSweep(const pcl::PointCloud<pcl::PointXYZ>& sweep, const Time& stamp)
+{
+  SweepWorkPtr work(new SweepWork());
+  work->sweep = sweep;
+  work->stamp = stamp;
+
+  {
+    std::lock_guard<std::mutex> lock(_resultMutex);
+    _pushedSweeps++;
+  }
+  if (!_registrationQueue.push(std::move(work)))
+    finishSweeps(1);
+}
+
+
+
+bool PipelineExecutor::pullPose(PipelinePose& pose)
+{
+  std::lock_guard<std::mutex> lock(_resultMutex);
+  if (_poses.empty())
+    return false;
+
+  pose = _poses.front();
+  _poses.pop_front();
+  return true;
+}
+
+
+
+void PipelineExecutor::flush()
+{
+  std::unique_lock<std::mutex> lock(_resultMutex);
+  _flushCond.wait(lock, [this] { return _finishedSweeps + droppedSweeps() >= _pushedSweeps; });
+}
+
+
+
+size_t PipelineExecutor::droppedSweeps() const
+{
+  return _registrationQueue.dropped() + _odometryQueue.dropped() + _mappingQueue.dropped();
+}
+
+
+
+void PipelineExecutor::finishSweeps(const size_t& n)
+{
+  {
+    std::lock_guard<std::mutex> lock(_resultMutex);
+    _finishedSweeps += n;
+  }
+  _flushCond.notify_all();
+}
+
+
+
+void PipelineExecutor::registrationLoop()
+{
+  SweepWorkPtr work;
+  while (_registrationQueue.pop(work))
+  {
+    auto start = std::chrono::steady_clock::now();
+    if (!_scanRegistration.process(work->sweep, work->stamp))
+    {
+      // nothing registered, the sweep has no pose
+      finishSweeps(1);
+      continue;
+    }
+
+    _scanRegistration.swapResults(work->laserCloud,
+                                  work->cornerSharp,
+                                  work->cornerLessSharp,
+                                  work->surfFlat,
+                                  work->surfLessFlat);
+    work->imuTrans = _scanRegistration.imuTransform();
+    work->stamp = _scanRegistration.sweepStart();
+    work->sweep.clear();
+    work->times.registration = lap(start);
+
+    if (!_odometryQueue.push(std::move(work)))
+      finishSweeps(1);
+  }
+  _odometryQueue.close();
+}
+
+
+
+void PipelineExecutor::odometryLoop()
+{
+  SweepWorkPtr work;
+  while (_odometryQueue.pop(work))
+  {
+    // the feature clouds are swapped into the odometry input clouds
+    _odometry.laserCloud()->swap(work->laserCloud);
+    _odometry.cornerPointsSharp()->swap(work->cornerSharp);
+    _odometry.cornerPointsLessSharp()->swap(work->cornerLessSharp);
+    _odometry.surfPointsFlat()->swap(work->surfFlat);
+    _odometry.surfPointsLessFlat()->swap(work->surfLessFlat);
+    _odometry.updateIMU(work->imuTrans);
+
+    auto start = std::chrono::steady_clock::now();
+    _odometry.process();
+    work->odometry = _odometry.transformSum();
+
+    // hand the clouds over for the mapping sweeps (see Pipeline::pushSweep())
+    work->mapSweep = _ioRatio < 2 || _odometry.frameCount() % _ioRatio == 1;
+    if (work->mapSweep)
+    {
+      _odometry.transformToEnd(_odometry.laserCloud());
+      work->laserCloud.swap(*_odometry.laserCloud());
+      work->cornerLast = *_odometry.lastCornerCloud();
+      work->surfLast = *_odometry.lastSurfaceCloud();
+    }
+    work->times.odometry = lap(start);
+
+    bool queued;
+    if (_policy == SKIP_MAPPING)
+    {
+      // never wait for the mapping, a queued mapping sweep superseded by a new one only keeps its pose
+      if (!work->mapSweep)
+        work->releaseClouds();
+      queued = _mappingQueue.pushSuperseding(std::move(work), [this](SweepWorkPtr& older, const SweepWorkPtr& newer) {
+        if (newer->mapSweep && older->mapSweep)
+        {
+          older->mapSweep = false;
+          older->releaseClouds();
+          _skippedMappings++;
+        }
+      });
+    }
+    else
+    {
+      queued = _mappingQueue.push(std::move(work));
+    }
+
+    if (!queued)
+      finishSweeps(1);
+  }
+  _mappingQueue.close();
+}
+
+
+
+void PipelineExecutor::mappingLoop()
+{
+  SweepWorkPtr work;
+  while (_mappingQueue.pop(work))
+  {
+    PipelinePose pose;
+    pose.stamp = work->stamp;
+    pose.odometry = work->odometry;
+    pose.mapped = false;
+    pose.times = work->times;
+
+    auto start = std::chrono::steady_clock::now();
+    if (work->mapSweep)
+    {
+      _mapping.laserCloud().swap(work->laserCloud);
+      _mapping.laserCloudCornerLast().swap(work->cornerLast);
+      _mapping.laserCloudSurfLast().swap(work->surfLast);
+      _mapping.updateOdometry(pose.odometry);
+
+      if (_mapping.process(pose.stamp))
+      {
+        _transformMaintenance.updateMappingTransform(_mapping.transformAftMapped(), _mapping.transformBefMapped());
+        pose.mapped = true;
+      }
+      pose.times.mapping = lap(start);
+    }
+
+    start = std::chrono::steady_clock::now();
+    pose.integrated = integrateOdometry(_transformMaintenance, pose.odometry);
+    pose.times.maintenance = lap(start);
+
+    {
+      std::lock_guard<std::mutex> lock(_resultMutex);
+      _poses.push_back(pose);
+    }
+    finishSweeps(1);
+  }
+}
+
+} // end namespace loam
@@ -185,12 +185,12 @@ bool ScanRegistration::setupROS(ros::NodeHandle& node, ros::NodeHandle& privateN
   _subImu = node.subscribe<sensor_msgs::Imu>("/imu/data", 50, &ScanRegistration::handleIMUMessage, this);
 
   // advertise scan registration topics
-  _pubLaserCloud            = node.advertise<sensor_msgs::PointCloud2>("/velodyne_cloud_2", 2);
-  _pubCornerPointsSharp     = node.advertise<sensor_msgs::PointCloud2>("/laser_cloud_sharp", 2);
-  _pubCornerPointsLessSharp = node.advertise<sensor_msgs::PointCloud2>("/laser_cloud_less_sharp", 2);
-  _pubSurfPointsFlat        = node.advertise<sensor_msgs::PointCloud2>("/laser_cloud_flat", 2);
-  _pubSurfPointsLessFlat    = node.advertise<sensor_msgs::PointCloud2>("/laser_cloud_less_flat", 2);
-  _pubImuTrans              = node.advertise<sensor_msgs::PointCloud2>("/imu_trans", 5);
+  _pubLaserCloud.advertise(node, "/velodyne_cloud_2", 2);
+  _pubCornerPointsSharp.advertise(node, "/laser_cloud_sharp", 2);
+  _pubCornerPointsLessSharp.advertise(node, "/laser_cloud_less_sharp", 2);
+  _pubSurfPointsFlat.advertise(node, "/laser_cloud_flat", 2);
+  _pubSurfPointsLessFlat.advertise(node, "/laser_cloud_less_flat", 2);
+  _pubImuTrans.advertise(node, "/imu_trans", 5);
 
   return true;
 }
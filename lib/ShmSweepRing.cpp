@@ -0,0 +1,263 @@
+#include "loam_velodyne/ShmSweepRing.h"
+
+#include <cstring>
+#include <new>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+namespace loam
+{
+
+static inline ShmSweepSlot& slotAt(void* data, const ShmSweepRingHeader& header, const uint64_t& n)
+{
+  char* slots = static_cast<char*>(data) + sizeof(ShmSweepRingHeader);
+  return *reinterpret_cast<ShmSweepSlot*>(slots + (n & (header.slotCount - 1)) * header.slotSize);
+}
+
+static inline pcl::PointXYZ* slotPoints(ShmSweepSlot& slot)
+{
+  return reinterpret_cast<pcl::PointXYZ*>(reinterpret_cast<char*>(&slot) + sizeof(ShmSweepSlot));
+}
+
+
+
+ShmSweepRingWriter::ShmSweepRingWriter()
+      : _data(NULL),
+        _size(0),
+        _header(NULL)
+{
+}
+
+
+
+ShmSweepRingWriter::~ShmSweepRingWriter()
+{
+  close();
+}
+
+
+
+bool ShmSweepRingWriter::create(const std::string& name, const uint32_t& slotCount, const uint32_t& maxPoints)
+{
+  close();
+
+  uint32_t nSlots = 2;
+  while (nSlots < slotCount)
+    nSlots *= 2;
+  uint64_t slotSize = (sizeof(ShmSweepSlot) + uint64_t(maxPoints) * sizeof(pcl::PointXYZ) + 63) / 64 * 64;
+  size_t size = sizeof(ShmSweepRingHeader) + nSlots * slotSize;
+
+  // a new object, readers of a previous ring keep their (stale) mapping
+  shm_unlink(name.c_str());
+  int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+  if (fd < 0)
+    return false;
+
+  void* data = MAP_FAILED;
+  if (ftruncate(fd, size) == 0)
+    data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  ::close(fd);
+  if (data == MAP_FAILED)
+  {
+    shm_unlink(name.c_str());
+    return false;
+  }
+
+  // the object is zero filled, i.e. all slot sequences are 0 (no sweep)
+  _name = name;
+  _data = data;
+  _size = size;
+  _header = new (data) ShmSweepRingHeader();
+  _header->version = SHM_SWEEP_RING_VERSION;
+  _header->slotCount = nSlots;
+  _header->maxPoints = maxPoints;
+  _header->slotSize = slotSize;
+  _header->published.store(0, std::memory_order_relaxed);
+  for (uint32_t i = 0; i < nSlots; i++)
+    new (&slotAt(_data, *_header, i)) ShmSweepSlot();
+
+  std::atomic_thread_fence(std::memory_order_release);
+  _header->magic = SHM_SWEEP_RING_MAGIC;
+
+  return true;
+}
+
+
+
+void ShmSweepRingWriter::close()
+{
+  if (_data == NULL)
+    return;
+
+  munmap(_data, _size);
+  shm_unlink(_name.c_str());
+  _data = NULL;
+  _header = NULL;
+  _size = 0;
+}
+
+
+
+bool ShmSweepRingWriter::write(const pcl::PointCloud<pcl::PointXYZ>& sweep, const Time& stamp)
+{
+  if (_header == NULL || sweep.size() > _header->maxPoints)
+    return false;
+
+  const uint64_t n = _header->published.load(std::memory_order_relaxed);
+  ShmSweepSlot& slot = slotAt(_data, *_header, n);
+
+  // mark the slot as being written before touching its data
+  slot.sequence.store(2 * n + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+
+  slot.stamp = std::chrono::duration_cast<std::chrono::nanoseconds>(stamp.time_since_epoch()).count();
+  slot.pointCount = sweep.size();
+  std::memcpy(slotPoints(slot), sweep.points.data(), sweep.size() * sizeof(pcl::PointXYZ));
+
+  slot.sequence.store(2 * n + 2, std::memory_order_release);
+  _header->published.store(n + 1, std::memory_order_release);
+  return true;
+}
+
+
+
+ShmSweepRingReader::ShmSweepRingReader()
+      : _data(NULL),
+        _size(0),
+        _header(NULL),
+        _inode(0),
+        _next(0),
+        _dropped(0)
+{
+}
+
+
+
+ShmSweepRingReader::~ShmSweepRingReader()
+{
+  close();
+}
+
+
+
+bool ShmSweepRingReader::open(const std::string& name)
+{
+  close();
+
+  int fd = shm_open(name.c_str(), O_RDONLY, 0);
+  if (fd < 0)
+    return false;
+
+  struct stat st;
+  void* data = MAP_FAILED;
+  if (fstat(fd, &st) == 0 && size_t(st.st_size) >= sizeof(ShmSweepRingHeader))
+    data = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  ::close(fd);
+  if (data == MAP_FAILED)
+    return false;
+
+  const ShmSweepRingHeader* header = static_cast<const ShmSweepRingHeader*>(data);
+  bool valid = header->magic == SHM_SWEEP_RING_MAGIC;
+  std::atomic_thread_fence(std::memory_order_acquire);
+  valid = valid
+          && header->version == SHM_SWEEP_RING_VERSION
+          && header->slotCount > 0 && (header->slotCount & (header->slotCount - 1)) == 0
+          && header->slotSize >= sizeof(ShmSweepSlot) + uint64_t(header->maxPoints) * sizeof(pcl::PointXYZ)
+          && sizeof(ShmSweepRingHeader) + header->slotCount * header->slotSize <= size_t(st.st_size);
+  if (!valid)
+  {
+    munmap(data, st.st_size);
+    return false;
+  }
+
+  _data = data;
+  _size = st.st_size;
+  _header = header;
+  _inode = st.st_ino;
+  _next = header->published.load(std::memory_order_acquire);
+  return true;
+}
+
+
+
+bool ShmSweepRingReader::isReplaced(const std::string& name) const
+{
+  if (_header == NULL)
+    return false;
+
+  int fd = shm_open(name.c_str(), O_RDONLY, 0);
+  if (fd < 0)
+    return true;
+
+  struct stat st;
+  bool replaced = fstat(fd, &st) != 0 || uint64_t(st.st_ino) != _inode;
+  ::close(fd);
+  return replaced;
+}
+
+
+
+void ShmSweepRingReader::close()
+{
+  if (_data == NULL)
+    return;
+
+  munmap(_data, _size);
+  _data = NULL;
+  _header = NULL;
+  _size = 0;
+}
+
+
+
+bool ShmSweepRingReader::read(pcl::PointCloud<pcl::PointXYZ>& sweep, Time& stamp)
+{
+  if (_header == NULL)
+    return false;
+
+  const uint64_t published = _header->published.load(std::memory_order_acquire);
+  while (_next < published)
+  {
+    // skip the sweeps already overwritten
+    if (published - _next > _header->slotCount)
+    {
+      _dropped += published - _header->slotCount - _next;
+      _next = published - _header->slotCount;
+    }
+
+    ShmSweepSlot& slot = slotAt(_data, *_header, _next);
+    const uint64_t sequence = slot.sequence.load(std::memory_order_acquire);
+    if (sequence == 2 * _next + 2)
+    {
+      uint32_t n = slot.pointCount;
+      if (n > _header->maxPoints)
+        n = _header->maxPoints;
+      int64_t ns = slot.stamp;
+      sweep.resize(n);
+      std::memcpy(sweep.points.data(), slotPoints(slot), n * sizeof(pcl::PointXYZ));
+
+      // the copy is valid if the writer has not started to overwrite the slot meanwhile
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if (slot.sequence.load(std::memory_order_relaxed) == sequence)
+      {
+        sweep.width = n;
+        sweep.height = 1;
+        sweep.is_dense = false;
+        stamp = Time(std::chrono::duration_cast<Time::duration>(std::chrono::nanoseconds(ns)));
+        _next++;
+        return true;
+      }
+    }
+
+    _dropped++;
+    _next++;
+  }
+
+  return false;
+}
+
+} // end namespace loam
@@ -0,0 +1,217 @@
+#include "loam_velodyne/SweepLog.h"
+
+#include <sys/stat.h>
+
+
+namespace loam
+{
+
+static inline int64_t toNanoseconds(const Time& stamp)
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(stamp.time_since_epoch()).count();
+}
+
+static inline Time fromNanoseconds(const int64_t& ns)
+{
+  return Time(std::chrono::duration_cast<Time::duration>(std::chrono::nanoseconds(ns)));
+}
+
+
+
+SweepLogWriter::SweepLogWriter()
+      : _file(NULL),
+        _ok(false)
+{
+}
+
+
+
+SweepLogWriter::~SweepLogWriter()
+{
+  close();
+}
+
+
+
+bool SweepLogWriter::open(const std::string& path)
+{
+  close();
+
+  _file = fopen(path.c_str(), "wb");
+  if (_file == NULL)
+    return false;
+
+  SweepLogHeader header;
+  header.magic = SWEEP_LOG_MAGIC;
+  header.version = SWEEP_LOG_VERSION;
+  _ok = fwrite(&header, sizeof(header), 1, _file) == 1;
+  return _ok;
+}
+
+
+
+bool SweepLogWriter::close()
+{
+  if (_file == NULL)
+    return false;
+
+  bool ok = (fclose(_file) == 0) && _ok;
+  _file = NULL;
+  return ok;
+}
+
+
+
+bool SweepLogWriter::writeSweep(const pcl::PointCloud<pcl::PointXYZ>& sweep, const Time& stamp)
+{
+  if (_file == NULL || !_ok || sweep.size() > SWEEP_LOG_MAX_POINTS)
+    return false;
+
+  SweepLogRecordHeader header;
+  header.type = SWEEP_RECORD;
+  header.count = sweep.size();
+  header.stamp = toNanoseconds(stamp);
+
+  // x, y, z triples without the padding of pcl::PointXYZ
+  _buffer.resize(3 * sweep.size());
+  float* v = _buffer.data();
+  for (auto const& p : sweep)
+  {
+    *v++ = p.x;
+    *v++ = p.y;
+    *v++ = p.z;
+  }
+
+  _ok = fwrite(&header, sizeof(header), 1, _file) == 1
+        && fwrite(_buffer.data(), sizeof(float), _buffer.size(), _file) == _buffer.size();
+  return _ok;
+}
+
+
+
+bool SweepLogWriter::writeImu(const IMUState2& state)
+{
+  if (_file == NULL || !_ok)
+    return false;
+
+  SweepLogRecordHeader header;
+  header.type = IMU_RECORD;
+  header.count = 2;
+  header.stamp = toNanoseconds(state.stamp);
+  float values[2] = { state.roll.rad(), state.pitch.rad() };
+
+  _ok = fwrite(&header, sizeof(header), 1, _file) == 1
+        && fwrite(values, sizeof(float), 2, _file) == 2;
+  return _ok;
+}
+
+
+
+SweepLogReader::SweepLogReader()
+      : _file(NULL),
+        _eof(false)
+{
+}
+
+
+
+SweepLogReader::~SweepLogReader()
+{
+  close();
+}
+
+
+
+bool SweepLogReader::open(const std::string& path)
+{
+  close();
+
+  _file = fopen(path.c_str(), "rb");
+  if (_file == NULL)
+    return false;
+
+  SweepLogHeader header;
+  if (fread(&header, sizeof(header), 1, _file) != 1
+      || header.magic != SWEEP_LOG_MAGIC || header.version != SWEEP_LOG_VERSION)
+  {
+    close();
+    return false;
+  }
+
+  _eof = false;
+  return true;
+}
+
+
+
+void SweepLogReader::close()
+{
+  if (_file != NULL)
+  {
+    fclose(_file);
+    _file = NULL;
+  }
+}
+
+
+
+bool SweepLogReader::next(SweepLogRecord& record)
+{
+  if (_file == NULL)
+    return false;
+
+  SweepLogRecordHeader header;
+  size_t n = fread(&header, 1, sizeof(header), _file);
+  if (n != sizeof(header))
+  {
+    // a clean end of the log ends between two records
+    _eof = (n == 0 && feof(_file));
+    return false;
+  }
+
+  record.stamp = fromNanoseconds(header.stamp);
+
+  if (header.type == SWEEP_RECORD)
+  {
+    // don't trust the count of a corrupt record, the payload has to be in the file (which may still grow)
+    struct stat st;
+    off_t offset = ftello(_file);
+    if (header.count > SWEEP_LOG_MAX_POINTS || offset < 0 || fstat(fileno(_file), &st) != 0
+        || st.st_size - offset < off_t(3 * sizeof(float)) * header.count)
+      return false;
+
+    _buffer.resize(3 * size_t(header.count));
+    if (fread(_buffer.data(), sizeof(float), _buffer.size(), _file) != _buffer.size())
+      return false;
+
+    record.type = SWEEP_RECORD;
+    record.sweep.resize(header.count);
+    const float* v = _buffer.data();
+    for (auto& p : record.sweep)
+    {
+      p.x = *v++;
+      p.y = *v++;
+      p.z = *v++;
+    }
+    record.sweep.width = header.count;
+    record.sweep.height = 1;
+    record.sweep.is_dense = false;
+    return true;
+  }
+  else if (header.type == IMU_RECORD && header.count == 2)
+  {
+    float values[2];
+    if (fread(values, sizeof(float), 2, _file) != 2)
+      return false;
+
+    record.type = IMU_RECORD;
+    record.imu.stamp = record.stamp;
+    record.imu.roll = values[0];
+    record.imu.pitch = values[1];
+    return true;
+  }
+
+  return false;
+}
+
+} // end namespace loam
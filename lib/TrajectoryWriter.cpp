@@ -0,0 +1,80 @@
+#include "loam_velodyne/TrajectoryWriter.h"
+
+#include <Eigen/Geometry>
+
+
+namespace loam
+{
+
+TrajectoryWriter::TrajectoryWriter()
+      : _file(NULL),
+        _format(TUM_TRAJECTORY),
+        _ok(false)
+{
+}
+
+
+
+TrajectoryWriter::~TrajectoryWriter()
+{
+  close();
+}
+
+
+
+bool TrajectoryWriter::open(const std::string& path, const TrajectoryFormat& format)
+{
+  close();
+
+  _file = fopen(path.c_str(), "w");
+  _format = format;
+  _ok = _file != NULL;
+  return _ok;
+}
+
+
+
+bool TrajectoryWriter::close()
+{
+  if (_file == NULL)
+    return false;
+
+  bool ok = (fclose(_file) == 0) && _ok;
+  _file = NULL;
+  return ok;
+}
+
+
+
+bool TrajectoryWriter::write(const Time& stamp, const Twist& pose)
+{
+  if (_file == NULL || !_ok)
+    return false;
+
+  Eigen::Quaterniond q = Eigen::AngleAxisd(pose.rot_y.rad(), Eigen::Vector3d::UnitY())
+                         * Eigen::AngleAxisd(pose.rot_x.rad(), Eigen::Vector3d::UnitX())
+                         * Eigen::AngleAxisd(pose.rot_z.rad(), Eigen::Vector3d::UnitZ());
+  double tx = pose.pos.x();
+  double ty = pose.pos.y();
+  double tz = pose.pos.z();
+
+  int n;
+  if (_format == TUM_TRAJECTORY)
+  {
+    n = fprintf(_file, "%.9f %.9g %.9g %.9g %.9g %.9g %.9g %.9g\n",
+                toSec(stamp.time_since_epoch()), tx, ty, tz, q.x(), q.y(), q.z(), q.w());
+  }
+  else
+  {
+    Eigen::Matrix3d r = q.toRotationMatrix();
+    n = fprintf(_file, "%.9g %.9g %.9g %.9g %.9g %.9g %.9g %.9g %.9g %.9g %.9g %.9g\n",
+                r(0, 0), r(0, 1), r(0, 2), tx,
+                r(1, 0), r(1, 1), r(1, 2), ty,
+                r(2, 0), r(2, 1), r(2, 2), tz);
+  }
+
+  _ok = n > 0;
+  return _ok;
+}
+
+} // end namespace loam
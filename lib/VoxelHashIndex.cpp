@@ -0,0 +1,211 @@
+#include "loam_velodyne/VoxelHashIndex.h"
+#include "loam_velodyne/simd_dispatch.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+
+namespace loam
+{
+
+VoxelHashIndex::VoxelHashIndex(const float& voxelSize, const float& maxDistance)
+      : _voxelSize(voxelSize),
+        _maxDistance(maxDistance),
+        _invVoxelSize(1.0f / voxelSize)
+{
+}
+
+
+
+size_t VoxelHashIndex::findSlot(const int32_t& x, const int32_t& y, const int32_t& z) const
+{
+  const size_t mask = _slots.size() - 1;
+  size_t idx = (uint32_t(x) * 73856093u ^ uint32_t(y) * 19349663u ^ uint32_t(z) * 83492791u) & mask;
+
+  while (_slots[idx].cell != EMPTY_SLOT
+         && (_slots[idx].x != x || _slots[idx].y != y || _slots[idx].z != z))
+  {
+    idx = (idx + 1) & mask;
+  }
+
+  return idx;
+}
+
+
+
+void VoxelHashIndex::setInputCloud(const pcl::PointCloud<pcl::PointXYZI>::Ptr& cloud)
+{
+  const size_t n = cloud->size();
+  _invVoxelSize = 1.0f / _voxelSize;
+
+  // size the hash table for a load factor below 0.5 even if every point occupies its own voxel
+  size_t tableSize = 64;
+  while (tableSize < 2 * n)
+    tableSize *= 2;
+  _slots.assign(tableSize, Slot{0, 0, 0, EMPTY_SLOT});
+
+  // pass 1: assign the points to cells and count the points per cell
+  _cellStart.clear();
+  _pointCells.resize(n);
+  _pointVoxels.resize(3 * n);
+  int32_t* vx = _pointVoxels.data();
+  int32_t* vy = vx + n;
+  int32_t* vz = vy + n;
+  simd::kernels().voxelCoordinates(reinterpret_cast<const float*>(cloud->points.data()), n, _invVoxelSize,
+                                   vx, vy, vz);
+  for (size_t i = 0; i < n; i++)
+  {
+    const int32_t x = vx[i], y = vy[i], z = vz[i];
+
+    Slot& slot = _slots[findSlot(x, y, z)];
+    if (slot.cell == EMPTY_SLOT)
+    {
+      slot = Slot{x, y, z, uint32_t(_cellStart.size())};
+      _cellStart.push_back(0);
+    }
+    _cellStart[slot.cell]++;
+    _pointCells[i] = slot.cell;
+  }
+
+  // turn the counts into cell start offsets
+  uint32_t offset = 0;
+  for (auto& start : _cellStart)
+  {
+    uint32_t count = start;
+    start = offset;
+    offset += count;
+  }
+  _cellStart.push_back(offset);
+
+  // pass 2: scatter the points into their cells (advancing the start offsets, restored below)
+  _points.resize(n);
+  _indices.resize(n);
+  for (size_t i = 0; i < n; i++)
+  {
+    const pcl::PointXYZI& p = cloud->points[i];
+    uint32_t pos = _cellStart[_pointCells[i]]++;
+    _points[pos] = {{ p.x, p.y, p.z }};
+    _indices[pos] = int(i);
+  }
+  for (size_t c = _cellStart.size() - 1; c > 0; c--)
+    _cellStart[c] = _cellStart[c - 1];
+  _cellStart[0] = 0;
+}
+
+
+
+void VoxelHashIndex::searchVoxel(const int32_t& x, const int32_t& y, const int32_t& z, const float* query,
+                                 const int& k, int& count, int* indices, float* sqrDistances) const
+{
+  const Slot& slot = _slots[findSlot(x, y, z)];
+  if (slot.cell == EMPTY_SLOT)
+    return;
+
+  for (uint32_t pos = _cellStart[slot.cell]; pos < _cellStart[slot.cell + 1]; pos++)
+  {
+    const std::array<float, 3>& p = _points[pos];
+    float dx = p[0] - query[0];
+    float dy = p[1] - query[1];
+    float dz = p[2] - query[2];
+    float sqDist = dx * dx + dy * dy + dz * dz;
+
+    if (count == k && sqDist >= sqrDistances[k - 1])
+      continue;
+
+    // insert into the sorted candidate list
+    int j = count < k ? count++ : k - 1;
+    for (; j > 0 && sqrDistances[j - 1] > sqDist; j--)
+    {
+      sqrDistances[j] = sqrDistances[j - 1];
+      indices[j] = indices[j - 1];
+    }
+    sqrDistances[j] = sqDist;
+    indices[j] = _indices[pos];
+  }
+}
+
+
+
+int VoxelHashIndex::nearestKSearch(const pcl::PointXYZI& point, const int& k,
+                                   int* indices, float* sqrDistances) const
+{
+  int count = 0;
+
+  if (k > 0 && !_points.empty())
+  {
+    const float query[3] = { point.x, point.y, point.z };
+    const int32_t cx = int32_t(std::floor(point.x * _invVoxelSize));
+    const int32_t cy = int32_t(std::floor(point.y * _invVoxelSize));
+    const int32_t cz = int32_t(std::floor(point.z * _invVoxelSize));
+    const int32_t maxRing = int32_t(std::ceil(_maxDistance * _invVoxelSize));
+    const float maxSqDist = _maxDistance * _maxDistance;
+
+    // offsets of the query within its voxel
+    const float lo[3] = { point.x - cx * _voxelSize, point.y - cy * _voxelSize, point.z - cz * _voxelSize };
+    const float hi[3] = { _voxelSize - lo[0], _voxelSize - lo[1], _voxelSize - lo[2] };
+
+    // squared distance from the query to the voxel at the given offset along one axis
+    auto axisSqDist = [&](const int32_t& d, const int& axis)
+    {
+      float dist = d > 0 ? (d - 1) * _voxelSize + hi[axis] : d < 0 ? (-d - 1) * _voxelSize + lo[axis] : 0.0f;
+      return dist * dist;
+    };
+
+    for (int32_t r = 0; r <= maxRing; r++)
+    {
+      // visit all voxels with Chebyshev distance r to the query voxel, skipping voxels that can not
+      // contain a point closer than the current k-th neighbour or the distance gate
+      for (int32_t dx = -r; dx <= r; dx++)
+      {
+        const float sqDistX = axisSqDist(dx, 0);
+        for (int32_t dy = -r; dy <= r; dy++)
+        {
+          const float sqDistXY = sqDistX + axisSqDist(dy, 1);
+          const bool onShell = (dx == -r || dx == r || dy == -r || dy == r);
+          for (int32_t dz = -r; dz <= r; dz += (onShell || r == 0) ? 1 : 2 * r)
+          {
+            const float boxSqDist = sqDistXY + axisSqDist(dz, 2);
+            if (boxSqDist > maxSqDist || (count == k && boxSqDist >= sqrDistances[k - 1]))
+              continue;
+
+            searchVoxel(cx + dx, cy + dy, cz + dz, query, k, count, indices, sqrDistances);
+          }
+        }
+      }
+
+      // every point outside the visited block is farther away than the closest block face
+      float faceDist = std::min(std::min(lo[0], hi[0]), std::min(std::min(lo[1], hi[1]), std::min(lo[2], hi[2])));
+      faceDist += r * _voxelSize;
+      if (count == k && sqrDistances[k - 1] <= faceDist * faceDist)
+        break;
+    }
+
+    // drop candidates beyond the distance gate, they are not guaranteed to be the nearest ones
+    while (count > 0 && sqrDistances[count - 1] > maxSqDist)
+      count--;
+  }
+
+  for (int j = count; j < k; j++)
+  {
+    indices[j] = -1;
+    sqrDistances[j] = std::numeric_limits<float>::infinity();
+  }
+
+  return count;
+}
+
+
+
+void VoxelHashIndex::nearestKSearchBatch(const pcl::PointXYZI* queries, const size_t& numQueries, const int& k,
+                                         int* indices, float* sqrDistances) const
+{
+  const int n = int(numQueries);
+  #pragma omp parallel for schedule(static, 64) if (numQueries >= 256)
+  for (int i = 0; i < n; i++)
+  {
+    nearestKSearch(queries[i], k, indices + size_t(i) * k, sqrDistances + size_t(i) * k);
+  }
+}
+
+} // end namespace loam
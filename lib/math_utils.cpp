@@ -0,0 +1,55 @@
+#include "loam_velodyne/math_utils.h"
+#include "loam_velodyne/simd_dispatch.h"
+
+#include <cstddef>
+
+
+namespace loam
+{
+
+// the kernels access the points as raw floats
+static_assert(sizeof(pcl::PointXYZI) == simd::POINT_STRIDE * sizeof(float)
+              && offsetof(pcl::PointXYZI, intensity) == simd::POINT_INTENSITY * sizeof(float),
+              "unexpected pcl::PointXYZI layout");
+
+
+
+void transformCloud(const PointTransform& tf,
+                    const pcl::PointCloud<pcl::PointXYZI>& cloud,
+                    pcl::PointCloud<pcl::PointXYZI>& result)
+{
+  if (&result != &cloud)
+    result.resize(cloud.size());
+
+  simd::kernels().transformAoS(tf.r, tf.t, reinterpret_cast<const float*>(cloud.points.data()),
+                               reinterpret_cast<float*>(result.points.data()), cloud.size());
+}
+
+
+
+void transformPoints(const PointTransform& tf,
+                     const float* x, const float* y, const float* z,
+                     float* outX, float* outY, float* outZ, const size_t& n)
+{
+  simd::kernels().transformSoA(tf.r, tf.t, x, y, z, outX, outY, outZ, n);
+}
+
+
+
+void transformCloudInterpolated(const float& angZ, const float& angX, const float& angY,
+                                const Vector3& translation, const float& invScanPeriod,
+                                const pcl::PointCloud<pcl::PointXYZI>& cloud,
+                                pcl::PointCloud<pcl::PointXYZI>& result,
+                                const bool& truncateIntensity)
+{
+  if (&result != &cloud)
+    result.resize(cloud.size());
+
+  const float ang[3] = { angZ, angX, angY };
+  const float t[3] = { translation.x(), translation.y(), translation.z() };
+  simd::kernels().transformInterpolatedAoS(ang, t, invScanPeriod, truncateIntensity,
+                                           reinterpret_cast<const float*>(cloud.points.data()),
+                                           reinterpret_cast<float*>(result.points.data()), cloud.size());
+}
+
+} // end namespace loam
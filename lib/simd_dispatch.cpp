@@ -0,0 +1,45 @@
+#include "loam_velodyne/simd_kernels.h"
+
+#include <cstdlib>
+#include <cstring>
+
+
+namespace loam
+{
+namespace simd
+{
+
+const KernelTable& baselineKernels()
+{
+  static const KernelTable table = makeKernelTable<4>("baseline");
+  return table;
+}
+
+
+
+/** \brief Select the fastest kernels supported by the host. */
+static const KernelTable& selectKernels()
+{
+  const char* forced = std::getenv("LOAM_SIMD_ISA");
+  if (forced && std::strcmp(forced, "baseline") == 0)
+    return baselineKernels();
+
+#ifdef LOAM_HAVE_AVX2_KERNELS
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+    return avx2Kernels();
+#endif
+
+  return baselineKernels();
+}
+
+
+
+const KernelTable& kernels()
+{
+  static const KernelTable& table = selectKernels();
+  return table;
+}
+
+} // end namespace simd
+} // end namespace loam
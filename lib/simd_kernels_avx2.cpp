@@ -0,0 +1,30 @@
+// AVX2 + FMA variant of the SIMD kernels, compiled with -mavx2 -mfma (see LOAM_MULTI_ISA_KERNELS).
+//
+// Nothing but simd_kernels.h may be included here: any inline function pulled in from another header
+// (Eigen, pcl, the standard library) would be compiled with AVX2 as well and could be picked by the
+// linker for the baseline code paths.
+
+#include "loam_velodyne/simd_kernels.h"
+
+#if defined(EIGEN_WORLD_VERSION) || defined(PCL_MAJOR_VERSION)
+#error "the AVX2 kernel unit must not include Eigen or pcl"
+#endif
+
+#ifndef __AVX2__
+#error "the AVX2 kernel unit has to be compiled with -mavx2 -mfma"
+#endif
+
+
+namespace loam
+{
+namespace simd
+{
+
+const KernelTable& avx2Kernels()
+{
+  static const KernelTable table = makeKernelTable<8>("avx2");
+  return table;
+}
+
+} // end namespace simd
+} // end namespace loam
@@ -0,0 +1,368 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <memory>
+#include <string>
+
+#include <ros/ros.h>
+#include <rosbag/bag.h>
+#include <rosbag/view.h>
+#include <sensor_msgs/Imu.h>
+#include <sensor_msgs/PointCloud2.h>
+#include <tf/transform_datatypes.h>
+#include "loam_velodyne/common.h"
+#include "loam_velodyne/Pipeline.h"
+#include "loam_velodyne/PipelineExecutor.h"
+#include "loam_velodyne/SweepLog.h"
+#include "loam_velodyne/TrajectoryWriter.h"
+
+
+// Offline batch mode: runs the LOAM pipeline on a recorded bag or sweep log as fast as the CPU allows
+// (no ROS master, no real time replay) and writes the trajectory and the per-sweep stage timings.
+
+/** Batch options. */
+struct BatchOptions
+{
+  std::string input;                          ///< input bag or sweep log (*.sweeps)
+  std::string lidar = "VLP-16";               ///< lidar name, as the lidar parameter of multiScanRegistration
+  std::string cloudTopic = "/velodyne_points";
+  std::string imuTopic = "/imu/data";
+  std::string trajectoryPath;                 ///< trajectory output file
+  loam::TrajectoryFormat format = loam::TUM_TRAJECTORY;
+  bool odometryOnly = false;                  ///< write the laser odometry instead of the integrated poses
+  std::string timingPath;                     ///< stage timing CSV output file
+  std::string logPath;                        ///< sweep log output file (converted input)
+  float scanPeriod = 0.1;
+  int ioRatio = 2;
+  int skipSweeps = 20;                        ///< skipped initial sweeps, as the system delay of multiScanRegistration
+  bool staged = false;                        ///< run the stages on separate threads (PipelineExecutor)
+};
+
+
+
+void printUsage()
+{
+  printf("usage: loamBatch [options] <input.bag | input.sweeps>\n"
+         "  --lidar <name>           VLP-16 (default), HDL-32, HDL-64E or PandarQT\n"
+         "  --cloud-topic <topic>    bag point cloud topic (default /velodyne_points)\n"
+         "  --imu-topic <topic>      bag IMU topic (default /imu/data)\n"
+         "  --trajectory <file>      write the trajectory\n"
+         "  --format <tum|kitti>     trajectory format (default tum)\n"
+         "  --odometry               write the laser odometry instead of the mapping corrected poses\n"
+         "  --timing <file>          write the stage timings of every sweep as CSV\n"
+         "  --write-log <file>       write the input as sweep log for faster reprocessing\n"
+         "  --scan-period <s>        sweep duration (default 0.1)\n"
+         "  --io-ratio <n>           ratio of odometry to mapping sweeps (default 2)\n"
+         "  --skip <n>               skipped initial sweeps (default 20)\n"
+         "  --staged                 run the stages on separate threads\n");
+}
+
+
+
+bool parseOptions(int argc, char **argv, BatchOptions& options)
+{
+  for (int i = 1; i < argc; i++)
+  {
+    std::string arg = argv[i];
+    bool hasValue = i + 1 < argc;
+
+    if (arg == "--odometry")
+      options.odometryOnly = true;
+    else if (arg == "--staged")
+      options.staged = true;
+    else if (arg == "--lidar" && hasValue)
+      options.lidar = argv[++i];
+    else if (arg == "--cloud-topic" && hasValue)
+      options.cloudTopic = argv[++i];
+    else if (arg == "--imu-topic" && hasValue)
+      options.imuTopic = argv[++i];
+    else if (arg == "--trajectory" && hasValue)
+      options.trajectoryPath = argv[++i];
+    else if (arg == "--timing" && hasValue)
+      options.timingPath = argv[++i];
+    else if (arg == "--write-log" && hasValue)
+      options.logPath = argv[++i];
+    else if (arg == "--scan-period" && hasValue)
+      options.scanPeriod = std::atof(argv[++i]);
+    else if (arg == "--io-ratio" && hasValue)
+      options.ioRatio = std::atoi(argv[++i]);
+    else if (arg == "--skip" && hasValue)
+      options.skipSweeps = std::atoi(argv[++i]);
+    else if (arg == "--format" && hasValue)
+    {
+      std::string format = argv[++i];
+      if (format == "tum")
+        options.format = loam::TUM_TRAJECTORY;
+      else if (format == "kitti")
+        options.format = loam::KITTI_TRAJECTORY;
+      else
+      {
+        ROS_ERROR("Invalid trajectory format: %s (only \"tum\" and \"kitti\" are supported)!", format.c_str());
+        return false;
+      }
+    }
+    else if (arg.compare(0, 2, "--") != 0 && options.input.empty())
+      options.input = arg;
+    else
+    {
+      ROS_ERROR("Invalid argument: %s", arg.c_str());
+      return false;
+    }
+  }
+
+  if (options.input.empty())
+  {
+    ROS_ERROR("No input file given!");
+    return false;
+  }
+  if (options.scanPeriod <= 0 || options.ioRatio < 1 || options.skipSweeps < 0)
+  {
+    ROS_ERROR("Invalid scan period, io ratio or number of skipped sweeps!");
+    return false;
+  }
+
+  return true;
+}
+
+
+
+bool scanMapperFor(const std::string& lidar, loam::MultiScanMapper& mapper)
+{
+  if (lidar == "VLP-16")
+    mapper = loam::MultiScanMapper::Velodyne_VLP_16();
+  else if (lidar == "HDL-32")
+    mapper = loam::MultiScanMapper::Velodyne_HDL_32();
+  else if (lidar == "HDL-64E")
+    mapper = loam::MultiScanMapper::Velodyne_HDL_64E();
+  else if (lidar == "PandarQT")
+    mapper = loam::MultiScanMapper::PandarQT();
+  else
+  {
+    ROS_ERROR("Invalid lidar: %s (only \"VLP-16\", \"HDL-32\" , \"HDL-64E\" and \"PandarQT\" are supported)!", lidar.c_str());
+    return false;
+  }
+  return true;
+}
+
+
+
+typedef std::function<bool(const loam::SweepLogRecord&)> RecordHandler;
+
+/** \brief Feed the sweeps and IMU orientations of a sweep log to the handler, in recording order. */
+bool readSweepLog(const std::string& path, const RecordHandler& handler)
+{
+  loam::SweepLogReader reader;
+  if (!reader.open(path))
+  {
+    ROS_ERROR("Could not open sweep log %s!", path.c_str());
+    return false;
+  }
+
+  loam::SweepLogRecord record;
+  while (reader.next(record))
+  {
+    if (!handler(record))
+      return false;
+  }
+
+  if (!reader.eof())
+    ROS_WARN("Sweep log %s is truncated or invalid, stopped at the last complete record.", path.c_str());
+  return true;
+}
+
+/** \brief Feed the sweeps and IMU orientations of a bag to the handler, in recording order. */
+bool readBag(const std::string& path, const BatchOptions& options, const RecordHandler& handler)
+{
+  rosbag::Bag bag;
+  try
+  {
+    bag.open(path, rosbag::bagmode::Read);
+  }
+  catch (const rosbag::BagException& e)
+  {
+    ROS_ERROR("Could not open bag %s: %s", path.c_str(), e.what());
+    return false;
+  }
+
+  rosbag::View view(bag, rosbag::TopicQuery({ options.cloudTopic, options.imuTopic }));
+  loam::SweepLogRecord record;
+  for (auto const& m : view)
+  {
+    if (auto cloudMsg = m.instantiate<sensor_msgs::PointCloud2>())
+    {
+      record.type = loam::SWEEP_RECORD;
+      record.stamp = loam::fromROSTime(cloudMsg->header.stamp);
+      pcl::fromROSMsg(*cloudMsg, record.sweep);
+    }
+    else if (auto imuMsg = m.instantiate<sensor_msgs::Imu>())
+    {
+      // same orientation as the IMU handler of laserMapping
+      double roll, pitch, yaw;
+      tf::Quaternion orientation;
+      tf::quaternionMsgToTF(imuMsg->orientation, orientation);
+      tf::Matrix3x3(orientation).getRPY(roll, pitch, yaw);
+
+      record.type = loam::IMU_RECORD;
+      record.stamp = loam::fromROSTime(imuMsg->header.stamp);
+      record.imu = { record.stamp, roll, pitch };
+    }
+    else
+      continue;
+
+    if (!handler(record))
+      return false;
+  }
+
+  return true;
+}
+
+
+
+/** Main batch entry point. */
+int main(int argc, char **argv)
+{
+  BatchOptions options;
+  loam::MultiScanMapper scanMapper;
+  if (!parseOptions(argc, argv, options) || !scanMapperFor(options.lidar, scanMapper))
+  {
+    printUsage();
+    return 1;
+  }
+
+  loam::RegistrationParams config;
+  config.scanPeriod = options.scanPeriod;
+
+  // the serial pipeline, or the staged executor without dropping sweeps
+  std::unique_ptr<loam::Pipeline> pipeline;
+  std::unique_ptr<loam::PipelineExecutor> executor;
+  if (options.staged)
+  {
+    executor.reset(new loam::PipelineExecutor(scanMapper, config, options.ioRatio, loam::BLOCK_PRODUCER));
+    executor->start();
+  }
+  else
+    pipeline.reset(new loam::Pipeline(scanMapper, config, options.ioRatio));
+
+  loam::TrajectoryWriter trajectory;
+  if (!options.trajectoryPath.empty() && !trajectory.open(options.trajectoryPath, options.format))
+  {
+    ROS_ERROR("Could not create trajectory file %s!", options.trajectoryPath.c_str());
+    return 1;
+  }
+
+  std::unique_ptr<FILE, int(*)(FILE*)> timing(NULL, fclose);
+  if (!options.timingPath.empty())
+  {
+    timing.reset(fopen(options.timingPath.c_str(), "w"));
+    if (!timing)
+    {
+      ROS_ERROR("Could not create timing file %s!", options.timingPath.c_str());
+      return 1;
+    }
+    fprintf(timing.get(), "stamp,registration_ms,odometry_ms,mapping_ms,maintenance_ms,total_ms,mapped\n");
+  }
+
+  loam::SweepLogWriter log;
+  if (!options.logPath.empty() && !log.open(options.logPath))
+  {
+    ROS_ERROR("Could not create sweep log %s!", options.logPath.c_str());
+    return 1;
+  }
+
+  size_t nSweeps = 0;
+  size_t nPoses = 0;
+  size_t nMapped = 0;
+  double stageSum[4] = { 0, 0, 0, 0 };
+  bool hasStamp = false;
+  loam::Time firstStamp, lastStamp;
+
+  auto writePoses = [&]() {
+    loam::PipelinePose pose;
+    while (executor ? executor->pullPose(pose) : pipeline->pullPose(pose))
+    {
+      auto const& t = pose.times;
+      nPoses++;
+      nMapped += pose.mapped;
+      stageSum[0] += t.registration;
+      stageSum[1] += t.odometry;
+      stageSum[2] += t.mapping;
+      stageSum[3] += t.maintenance;
+
+      if (!options.trajectoryPath.empty())
+        trajectory.write(pose.stamp, options.odometryOnly ? pose.odometry : pose.integrated);
+
+      if (timing)
+      {
+        fprintf(timing.get(), "%.9f,%.3f,%.3f,%.3f,%.3f,%.3f,%d\n",
+                loam::toSec(pose.stamp.time_since_epoch()),
+                t.registration * 1e3, t.odometry * 1e3, t.mapping * 1e3, t.maintenance * 1e3,
+                (t.registration + t.odometry + t.mapping + t.maintenance) * 1e3, int(pose.mapped));
+      }
+    }
+  };
+
+  auto handler = [&](const loam::SweepLogRecord& record) {
+    if (record.type == loam::IMU_RECORD)
+    {
+      if (!options.logPath.empty() && !log.writeImu(record.imu))
+        return false;
+      if (executor)
+        executor->pushImu(record.imu);
+      else
+        pipeline->pushImu(record.imu);
+      return true;
+    }
+
+    if (!options.logPath.empty() && !log.writeSweep(record.sweep, record.stamp))
+      return false;
+    if (nSweeps++ < size_t(options.skipSweeps))
+      return true;
+
+    if (!hasStamp)
+      firstStamp = record.stamp;
+    lastStamp = record.stamp;
+    hasStamp = true;
+
+    if (executor)
+      executor->pushSweep(record.sweep, record.stamp);
+    else
+      pipeline->pushSweep(record.sweep, record.stamp);
+    writePoses();
+    return true;
+  };
+
+  auto start = std::chrono::steady_clock::now();
+  bool isLog = options.input.size() > 7 && options.input.compare(options.input.size() - 7, 7, ".sweeps") == 0;
+  bool ok = isLog ? readSweepLog(options.input, handler) : readBag(options.input, options, handler);
+
+  if (executor)
+  {
+    executor->flush();
+    executor->stop();
+    writePoses();
+  }
+  double wallTime = loam::lap(start);
+
+  if (!options.logPath.empty() && !log.close())
+  {
+    ROS_ERROR("Could not write sweep log %s!", options.logPath.c_str());
+    ok = false;
+  }
+  if (!options.trajectoryPath.empty() && !trajectory.close())
+  {
+    ROS_ERROR("Could not write trajectory file %s!", options.trajectoryPath.c_str());
+    ok = false;
+  }
+
+  double duration = hasStamp ? loam::toSec(lastStamp - firstStamp) + options.scanPeriod : 0;
+  ROS_INFO("Processed %zu sweeps (%zu mapped) in %.2f s, %.1fx real time.",
+           nPoses, nMapped, wallTime, wallTime > 0 ? duration / wallTime : 0.0);
+  if (nPoses > 0)
+  {
+    ROS_INFO("Mean stage times per sweep: registration %.2f ms, odometry %.2f ms, mapping %.2f ms, maintenance %.3f ms.",
+             stageSum[0] / nPoses * 1e3, stageSum[1] / nPoses * 1e3, stageSum[2] / nPoses * 1e3, stageSum[3] / nPoses * 1e3);
+  }
+
+  return ok ? 0 : 1;
+}
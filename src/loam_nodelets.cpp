@@ -0,0 +1,123 @@
+#include <memory>
+
+#include <nodelet/nodelet.h>
+#include <pluginlib/class_list_macros.h>
+
+#include "loam_velodyne/MultiScanRegistration.h"
+#include "loam_velodyne/LaserOdometry.h"
+#include "loam_velodyne/LaserMapping.h"
+#include "loam_velodyne/TransformMaintenance.h"
+
+
+// Nodelet variants of the four LOAM nodes. Loaded into a common nodelet manager, the components hand
+// the feature clouds to each other as shared pcl::PointCloud pointers without serialization (see
+// publishCloudMsg()). The components are the same as in the standalone nodes. In polling mode
+// (default, eventDriven false) the polling loop of LaserOdometry::spin() / LaserMapping::spin() is
+// replaced by a timer on the nodelet callback queue, which never runs concurrently with the message
+// handlers of the same nodelet. In event driven mode the message handlers trigger the processing.
+
+namespace loam
+{
+
+/** \brief Nodelet running a MultiScanRegistration component. */
+class MultiScanRegistrationNodelet : public nodelet::Nodelet
+{
+private:
+  void onInit() override
+  {
+    _multiScan.reset(new MultiScanRegistration());
+    if (!_multiScan->setup(getNodeHandle(), getPrivateNodeHandle()))
+      NODELET_ERROR("multiScanRegistration nodelet initialization failed!");
+  }
+
+  std::unique_ptr<MultiScanRegistration> _multiScan;
+};
+
+
+
+/** \brief Nodelet running a LaserOdometry component. */
+class LaserOdometryNodelet : public nodelet::Nodelet
+{
+public:
+  ~LaserOdometryNodelet()
+  {
+    _processTimer.stop();
+  }
+
+private:
+  void onInit() override
+  {
+    _laserOdom.reset(new LaserOdometry(0.1));
+    if (!_laserOdom->setup(getNodeHandle(), getPrivateNodeHandle()))
+    {
+      NODELET_ERROR("laserOdometry nodelet initialization failed!");
+      return;
+    }
+
+    // in polling mode, try processing new data at the rate of LaserOdometry::spin()
+    if (!_laserOdom->eventDriven())
+      _processTimer = getNodeHandle().createTimer(ros::Duration(0.01),
+                                                  [this](const ros::TimerEvent&) { _laserOdom->process(); });
+  }
+
+  std::unique_ptr<LaserOdometry> _laserOdom;
+  ros::Timer _processTimer;
+};
+
+
+
+/** \brief Nodelet running a LaserMapping component. */
+class LaserMappingNodelet : public nodelet::Nodelet
+{
+public:
+  ~LaserMappingNodelet()
+  {
+    _processTimer.stop();
+    if (_laserMapping)
+      _laserMapping->shutdown();
+  }
+
+private:
+  void onInit() override
+  {
+    _laserMapping.reset(new LaserMapping());
+    if (!_laserMapping->setup(getNodeHandle(), getPrivateNodeHandle()))
+    {
+      NODELET_ERROR("laserMapping nodelet initialization failed!");
+      _laserMapping.reset();
+      return;
+    }
+
+    // in polling mode, try processing buffered data at the rate of LaserMapping::spin()
+    if (!_laserMapping->eventDriven())
+      _processTimer = getNodeHandle().createTimer(ros::Duration(0.01),
+                                                  [this](const ros::TimerEvent&) { _laserMapping->process(); });
+  }
+
+  std::unique_ptr<LaserMapping> _laserMapping;
+  ros::Timer _processTimer;
+};
+
+
+
+/** \brief Nodelet running a TransformMaintenance component. */
+class TransformMaintenanceNodelet : public nodelet::Nodelet
+{
+private:
+  void onInit() override
+  {
+    _transMaintenance.reset(new TransformMaintenance());
+    if (!_transMaintenance->setup(getNodeHandle(), getPrivateNodeHandle()))
+      NODELET_ERROR("transformMaintenance nodelet initialization failed!");
+  }
+
+  std::unique_ptr<TransformMaintenance> _transMaintenance;
+};
+
+} // end namespace loam
+
+
+PLUGINLIB_EXPORT_CLASS(loam::MultiScanRegistrationNodelet, nodelet::Nodelet)
+PLUGINLIB_EXPORT_CLASS(loam::LaserOdometryNodelet, nodelet::Nodelet)
+PLUGINLIB_EXPORT_CLASS(loam::LaserMappingNodelet, nodelet::Nodelet)
+PLUGINLIB_EXPORT_CLASS(loam::TransformMaintenanceNodelet, nodelet::Nodelet)
@@ -0,0 +1,84 @@
+#include <map>
+#include <tuple>
+
+#include <ros/ros.h>
+#include <loam_velodyne/MapCubeUpdate.h>
+#include "loam_velodyne/common.h"
+#include "loam_velodyne/MapCubeCodec.h"
+
+
+// Reassembles the incremental map updates of laserMapping (incrementalMap mode) into a map cloud. Meant
+// to run on the receiving side of a slow link: only the modified cubes go over the link, the full map
+// cloud is published locally on every update. Lost updates are detected by their sequence numbers, the
+// map is complete again after the next key frame. A sequence number falling back marks a restarted
+// laserMapping, whose map replaces the assembled one.
+
+typedef std::tuple<int, int, int> CubeKey;
+
+std::map<CubeKey, pcl::PointCloud<pcl::PointXYZI> > cubes;   ///< map points by world cube coordinates
+ros::Publisher pubMap;                                        ///< map cloud publisher
+bool receivedUpdate = false;                                  ///< flag if an update has been received
+bool synchronized = false;                                    ///< flag if no update has been lost since the last key frame
+uint32_t nextSequence = 0;                                    ///< expected sequence number of the next update
+
+
+void mapCubeUpdateHandler(const loam_velodyne::MapCubeUpdate::ConstPtr& update)
+{
+  if ((update->keyFrame && update->sequence == 0) || (receivedUpdate && update->sequence < nextSequence))
+  {
+    // laserMapping (re)started with a new map, its first key frame may have been lost as well
+    cubes.clear();
+    synchronized = false;
+  }
+  else if (receivedUpdate && update->sequence > nextSequence)
+  {
+    ROS_WARN("Lost %u map updates, the map is incomplete until the next key frame!", update->sequence - nextSequence);
+    synchronized = false;
+  }
+
+  if (update->keyFrame && !synchronized)
+  {
+    ROS_INFO("Map synchronized by key frame %u", update->sequence);
+    synchronized = true;
+  }
+  receivedUpdate = true;
+  nextSequence = update->sequence + 1;
+
+  loam::QuantizedMapCube cube;
+  for (auto const& cubeMsg : update->cubes)
+  {
+    cube.cubeX = cubeMsg.x;
+    cube.cubeY = cubeMsg.y;
+    cube.cubeZ = cubeMsg.z;
+    cube.points = cubeMsg.points;
+
+    // an update replaces the previous points of its cube
+    auto& cloud = cubes[std::make_tuple(cube.cubeX, cube.cubeY, cube.cubeZ)];
+    cloud.clear();
+    loam::dequantizeMapCube(cube, update->cubeSize, cloud);
+  }
+
+  if (pubMap.getNumSubscribers() == 0)
+    return;
+
+  pcl::PointCloud<pcl::PointXYZI>::Ptr map(new pcl::PointCloud<pcl::PointXYZI>());
+  for (auto const& entry : cubes)
+    *map += entry.second;
+  map->header.stamp = pcl_conversions::toPCL(update->header.stamp);
+  map->header.frame_id = update->header.frame_id;
+  pubMap.publish(map);
+}
+
+
+/** Main node entry point. */
+int main(int argc, char **argv)
+{
+  ros::init(argc, argv, "mapCubeAssembler");
+  ros::NodeHandle node;
+
+  pubMap = node.advertise<pcl::PointCloud<pcl::PointXYZI> >("/laser_cloud_map", 1);
+  ros::Subscriber subUpdate = node.subscribe("/laser_cloud_map_updates", 5, mapCubeUpdateHandler);
+
+  ros::spin();
+  return 0;
+}
@@ -0,0 +1,164 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+
+#include "loam_velodyne/ShmSweepRing.h"
+#include "loam_velodyne/SweepLog.h"
+
+
+// Reference writer of the shared memory sweep ring (see ShmSweepRing.h): replays the sweeps of a sweep
+// log (see loamBatch --write-log) into the ring at the recorded rate, standing in for a lidar driver.
+// Without ROS dependencies, so that a driver can follow it directly.
+
+/** Writer options. */
+struct WriterOptions
+{
+  std::string input;                  ///< input sweep log
+  std::string ring = "/loam_sweeps";  ///< shared memory object name
+  uint32_t slots = 4;                 ///< ring slots
+  uint32_t maxPoints = 300000;        ///< maximum points per sweep
+  double rate = 1.0;                  ///< replay speed factor, 0: as fast as possible
+  bool loop = false;                  ///< replay the log repeatedly (the stamps continue with the mean sweep spacing)
+  bool restamp = false;               ///< stamp the sweeps with the current time
+};
+
+
+
+void printUsage()
+{
+  printf("usage: shmSweepWriter [options] <input.sweeps>\n"
+         "  --ring <name>         shared memory object name (default /loam_sweeps)\n"
+         "  --slots <n>           number of ring slots (default 4)\n"
+         "  --max-points <n>      maximum number of points per sweep (default 300000)\n"
+         "  --rate <factor>       replay speed factor, 0: as fast as possible (default 1)\n"
+         "  --loop                replay the log repeatedly, continuing the stamps\n"
+         "  --restamp             stamp the sweeps with the current time\n");
+}
+
+
+
+bool parseOptions(int argc, char **argv, WriterOptions& options)
+{
+  for (int i = 1; i < argc; i++)
+  {
+    std::string arg = argv[i];
+    bool hasValue = i + 1 < argc;
+
+    if (arg == "--loop")
+      options.loop = true;
+    else if (arg == "--restamp")
+      options.restamp = true;
+    else if (arg == "--ring" && hasValue)
+      options.ring = argv[++i];
+    else if (arg == "--slots" && hasValue)
+      options.slots = std::atoi(argv[++i]);
+    else if (arg == "--max-points" && hasValue)
+      options.maxPoints = std::atoi(argv[++i]);
+    else if (arg == "--rate" && hasValue)
+      options.rate = std::atof(argv[++i]);
+    else if (arg.compare(0, 2, "--") != 0 && options.input.empty())
+      options.input = arg;
+    else
+    {
+      fprintf(stderr, "Invalid argument: %s\n", arg.c_str());
+      return false;
+    }
+  }
+
+  if (options.input.empty() || options.slots < 1 || options.maxPoints < 1 || options.rate < 0)
+  {
+    fprintf(stderr, "No input file given, or invalid slots, maximum points or rate!\n");
+    return false;
+  }
+
+  return true;
+}
+
+
+
+/** Main writer entry point. */
+int main(int argc, char **argv)
+{
+  WriterOptions options;
+  if (!parseOptions(argc, argv, options))
+  {
+    printUsage();
+    return 1;
+  }
+
+  loam::ShmSweepRingWriter ring;
+  if (!ring.create(options.ring, options.slots, options.maxPoints))
+  {
+    fprintf(stderr, "Could not create shared memory sweep ring %s!\n", options.ring.c_str());
+    return 1;
+  }
+
+  loam::SweepLogReader log;
+  loam::SweepLogRecord record;
+  size_t nWritten = 0;
+  size_t nTooLarge = 0;
+  loam::Time::duration loopOffset(0);
+
+  do
+  {
+    if (!log.open(options.input))
+    {
+      fprintf(stderr, "Could not open sweep log %s!\n", options.input.c_str());
+      return 1;
+    }
+
+    // the replay clock starts with the first sweep of each pass
+    bool first = true;
+    size_t nSweeps = 0;
+    loam::Time firstStamp, lastStamp;
+    auto start = std::chrono::steady_clock::now();
+
+    while (log.next(record))
+    {
+      if (record.type != loam::SWEEP_RECORD)
+        continue;
+
+      if (first)
+        firstStamp = record.stamp;
+      first = false;
+      lastStamp = record.stamp;
+      nSweeps++;
+
+      if (options.rate > 0)
+        std::this_thread::sleep_until(start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                                                  (record.stamp - firstStamp) / options.rate));
+
+      loam::Time stamp = options.restamp ? std::chrono::system_clock::now() : record.stamp + loopOffset;
+      if (ring.write(record.sweep, stamp))
+        nWritten++;
+      else
+        nTooLarge++;
+    }
+
+    if (!log.eof())
+      fprintf(stderr, "Sweep log %s is truncated or invalid, stopped at the last complete record.\n", options.input.c_str());
+
+    // nothing to replay (and to loop over)
+    if (nSweeps == 0)
+    {
+      fprintf(stderr, "Sweep log %s contains no sweeps!\n", options.input.c_str());
+      return 1;
+    }
+
+    // continue the stamps of the next pass one sweep period after the last sweep, the period being the
+    // mean sweep spacing of the log (0.1 s for a single sweep)
+    if (nSweeps > 1)
+      loopOffset += (lastStamp - firstStamp) + (lastStamp - firstStamp) / (nSweeps - 1);
+    else
+      loopOffset += std::chrono::milliseconds(100);
+  }
+  while (options.loop);
+
+  printf("Wrote %zu sweeps to %s, skipped %zu sweeps with more than %u points.\n",
+         nWritten, options.ring.c_str(), nTooLarge, options.maxPoints);
+
+  // removing the ring on exit leaves the mapping of the reader intact, it still reads the last sweeps
+  return 0;
+}
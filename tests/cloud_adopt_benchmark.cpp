@@ -0,0 +1,85 @@
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <vector>
+
+#include <pcl/filters/filter.h>
+#include <pcl/point_types.h>
+
+#include "loam_velodyne/cloud_utils.h"
+
+
+// Micro-benchmark of taking over a received cloud with loam::adoptFinitePoints() (see cloud_utils.h)
+// against copying it with pcl::removeNaNFromPointCloud(), as the laserOdometry / laserMapping handlers
+// did before. 100k point clouds, dense and with 2% NaN points.
+
+typedef pcl::PointCloud<pcl::PointXYZI> Cloud;
+
+const size_t NUM_POINTS = 100000;
+const int NUM_ROUNDS = 200;
+
+
+
+/** \brief Create a received cloud, the intensity encodes the scan ring and relative point time. */
+Cloud makeCloud(const bool& withNaN)
+{
+  Cloud cloud;
+  cloud.points.resize(NUM_POINTS);
+  for (size_t i = 0; i < NUM_POINTS; i++)
+  {
+    cloud.points[i].x = float(i);
+    cloud.points[i].y = 1;
+    cloud.points[i].z = 2;
+    cloud.points[i].intensity = (i % 16) + 0.01f * (i % 10);
+    if (withNaN && i % 50 == 0)
+      cloud.points[i].x = NAN;
+  }
+  cloud.width = NUM_POINTS;
+  cloud.height = 1;
+  cloud.is_dense = !withNaN;
+  return cloud;
+}
+
+
+
+void benchmark(const bool& withNaN)
+{
+  // a fresh received cloud per round, adopting empties it
+  std::vector<Cloud> copyInput(NUM_ROUNDS, makeCloud(withNaN));
+  std::vector<Cloud> adoptInput(NUM_ROUNDS, makeCloud(withNaN));
+  Cloud copied, adopted;
+  std::vector<int> indices;
+  double copyTime = 0, adoptTime = 0;
+
+  for (int r = 0; r < NUM_ROUNDS; r++)
+  {
+    auto start = std::chrono::steady_clock::now();
+    pcl::removeNaNFromPointCloud(copyInput[r], copied, indices);
+    copyTime += std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+
+    start = std::chrono::steady_clock::now();
+    loam::adoptFinitePoints(adoptInput[r], adopted);
+    adoptTime += std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+  }
+
+  // both paths have to deliver the same points, including the intensity
+  bool same = copied.size() == adopted.size();
+  for (size_t i = 0; same && i < copied.size(); i++)
+  {
+    same = copied.points[i].x == adopted.points[i].x
+           && copied.points[i].intensity == adopted.points[i].intensity;
+  }
+
+  printf("%-7s %zu points: removeNaNFromPointCloud %7.1f us, adoptFinitePoints %7.1f us%s\n",
+         withNaN ? "2% NaN," : "dense,", adopted.size(), copyTime / NUM_ROUNDS, adoptTime / NUM_ROUNDS,
+         same ? "" : " (RESULTS DIFFER!)");
+}
+
+
+
+int main(int argc, char **argv)
+{
+  benchmark(false);
+  benchmark(true);
+  return 0;
+}
@@ -0,0 +1,122 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "loam_velodyne/nanoflann_pcl.h"
+
+
+// Micro-benchmark of the packed L2 point adaptor of nanoflann::KdTreeFLANN (see nanoflann_pcl.h)
+// against the generic cloud adaptor it replaced, which branched on the dimension and on the optional
+// indices vector for every coordinate access and went through SO3_Adaptor. Builds and 5-NN queries on
+// an odometry sized (2k points) and a map sized (100k points) random cloud.
+
+/** The generic cloud adaptor replaced by the packed adaptor, kept as reference. */
+struct GenericCloudAdaptor
+{
+  inline size_t kdtree_get_point_count() const
+  {
+    if (indices) return indices->size();
+    if (pcl) return pcl->points.size();
+    return 0;
+  }
+
+  inline float kdtree_get_pt(const size_t idx, int dim) const
+  {
+    const pcl::PointXYZI& p = (indices) ? pcl->points[(*indices)[idx]] : pcl->points[idx];
+    if (dim == 0) return p.x;
+    else if (dim == 1) return p.y;
+    else if (dim == 2) return p.z;
+    else return 0.0;
+  }
+
+  template <class BBOX> bool kdtree_get_bbox(BBOX&) const { return false; }
+
+  pcl::PointCloud<pcl::PointXYZI>::ConstPtr pcl;
+  boost::shared_ptr<const std::vector<int> > indices;
+};
+
+typedef nanoflann::KDTreeSingleIndexAdaptor<
+  nanoflann::SO3_Adaptor<float, GenericCloudAdaptor>, GenericCloudAdaptor, 3, int> GenericKdTree;
+
+const int NUM_BUILDS = 20;
+const int NUM_QUERIES = 200000;
+const int K = 5;
+
+
+
+double elapsedMs(const std::chrono::steady_clock::time_point& start)
+{
+  return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+
+
+void benchmark(const int& numPoints)
+{
+  pcl::PointCloud<pcl::PointXYZI>::Ptr cloud(new pcl::PointCloud<pcl::PointXYZI>);
+  for (int i = 0; i < numPoints; i++)
+  {
+    pcl::PointXYZI p;
+    p.x = (std::rand() % 10000) / 100.0f;
+    p.y = (std::rand() % 10000) / 100.0f;
+    p.z = (std::rand() % 1000) / 100.0f;
+    p.intensity = 0;
+    cloud->push_back(p);
+  }
+
+  std::vector<int> indices(K);
+  std::vector<float> sqDistances(K);
+  double checksum[2] = { 0, 0 };
+
+  // generic adaptor
+  GenericCloudAdaptor adaptor;
+  adaptor.pcl = cloud;
+  GenericKdTree genericTree(3, adaptor);
+  nanoflann::SearchParams params;
+
+  auto start = std::chrono::steady_clock::now();
+  for (int r = 0; r < NUM_BUILDS; r++)
+    genericTree.buildIndex();
+  double genericBuild = elapsedMs(start) / NUM_BUILDS;
+
+  start = std::chrono::steady_clock::now();
+  for (int q = 0; q < NUM_QUERIES; q++)
+  {
+    nanoflann::KNNResultSet<float, int> resultSet(K);
+    resultSet.init(indices.data(), sqDistances.data());
+    genericTree.findNeighbors(resultSet, cloud->points[q % numPoints].data, params);
+    checksum[0] += sqDistances[K - 1];
+  }
+  double genericQuery = elapsedMs(start) * 1e6 / NUM_QUERIES;
+
+  // packed adaptor
+  nanoflann::KdTreeFLANN<pcl::PointXYZI> packedTree;
+
+  start = std::chrono::steady_clock::now();
+  for (int r = 0; r < NUM_BUILDS; r++)
+    packedTree.setInputCloud(cloud);
+  double packedBuild = elapsedMs(start) / NUM_BUILDS;
+
+  start = std::chrono::steady_clock::now();
+  for (int q = 0; q < NUM_QUERIES; q++)
+  {
+    packedTree.nearestKSearch(cloud->points[q % numPoints], K, indices, sqDistances);
+    checksum[1] += sqDistances[K - 1];
+  }
+  double packedQuery = elapsedMs(start) * 1e6 / NUM_QUERIES;
+
+  printf("%6d points: build %7.3f -> %7.3f ms, %d-NN query %6.1f -> %6.1f ns%s\n",
+         numPoints, genericBuild, packedBuild, K, genericQuery, packedQuery,
+         checksum[0] == checksum[1] ? "" : " (RESULTS DIFFER!)");
+}
+
+
+
+int main(int argc, char **argv)
+{
+  std::srand(42);
+  benchmark(2000);
+  benchmark(100000);
+  return 0;
+}
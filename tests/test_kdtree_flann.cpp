@@ -0,0 +1,195 @@
+#include <algorithm>
+#include <atomic>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "loam_velodyne/nanoflann_pcl.h"
+
+
+// Stress test of the reentrant searches of nanoflann::KdTreeFLANN: several threads search the same
+// tree at once and have to get the results of a brute force search.
+
+const int NUM_THREADS = 8;
+const int NUM_ROUNDS = 5;
+const float RADIUS = 1.5f;
+const int K = 5;
+
+class KdTreeFLANNTest : public ::testing::Test
+{
+protected:
+  void SetUp() override
+  {
+    std::mt19937 rng(1);
+    std::uniform_real_distribution<float> coord(-20, 20);
+
+    _cloud.reset(new pcl::PointCloud<pcl::PointXYZI>());
+    for (int i = 0; i < 20000; i++)
+      _cloud->push_back(randomPoint(rng, coord));
+    for (int i = 0; i < 2000; i++)
+      _queries.push_back(randomPoint(rng, coord));
+  }
+
+  static pcl::PointXYZI randomPoint(std::mt19937& rng, std::uniform_real_distribution<float>& coord)
+  {
+    pcl::PointXYZI p;
+    p.x = coord(rng);
+    p.y = coord(rng);
+    p.z = coord(rng);
+    p.intensity = 0;
+    return p;
+  }
+
+  /** \brief Sorted squared distances of all cloud points to the query point. */
+  std::vector<float> bruteForceDistances(const pcl::PointXYZI& query) const
+  {
+    std::vector<float> sqDistances;
+    sqDistances.reserve(_cloud->size());
+    for (auto const& p : _cloud->points)
+    {
+      float dx = p.x - query.x, dy = p.y - query.y, dz = p.z - query.z;
+      sqDistances.push_back(dx * dx + dy * dy + dz * dz);
+    }
+    std::sort(sqDistances.begin(), sqDistances.end());
+    return sqDistances;
+  }
+
+  /** \brief Run a search on all queries from NUM_THREADS threads at once, return the number of errors. */
+  template <class Check>
+  int runConcurrently(Check check) const
+  {
+    std::atomic<int> errors(0);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < NUM_THREADS; t++)
+    {
+      threads.emplace_back([&, t] {
+        // each thread keeps its own result vectors, like the callers of the tree
+        std::vector<int> indices;
+        std::vector<float> sqDistances;
+        for (int round = 0; round < NUM_ROUNDS; round++)
+        {
+          // start at different queries, so that the threads do not run in lock step
+          for (size_t i = 0; i < _queries.size(); i++)
+          {
+            size_t q = (i + t * _queries.size() / NUM_THREADS) % _queries.size();
+            if (!check(q, indices, sqDistances))
+              errors++;
+          }
+        }
+      });
+    }
+    for (auto& thread : threads)
+      thread.join();
+    return errors;
+  }
+
+  pcl::PointCloud<pcl::PointXYZI>::Ptr _cloud;
+  std::vector<pcl::PointXYZI> _queries;
+};
+
+
+
+TEST_F(KdTreeFLANNTest, concurrentRadiusSearch)
+{
+  nanoflann::KdTreeFLANN<pcl::PointXYZI> tree;
+  tree.setInputCloud(_cloud);
+
+  std::vector<int> expected(_queries.size());
+  for (size_t q = 0; q < _queries.size(); q++)
+  {
+    auto sqDistances = bruteForceDistances(_queries[q]);
+    expected[q] = std::lower_bound(sqDistances.begin(), sqDistances.end(), RADIUS * RADIUS) - sqDistances.begin();
+  }
+
+  int errors = runConcurrently([&](size_t q, std::vector<int>& indices, std::vector<float>& sqDistances) {
+    int n = tree.radiusSearch(_queries[q], RADIUS, indices, sqDistances);
+    return n == expected[q]
+           && indices.size() == size_t(n) && sqDistances.size() == size_t(n)
+           && std::is_sorted(sqDistances.begin(), sqDistances.end());
+  });
+  EXPECT_EQ(0, errors);
+}
+
+
+
+TEST_F(KdTreeFLANNTest, concurrentNearestKSearch)
+{
+  nanoflann::KdTreeFLANN<pcl::PointXYZI> tree;
+  tree.setInputCloud(_cloud);
+
+  std::vector<float> expected(_queries.size());
+  for (size_t q = 0; q < _queries.size(); q++)
+    expected[q] = bruteForceDistances(_queries[q])[K - 1];
+
+  int errors = runConcurrently([&](size_t q, std::vector<int>& indices, std::vector<float>& sqDistances) {
+    int n = tree.nearestKSearch(_queries[q], K, indices, sqDistances);
+    return n == K && sqDistances[K - 1] == expected[q]
+           && std::is_sorted(sqDistances.begin(), sqDistances.end());
+  });
+  EXPECT_EQ(0, errors);
+}
+
+
+
+TEST_F(KdTreeFLANNTest, approximateSearchHonoursEpsilon)
+{
+  const float eps = 0.5f;
+  nanoflann::KdTreeFLANN<pcl::PointXYZI> exactTree, approxTree;
+  approxTree.setEpsilon(eps);
+  exactTree.setInputCloud(_cloud);
+  approxTree.setInputCloud(_cloud);
+
+  // the k-th neighbour of an approximate search is at most (1 + eps) times farther away
+  int differing = 0;
+  std::vector<int> exactIndices, approxIndices;
+  std::vector<float> exactDistances, approxDistances;
+  for (auto const& query : _queries)
+  {
+    ASSERT_EQ(K, exactTree.nearestKSearch(query, K, exactIndices, exactDistances));
+    ASSERT_EQ(K, approxTree.nearestKSearch(query, K, approxIndices, approxDistances));
+    EXPECT_LE(approxDistances[K - 1], (1 + eps) * (1 + eps) * exactDistances[K - 1] + 1e-4f);
+    if (approxIndices != exactIndices)
+      differing++;
+  }
+
+  // the epsilon has to reach the tree, otherwise the searches are all exact
+  EXPECT_GT(differing, 0);
+}
+
+
+
+TEST_F(KdTreeFLANNTest, batchedSearchMatchesSingleSearch)
+{
+  nanoflann::KdTreeFLANN<pcl::PointXYZI> tree;
+  tree.setInputCloud(_cloud);
+
+  // a Morton ordered batch split across threads, then a small unsorted one reusing the order buffer
+  for (size_t numQueries : { _queries.size(), size_t(10), size_t(0) })
+  {
+    std::vector<int> batchIndices(numQueries * K);
+    std::vector<float> batchDistances(numQueries * K);
+    tree.nearestKSearchBatch(_queries.data(), numQueries, K, batchIndices.data(), batchDistances.data());
+
+    std::vector<int> indices;
+    std::vector<float> sqDistances;
+    for (size_t q = 0; q < numQueries; q++)
+    {
+      ASSERT_EQ(K, tree.nearestKSearch(_queries[q], K, indices, sqDistances));
+      for (int j = 0; j < K; j++)
+      {
+        EXPECT_EQ(indices[j], batchIndices[q * K + j]) << "query " << q << " of " << numQueries;
+        EXPECT_EQ(sqDistances[j], batchDistances[q * K + j]) << "query " << q << " of " << numQueries;
+      }
+    }
+  }
+}
+
+
+
+int main(int argc, char **argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,125 @@
+#include <cmath>
+#include <random>
+
+#include <gtest/gtest.h>
+
+#include "loam_velodyne/MapCubeCodec.h"
+
+
+using namespace loam;
+
+const float CUBE_SIZE = 50;                             ///< cube edge length of laserMapping
+const float RESOLUTION = CUBE_SIZE / 65536;             ///< quantization step
+
+
+
+pcl::PointXYZI makePoint(const float& x, const float& y, const float& z)
+{
+  pcl::PointXYZI p;
+  p.x = x;
+  p.y = y;
+  p.z = z;
+  p.intensity = 1;
+  return p;
+}
+
+
+
+QuantizedMapCube makeCube(const int& x, const int& y, const int& z)
+{
+  QuantizedMapCube cube;
+  cube.cubeX = x;
+  cube.cubeY = y;
+  cube.cubeZ = z;
+  return cube;
+}
+
+
+
+TEST(MapCubeCodecTest, roundTripWithinHalfResolution)
+{
+  QuantizedMapCube cube = makeCube(2, -1, 0);
+  std::mt19937 random(42);
+  std::uniform_real_distribution<float> offset(-CUBE_SIZE / 2, CUBE_SIZE / 2 - RESOLUTION);
+
+  pcl::PointCloud<pcl::PointXYZI> cloud;
+  for (int i = 0; i < 10000; i++)
+    cloud.push_back(makePoint(2 * CUBE_SIZE + offset(random), -CUBE_SIZE + offset(random), offset(random)));
+  // the cube center and corners
+  cloud.push_back(makePoint(2 * CUBE_SIZE, -CUBE_SIZE, 0));
+  cloud.push_back(makePoint(1.5f * CUBE_SIZE, -1.5f * CUBE_SIZE, -0.5f * CUBE_SIZE));
+
+  quantizeMapCube(cloud, CUBE_SIZE, cube);
+  ASSERT_EQ(3 * cloud.size(), cube.points.size());
+
+  pcl::PointCloud<pcl::PointXYZI> decoded;
+  dequantizeMapCube(cube, CUBE_SIZE, decoded);
+  ASSERT_EQ(cloud.size(), decoded.size());
+
+  // half a quantization step, plus the float rounding of the map coordinates
+  const float bound = RESOLUTION / 2 + 2e-5f;
+  for (size_t i = 0; i < cloud.size(); i++)
+  {
+    EXPECT_NEAR(cloud[i].x, decoded[i].x, bound) << "point " << i;
+    EXPECT_NEAR(cloud[i].y, decoded[i].y, bound) << "point " << i;
+    EXPECT_NEAR(cloud[i].z, decoded[i].z, bound) << "point " << i;
+    EXPECT_EQ(0, decoded[i].intensity);
+  }
+}
+
+
+
+TEST(MapCubeCodecTest, pointsOutsideCubeAreClamped)
+{
+  QuantizedMapCube cube = makeCube(0, 1, -1);
+  pcl::PointCloud<pcl::PointXYZI> cloud;
+  cloud.push_back(makePoint(CUBE_SIZE, CUBE_SIZE - 100, -CUBE_SIZE + CUBE_SIZE / 2));
+  cloud.push_back(makePoint(-1000, CUBE_SIZE + 1000, -CUBE_SIZE - 1000));
+
+  quantizeMapCube(cloud, CUBE_SIZE, cube);
+  ASSERT_EQ(6u, cube.points.size());
+  EXPECT_EQ(32767, cube.points[0]);
+  EXPECT_EQ(-32768, cube.points[1]);
+  EXPECT_EQ(32767, cube.points[2]);
+  EXPECT_EQ(-32768, cube.points[3]);
+  EXPECT_EQ(32767, cube.points[4]);
+  EXPECT_EQ(-32768, cube.points[5]);
+
+  // the clamped points end up on the cube border
+  pcl::PointCloud<pcl::PointXYZI> decoded;
+  dequantizeMapCube(cube, CUBE_SIZE, decoded);
+  ASSERT_EQ(2u, decoded.size());
+  EXPECT_NEAR(CUBE_SIZE / 2 - RESOLUTION, decoded[0].x, 1e-5f);
+  EXPECT_NEAR(CUBE_SIZE / 2, decoded[0].y, 1e-5f);
+  EXPECT_NEAR(-CUBE_SIZE / 2 - RESOLUTION, decoded[0].z, 1e-5f);
+  EXPECT_NEAR(-CUBE_SIZE / 2, decoded[1].x, 1e-5f);
+  EXPECT_NEAR(1.5f * CUBE_SIZE - RESOLUTION, decoded[1].y, 1e-5f);
+  EXPECT_NEAR(-1.5f * CUBE_SIZE, decoded[1].z, 1e-5f);
+}
+
+
+
+TEST(MapCubeCodecTest, emptyCube)
+{
+  // quantizing an empty cloud drops previous points
+  QuantizedMapCube cube = makeCube(3, 3, 3);
+  cube.points.assign(6, 1);
+  quantizeMapCube(pcl::PointCloud<pcl::PointXYZI>(), CUBE_SIZE, cube);
+  EXPECT_TRUE(cube.points.empty());
+
+  // an empty cube appends nothing
+  pcl::PointCloud<pcl::PointXYZI> cloud;
+  cloud.push_back(makePoint(1, 2, 3));
+  dequantizeMapCube(cube, CUBE_SIZE, cloud);
+  ASSERT_EQ(1u, cloud.size());
+  EXPECT_EQ(1, cloud[0].x);
+  EXPECT_EQ(1, cloud[0].intensity);
+}
+
+
+
+int main(int argc, char **argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
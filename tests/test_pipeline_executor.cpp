@@ -0,0 +1,362 @@
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "loam_velodyne/Pipeline.h"
+#include "loam_velodyne/PipelineExecutor.h"
+#include "loam_velodyne/StageQueue.h"
+
+
+using namespace loam;
+
+// Tests of the StageQueue overflow policies and of the PipelineExecutor policies and flush / stop,
+// checked against the serial Pipeline. The executor tests only check results which do not depend on
+// the thread timing (which sweeps are dropped or skipped does).
+
+const int NUM_SWEEPS = 12;
+
+
+
+/** \brief Simulated VLP-16 sweep in a 20 x 20 x 6 m box room, the sensor moved by tx along x. */
+pcl::PointCloud<pcl::PointXYZ> boxRoomSweep(const float& tx)
+{
+  pcl::PointCloud<pcl::PointXYZ> sweep;
+  for (int a = 0; a < 1800; a++)
+  {
+    float azimuth = float(-M_PI + 2 * M_PI * a / 1800);
+    for (int ring = 0; ring < 16; ring++)
+    {
+      float elevation = float((-15 + 2 * ring) * M_PI / 180);
+      float dx = std::cos(elevation) * std::cos(azimuth);
+      float dy = std::cos(elevation) * std::sin(azimuth);
+      float dz = std::sin(elevation);
+
+      // distance to the nearest wall along the ray
+      float t = 1e9;
+      auto hit = [&](const float& d, const float& wall) { if (d > 1e-6) t = std::min(t, wall / d); };
+      hit(dx, 10 - tx);
+      hit(-dx, 10 + tx);
+      hit(dy, 10);
+      hit(-dy, 10);
+      hit(dz, 4);
+      hit(-dz, 2);
+
+      pcl::PointXYZ p;
+      p.x = dx * t;
+      p.y = dy * t;
+      p.z = dz * t;
+      sweep.push_back(p);
+    }
+  }
+  return sweep;
+}
+
+
+
+Time sweepTime(const int& i)
+{
+  return Time(std::chrono::milliseconds(100 * (i + 1)));
+}
+
+
+
+void expectSameTwist(const Twist& expected, const Twist& actual)
+{
+  EXPECT_EQ(expected.rot_x.rad(), actual.rot_x.rad());
+  EXPECT_EQ(expected.rot_y.rad(), actual.rot_y.rad());
+  EXPECT_EQ(expected.rot_z.rad(), actual.rot_z.rad());
+  EXPECT_EQ(expected.pos.x(), actual.pos.x());
+  EXPECT_EQ(expected.pos.y(), actual.pos.y());
+  EXPECT_EQ(expected.pos.z(), actual.pos.z());
+}
+
+
+
+class PipelineExecutorTest : public ::testing::Test
+{
+protected:
+  static void SetUpTestCase()
+  {
+    for (int i = 0; i < NUM_SWEEPS; i++)
+      _sweeps.push_back(boxRoomSweep(0.1f * i));
+  }
+
+  /** \brief Run the sweeps through the serial pipeline. */
+  static std::vector<PipelinePose> runSerial(const uint16_t& ioRatio)
+  {
+    std::vector<PipelinePose> poses;
+    Pipeline pipeline(MultiScanMapper::Velodyne_VLP_16(), RegistrationParams(), ioRatio);
+    for (int i = 0; i < NUM_SWEEPS; i++)
+    {
+      pipeline.pushSweep(_sweeps[i], sweepTime(i));
+      PipelinePose pose;
+      while (pipeline.pullPose(pose))
+        poses.push_back(pose);
+    }
+    return poses;
+  }
+
+  /** \brief Push all sweeps at once into the executor, flush it and pull the poses. */
+  static std::vector<PipelinePose> runExecutor(PipelineExecutor& executor)
+  {
+    executor.start();
+    for (int i = 0; i < NUM_SWEEPS; i++)
+      executor.pushSweep(_sweeps[i], sweepTime(i));
+    executor.flush();
+
+    std::vector<PipelinePose> poses;
+    PipelinePose pose;
+    while (executor.pullPose(pose))
+      poses.push_back(pose);
+    executor.stop();
+    return poses;
+  }
+
+  /** \brief Run the sweeps through the executor with a slow mapping stage, timing the sweep pushes. */
+  static std::vector<PipelinePose> runSlowMapping(PipelineExecutor& executor, double& pushTime)
+  {
+    // always run the maximum number of mapping iterations
+    executor.mapping().setMaxIterations(100);
+    executor.mapping().setDeltaTAbort(0);
+    executor.mapping().setDeltaRAbort(0);
+
+    executor.start();
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < NUM_SWEEPS; i++)
+      executor.pushSweep(_sweeps[i], sweepTime(i));
+    pushTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    executor.flush();
+
+    std::vector<PipelinePose> poses;
+    PipelinePose pose;
+    while (executor.pullPose(pose))
+      poses.push_back(pose);
+    executor.stop();
+    return poses;
+  }
+
+  static std::vector<pcl::PointCloud<pcl::PointXYZ> > _sweeps;
+};
+
+std::vector<pcl::PointCloud<pcl::PointXYZ> > PipelineExecutorTest::_sweeps;
+
+
+
+TEST(StageQueueTest, blockProducerWaitsForRoom)
+{
+  StageQueue<int> queue(2);
+  ASSERT_TRUE(queue.push(1));
+  ASSERT_TRUE(queue.push(2));
+
+  std::atomic<bool> pushed(false);
+  std::thread producer([&] {
+    queue.push(3);
+    pushed = true;
+  });
+
+  // the producer stays blocked until an item is taken
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  EXPECT_FALSE(pushed);
+  EXPECT_EQ(2u, queue.size());
+
+  int item;
+  ASSERT_TRUE(queue.pop(item));
+  EXPECT_EQ(1, item);
+  producer.join();
+  EXPECT_TRUE(pushed);
+
+  ASSERT_TRUE(queue.pop(item));
+  EXPECT_EQ(2, item);
+  ASSERT_TRUE(queue.pop(item));
+  EXPECT_EQ(3, item);
+  EXPECT_EQ(0u, queue.dropped());
+}
+
+
+
+TEST(StageQueueTest, dropOldestDiscardsOldestItems)
+{
+  StageQueue<int> queue(2);
+  queue.setDropOldest(true);
+  for (int i = 1; i <= 5; i++)
+    ASSERT_TRUE(queue.push(i));
+
+  EXPECT_EQ(3u, queue.dropped());
+  EXPECT_EQ(2u, queue.size());
+
+  int item;
+  ASSERT_TRUE(queue.pop(item));
+  EXPECT_EQ(4, item);
+  ASSERT_TRUE(queue.pop(item));
+  EXPECT_EQ(5, item);
+}
+
+
+
+TEST(StageQueueTest, closeDrainsAndWakesUp)
+{
+  StageQueue<int> queue(1);
+  ASSERT_TRUE(queue.push(1));
+
+  // a producer blocked on the full queue returns false when the queue is closed
+  std::atomic<int> result(-1);
+  std::thread producer([&] { result = queue.push(2) ? 1 : 0; });
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  queue.close();
+  producer.join();
+  EXPECT_EQ(0, result);
+
+  // the queued item is still delivered, then pop() reports the end
+  int item;
+  ASSERT_TRUE(queue.pop(item));
+  EXPECT_EQ(1, item);
+  EXPECT_FALSE(queue.pop(item));
+  EXPECT_FALSE(queue.push(3));
+
+  // a consumer waiting on the empty queue returns false when the queue is closed
+  queue.reopen();
+  std::thread consumer([&] { int value; result = queue.pop(value) ? 1 : 0; });
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  queue.close();
+  consumer.join();
+  EXPECT_EQ(0, result);
+
+  // reopening discards the remaining items
+  queue.reopen();
+  ASSERT_TRUE(queue.push(4));
+  queue.reopen();
+  EXPECT_EQ(0u, queue.size());
+}
+
+
+
+TEST_F(PipelineExecutorTest, blockProducerMatchesSerialPipeline)
+{
+  auto expected = runSerial(2);
+  ASSERT_EQ(size_t(NUM_SWEEPS), expected.size());
+
+  PipelineExecutor executor(MultiScanMapper::Velodyne_VLP_16(), RegistrationParams(), 2, BLOCK_PRODUCER, 1);
+  auto poses = runExecutor(executor);
+
+  EXPECT_EQ(0u, executor.droppedSweeps());
+  EXPECT_EQ(0u, executor.skippedMappings());
+  ASSERT_EQ(expected.size(), poses.size());
+  for (size_t i = 0; i < poses.size(); i++)
+  {
+    EXPECT_TRUE(expected[i].stamp == poses[i].stamp);
+    EXPECT_EQ(expected[i].mapped, poses[i].mapped);
+    expectSameTwist(expected[i].odometry, poses[i].odometry);
+    expectSameTwist(expected[i].integrated, poses[i].integrated);
+  }
+}
+
+
+
+TEST_F(PipelineExecutorTest, dropOldestAccountsForEverySweep)
+{
+  PipelineExecutor executor(MultiScanMapper::Velodyne_VLP_16(), RegistrationParams(), 2, DROP_OLDEST, 1);
+  auto poses = runExecutor(executor);
+
+  // every sweep either has a pose or has been dropped, the poses keep the sweep order
+  EXPECT_EQ(size_t(NUM_SWEEPS), poses.size() + executor.droppedSweeps());
+  EXPECT_EQ(0u, executor.skippedMappings());
+  for (size_t i = 1; i < poses.size(); i++)
+    EXPECT_TRUE(poses[i - 1].stamp < poses[i].stamp);
+}
+
+
+
+TEST_F(PipelineExecutorTest, skipMappingKeepsAllOdometryPoses)
+{
+  // every sweep is a mapping sweep, so the odometry can queue up mapping sweeps for skipping
+  auto expected = runSerial(1);
+
+  PipelineExecutor executor(MultiScanMapper::Velodyne_VLP_16(), RegistrationParams(), 1, SKIP_MAPPING, 2);
+  auto poses = runExecutor(executor);
+
+  // no sweep is lost and the odometry does not depend on the mapping
+  EXPECT_EQ(0u, executor.droppedSweeps());
+  ASSERT_EQ(expected.size(), poses.size());
+  size_t mapped = 0;
+  for (size_t i = 0; i < poses.size(); i++)
+  {
+    EXPECT_TRUE(expected[i].stamp == poses[i].stamp);
+    expectSameTwist(expected[i].odometry, poses[i].odometry);
+    mapped += poses[i].mapped;
+  }
+
+  // each mapping sweep is either mapped or skipped, the last one is never skipped
+  EXPECT_EQ(poses.size(), mapped + executor.skippedMappings());
+  EXPECT_TRUE(poses.back().mapped);
+}
+
+
+
+TEST_F(PipelineExecutorTest, skipMappingDoesNotThrottleOdometry)
+{
+  auto expected = runSerial(2);
+
+  // with a mapping stage much slower than the odometry, the sweeps are handed over while the mapping is busy
+  PipelineExecutor blocking(MultiScanMapper::Velodyne_VLP_16(), RegistrationParams(), 2, BLOCK_PRODUCER, 1);
+  PipelineExecutor skipping(MultiScanMapper::Velodyne_VLP_16(), RegistrationParams(), 2, SKIP_MAPPING, 1);
+  double blockingTime, skippingTime;
+  runSlowMapping(blocking, blockingTime);
+  auto poses = runSlowMapping(skipping, skippingTime);
+
+  EXPECT_EQ(0u, skipping.droppedSweeps());
+  ASSERT_EQ(expected.size(), poses.size());
+  size_t mapped = 0;
+  for (size_t i = 0; i < poses.size(); i++)
+  {
+    EXPECT_TRUE(expected[i].stamp == poses[i].stamp);
+    expectSameTwist(expected[i].odometry, poses[i].odometry);
+    mapped += poses[i].mapped;
+  }
+
+  // the waiting mapping sweeps are superseded instead of holding up the odometry
+  EXPECT_EQ(size_t(NUM_SWEEPS / 2), mapped + skipping.skippedMappings());
+  EXPECT_GT(skipping.skippedMappings(), 0u);
+  EXPECT_TRUE(poses.back().mapped);
+  EXPECT_LT(1.5 * skippingTime, blockingTime) << "skipping " << skippingTime << " s, blocking " << blockingTime << " s";
+}
+
+
+
+TEST_F(PipelineExecutorTest, stopProcessesPushedSweepsAndRestarts)
+{
+  PipelineExecutor executor(MultiScanMapper::Velodyne_VLP_16(), RegistrationParams(), 2, BLOCK_PRODUCER, 1);
+
+  // stop() without flush() processes all pushed sweeps
+  executor.start();
+  for (int i = 0; i < 4; i++)
+    executor.pushSweep(_sweeps[i], sweepTime(i));
+  executor.stop();
+  executor.stop();
+
+  std::vector<PipelinePose> poses;
+  PipelinePose pose;
+  while (executor.pullPose(pose))
+    poses.push_back(pose);
+  ASSERT_EQ(4u, poses.size());
+
+  // after a restart, empty sweeps get no pose but count as processed for flush()
+  executor.start();
+  executor.pushSweep(pcl::PointCloud<pcl::PointXYZ>(), sweepTime(4));
+  executor.pushSweep(_sweeps[5], sweepTime(5));
+  executor.flush();
+  ASSERT_TRUE(executor.pullPose(pose));
+  EXPECT_TRUE(sweepTime(5) == pose.stamp);
+  EXPECT_FALSE(executor.pullPose(pose));
+}
+
+
+
+int main(int argc, char **argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,307 @@
+#include <chrono>
+#include <csignal>
+#include <string>
+#include <thread>
+
+#include <gtest/gtest.h>
+
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "loam_velodyne/ShmSweepRing.h"
+#include "loam_velodyne/SweepLog.h"
+
+
+using namespace loam;
+
+// Tests of the shared memory sweep ring, in process and with the shmSweepWriter replay tool as the
+// writer (its path is given by the build, see CMakeLists.txt).
+
+#ifndef SHM_SWEEP_WRITER
+#define SHM_SWEEP_WRITER "shmSweepWriter"
+#endif
+
+const int LOG_SWEEPS = 5;          ///< number of sweeps of the replayed log
+const int OVERSIZED_SWEEP = 2;     ///< index of the log sweep exceeding the ring capacity
+const int MAX_POINTS = 150;        ///< point capacity of the replay rings
+
+
+
+/** \brief Sweep of numPoints points, the x coordinate marks the sweep index. */
+pcl::PointCloud<pcl::PointXYZ> makeSweep(const int& index, const int& numPoints)
+{
+  pcl::PointCloud<pcl::PointXYZ> sweep;
+  for (int k = 0; k < numPoints; k++)
+    sweep.push_back(pcl::PointXYZ(float(index), float(k), 0));
+  return sweep;
+}
+
+
+
+/** \brief Shared memory object name unique to this test process. */
+std::string ringName(const std::string& suffix)
+{
+  return "/loam_test_" + std::to_string(getpid()) + "_" + suffix;
+}
+
+
+
+TEST(ShmSweepRingTest, lappedReaderSkipsOverwrittenSweeps)
+{
+  std::string name = ringName("lapping");
+  ShmSweepRingWriter writer;
+  ASSERT_TRUE(writer.create(name, 3, 100));   // rounded up to 4 slots
+  ShmSweepRingReader reader;
+  ASSERT_TRUE(reader.open(name));
+
+  for (int i = 0; i < 10; i++)
+    ASSERT_TRUE(writer.write(makeSweep(i, i + 1), Time(std::chrono::seconds(i))));
+
+  // only the sweeps of the last lap are left
+  pcl::PointCloud<pcl::PointXYZ> sweep;
+  Time stamp;
+  for (int i = 6; i < 10; i++)
+  {
+    ASSERT_TRUE(reader.read(sweep, stamp));
+    ASSERT_EQ(size_t(i + 1), sweep.size());
+    EXPECT_EQ(float(i), sweep[0].x);
+    EXPECT_EQ(float(i), sweep[i].y);
+    EXPECT_TRUE(Time(std::chrono::seconds(i)) == stamp);
+  }
+  EXPECT_FALSE(reader.read(sweep, stamp));
+  EXPECT_EQ(6u, reader.dropped());
+}
+
+
+
+TEST(ShmSweepRingTest, oversizedSweepIsRejected)
+{
+  std::string name = ringName("oversized");
+  ShmSweepRingWriter writer;
+  ASSERT_TRUE(writer.create(name, 2, 100));
+  ShmSweepRingReader reader;
+  ASSERT_TRUE(reader.open(name));
+
+  EXPECT_FALSE(writer.write(makeSweep(0, 101), Time()));
+  EXPECT_TRUE(writer.write(makeSweep(1, 100), Time()));
+
+  pcl::PointCloud<pcl::PointXYZ> sweep;
+  Time stamp;
+  ASSERT_TRUE(reader.read(sweep, stamp));
+  EXPECT_EQ(100u, sweep.size());
+  EXPECT_EQ(1.0f, sweep[0].x);
+  EXPECT_FALSE(reader.read(sweep, stamp));
+  EXPECT_EQ(0u, reader.dropped());
+}
+
+
+
+TEST(ShmSweepRingTest, replacedRingIsDetected)
+{
+  std::string name = ringName("replaced");
+  ShmSweepRingWriter writer;
+  ASSERT_TRUE(writer.create(name, 2, 100));
+  ShmSweepRingReader reader;
+  ASSERT_TRUE(reader.open(name));
+  EXPECT_FALSE(reader.isReplaced(name));
+
+  // a restarted writer creates a new ring of the same name
+  ShmSweepRingWriter restarted;
+  ASSERT_TRUE(restarted.create(name, 2, 100));
+  EXPECT_TRUE(reader.isReplaced(name));
+
+  ASSERT_TRUE(reader.open(name));
+  EXPECT_FALSE(reader.isReplaced(name));
+  ASSERT_TRUE(restarted.write(makeSweep(7, 10), Time()));
+  pcl::PointCloud<pcl::PointXYZ> sweep;
+  Time stamp;
+  ASSERT_TRUE(reader.read(sweep, stamp));
+  EXPECT_EQ(7.0f, sweep[0].x);
+
+  // a removed ring counts as replaced
+  restarted.close();
+  EXPECT_TRUE(reader.isReplaced(name));
+}
+
+
+
+/** Runs the shmSweepWriter tool on a log of LOG_SWEEPS sweeps, 50 ms apart, one of them too large. */
+class ShmSweepWriterTest : public ::testing::Test
+{
+protected:
+  void SetUp()
+  {
+    _ring = ringName("replay");
+    _log = testing::TempDir() + "shm_sweep_ring_test.sweeps";
+
+    SweepLogWriter writer;
+    ASSERT_TRUE(writer.open(_log));
+    for (int i = 0; i < LOG_SWEEPS; i++)
+      ASSERT_TRUE(writer.writeSweep(makeSweep(i, i == OVERSIZED_SWEEP ? 2 * MAX_POINTS : 100), logStamp(i)));
+    ASSERT_TRUE(writer.close());
+  }
+
+  void TearDown()
+  {
+    stopWriter();
+    shm_unlink(_ring.c_str());
+  }
+
+  /** \brief Stamp of a log sweep in the given replay pass. */
+  static Time logStamp(const int& index, const int& pass = 0)
+  {
+    // a pass continues one mean sweep spacing (50 ms) after the last sweep of the previous one
+    return Time(std::chrono::milliseconds(1000 + 50 * index + 50 * LOG_SWEEPS * pass));
+  }
+
+  /** \brief Start the writer tool in a looped replay. */
+  void startWriter(const std::string& slots, const std::string& rate)
+  {
+    std::string maxPoints = std::to_string(MAX_POINTS);
+    _writer = fork();
+    if (_writer == 0)
+    {
+      execl(SHM_SWEEP_WRITER, "shmSweepWriter", "--ring", _ring.c_str(), "--slots", slots.c_str(),
+            "--max-points", maxPoints.c_str(), "--rate", rate.c_str(), "--loop", _log.c_str(), (char*)NULL);
+      _exit(127);
+    }
+  }
+
+  /** \brief Kill the writer tool (which leaves its ring behind). */
+  void stopWriter()
+  {
+    if (_writer <= 0)
+      return;
+
+    kill(_writer, SIGTERM);
+    waitpid(_writer, NULL, 0);
+    _writer = -1;
+  }
+
+  /** \brief Wait until the condition is met, at most 5 seconds. */
+  template <typename Condition>
+  static bool waitFor(Condition condition)
+  {
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    while (!condition())
+    {
+      if (std::chrono::steady_clock::now() > deadline)
+        return false;
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return true;
+  }
+
+  std::string _ring;     ///< ring name
+  std::string _log;      ///< replayed sweep log
+  pid_t _writer = -1;    ///< writer tool process
+};
+
+
+
+TEST_F(ShmSweepWriterTest, loopedReplayContinuesSweepSpacing)
+{
+  // 25 ms per sweep, the reader polls every millisecond and keeps up
+  startWriter("8", "2");
+  ShmSweepRingReader reader;
+  ASSERT_TRUE(waitFor([&] { return reader.open(_ring); }));
+
+  pcl::PointCloud<pcl::PointXYZ> sweep;
+  Time stamp;
+  int pass = 0, lastIndex = -1;
+  for (int n = 0; n < 3 * LOG_SWEEPS; n++)
+  {
+    ASSERT_TRUE(waitFor([&] { return reader.read(sweep, stamp); }));
+    ASSERT_FALSE(sweep.empty());
+
+    // the oversized sweep is skipped, the stamps run on across the passes
+    int index = int(sweep[0].x);
+    if (index <= lastIndex)
+      pass++;
+    lastIndex = index;
+    EXPECT_NE(OVERSIZED_SWEEP, index);
+    EXPECT_EQ(100u, sweep.size());
+    EXPECT_TRUE(logStamp(index, pass) == stamp) << "sweep " << index << " of pass " << pass;
+  }
+
+  EXPECT_GE(pass, 2);
+  EXPECT_EQ(0u, reader.dropped());
+}
+
+
+
+TEST_F(ShmSweepWriterTest, lappedReaderCountsDroppedSweeps)
+{
+  // 2.5 ms per sweep into 2 slots, the reader pauses until the writer is 40 sweeps ahead
+  startWriter("2", "20");
+  ShmSweepRingReader reader;
+  ASSERT_TRUE(waitFor([&] { return reader.open(_ring); }));
+  const uint64_t start = reader.published();
+  ASSERT_TRUE(waitFor([&] { return reader.published() >= start + 40; }));
+  const uint64_t ahead = reader.published() - start;
+
+  pcl::PointCloud<pcl::PointXYZ> sweep;
+  Time stamp, lastStamp;
+  int numRead = 0;
+  while (reader.read(sweep, stamp))
+  {
+    EXPECT_TRUE(numRead == 0 || lastStamp < stamp);
+    lastStamp = stamp;
+    numRead++;
+  }
+
+  // the reading started at most at start, all but the sweeps of the 2 slots were overwritten then
+  EXPECT_GE(numRead, 1);
+  EXPECT_GE(reader.dropped(), ahead - 2);
+  EXPECT_GE(numRead + reader.dropped(), ahead);
+}
+
+
+
+TEST_F(ShmSweepWriterTest, logWithoutSweepsIsAnError)
+{
+  // a log with IMU records only, the looped replay would spin without writing anything
+  SweepLogWriter writer;
+  ASSERT_TRUE(writer.open(_log));
+  IMUState2 imu;
+  ASSERT_TRUE(writer.writeImu(imu));
+  ASSERT_TRUE(writer.close());
+
+  startWriter("2", "20");
+  int status = 0;
+  ASSERT_TRUE(waitFor([&] { return waitpid(_writer, &status, WNOHANG) == _writer; }));
+  _writer = -1;
+  ASSERT_TRUE(WIFEXITED(status));
+  EXPECT_EQ(1, WEXITSTATUS(status));
+}
+
+
+
+TEST_F(ShmSweepWriterTest, restartedWriterReplacesRing)
+{
+  startWriter("4", "2");
+  ShmSweepRingReader reader;
+  ASSERT_TRUE(waitFor([&] { return reader.open(_ring); }));
+
+  pcl::PointCloud<pcl::PointXYZ> sweep;
+  Time stamp;
+  ASSERT_TRUE(waitFor([&] { return reader.read(sweep, stamp); }));
+  EXPECT_FALSE(reader.isReplaced(_ring));
+
+  // the reader notices the ring of the restarted writer and continues with it
+  stopWriter();
+  startWriter("4", "2");
+  ASSERT_TRUE(waitFor([&] { return reader.isReplaced(_ring); }));
+  ASSERT_TRUE(waitFor([&] { return reader.open(_ring); }));
+  EXPECT_FALSE(reader.isReplaced(_ring));
+  ASSERT_TRUE(waitFor([&] { return reader.read(sweep, stamp); }));
+}
+
+
+
+int main(int argc, char **argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,324 @@
+#include <cmath>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "loam_velodyne/simd_dispatch.h"
+
+
+using namespace loam::simd;
+
+// Checks every kernel of every instruction set the host supports against a scalar reference, for sizes
+// around the vector width to cover the tail handling. Output beyond the requested size has to stay
+// untouched.
+
+const float SENTINEL = -12345.0f;   ///< value of the output entries the kernels must not write
+
+
+
+/** Kernel table and its vector width. */
+struct KernelVariant
+{
+  const KernelTable* table;
+  size_t width;
+};
+
+
+
+std::vector<KernelVariant> supportedVariants()
+{
+  std::vector<KernelVariant> variants = { { &baselineKernels(), 4 } };
+#ifdef LOAM_HAVE_AVX2_KERNELS
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+    variants.push_back({ &avx2Kernels(), 8 });
+#endif
+  return variants;
+}
+
+
+
+/** \brief Sizes 0, 1, width - 1, width + 1 and a large size crossing several curvature chunks. */
+std::vector<size_t> testSizes(const size_t& width)
+{
+  return { 0, 1, width - 1, width, width + 1, 1000 + width - 1 };
+}
+
+
+
+/** \brief Relative tolerance check of a kernel result against the double precision reference. */
+void expectClose(const double& expected, const float& actual, const double& tolerance, const char* what,
+                 const KernelVariant& variant, const size_t& n, const size_t& i)
+{
+  EXPECT_NEAR(expected, actual, tolerance * (1 + std::fabs(expected)))
+    << what << " of " << variant.table->name << ", n = " << n << ", i = " << i;
+}
+
+
+
+class SimdKernelsTest : public ::testing::Test
+{
+protected:
+  void SetUp() override
+  {
+    std::mt19937 rng(3);
+    std::uniform_real_distribution<float> coord(-50, 50);
+    std::uniform_real_distribution<float> unit(-1, 1);
+    std::uniform_real_distribution<float> time(0, 0.1f);
+
+    // AoS points with padding lanes, intensity = scan ring + relative time; some coordinates exactly on
+    // voxel borders
+    _points.resize(MAX_POINTS * POINT_STRIDE);
+    for (size_t i = 0; i < MAX_POINTS; i++)
+    {
+      float* p = &_points[i * POINT_STRIDE];
+      for (int d = 0; d < 3; d++)
+        p[d] = (i % 7 == 0) ? float(int(coord(rng))) * 0.5f : coord(rng);
+      p[3] = 1.0f;
+      p[POINT_INTENSITY] = float(i % 16) + time(rng);
+    }
+
+    for (int c = 0; c < 7; c++)
+    {
+      _columns[c].resize(MAX_POINTS);
+      for (auto& v : _columns[c])
+        v = c < 3 ? coord(rng) : unit(rng);
+    }
+
+    for (int k = 0; k < 9; k++)
+      _r[k] = unit(rng);
+    for (int k = 0; k < 3; k++)
+    {
+      _t[k] = coord(rng);
+      _ang[k] = 0.3f * unit(rng);
+    }
+
+    for (int k = 0; k < 3; k++)
+      for (int c = 0; c < 3; c++)
+      {
+        for (int m = 0; m < 3; m++)
+          _J.rot[k][c][m] = unit(rng);
+        _J.trans[k][c] = unit(rng);
+      }
+    for (int k = 0; k < 3; k++)
+      _J.offset[k] = coord(rng);
+    _J.residualScale = -0.05f;
+  }
+
+  static const size_t MAX_POINTS = 1100;
+  static const int MAX_REGION = 40;
+
+  std::vector<float> _points;         ///< AoS points
+  std::vector<float> _columns[7];     ///< SoA residual columns px, py, pz, nx, ny, nz, d
+  float _r[9], _t[3], _ang[3];        ///< transformation
+  LinearJacobian _J;                  ///< Jacobian linearization
+};
+
+
+
+TEST_F(SimdKernelsTest, transformsMatchScalarReference)
+{
+  for (auto const& variant : supportedVariants())
+  {
+    for (size_t n : testSizes(variant.width))
+    {
+      // AoS
+      std::vector<float> out((n + 1) * POINT_STRIDE, SENTINEL);
+      variant.table->transformAoS(_r, _t, _points.data(), out.data(), n);
+      for (size_t i = 0; i < n; i++)
+      {
+        const float* p = &_points[i * POINT_STRIDE];
+        const float* q = &out[i * POINT_STRIDE];
+        for (int k = 0; k < 3; k++)
+          expectClose(double(_r[3 * k]) * p[0] + double(_r[3 * k + 1]) * p[1] + double(_r[3 * k + 2]) * p[2] + _t[k],
+                      q[k], 1e-5, "transformAoS", variant, n, i);
+        EXPECT_EQ(p[POINT_INTENSITY], q[POINT_INTENSITY]);
+      }
+      EXPECT_EQ(SENTINEL, out[n * POINT_STRIDE]) << variant.table->name << ", n = " << n;
+
+      // SoA
+      std::vector<float> ox(n + 1, SENTINEL), oy(n + 1, SENTINEL), oz(n + 1, SENTINEL);
+      variant.table->transformSoA(_r, _t, _columns[0].data(), _columns[1].data(), _columns[2].data(),
+                                  ox.data(), oy.data(), oz.data(), n);
+      float* o[3] = { ox.data(), oy.data(), oz.data() };
+      for (size_t i = 0; i < n; i++)
+        for (int k = 0; k < 3; k++)
+          expectClose(double(_r[3 * k]) * _columns[0][i] + double(_r[3 * k + 1]) * _columns[1][i]
+                      + double(_r[3 * k + 2]) * _columns[2][i] + _t[k], o[k][i], 1e-5, "transformSoA", variant, n, i);
+      EXPECT_EQ(SENTINEL, ox[n]);
+      EXPECT_EQ(SENTINEL, oy[n]);
+      EXPECT_EQ(SENTINEL, oz[n]);
+    }
+  }
+}
+
+
+
+TEST_F(SimdKernelsTest, interpolatedTransformMatchesScalarReference)
+{
+  const float invScanPeriod = 10;
+  for (auto const& variant : supportedVariants())
+  {
+    for (size_t n : testSizes(variant.width))
+    {
+      for (bool truncate : { false, true })
+      {
+        std::vector<float> out((n + 1) * POINT_STRIDE, SENTINEL);
+        variant.table->transformInterpolatedAoS(_ang, _t, invScanPeriod, truncate, _points.data(), out.data(), n);
+
+        for (size_t i = 0; i < n; i++)
+        {
+          const float* p = &_points[i * POINT_STRIDE];
+          const float* q = &out[i * POINT_STRIDE];
+          double s = invScanPeriod * (p[POINT_INTENSITY] - int(p[POINT_INTENSITY]));
+          double x = p[0] + s * _t[0], y = p[1] + s * _t[1], z = p[2] + s * _t[2], tmp;
+
+          // rotate around z, x and y (the angles are given in this order)
+          double a = s * _ang[0];
+          tmp = x; x = std::cos(a) * tmp - std::sin(a) * y; y = std::sin(a) * tmp + std::cos(a) * y;
+          a = s * _ang[1];
+          tmp = y; y = std::cos(a) * tmp - std::sin(a) * z; z = std::sin(a) * tmp + std::cos(a) * z;
+          a = s * _ang[2];
+          tmp = x; x = std::cos(a) * tmp + std::sin(a) * z; z = std::cos(a) * z - std::sin(a) * tmp;
+
+          expectClose(x, q[0], 1e-5, "transformInterpolatedAoS", variant, n, i);
+          expectClose(y, q[1], 1e-5, "transformInterpolatedAoS", variant, n, i);
+          expectClose(z, q[2], 1e-5, "transformInterpolatedAoS", variant, n, i);
+          EXPECT_EQ(truncate ? float(int(p[POINT_INTENSITY])) : p[POINT_INTENSITY], q[POINT_INTENSITY]);
+        }
+        EXPECT_EQ(SENTINEL, out[n * POINT_STRIDE]) << variant.table->name << ", n = " << n;
+      }
+    }
+  }
+}
+
+
+
+TEST_F(SimdKernelsTest, curvatureMatchesScalarReference)
+{
+  for (auto const& variant : supportedVariants())
+  {
+    // a vectorized region and one beyond the stack buffers of the kernel
+    for (int region : { 5, MAX_REGION })
+    {
+      for (size_t n : testSizes(variant.width))
+      {
+        if (n + 2 * region > MAX_POINTS)
+          continue;
+
+        std::vector<float> out(n + 1, SENTINEL);
+        const float* first = &_points[region * POINT_STRIDE];
+        variant.table->curvature(first, n, region, out.data());
+
+        for (size_t i = 0; i < n; i++)
+        {
+          const float* c = first + i * POINT_STRIDE;
+          double sqDiff = 0;
+          for (int d = 0; d < 3; d++)
+          {
+            double diff = -2.0 * region * c[d];
+            for (int j = 1; j <= region; j++)
+              diff += double(c[j * int(POINT_STRIDE) + d]) + c[-j * int(POINT_STRIDE) + d];
+            sqDiff += diff * diff;
+          }
+          expectClose(sqDiff, out[i], 1e-4, "curvature", variant, n, i);
+        }
+        EXPECT_EQ(SENTINEL, out[n]) << variant.table->name << ", n = " << n;
+      }
+    }
+  }
+}
+
+
+
+TEST_F(SimdKernelsTest, voxelCoordinatesMatchFloor)
+{
+  const float invVoxelSize = 2.0f;
+  for (auto const& variant : supportedVariants())
+  {
+    for (size_t n : testSizes(variant.width))
+    {
+      std::vector<int32_t> vx(n + 1, -1), vy(n + 1, -1), vz(n + 1, -1);
+      variant.table->voxelCoordinates(_points.data(), n, invVoxelSize, vx.data(), vy.data(), vz.data());
+
+      // exact, also for the points on voxel borders
+      int32_t* v[3] = { vx.data(), vy.data(), vz.data() };
+      for (size_t i = 0; i < n; i++)
+        for (int d = 0; d < 3; d++)
+          EXPECT_EQ(int32_t(std::floor(_points[i * POINT_STRIDE + d] * invVoxelSize)), v[d][i])
+            << variant.table->name << ", n = " << n << ", i = " << i;
+      EXPECT_EQ(-1, vx[n]);
+      EXPECT_EQ(-1, vy[n]);
+      EXPECT_EQ(-1, vz[n]);
+    }
+  }
+}
+
+
+
+TEST_F(SimdKernelsTest, jacobianMatchesScalarReference)
+{
+  for (auto const& variant : supportedVariants())
+  {
+    for (size_t n : testSizes(variant.width))
+    {
+      // the matrix rows are padded, the padding must stay untouched
+      const size_t ld = n + 3;
+      std::vector<float> A(6 * ld, SENTINEL), b(n + 1, SENTINEL);
+      variant.table->jacobian(_J, _columns[0].data(), _columns[1].data(), _columns[2].data(), _columns[3].data(),
+                              _columns[4].data(), _columns[5].data(), _columns[6].data(), n, A.data(), ld, b.data());
+
+      for (size_t i = 0; i < n; i++)
+      {
+        double q[3], v[3];
+        for (int c = 0; c < 3; c++)
+        {
+          q[c] = double(_columns[c][i]) - _J.offset[c];
+          v[c] = _columns[c + 3][i];
+        }
+
+        for (int k = 0; k < 3; k++)
+        {
+          double rot = 0, trans = 0;
+          for (int c = 0; c < 3; c++)
+          {
+            const float* r = _J.rot[k][c];
+            rot += (r[0] * q[0] + r[1] * q[1] + r[2] * q[2]) * v[c];
+            trans += _J.trans[k][c] * v[c];
+          }
+          expectClose(rot, A[k * ld + i], 1e-5, "jacobian rotation", variant, n, i);
+          expectClose(trans, A[(k + 3) * ld + i], 1e-5, "jacobian translation", variant, n, i);
+        }
+        expectClose(double(_J.residualScale) * _columns[6][i], b[i], 1e-6, "jacobian rhs", variant, n, i);
+      }
+
+      for (int k = 0; k < 6; k++)
+        for (size_t i = n; i < ld; i++)
+          EXPECT_EQ(SENTINEL, A[k * ld + i]) << variant.table->name << ", n = " << n << ", row " << k;
+      EXPECT_EQ(SENTINEL, b[n]) << variant.table->name << ", n = " << n;
+    }
+  }
+}
+
+
+
+TEST(SimdDispatchTest, selectsSupportedKernels)
+{
+  // the dispatched kernels are the fastest supported variant, unless the baseline is forced
+  const char* forced = std::getenv("LOAM_SIMD_ISA");
+  if (forced && std::string(forced) == "baseline")
+    EXPECT_EQ(&baselineKernels(), &kernels());
+  else
+    EXPECT_EQ(supportedVariants().back().table, &kernels());
+}
+
+
+
+int main(int argc, char **argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
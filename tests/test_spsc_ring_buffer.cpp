@@ -0,0 +1,130 @@
+#include <algorithm>
+#include <cstdint>
+#include <thread>
+
+#include <gtest/gtest.h>
+
+#include "loam_velodyne/SpscRingBuffer.h"
+
+
+using namespace loam;
+
+// Tests of the lock-free sensor history buffer: its full / empty boundaries, and a producer and a
+// consumer thread exchanging many more elements than the buffer holds.
+
+/** Buffer element, the stamp counts the pushed elements. */
+struct Element
+{
+  uint64_t stamp = 0;
+  uint64_t check = 0;   ///< derived from the stamp, to detect torn elements
+};
+
+
+
+Element makeElement(const uint64_t& stamp)
+{
+  Element element;
+  element.stamp = stamp;
+  element.check = ~stamp;
+  return element;
+}
+
+
+
+TEST(SpscRingBufferTest, fullAndEmptyBoundaries)
+{
+  SpscRingBuffer<Element> buffer(3);
+  EXPECT_EQ(4u, buffer.capacity());
+  EXPECT_TRUE(buffer.empty());
+  EXPECT_EQ(0u, buffer.upperBound(uint64_t(0)));
+
+  // fill up, the next element is dropped
+  for (uint64_t i = 0; i < 4; i++)
+    ASSERT_TRUE(buffer.push(makeElement(i)));
+  EXPECT_EQ(4u, buffer.size());
+  EXPECT_FALSE(buffer.push(makeElement(4)));
+  EXPECT_EQ(1u, buffer.dropped());
+  EXPECT_EQ(0u, buffer.first().stamp);
+  EXPECT_EQ(3u, buffer.last().stamp);
+
+  // a discarded slot takes the next element, the indices wrap around
+  buffer.discard(1);
+  ASSERT_TRUE(buffer.push(makeElement(5)));
+  EXPECT_FALSE(buffer.push(makeElement(6)));
+  EXPECT_EQ(2u, buffer.dropped());
+  EXPECT_EQ(1u, buffer[0].stamp);
+  EXPECT_EQ(5u, buffer[3].stamp);
+
+  // the latest element older than the given time is kept
+  buffer.discardOlderThan(uint64_t(4));
+  EXPECT_EQ(2u, buffer.size());
+  EXPECT_EQ(3u, buffer.first().stamp);
+
+  // drain to empty and refill across the wrap around
+  buffer.discard(buffer.size());
+  EXPECT_TRUE(buffer.empty());
+  for (uint64_t i = 10; i < 14; i++)
+    ASSERT_TRUE(buffer.push(makeElement(i)));
+  EXPECT_EQ(10u, buffer.first().stamp);
+  EXPECT_EQ(13u, buffer.last().stamp);
+  EXPECT_EQ(2u, buffer.dropped());
+
+  // shrinking keeps the newest elements
+  buffer.setCapacity(2);
+  EXPECT_EQ(2u, buffer.capacity());
+  ASSERT_EQ(2u, buffer.size());
+  EXPECT_EQ(12u, buffer.first().stamp);
+  EXPECT_EQ(13u, buffer.last().stamp);
+}
+
+
+
+TEST(SpscRingBufferTest, producerConsumerKeepOrder)
+{
+  const uint64_t NUM_ELEMENTS = 200000;
+  SpscRingBuffer<Element> buffer(64);
+
+  // the producer retries pushes into the full buffer, so every element gets through exactly once
+  std::thread producer([&] {
+    for (uint64_t i = 0; i < NUM_ELEMENTS; i++)
+    {
+      while (!buffer.push(makeElement(i)))
+        std::this_thread::yield();
+    }
+  });
+
+  uint64_t expected = 0;
+  size_t maxSize = 0, errors = 0;
+  while (expected < NUM_ELEMENTS)
+  {
+    size_t n = buffer.size();
+    if (n == 0)
+    {
+      std::this_thread::yield();
+      continue;
+    }
+
+    maxSize = std::max(maxSize, n);
+    for (size_t i = 0; i < n; i++, expected++)
+    {
+      const Element& element = buffer[i];
+      if (element.stamp != expected || element.check != ~expected)
+        errors++;
+    }
+    buffer.discard(n);
+  }
+  producer.join();
+
+  EXPECT_EQ(0u, errors);
+  EXPECT_EQ(NUM_ELEMENTS, expected);
+  EXPECT_TRUE(buffer.empty());
+  EXPECT_LE(maxSize, buffer.capacity());
+}
+
+
+
+int main(int argc, char **argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,177 @@
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "loam_velodyne/SweepLog.h"
+
+
+using namespace loam;
+
+const int NUM_SWEEPS = 5;
+
+
+
+/** \brief Sweep with distinct point coordinates per sweep. */
+pcl::PointCloud<pcl::PointXYZ> makeSweep(const int& index)
+{
+  pcl::PointCloud<pcl::PointXYZ> sweep;
+  for (int i = 0; i < 1000 + index; i++)
+    sweep.push_back(pcl::PointXYZ(0.5f * i, -0.25f * index, 0.125f * (i + index)));
+  return sweep;
+}
+
+
+
+Time sweepTime(const int& index)
+{
+  return Time(std::chrono::milliseconds(100 * index));
+}
+
+
+
+/** \brief Write a log of alternating IMU and sweep records. */
+std::string writeLog(const std::string& name)
+{
+  std::string path = testing::TempDir() + name;
+  SweepLogWriter writer;
+  EXPECT_TRUE(writer.open(path));
+  for (int i = 0; i < NUM_SWEEPS; i++)
+  {
+    IMUState2 imu;
+    imu.stamp = sweepTime(i);
+    imu.roll = 0.01f * i;
+    imu.pitch = -0.02f * i;
+    EXPECT_TRUE(writer.writeImu(imu));
+    EXPECT_TRUE(writer.writeSweep(makeSweep(i), sweepTime(i)));
+  }
+  EXPECT_TRUE(writer.close());
+  return path;
+}
+
+
+
+std::vector<char> readFile(const std::string& path)
+{
+  std::vector<char> data;
+  FILE* file = fopen(path.c_str(), "rb");
+  char buffer[4096];
+  size_t n;
+  while (file != NULL && (n = fread(buffer, 1, sizeof(buffer), file)) > 0)
+    data.insert(data.end(), buffer, buffer + n);
+  if (file != NULL)
+    fclose(file);
+  return data;
+}
+
+
+
+void writeFile(const std::string& path, const std::vector<char>& data)
+{
+  FILE* file = fopen(path.c_str(), "wb");
+  ASSERT_TRUE(file != NULL);
+  ASSERT_EQ(data.size(), fwrite(data.data(), 1, data.size(), file));
+  fclose(file);
+}
+
+
+
+TEST(SweepLogTest, roundTrip)
+{
+  std::string path = writeLog("round_trip.sweeps");
+
+  SweepLogReader reader;
+  ASSERT_TRUE(reader.open(path));
+  SweepLogRecord record;
+  int numSweeps = 0, numImu = 0;
+  while (reader.next(record))
+  {
+    if (record.type == SWEEP_RECORD)
+    {
+      auto expected = makeSweep(numSweeps);
+      ASSERT_EQ(expected.size(), record.sweep.size());
+      for (size_t i = 0; i < expected.size(); i++)
+      {
+        EXPECT_EQ(expected[i].x, record.sweep[i].x);
+        EXPECT_EQ(expected[i].y, record.sweep[i].y);
+        EXPECT_EQ(expected[i].z, record.sweep[i].z);
+      }
+      EXPECT_TRUE(sweepTime(numSweeps) == record.stamp);
+      numSweeps++;
+    }
+    else
+    {
+      EXPECT_EQ(IMU_RECORD, record.type);
+      EXPECT_EQ(0.01f * numImu, record.imu.roll.rad());
+      EXPECT_EQ(-0.02f * numImu, record.imu.pitch.rad());
+      EXPECT_TRUE(sweepTime(numImu) == record.imu.stamp);
+      numImu++;
+    }
+  }
+
+  EXPECT_TRUE(reader.eof());
+  EXPECT_EQ(NUM_SWEEPS, numSweeps);
+  EXPECT_EQ(NUM_SWEEPS, numImu);
+}
+
+
+
+TEST(SweepLogTest, truncatedLogIsNoCleanEnd)
+{
+  std::vector<char> data = readFile(writeLog("full.sweeps"));
+
+  // cut the log within the payload of the last sweep record
+  std::string path = testing::TempDir() + "truncated.sweeps";
+  data.resize(data.size() - 100);
+  writeFile(path, data);
+
+  SweepLogReader reader;
+  ASSERT_TRUE(reader.open(path));
+  SweepLogRecord record;
+  int numRecords = 0;
+  while (reader.next(record))
+    numRecords++;
+
+  EXPECT_EQ(2 * NUM_SWEEPS - 1, numRecords);
+  EXPECT_FALSE(reader.eof());
+}
+
+
+
+TEST(SweepLogTest, corruptCountIsRejected)
+{
+  std::vector<char> data = readFile(writeLog("valid.sweeps"));
+
+  // the first sweep record follows the file header and the first IMU record
+  size_t countOffset = sizeof(SweepLogHeader) + sizeof(SweepLogRecordHeader) + 2 * sizeof(float)
+                       + offsetof(SweepLogRecordHeader, count);
+  std::string path = testing::TempDir() + "corrupt.sweeps";
+
+  for (uint32_t count : { 0xffffffffu, SWEEP_LOG_MAX_POINTS, 1000000u })
+  {
+    std::vector<char> corrupt = data;
+    memcpy(&corrupt[countOffset], &count, sizeof(count));
+    writeFile(path, corrupt);
+
+    // the count exceeds the remaining file size, the reader fails without allocating it
+    SweepLogReader reader;
+    ASSERT_TRUE(reader.open(path));
+    SweepLogRecord record;
+    ASSERT_TRUE(reader.next(record));
+    EXPECT_EQ(IMU_RECORD, record.type);
+    EXPECT_FALSE(reader.next(record));
+    EXPECT_FALSE(reader.eof());
+    EXPECT_EQ(0u, record.sweep.size());
+  }
+}
+
+
+
+int main(int argc, char **argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,154 @@
+#include <memory>
+
+#include <gtest/gtest.h>
+
+#include "loam_velodyne/SweepSynchronizer.h"
+
+
+using loam::SweepSynchronizer;
+
+// two topics: a cloud (int) and a pose (double) per sweep
+typedef SweepSynchronizer<std::shared_ptr<int>, std::shared_ptr<double> > Synchronizer;
+
+
+
+TEST(SweepSynchronizerTest, assemblesSweepsByStamp)
+{
+  Synchronizer sync(3);
+  uint64_t stamp;
+  Synchronizer::MessageSet messages;
+
+  // topic 0 runs a sweep ahead, its second message must not replace the first one
+  sync.add<0>(10, std::make_shared<int>(1));
+  sync.add<0>(20, std::make_shared<int>(2));
+  EXPECT_FALSE(sync.pop(stamp, messages));
+
+  sync.add<1>(10, std::make_shared<double>(1.5));
+  ASSERT_TRUE(sync.pop(stamp, messages));
+  EXPECT_EQ(10u, stamp);
+  EXPECT_EQ(1, *std::get<0>(messages));
+  EXPECT_EQ(1.5, *std::get<1>(messages));
+
+  sync.add<1>(20, std::make_shared<double>(2.5));
+  ASSERT_TRUE(sync.pop(stamp, messages));
+  EXPECT_EQ(20u, stamp);
+  EXPECT_EQ(2, *std::get<0>(messages));
+  EXPECT_EQ(0u, sync.pending());
+  EXPECT_EQ(0u, sync.dropped());
+  EXPECT_EQ(0u, sync.lateMessages());
+}
+
+
+
+TEST(SweepSynchronizerTest, dropsIncompleteSweepsBeforePoppedOne)
+{
+  Synchronizer sync(3);
+  uint64_t stamp;
+  Synchronizer::MessageSet messages;
+
+  // the second topic never delivers sweep 20
+  sync.add<0>(20, std::make_shared<int>(2));
+  sync.add<0>(30, std::make_shared<int>(3));
+  sync.add<1>(30, std::make_shared<double>(3));
+
+  ASSERT_TRUE(sync.pop(stamp, messages));
+  EXPECT_EQ(30u, stamp);
+  EXPECT_EQ(1u, sync.dropped());
+  EXPECT_EQ(0u, sync.pending());
+}
+
+
+
+TEST(SweepSynchronizerTest, maxPendingEvictsOldestSweep)
+{
+  Synchronizer sync(3);
+  uint64_t stamp;
+  Synchronizer::MessageSet messages;
+
+  // the fourth sweep evicts the oldest one
+  for (uint64_t s = 10; s <= 40; s += 10)
+    sync.add<0>(s, std::make_shared<int>(int(s)));
+  EXPECT_EQ(3u, sync.pending());
+  EXPECT_EQ(1u, sync.dropped());
+
+  // a new sweep older than all buffered ones evicts itself
+  sync.add<0>(15, std::make_shared<int>(15));
+  EXPECT_EQ(3u, sync.pending());
+  EXPECT_EQ(2u, sync.dropped());
+
+  // the remaining sweeps can still be completed
+  sync.add<1>(20, std::make_shared<double>(20));
+  ASSERT_TRUE(sync.pop(stamp, messages));
+  EXPECT_EQ(20u, stamp);
+  EXPECT_EQ(20, *std::get<0>(messages));
+
+  // a smaller buffer is clamped to one sweep
+  sync.setMaxPending(0);
+  EXPECT_EQ(1u, sync.maxPending());
+}
+
+
+
+TEST(SweepSynchronizerTest, ignoresLateMessages)
+{
+  Synchronizer sync(3);
+  uint64_t stamp;
+  Synchronizer::MessageSet messages;
+
+  sync.add<0>(10, std::make_shared<int>(1));
+  sync.add<1>(10, std::make_shared<double>(1));
+  ASSERT_TRUE(sync.pop(stamp, messages));
+
+  // a second message of the popped sweep and a message of an older sweep
+  sync.add<1>(10, std::make_shared<double>(9));
+  sync.add<0>(5, std::make_shared<int>(9));
+  EXPECT_EQ(2u, sync.lateMessages());
+  EXPECT_EQ(0u, sync.pending());
+
+  // messages of an evicted sweep are late as well
+  sync.add<0>(20, nullptr);
+  sync.add<0>(30, nullptr);
+  sync.add<0>(40, nullptr);
+  sync.add<0>(50, nullptr);
+  EXPECT_EQ(1u, sync.dropped());
+  sync.add<1>(20, nullptr);
+  EXPECT_EQ(3u, sync.lateMessages());
+  EXPECT_EQ(3u, sync.pending());
+}
+
+
+
+TEST(SweepSynchronizerTest, countedTopicsRestrictDropCount)
+{
+  Synchronizer sync(2);
+  uint64_t stamp;
+  Synchronizer::MessageSet messages;
+
+  // topic 0 is published for every sweep, topic 1 only for some sweeps
+  sync.setCountedTopics(1u << 1);
+
+  // sweeps with a topic 0 message only are not counted when they are dropped
+  sync.add<0>(10, nullptr);
+  sync.add<0>(20, nullptr);
+  sync.add<0>(30, nullptr);
+  EXPECT_EQ(0u, sync.dropped());
+
+  // a sweep with a topic 1 message is
+  sync.add<1>(40, nullptr);
+  sync.add<0>(50, nullptr);
+  sync.add<0>(60, nullptr);
+  sync.add<1>(60, nullptr);
+  EXPECT_EQ(1u, sync.dropped());
+
+  ASSERT_TRUE(sync.pop(stamp, messages));
+  EXPECT_EQ(60u, stamp);
+  EXPECT_EQ(1u, sync.dropped());
+}
+
+
+
+int main(int argc, char **argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,250 @@
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "loam_velodyne/Pipeline.h"
+#include "loam_velodyne/VoxelHashIndex.h"
+
+
+using namespace loam;
+
+// Checks the voxel hash index against a brute force search, and the mapping results of the voxel hash
+// correspondence search against the ones of the kd-tree.
+
+const float VOXEL_SIZE = 0.5f;
+const float MAX_DISTANCE = 1.0f;
+const int K = 5;
+
+
+
+pcl::PointXYZI makePoint(const float& x, const float& y, const float& z)
+{
+  pcl::PointXYZI p;
+  p.x = x;
+  p.y = y;
+  p.z = z;
+  p.intensity = 0;
+  return p;
+}
+
+
+
+/** \brief Simulated VLP-16 sweep in a 20 x 20 x 6 m box room, the sensor moved by tx along x. */
+pcl::PointCloud<pcl::PointXYZ> boxRoomSweep(const float& tx)
+{
+  pcl::PointCloud<pcl::PointXYZ> sweep;
+  for (int a = 0; a < 1800; a++)
+  {
+    float azimuth = float(-M_PI + 2 * M_PI * a / 1800);
+    for (int ring = 0; ring < 16; ring++)
+    {
+      float elevation = float((-15 + 2 * ring) * M_PI / 180);
+      float dx = std::cos(elevation) * std::cos(azimuth);
+      float dy = std::cos(elevation) * std::sin(azimuth);
+      float dz = std::sin(elevation);
+
+      // distance to the nearest wall along the ray
+      float t = 1e9;
+      auto hit = [&](const float& d, const float& wall) { if (d > 1e-6) t = std::min(t, wall / d); };
+      hit(dx, 10 - tx);
+      hit(-dx, 10 + tx);
+      hit(dy, 10);
+      hit(-dy, 10);
+      hit(dz, 4);
+      hit(-dz, 2);
+
+      sweep.push_back(pcl::PointXYZ(dx * t, dy * t, dz * t));
+    }
+  }
+  return sweep;
+}
+
+
+
+class VoxelHashIndexTest : public ::testing::Test
+{
+protected:
+  void SetUp() override
+  {
+    // dense clusters separated by empty voxels, plus some scattered points
+    std::mt19937 rng(7);
+    std::uniform_real_distribution<float> coord(-10, 10);
+    std::normal_distribution<float> spread(0, 0.3f);
+
+    _cloud.reset(new pcl::PointCloud<pcl::PointXYZI>());
+    for (int c = 0; c < 40; c++)
+    {
+      pcl::PointXYZI center = makePoint(coord(rng), coord(rng), coord(rng));
+      for (int i = 0; i < 200; i++)
+        _cloud->push_back(makePoint(center.x + spread(rng), center.y + spread(rng), center.z + spread(rng)));
+      _queries.push_back(center);
+    }
+    for (int i = 0; i < 2000; i++)
+      _cloud->push_back(makePoint(coord(rng), coord(rng), coord(rng)));
+
+    // random queries, queries on voxel borders, edges and corners, and queries next to cloud points
+    for (int i = 0; i < 2000; i++)
+      _queries.push_back(makePoint(coord(rng), coord(rng), coord(rng)));
+    std::uniform_int_distribution<int> voxel(-20, 20);
+    for (int i = 0; i < 1000; i++)
+    {
+      pcl::PointXYZI q = makePoint(voxel(rng) * VOXEL_SIZE, voxel(rng) * VOXEL_SIZE, voxel(rng) * VOXEL_SIZE);
+      if (i % 3 > 0)
+        q.y = coord(rng);
+      if (i % 3 > 1)
+        q.z = coord(rng);
+      _queries.push_back(q);
+    }
+    for (size_t i = 0; i < _cloud->size(); i += 97)
+      _queries.push_back(makePoint((*_cloud)[i].x + 0.01f, (*_cloud)[i].y, (*_cloud)[i].z));
+  }
+
+  /** \brief Check the search results against a brute force search over the given cloud. */
+  static void expectBruteForceResult(const pcl::PointCloud<pcl::PointXYZI>& cloud, const pcl::PointXYZI& query,
+                                     const int& count, const int* indices, const float* sqrDistances)
+  {
+    std::vector<float> expected;
+    for (auto const& p : cloud)
+    {
+      float dx = p.x - query.x, dy = p.y - query.y, dz = p.z - query.z;
+      float sqDist = dx * dx + dy * dy + dz * dz;
+      if (sqDist <= MAX_DISTANCE * MAX_DISTANCE)
+        expected.push_back(sqDist);
+    }
+    std::sort(expected.begin(), expected.end());
+    expected.resize(std::min(expected.size(), size_t(K)));
+
+    // all neighbours within the distance gate are found, ties may come in any order
+    ASSERT_EQ(int(expected.size()), count) << "query " << query.x << " " << query.y << " " << query.z;
+    for (int j = 0; j < K; j++)
+    {
+      if (j < count)
+      {
+        EXPECT_EQ(expected[j], sqrDistances[j]);
+        ASSERT_GE(indices[j], 0);
+        const pcl::PointXYZI& p = cloud[indices[j]];
+        float dx = p.x - query.x, dy = p.y - query.y, dz = p.z - query.z;
+        EXPECT_EQ(dx * dx + dy * dy + dz * dz, sqrDistances[j]);
+      }
+      else
+      {
+        EXPECT_EQ(-1, indices[j]);
+        EXPECT_TRUE(std::isinf(sqrDistances[j]));
+      }
+    }
+  }
+
+  pcl::PointCloud<pcl::PointXYZI>::Ptr _cloud;
+  std::vector<pcl::PointXYZI> _queries;
+};
+
+
+
+TEST_F(VoxelHashIndexTest, matchesBruteForceWithinDistanceGate)
+{
+  VoxelHashIndex index(VOXEL_SIZE, MAX_DISTANCE);
+  index.setInputCloud(_cloud);
+
+  int indices[K];
+  float sqrDistances[K];
+  for (auto const& query : _queries)
+  {
+    int count = index.nearestKSearch(query, K, indices, sqrDistances);
+    expectBruteForceResult(*_cloud, query, count, indices, sqrDistances);
+  }
+}
+
+
+
+TEST_F(VoxelHashIndexTest, batchMatchesSingleSearch)
+{
+  VoxelHashIndex index(VOXEL_SIZE, MAX_DISTANCE);
+  index.setInputCloud(_cloud);
+
+  std::vector<int> batchIndices(_queries.size() * K);
+  std::vector<float> batchDistances(_queries.size() * K);
+  index.nearestKSearchBatch(_queries.data(), _queries.size(), K, batchIndices.data(), batchDistances.data());
+
+  int indices[K];
+  float sqrDistances[K];
+  for (size_t q = 0; q < _queries.size(); q++)
+  {
+    index.nearestKSearch(_queries[q], K, indices, sqrDistances);
+    for (int j = 0; j < K; j++)
+    {
+      EXPECT_EQ(indices[j], batchIndices[q * K + j]);
+      EXPECT_EQ(sqrDistances[j], batchDistances[q * K + j]);
+    }
+  }
+}
+
+
+
+TEST_F(VoxelHashIndexTest, emptyCloudHasNoNeighbours)
+{
+  VoxelHashIndex index(VOXEL_SIZE, MAX_DISTANCE);
+  index.setInputCloud(pcl::PointCloud<pcl::PointXYZI>::Ptr(new pcl::PointCloud<pcl::PointXYZI>()));
+  EXPECT_EQ(0u, index.size());
+
+  int indices[K];
+  float sqrDistances[K];
+  EXPECT_EQ(0, index.nearestKSearch(makePoint(0, 0, 0), K, indices, sqrDistances));
+  for (int j = 0; j < K; j++)
+  {
+    EXPECT_EQ(-1, indices[j]);
+    EXPECT_TRUE(std::isinf(sqrDistances[j]));
+  }
+
+  // a rebuilt index forgets the previous cloud
+  index.setInputCloud(_cloud);
+  index.setInputCloud(pcl::PointCloud<pcl::PointXYZI>::Ptr(new pcl::PointCloud<pcl::PointXYZI>()));
+  EXPECT_EQ(0, index.nearestKSearch((*_cloud)[0], K, indices, sqrDistances));
+}
+
+
+
+TEST(VoxelHashMappingTest, mappingMatchesKdTree)
+{
+  // the same sweeps through the pipeline, with the kd-tree and the voxel hash correspondence search
+  Pipeline kdtree(MultiScanMapper::Velodyne_VLP_16(), RegistrationParams(), 1);
+  Pipeline voxelHash(MultiScanMapper::Velodyne_VLP_16(), RegistrationParams(), 1);
+  voxelHash.odometry().setNeighborSearchMethod(SEARCH_VOXEL_HASH);
+  voxelHash.mapping().setNeighborSearchMethod(SEARCH_VOXEL_HASH);
+
+  int numMapped = 0;
+  for (int i = 0; i < 10; i++)
+  {
+    auto sweep = boxRoomSweep(0.1f * i);
+    Time stamp(std::chrono::milliseconds(100 * (i + 1)));
+    kdtree.pushSweep(sweep, stamp);
+    voxelHash.pushSweep(sweep, stamp);
+
+    PipelinePose expected, pose;
+    ASSERT_TRUE(kdtree.pullPose(expected));
+    ASSERT_TRUE(voxelHash.pullPose(pose));
+    ASSERT_EQ(expected.mapped, pose.mapped);
+    numMapped += pose.mapped;
+
+    // the correspondences agree up to the order of equidistant neighbours
+    const Twist& a = kdtree.mapping().transformAftMapped();
+    const Twist& b = voxelHash.mapping().transformAftMapped();
+    EXPECT_NEAR(a.rot_x.rad(), b.rot_x.rad(), 1e-4) << "sweep " << i;
+    EXPECT_NEAR(a.rot_y.rad(), b.rot_y.rad(), 1e-4) << "sweep " << i;
+    EXPECT_NEAR(a.rot_z.rad(), b.rot_z.rad(), 1e-4) << "sweep " << i;
+    EXPECT_NEAR(a.pos.x(), b.pos.x(), 1e-3) << "sweep " << i;
+    EXPECT_NEAR(a.pos.y(), b.pos.y(), 1e-3) << "sweep " << i;
+    EXPECT_NEAR(a.pos.z(), b.pos.z(), 1e-3) << "sweep " << i;
+  }
+  EXPECT_GT(numMapped, 5);
+}
+
+
+
+int main(int argc, char **argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}